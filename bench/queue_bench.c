@@ -0,0 +1,787 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "blocking_queue.h"
+#include "queue.h"
+#include "lb_queue.h"
+#include "ab_queue.h"
+#include "spsc_queue.h"
+#include "mpmc_queue.h"
+#include "ms_queue.h"
+#include "ml_queue.h"
+#include "dl_queue.h"
+#include "pb_queue.h"
+#include "lp_queue.h"
+#include "sl_queue.h"
+#include "mq_queue.h"
+#include "histogram.h"
+#include "node_pool.h"
+#include "cpu_util.h"
+#include "time_util.h"
+
+/* most values a list option takes */
+#define BENCH_LIST_MAX 16
+
+/* default number of elements passed through the queue per run */
+#define BENCH_ELEMENTS 1000000ULL
+
+/**
+ * queue element, padded to the element size of the run
+ */
+struct _element_t
+{
+    /* nano_time when the element was offered */
+    uint64_t stamp;
+
+    /* producer sequence */
+    uint64_t seq;
+
+    unsigned char payload[];
+};
+
+/**
+ * how a queue is driven
+ */
+enum _bench_kind_e {
+    /* blocking_queue_t, any number of threads */
+    BENCH_BLOCKING,
+
+    /* blocking_queue_t for one producer and one consumer */
+    BENCH_BLOCKING_SPSC,
+
+    /* queue_t, any number of threads, offer and poll only */
+    BENCH_CONCURRENT,
+
+    /* queue_t that is not thread-safe, run by one thread */
+    BENCH_SEQUENTIAL
+};
+
+struct _bench_queue_t
+{
+    const char *name;
+
+    enum _bench_kind_e kind;
+
+    struct blocking_queue_t *(*blocking)(const uint32_t capacity);
+
+    struct queue_t *(*queue)(const uint32_t capacity);
+};
+
+/**
+ * state shared by the threads of one run
+ */
+struct _run_t
+{
+    const struct _bench_queue_t *bench;
+
+    struct blocking_queue_t *bq;
+
+    struct queue_t *q;
+
+    struct node_pool_t *pool;
+
+    /* offer to poll times */
+    struct histogram_t *latency;
+
+    /* producers, consumers and the main thread start together */
+    pthread_barrier_t start;
+
+    /* element size in bytes */
+    uint32_t size;
+
+    /* put and take rather than offer and poll */
+    bool block;
+
+    /* producers still running */
+    atomic_uint producing;
+
+    /* elements each producer offers, the first one takes the remainder */
+    uint64_t elements;
+
+    uint64_t remainder;
+};
+
+struct _thread_t
+{
+    struct _run_t *run;
+
+    pthread_t tid;
+
+    uint32_t index;
+};
+
+/**
+ * Orders elements by offer time, so the priority queues hand them out
+ * about first in first out.
+ */
+static int32_t _compare(const void *a, const void *b)
+{
+    const uint64_t x = ((const struct _element_t *)a)->stamp;
+    const uint64_t y = ((const struct _element_t *)b)->stamp;
+
+    return (x > y) ? 1 : ((x < y) ? -1 : 0);
+}
+
+static uint32_t _level(const void *element)
+{
+    return 0;
+}
+
+static uint64_t _deadline(const void *element)
+{
+    return ((const struct _element_t *)element)->stamp;
+}
+
+static struct blocking_queue_t *_lb(const uint32_t capacity)
+{
+    return lb_queue(capacity);
+}
+
+static struct blocking_queue_t *_ab(const uint32_t capacity)
+{
+    return ab_queue(capacity);
+}
+
+static struct blocking_queue_t *_spsc(const uint32_t capacity)
+{
+    return spsc_queue(capacity);
+}
+
+static struct blocking_queue_t *_mpmc(const uint32_t capacity)
+{
+    return mpmc_queue(capacity);
+}
+
+static struct blocking_queue_t *_ms(const uint32_t capacity)
+{
+    return ms_queue();
+}
+
+static struct blocking_queue_t *_ml(const uint32_t capacity)
+{
+    return ml_queue(capacity, 1, _level);
+}
+
+static struct blocking_queue_t *_dl(const uint32_t capacity)
+{
+    /* elements are due when offered, the run measures the wheel overhead */
+    return dl_queue(capacity, 1000, &TIME_UNIT_NANO, _deadline);
+}
+
+static struct blocking_queue_t *_pb(const uint32_t capacity)
+{
+    return pb_queue(capacity, _compare);
+}
+
+static struct queue_t *_lp(const uint32_t capacity)
+{
+    return lp_queue(capacity, _compare);
+}
+
+static struct queue_t *_sl(const uint32_t capacity)
+{
+    return sl_queue(_compare);
+}
+
+static struct queue_t *_mq(const uint32_t capacity)
+{
+    return mq_queue(0, _compare);
+}
+
+static const struct _bench_queue_t _queues[] = {
+    { "lb", BENCH_BLOCKING, _lb, NULL },
+    { "ab", BENCH_BLOCKING, _ab, NULL },
+    { "spsc", BENCH_BLOCKING_SPSC, _spsc, NULL },
+    { "mpmc", BENCH_BLOCKING, _mpmc, NULL },
+    { "ms", BENCH_BLOCKING, _ms, NULL },
+    { "ml", BENCH_BLOCKING, _ml, NULL },
+    { "dl", BENCH_BLOCKING, _dl, NULL },
+    { "pb", BENCH_BLOCKING, _pb, NULL },
+    { "lp", BENCH_SEQUENTIAL, NULL, _lp },
+    { "sl", BENCH_CONCURRENT, NULL, _sl },
+    { "mq", BENCH_CONCURRENT, NULL, _mq },
+};
+
+#define BENCH_QUEUES (sizeof(_queues) / sizeof(_queues[0]))
+
+static void _pin(const pthread_t tid, const uint32_t index)
+{
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET((int)(index % (uint32_t)(cpus > 0 ? cpus : 1)), &set);
+
+    if (pthread_setaffinity_np(tid, sizeof(set), &set) != 0)
+        fprintf(stderr, "queue_bench: cannot pin thread %u\n", index);
+}
+
+/**
+ * Backs off after a failed offer or poll, yielding the cpu now and then so
+ * that a run with more threads than cpus still makes progress.
+ */
+static inline void _backoff(uint32_t *const spins)
+{
+    if ((++*spins & 63) == 0)
+        sched_yield();
+    else
+        cpu_relax();
+}
+
+static struct _element_t *_produce(struct _run_t *const run, const uint64_t seq)
+{
+    struct _element_t *e = (struct _element_t *)node_pool_alloc(run->pool);
+
+    if (!e)
+        return NULL;
+
+    e->seq = seq;
+    memset(e->payload, (int)seq, run->size - sizeof(struct _element_t));
+    e->stamp = nano_time();
+
+    return e;
+}
+
+/**
+ * Records the element's latency, reads its payload a cache line at a time
+ * like a consumer would, and gives it back.
+ */
+static uint32_t _consume(struct _run_t *const run, struct _element_t *const e)
+{
+    const uint32_t n = run->size - sizeof(struct _element_t);
+    uint32_t sum = 0;
+
+    histogram_record(run->latency, nano_time() - e->stamp);
+
+    for (uint32_t i = 0; i < n; i += CACHE_LINE_SIZE)
+        sum += e->payload[i];
+
+    node_pool_release(run->pool, e);
+
+    return sum;
+}
+
+static void *_producer(void *arg)
+{
+    struct _thread_t *const t = (struct _thread_t *)arg;
+    struct _run_t *const run = t->run;
+    const uint64_t n = run->elements + (t->index == 0 ? run->remainder : 0);
+    struct _element_t *e;
+    uint32_t spins = 0;
+
+    pthread_barrier_wait(&run->start);
+
+    for (uint64_t i = 0; i < n; i++)
+    {
+        if (!(e = _produce(run, i)))
+            break;
+
+        if (run->bq && run->block)
+        {
+            if (!run->bq->put(run->bq, e))
+                break;
+        }
+        else if (run->bq)
+        {
+            while (!run->bq->offer(run->bq, e))
+                _backoff(&spins);
+        }
+        else
+        {
+            while (!run->q->offer(run->q, e))
+                _backoff(&spins);
+        }
+    }
+
+    atomic_fetch_sub_explicit(&run->producing, 1, memory_order_release);
+
+    return NULL;
+}
+
+static void *_consumer(void *arg)
+{
+    struct _thread_t *const t = (struct _thread_t *)arg;
+    struct _run_t *const run = t->run;
+    volatile uint32_t sum = 0;
+    struct _element_t *e;
+    uint32_t spins = 0;
+
+    pthread_barrier_wait(&run->start);
+
+    for (;;)
+    {
+        if (run->bq && run->block)
+        {
+            /* NULL once the queue is closed and drained */
+            if (!(e = run->bq->take(run->bq)))
+                break;
+        }
+        else
+        {
+            e = run->bq ? run->bq->poll(run->bq) : run->q->poll(run->q);
+
+            if (!e)
+            {
+                /* every offer has returned, what is queued can be seen */
+                if (atomic_load_explicit(&run->producing, memory_order_acquire) == 0)
+                {
+                    e = run->bq ? run->bq->poll(run->bq) : run->q->poll(run->q);
+                    if (!e)
+                        break;
+                }
+                else
+                {
+                    _backoff(&spins);
+                    continue;
+                }
+            }
+        }
+
+        sum += _consume(run, e);
+    }
+
+    return NULL;
+}
+
+/**
+ * Runs a queue that is not thread-safe in the calling thread: fills it up
+ * to capacity, then drains it.
+ */
+static uint64_t _sequential(struct _run_t *const run, const uint32_t capacity)
+{
+    const uint64_t total = run->elements;
+    const uint32_t burst = capacity ? capacity : 1024;
+    volatile uint32_t sum = 0;
+    struct _element_t *e;
+    uint64_t done = 0;
+    uint32_t k;
+
+    while (done < total)
+    {
+        for (k = 0; k < burst && done + k < total; k++)
+        {
+            if (!(e = _produce(run, done + k)))
+                break;
+            if (!run->q->offer(run->q, e))
+            {
+                node_pool_release(run->pool, e);
+                break;
+            }
+        }
+
+        if (k == 0)
+            break;
+
+        done += k;
+
+        while ((e = run->q->poll(run->q)) != NULL)
+            sum += _consume(run, e);
+    }
+
+    return done;
+}
+
+struct _config_t
+{
+    const struct _bench_queue_t *queues[BENCH_QUEUES];
+    uint32_t nqueues;
+
+    uint32_t producers[BENCH_LIST_MAX];
+    uint32_t nproducers;
+
+    uint32_t consumers[BENCH_LIST_MAX];
+    uint32_t nconsumers;
+
+    uint32_t capacities[BENCH_LIST_MAX];
+    uint32_t ncapacities;
+
+    uint32_t sizes[BENCH_LIST_MAX];
+    uint32_t nsizes;
+
+    bool modes[2];
+    uint32_t nmodes;
+
+    bool pin;
+
+    bool json;
+
+    uint64_t elements;
+};
+
+/**
+ * One result row.
+ */
+struct _result_t
+{
+    const char *queue;
+    uint32_t producers;
+    uint32_t consumers;
+    uint32_t capacity;
+    uint32_t size;
+    bool block;
+    bool pin;
+    uint64_t elements;
+    double seconds;
+    struct histogram_summary_t latency;
+    struct queue_stats_t stats;
+};
+
+static void _print(const struct _config_t *const config, const struct _result_t *const r, const bool first)
+{
+    const double rate = r->seconds > 0 ? (double)r->elements / r->seconds : 0;
+
+    if (config->json)
+    {
+        printf("%s  {\"queue\": \"%s\", \"producers\": %u, \"consumers\": %u, \"capacity\": %u, \"size\": %u, "
+               "\"mode\": \"%s\", \"pinned\": %s, \"elements\": %llu, \"seconds\": %.6f, \"ops_per_sec\": %.0f, "
+               "\"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu, \"waits\": %llu, \"signals\": %llu}",
+               first ? "" : ",\n", r->queue, r->producers, r->consumers, r->capacity, r->size, r->block ? "block" : "spin",
+               r->pin ? "true" : "false", (unsigned long long)r->elements, r->seconds, rate,
+               (unsigned long long)r->latency.p50, (unsigned long long)r->latency.p99,
+               (unsigned long long)r->latency.p999, (unsigned long long)r->latency.max,
+               (unsigned long long)r->stats.waits, (unsigned long long)r->stats.signals);
+    }
+    else
+    {
+        printf("%s,%u,%u,%u,%u,%s,%d,%llu,%.6f,%.0f,%llu,%llu,%llu,%llu,%llu,%llu\n", r->queue, r->producers, r->consumers,
+               r->capacity, r->size, r->block ? "block" : "spin", r->pin ? 1 : 0, (unsigned long long)r->elements,
+               r->seconds, rate, (unsigned long long)r->latency.p50, (unsigned long long)r->latency.p99,
+               (unsigned long long)r->latency.p999, (unsigned long long)r->latency.max,
+               (unsigned long long)r->stats.waits, (unsigned long long)r->stats.signals);
+    }
+
+    fflush(stdout);
+}
+
+/**
+ * Runs one point of the matrix.
+ *
+ * @return true if the run completed and r was filled
+ */
+static bool _run(const struct _config_t *const config, const struct _bench_queue_t *const bench, const uint32_t producers,
+                 const uint32_t consumers, const uint32_t capacity, const uint32_t size, const bool block,
+                 struct _result_t *const r)
+{
+    struct _run_t run;
+    struct _thread_t *threads;
+    const uint32_t n = producers + consumers;
+    uint64_t start;
+    uint64_t done = config->elements;
+    bool ok = false;
+
+    memset(&run, 0, sizeof(run));
+    memset(r, 0, sizeof(*r));
+
+    run.bench = bench;
+    run.size = size;
+    run.block = block;
+
+    if (!(run.pool = node_pool(size, capacity < 65536 ? capacity + 1024 : 65536)))
+        return false;
+
+    if (!(run.latency = histogram()))
+        goto run_err_1;
+
+    if (bench->blocking)
+        run.bq = bench->blocking(capacity);
+    else
+        run.q = bench->queue(capacity);
+
+    if (!run.bq && !run.q)
+    {
+        fprintf(stderr, "queue_bench: cannot create %s of capacity %u: %s\n", bench->name, capacity, strerror(errno));
+        goto run_err_2;
+    }
+
+    if (bench->kind == BENCH_SEQUENTIAL)
+    {
+        run.elements = config->elements;
+
+        start = nano_time();
+        done = _sequential(&run, capacity);
+        r->seconds = (double)(nano_time() - start) / 1e9;
+
+        ok = true;
+        goto run_out;
+    }
+
+    threads = (struct _thread_t *)calloc(n, sizeof(struct _thread_t));
+    if (!threads)
+        goto run_out;
+
+    run.elements = config->elements / producers;
+    run.remainder = config->elements % producers;
+    atomic_init(&run.producing, producers);
+    pthread_barrier_init(&run.start, NULL, n + 1);
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        threads[i].run = &run;
+        threads[i].index = i < producers ? i : i - producers;
+        pthread_create(&threads[i].tid, NULL, i < producers ? _producer : _consumer, &threads[i]);
+
+        if (config->pin)
+            _pin(threads[i].tid, i);
+    }
+
+    pthread_barrier_wait(&run.start);
+    start = nano_time();
+
+    for (uint32_t i = 0; i < producers; i++)
+        pthread_join(threads[i].tid, NULL);
+
+    /* wakes the consumers blocked in take once the queue is drained */
+    if (run.bq)
+        run.bq->close(run.bq);
+
+    for (uint32_t i = producers; i < n; i++)
+        pthread_join(threads[i].tid, NULL);
+
+    r->seconds = (double)(nano_time() - start) / 1e9;
+
+    pthread_barrier_destroy(&run.start);
+    free(threads);
+
+    ok = true;
+
+run_out:
+    r->queue = bench->name;
+    r->producers = producers;
+    r->consumers = consumers;
+    r->capacity = capacity;
+    r->size = size;
+    r->block = block;
+    r->pin = config->pin;
+    r->elements = done;
+    histogram_summary(run.latency, &r->latency);
+
+    if (run.bq)
+    {
+        run.bq->stats(run.bq, &r->stats);
+        run.bq->free(run.bq);
+    }
+    else
+    {
+        run.q->free(run.q);
+    }
+
+run_err_2:
+    histogram_free(run.latency);
+run_err_1:
+    node_pool_free(run.pool);
+
+    return ok;
+}
+
+/**
+ * Parses a comma separated list of numbers.
+ *
+ * @return the number of values, 0 if the list is invalid
+ */
+static uint32_t _parse_list(const char *s, uint32_t *const out)
+{
+    uint32_t n = 0;
+    char *end;
+
+    while (*s && n < BENCH_LIST_MAX)
+    {
+        const unsigned long v = strtoul(s, &end, 0);
+
+        if (end == s || (*end && *end != ','))
+            return 0;
+
+        out[n++] = (uint32_t)v;
+        s = *end ? end + 1 : end;
+    }
+
+    return *s ? 0 : n;
+}
+
+static bool _parse_queues(char *s, struct _config_t *const config)
+{
+    char *save = NULL;
+
+    config->nqueues = 0;
+
+    for (char *name = strtok_r(s, ",", &save); name; name = strtok_r(NULL, ",", &save))
+    {
+        uint32_t i;
+
+        for (i = 0; i < BENCH_QUEUES && strcmp(_queues[i].name, name) != 0; i++)
+            ;
+
+        if (i == BENCH_QUEUES || config->nqueues == BENCH_QUEUES)
+        {
+            fprintf(stderr, "queue_bench: unknown queue %s\n", name);
+            return false;
+        }
+
+        config->queues[config->nqueues++] = &_queues[i];
+    }
+
+    return config->nqueues > 0;
+}
+
+static bool _parse_modes(char *s, struct _config_t *const config)
+{
+    char *save = NULL;
+
+    config->nmodes = 0;
+
+    for (char *mode = strtok_r(s, ",", &save); mode && config->nmodes < 2; mode = strtok_r(NULL, ",", &save))
+    {
+        if (strcmp(mode, "block") == 0)
+            config->modes[config->nmodes++] = true;
+        else if (strcmp(mode, "spin") == 0)
+            config->modes[config->nmodes++] = false;
+        else
+            return false;
+    }
+
+    return config->nmodes > 0;
+}
+
+static void _usage(void)
+{
+    fprintf(stderr,
+            "usage: queue_bench [options]\n"
+            "  -q queues      comma separated, default all of:");
+
+    for (uint32_t i = 0; i < BENCH_QUEUES; i++)
+        fprintf(stderr, "%s%s", i ? "," : " ", _queues[i].name);
+
+    fprintf(stderr,
+            "\n"
+            "  -p producers   comma separated thread counts, default 1\n"
+            "  -c consumers   comma separated thread counts, default 1\n"
+            "  -n capacities  comma separated, default 1024\n"
+            "  -s sizes       comma separated element sizes in bytes, default 64\n"
+            "  -m modes       block (put/take) and/or spin (offer/poll), default block,spin\n"
+            "  -e elements    elements per run, default %llu\n"
+            "  -a             pin threads to cpus, producers first\n"
+            "  -j             print json instead of csv\n",
+            (unsigned long long)BENCH_ELEMENTS);
+}
+
+int main(int argc, char *argv[])
+{
+    struct _config_t config;
+    struct _result_t r;
+    bool first = true;
+    int opt;
+
+    memset(&config, 0, sizeof(config));
+
+    for (uint32_t i = 0; i < BENCH_QUEUES; i++)
+        config.queues[config.nqueues++] = &_queues[i];
+
+    config.producers[config.nproducers++] = 1;
+    config.consumers[config.nconsumers++] = 1;
+    config.capacities[config.ncapacities++] = 1024;
+    config.sizes[config.nsizes++] = 64;
+    config.modes[config.nmodes++] = true;
+    config.modes[config.nmodes++] = false;
+    config.elements = BENCH_ELEMENTS;
+
+    while ((opt = getopt(argc, argv, "q:p:c:n:s:m:e:ajh")) != -1)
+    {
+        bool valid = true;
+
+        switch (opt)
+        {
+        case 'q':
+            valid = _parse_queues(optarg, &config);
+            break;
+        case 'p':
+            valid = (config.nproducers = _parse_list(optarg, config.producers)) != 0;
+            break;
+        case 'c':
+            valid = (config.nconsumers = _parse_list(optarg, config.consumers)) != 0;
+            break;
+        case 'n':
+            valid = (config.ncapacities = _parse_list(optarg, config.capacities)) != 0;
+            break;
+        case 's':
+            valid = (config.nsizes = _parse_list(optarg, config.sizes)) != 0;
+            break;
+        case 'm':
+            valid = _parse_modes(optarg, &config);
+            break;
+        case 'e':
+            config.elements = strtoull(optarg, NULL, 0);
+            valid = config.elements != 0;
+            break;
+        case 'a':
+            config.pin = true;
+            break;
+        case 'j':
+            config.json = true;
+            break;
+        default:
+            valid = false;
+            break;
+        }
+
+        if (!valid)
+        {
+            _usage();
+            return 1;
+        }
+    }
+
+    if (config.json)
+        printf("[\n");
+    else
+        printf("queue,producers,consumers,capacity,size,mode,pinned,elements,seconds,ops_per_sec,"
+               "p50_ns,p99_ns,p999_ns,max_ns,waits,signals\n");
+
+    for (uint32_t q = 0; q < config.nqueues; q++)
+    {
+        const struct _bench_queue_t *const bench = config.queues[q];
+
+        for (uint32_t p = 0; p < config.nproducers; p++)
+        for (uint32_t c = 0; c < config.nconsumers; c++)
+        for (uint32_t n = 0; n < config.ncapacities; n++)
+        for (uint32_t s = 0; s < config.nsizes; s++)
+        for (uint32_t m = 0; m < config.nmodes; m++)
+        {
+            const uint32_t producers = config.producers[p];
+            const uint32_t consumers = config.consumers[c];
+            const uint32_t size = config.sizes[s] < sizeof(struct _element_t) ? sizeof(struct _element_t) : config.sizes[s];
+            const bool block = config.modes[m];
+
+            if (producers == 0 || consumers == 0)
+                continue;
+
+            /* one thread runs it, producers and consumers do not apply */
+            if (bench->kind == BENCH_SEQUENTIAL && (producers != 1 || consumers != 1 || block))
+                continue;
+
+            if (bench->kind == BENCH_BLOCKING_SPSC && (producers != 1 || consumers != 1))
+                continue;
+
+            if (bench->kind == BENCH_CONCURRENT && block)
+                continue;
+
+            if (_run(&config, bench, producers, consumers, config.capacities[n], size, block, &r))
+            {
+                _print(&config, &r, first);
+                first = false;
+            }
+        }
+    }
+
+    if (config.json)
+        printf("%s]\n", first ? "" : "\n");
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "ab_queue.h"
+#include "blocking_queue.h"
+
+#define ELEMENTS 10000
+
+typedef struct _data_s {
+    int num;
+} _data_t;
+
+void *thread_ab_queue_take(void *arg)
+{
+    struct blocking_queue_t *queue = arg;
+    _data_t *out[16];
+    int taken = 0;
+    uint32_t i, k;
+
+    while (taken < ELEMENTS)
+    {
+        /* wait for at least one element, then take whatever else is there */
+        k = queue->take_batch(queue, (void **)out, 1, 16, 0, NULL);
+
+        for (i = 0; i < k; i++)
+        {
+            if (out[i]->num != taken)
+                fprintf(stderr, "Array Queue out of order : [%d] expected [%d]\n", out[i]->num, taken);
+
+            taken++;
+            free(out[i]);
+        }
+    }
+
+    printf("Array Queue took %d elements\n", taken);
+
+    return NULL;
+}
+
+int main(int argc, const char *argv[])
+{
+    pthread_t tid;
+    _data_t *pdat;
+    int i;
+
+    struct blocking_queue_t *queue = ab_queue(4);
+
+    /* a bounded queue refuses an offer once full */
+    for (i = 0; i < 5; i++)
+    {
+        pdat = (_data_t *)malloc(sizeof(_data_t));
+        pdat->num = i;
+
+        if (!queue->offer(queue, pdat))
+        {
+            printf("Array Queue full at %d elements, offer refused\n", queue->size(queue));
+            free(pdat);
+        }
+    }
+
+    /* and a timed offer gives up after the timeout */
+    pdat = (_data_t *)malloc(sizeof(_data_t));
+    if (!queue->offer_await(queue, pdat, 100, &TIME_UNIT_MILLI))
+        printf("Array Queue offer_await timed out after 100 ms\n");
+    free(pdat);
+
+    while ((pdat = queue->poll(queue)) != NULL)
+        free(pdat);
+
+    /* put blocks while the consumer is behind */
+    pthread_create(&tid, NULL, thread_ab_queue_take, queue);
+
+    for (i = 0; i < ELEMENTS; i++)
+    {
+        pdat = (_data_t *)malloc(sizeof(_data_t));
+        pdat->num = i;
+        queue->put(queue, pdat);
+    }
+
+    pthread_join(tid, NULL);
+
+    printf("Array Queue current size: %d\n", queue->size(queue));
+
+    queue->free(queue);
+
+    return 0;
+}
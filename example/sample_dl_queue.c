@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "dl_queue.h"
+#include "blocking_queue.h"
+#include "time_util.h"
+
+typedef struct _data_s {
+    uint64_t deadline;    /* absolute nano_time */
+    char dat[16];
+} _data_t;
+
+uint64_t deadline(const void *element)
+{
+    return ((const _data_t *)element)->deadline;
+}
+
+static _data_t *data(const uint64_t start, const uint64_t delay_ms, const char *dat)
+{
+    _data_t *pdat = (_data_t *)malloc(sizeof(_data_t));
+
+    pdat->deadline = start + delay_ms * NANOS_PER_MILLI;
+    snprintf(pdat->dat, sizeof(pdat->dat), "%s", dat);
+
+    return pdat;
+}
+
+int main(int argc, const char *argv[])
+{
+    const uint64_t start = nano_time();
+    _data_t *pdat;
+    uint64_t handle;
+
+    /* a 1 ms wheel : an element is taken at most one tick after its deadline */
+    struct blocking_queue_t *queue = dl_queue(0, 1, &TIME_UNIT_MILLI, deadline);
+
+    queue->offer(queue, data(start, 30, "30 ms"));
+    queue->offer(queue, data(start, 10, "10 ms"));
+    queue->offer(queue, data(start, 20, "20 ms"));
+    handle = dl_queue_schedule(queue, data(start, 15, "cancelled"));
+
+    /* nothing has expired yet : size counts the waiting elements, poll sees none */
+    printf("DL Queue size %u, poll %p\n", queue->size(queue), queue->poll(queue));
+
+    pdat = dl_queue_cancel(queue, handle);
+    printf("DL Queue cancelled %s\n", pdat->dat);
+    free(pdat);
+
+    /* take sleeps until the next deadline, never returning an element early */
+    while (queue->size(queue) > 0)
+    {
+        pdat = queue->take(queue);
+        printf("DL Queue take %s after %lu ms\n", pdat->dat, (unsigned long)((nano_time() - start) / NANOS_PER_MILLI));
+        free(pdat);
+    }
+
+    /* poll_await gives up when no deadline falls within the timeout */
+    queue->offer(queue, data(nano_time(), 1000, "1 s"));
+    if (queue->poll_await(queue, 50, &TIME_UNIT_MILLI) == NULL)
+        printf("DL Queue poll_await timed out before the 1 s deadline\n");
+
+    queue->free(queue);
+
+    return 0;
+}
@@ -0,0 +1,44 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include "ab_queue.h"
+#include "executor.h"
+
+#define TASKS 10000
+
+static atomic_long done;
+
+void task_count(void *arg)
+{
+    atomic_fetch_add(&done, (long)arg);
+}
+
+int main(int argc, const char *argv[])
+{
+    long i;
+
+    /* a bounded queue makes submit wait while the workers are behind */
+    struct blocking_queue_t *queue = ab_queue(64);
+    struct executor_t *executor = executor_create(4, queue);
+
+    for (i = 1; i <= TASKS; i++)
+        executor_submit(executor, task_count, (void *)i);
+
+    /* closes the queue, the workers finish what was submitted and exit */
+    executor_shutdown(executor);
+
+    if (!executor_submit(executor, task_count, (void *)0) && errno == EPIPE)
+        printf("Executor submit after shutdown refused : %s\n", strerror(errno));
+
+    if (executor_await(executor, 5, &TIME_UNIT_SECOND))
+        printf("Executor ran tasks, sum %ld expected %ld\n", atomic_load(&done), (long)TASKS * (TASKS + 1) / 2);
+
+    executor_free(executor);
+
+    /* the caller's queue outlives the executor */
+    queue->free(queue);
+
+    return 0;
+}
@@ -0,0 +1,50 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "ml_queue.h"
+#include "blocking_queue.h"
+
+#define LEVELS 3
+
+typedef struct _data_s {
+    uint32_t level;    /* LEVELS - 1 is served first */
+    int seq;
+} _data_t;
+
+uint32_t level(const void *element)
+{
+    return ((const _data_t *)element)->level;
+}
+
+int main(int argc, const char *argv[])
+{
+    const uint32_t levels[] = { 0, 2, 1, 0, 2, 1 };
+    _data_t *pdat;
+    int i;
+
+    struct blocking_queue_t *queue = ml_queue(16, LEVELS, level);
+
+    for (i = 0; i < 6; i++)
+    {
+        pdat = (_data_t *)malloc(sizeof(_data_t));
+        pdat->level = levels[i];
+        pdat->seq = i;
+        queue->put(queue, pdat);
+    }
+
+    /* or given per call, for elements that do not carry it */
+    pdat = (_data_t *)malloc(sizeof(_data_t));
+    pdat->level = LEVELS - 1;
+    pdat->seq = 6;
+    ml_queue_put_level(queue, pdat, LEVELS - 1);
+
+    /* highest non-empty level first, oldest first within a level */
+    while ((pdat = queue->poll(queue)) != NULL)
+    {
+        printf("ML Queue poll : level <%u> seq <%d>\n", pdat->level, pdat->seq);
+        free(pdat);
+    }
+
+    queue->free(queue);
+
+    return 0;
+}
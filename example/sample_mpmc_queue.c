@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "mpmc_queue.h"
+#include "blocking_queue.h"
+
+#define PRODUCERS 4
+#define CONSUMERS 4
+#define ELEMENTS 10000
+
+typedef struct _data_s {
+    int producer;
+    int num;
+} _data_t;
+
+static struct blocking_queue_t *queue;
+
+void *thread_mpmc_queue_put(void *arg)
+{
+    const int producer = (int)(long)arg;
+    int i;
+
+    for (i = 0; i < ELEMENTS; i++)
+    {
+        _data_t *pdat = (_data_t *)malloc(sizeof(_data_t));
+
+        pdat->producer = producer;
+        pdat->num = i;
+        queue->put(queue, pdat);
+    }
+
+    return NULL;
+}
+
+void *thread_mpmc_queue_take(void *arg)
+{
+    long sum = 0;
+    _data_t *pdat;
+
+    /* take returns NULL once the queue is closed and drained */
+    while ((pdat = queue->take(queue)) != NULL)
+    {
+        sum += pdat->num;
+        free(pdat);
+    }
+
+    return (void *)sum;
+}
+
+int main(int argc, const char *argv[])
+{
+    pthread_t producers[PRODUCERS];
+    pthread_t consumers[CONSUMERS];
+    long i, sum = 0;
+    void *r;
+
+    /* rounded up to a power of two */
+    queue = mpmc_queue(100);
+
+    for (i = 0; i < CONSUMERS; i++)
+        pthread_create(&consumers[i], NULL, thread_mpmc_queue_take, NULL);
+    for (i = 0; i < PRODUCERS; i++)
+        pthread_create(&producers[i], NULL, thread_mpmc_queue_put, (void *)i);
+
+    for (i = 0; i < PRODUCERS; i++)
+        pthread_join(producers[i], NULL);
+
+    queue->close(queue);
+
+    for (i = 0; i < CONSUMERS; i++)
+    {
+        pthread_join(consumers[i], &r);
+        sum += (long)r;
+    }
+
+    printf("MPMC Queue sum %ld expected %ld\n", sum, (long)PRODUCERS * ELEMENTS * (ELEMENTS - 1) / 2);
+
+    queue->free(queue);
+
+    return 0;
+}
@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "mq_queue.h"
+#include "queue.h"
+
+#define ELEMENTS 10000
+#define HEAPS 8
+
+int32_t compare(const void *a, const void *b)
+{
+    const uintptr_t ka = (uintptr_t)a;
+    const uintptr_t kb = (uintptr_t)b;
+
+    return (ka > kb) - (ka < kb);
+}
+
+int main(int argc, const char *argv[])
+{
+    static bool polled[ELEMENTS + 1];
+    uintptr_t keys[ELEMENTS];
+    uintptr_t i, key, rank, lo = 1, distance = 0, max = 0;
+    unsigned int seed = 1;
+    void *element;
+
+    struct queue_t *queue = mq_queue(HEAPS, compare);
+
+    /* keys 1..ELEMENTS in random order, the element is the key itself */
+    for (i = 0; i < ELEMENTS; i++)
+        keys[i] = i + 1;
+    for (i = ELEMENTS - 1; i > 0; i--)
+    {
+        const uintptr_t j = rand_r(&seed) % (i + 1);
+
+        key = keys[i];
+        keys[i] = keys[j];
+        keys[j] = key;
+    }
+
+    for (i = 0; i < ELEMENTS; i++)
+        queue->offer(queue, (void *)keys[i]);
+
+    /* each poll returns one of the first elements, the head of the better of two heaps */
+    while ((element = queue->poll(queue)) != NULL)
+    {
+        key = (uintptr_t)element;
+        polled[key] = true;
+
+        /* its rank error : queued keys smaller than it */
+        for (i = lo, rank = 0; i < key; i++)
+            rank += !polled[i];
+
+        distance += rank;
+        if (rank > max)
+            max = rank;
+
+        while (lo <= ELEMENTS && polled[lo])
+            lo++;
+    }
+
+    printf("MQ Queue %d heaps : keys polled %lu ranks behind the smallest on average, %lu at most\n", HEAPS,
+           (unsigned long)(distance / ELEMENTS), (unsigned long)max);
+
+    /* what a running queue can tell about itself, from one poll in 64 */
+    printf("MQ Queue sampled rank error %.2f\n", mq_queue_rank_error(queue));
+
+    queue->free(queue);
+
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "ms_queue.h"
+#include "blocking_queue.h"
+
+#define PRODUCERS 4
+#define ELEMENTS 10000
+
+typedef struct _data_s {
+    int num;
+} _data_t;
+
+static struct blocking_queue_t *queue;
+
+void *thread_ms_queue_offer(void *arg)
+{
+    int i;
+
+    for (i = 0; i < ELEMENTS; i++)
+    {
+        _data_t *pdat = (_data_t *)malloc(sizeof(_data_t));
+
+        pdat->num = i;
+
+        /* unbounded : offer only fails when memory is exhausted */
+        if (!queue->offer(queue, pdat))
+        {
+            fprintf(stderr, "MS Queue offer <%d> failed!\n", i);
+            free(pdat);
+        }
+    }
+
+    return NULL;
+}
+
+int main(int argc, const char *argv[])
+{
+    pthread_t producers[PRODUCERS];
+    _data_t *pdat;
+    long i, taken = 0;
+
+    queue = ms_queue();
+
+    for (i = 0; i < PRODUCERS; i++)
+        pthread_create(&producers[i], NULL, thread_ms_queue_offer, NULL);
+
+    /* take parks while the queue is empty */
+    while (taken < PRODUCERS * ELEMENTS)
+    {
+        pdat = queue->take(queue);
+        if (pdat)
+        {
+            taken++;
+            free(pdat);
+        }
+    }
+
+    for (i = 0; i < PRODUCERS; i++)
+        pthread_join(producers[i], NULL);
+
+    /* nothing left, a timed poll gives up */
+    if (queue->poll_await(queue, 10, &TIME_UNIT_MILLI) == NULL)
+        printf("MS Queue took %ld elements, poll_await timed out on the empty queue\n", taken);
+
+    queue->free(queue);
+
+    return 0;
+}
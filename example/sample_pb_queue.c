@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "pb_queue.h"
+#include "blocking_queue.h"
+
+typedef struct _data_s {
+    int priority;    /* comparison variable, smaller first */
+    int seq;
+} _data_t;
+
+int32_t compare(const void *a, const void *b)
+{
+    const _data_t *da = a;
+    const _data_t *db = b;
+
+    return (da->priority > db->priority) - (da->priority < db->priority);
+}
+
+void *thread_pb_queue_take(void *arg)
+{
+    struct blocking_queue_t *queue = arg;
+    _data_t *pdat;
+
+    /* blocks until the producer puts, then drains in priority order */
+    while ((pdat = queue->take(queue)) != NULL)
+    {
+        printf("PB Queue take : priority <%d> seq <%d>\n", pdat->priority, pdat->seq);
+        free(pdat);
+    }
+
+    return NULL;
+}
+
+int main(int argc, const char *argv[])
+{
+    const int priorities[] = { 5, 1, 3, 1, 5, 0, 3 };
+    const int n = sizeof(priorities) / sizeof(priorities[0]);
+    _data_t *elements[sizeof(priorities) / sizeof(priorities[0])];
+    pthread_t tid;
+    int i;
+
+    struct blocking_queue_t *queue = pb_queue(16, compare);
+
+    for (i = 0; i < n; i++)
+    {
+        elements[i] = (_data_t *)malloc(sizeof(_data_t));
+        elements[i]->priority = priorities[i];
+        elements[i]->seq = i;
+    }
+
+    pthread_create(&tid, NULL, thread_pb_queue_take, queue);
+    usleep(10000);
+
+    /* one batch, so the consumer sees every element at once; equal priorities leave in seq order */
+    queue->put_batch(queue, (void *const *)elements, n);
+
+    queue->close(queue);
+    pthread_join(tid, NULL);
+
+    queue->free(queue);
+
+    return 0;
+}
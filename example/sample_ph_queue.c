@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ph_queue.h"
+
+typedef struct _data_s {
+    int key;    /* comparison variable, smaller first */
+    char dat[16];
+} _data_t;
+
+int32_t compare(const void *a, const void *b)
+{
+    const _data_t *da = a;
+    const _data_t *db = b;
+
+    return (da->key > db->key) - (da->key < db->key);
+}
+
+static struct ph_handle_t *offer(struct ph_queue_t *queue, const int key, const char *dat)
+{
+    _data_t *pdat = (_data_t *)malloc(sizeof(_data_t));
+
+    pdat->key = key;
+    snprintf(pdat->dat, sizeof(pdat->dat), "%s", dat);
+
+    return ph_queue_offer(queue, pdat);
+}
+
+int main(int argc, const char *argv[])
+{
+    struct ph_queue_t *queue = ph_queue(compare);
+    struct ph_queue_t *other = ph_queue(compare);
+    struct ph_handle_t *h;
+    _data_t *pdat;
+
+    offer(queue, 40, "forty");
+    h = offer(queue, 50, "fifty");
+    offer(queue, 30, "thirty");
+
+    /* the key of a queued element changes through its handle */
+    pdat = ph_queue_element(h);
+    pdat->key = 10;
+    ph_queue_update(queue, h);
+    printf("PH Queue head after update : %s\n", ((_data_t *)ph_queue_peek(queue))->dat);
+
+    /* an element leaves from anywhere in the heap */
+    h = offer(queue, 20, "twenty");
+    free(ph_queue_remove(queue, h));
+
+    /* meld moves every element of other into queue */
+    offer(other, 25, "twenty-five");
+    offer(other, 5, "five");
+    ph_queue_meld(queue, other);
+
+    printf("PH Queue size %u after meld, other %u\n", ph_queue_size(queue), ph_queue_size(other));
+
+    while ((pdat = ph_queue_poll(queue)) != NULL)
+    {
+        printf("PH Queue poll : <%d> %s\n", pdat->key, pdat->dat);
+        free(pdat);
+    }
+
+    ph_queue_free(other);
+    ph_queue_free(queue);
+
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "lb_queue.h"
+#include "blocking_queue.h"
+
+#define CONSUMERS 3
+#define ELEMENTS 1000
+
+typedef struct _data_s {
+    int num;
+} _data_t;
+
+void *thread_queue_take(void *arg)
+{
+    struct blocking_queue_t *queue = arg;
+    _data_t *pdat;
+    long taken = 0;
+
+    /* take keeps returning elements after close until the queue is drained */
+    while ((pdat = queue->take(queue)) != NULL)
+    {
+        taken++;
+        free(pdat);
+    }
+
+    if (errno == EPIPE)
+        printf("consumer done after %ld elements : %s\n", taken, strerror(errno));
+
+    return (void *)taken;
+}
+
+int main(int argc, const char *argv[])
+{
+    pthread_t tid[CONSUMERS];
+    _data_t *pdat;
+    long i, taken = 0;
+    void *r;
+
+    struct blocking_queue_t *queue = lb_queue(64);
+
+    for (i = 0; i < CONSUMERS; i++)
+        pthread_create(&tid[i], NULL, thread_queue_take, queue);
+
+    for (i = 0; i < ELEMENTS; i++)
+    {
+        pdat = (_data_t *)malloc(sizeof(_data_t));
+        pdat->num = i;
+        queue->put(queue, pdat);
+    }
+
+    /* wakes every parked consumer, the elements still queued are taken first */
+    queue->close(queue);
+
+    /* a closed queue refuses new elements with EPIPE */
+    pdat = (_data_t *)malloc(sizeof(_data_t));
+    if (!queue->put(queue, pdat) && errno == EPIPE)
+        printf("put after close refused : %s\n", strerror(errno));
+    free(pdat);
+
+    for (i = 0; i < CONSUMERS; i++)
+    {
+        pthread_join(tid[i], &r);
+        taken += (long)r;
+    }
+
+    printf("took %ld of %d elements, closed: %d\n", taken, ELEMENTS, queue->closed(queue));
+
+    queue->free(queue);
+
+    return 0;
+}
@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "lb_queue.h"
+#include "mpmc_queue.h"
+#include "queue_select.h"
+#include "blocking_queue.h"
+
+#define ELEMENTS 5
+
+/* control messages are preferred, data is only taken while there is none */
+static struct blocking_queue_t *queues[2];
+
+void *thread_queue_put(void *arg)
+{
+    uintptr_t i;
+
+    for (i = 1; i <= ELEMENTS; i++)
+    {
+        queues[1]->put(queues[1], (void *)i);
+        queues[0]->put(queues[0], (void *)(i * 100));
+        usleep(10000);
+    }
+
+    queues[0]->close(queues[0]);
+    queues[1]->close(queues[1]);
+
+    return NULL;
+}
+
+int main(int argc, const char *argv[])
+{
+    pthread_t tid;
+    void *element;
+    int i;
+
+    queues[0] = lb_queue(16);
+    queues[1] = mpmc_queue(16);
+
+    /* nothing to take yet, select gives up after the timeout */
+    if (blocking_queue_select(queues, 2, &element, 20, &TIME_UNIT_MILLI) < 0 && errno == ETIMEDOUT)
+        printf("select timed out on empty queues\n");
+
+    pthread_create(&tid, NULL, thread_queue_put, NULL);
+
+    /* returns the earliest ready queue, until every queue is closed and empty */
+    while ((i = blocking_queue_select(queues, 2, &element, 0, NULL)) >= 0)
+        printf("select queue %d : %lu\n", i, (unsigned long)(uintptr_t)element);
+
+    printf("select done : %s\n", strerror(errno));
+
+    pthread_join(tid, NULL);
+
+    queues[0]->free(queues[0]);
+    queues[1]->free(queues[1]);
+
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "shm_queue.h"
+#include "blocking_queue.h"
+
+#define ELEMENTS 1000
+
+typedef struct _data_s {
+    pid_t pid;
+    int num;
+    char dat[32];
+} _data_t;
+
+/* runs in the child : fills blocks of the shared arena and puts them */
+static void shm_queue_produce(struct blocking_queue_t *queue)
+{
+    int i;
+
+    for (i = 0; i < ELEMENTS; i++)
+    {
+        _data_t *pdat = shm_queue_element(queue, 0, NULL);
+        if (!pdat)
+            break;
+
+        pdat->pid = getpid();
+        pdat->num = i;
+        snprintf(pdat->dat, sizeof(pdat->dat), ">>>>> %d", i);
+
+        queue->put(queue, pdat);
+    }
+
+    /* the consumer drains what is left and then sees EPIPE */
+    queue->close(queue);
+}
+
+int main(int argc, const char *argv[])
+{
+    struct blocking_queue_t *queue;
+    struct blocking_queue_t *child;
+    _data_t *pdat;
+    pid_t pid;
+    int taken = 0;
+
+    /* an anonymous memfd mapping, shared with the child through its descriptor */
+    queue = shm_queue(NULL, 64, sizeof(_data_t));
+    if (!queue)
+    {
+        perror("shm_queue");
+        return 1;
+    }
+
+    pid = fork();
+    if (pid == 0)
+    {
+        /* the child attaches a view of its own */
+        child = shm_queue_attach_fd(shm_queue_fd(queue));
+        shm_queue_produce(child);
+        child->free(child);
+        _exit(0);
+    }
+
+    while ((pdat = queue->take(queue)) != NULL)
+    {
+        if (pdat->num != taken)
+            fprintf(stderr, "SHM Queue out of order : [%d] expected [%d]\n", pdat->num, taken);
+
+        taken++;
+
+        /* the block goes back to the arena for the child to fill again */
+        shm_queue_release(queue, pdat);
+    }
+
+    waitpid(pid, NULL, 0);
+
+    printf("SHM Queue took %d elements from process %d, closed: %d\n", taken, (int)pid, queue->closed(queue));
+
+    queue->free(queue);
+
+    return 0;
+}
@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "sl_queue.h"
+#include "ebr.h"
+#include "queue.h"
+
+#define THREADS 4
+#define ELEMENTS 10000
+
+typedef struct _data_s {
+    int key;    /* comparison variable, smaller first */
+
+    /* polled elements are retired through this link */
+    struct ebr_entry_t entry;
+} _data_t;
+
+static struct queue_t *queue;
+
+int32_t compare(const void *a, const void *b)
+{
+    const _data_t *da = a;
+    const _data_t *db = b;
+
+    return (da->key > db->key) - (da->key < db->key);
+}
+
+void reclaim(struct ebr_entry_t *const entry)
+{
+    free((char *)entry - offsetof(_data_t, entry));
+}
+
+void *thread_sl_queue_offer(void *arg)
+{
+    unsigned int seed = (unsigned int)(long)arg;
+    int i;
+
+    for (i = 0; i < ELEMENTS; i++)
+    {
+        _data_t *pdat = (_data_t *)malloc(sizeof(_data_t));
+
+        pdat->key = rand_r(&seed) % 100000;
+        queue->offer(queue, pdat);
+    }
+
+    return NULL;
+}
+
+void *thread_sl_queue_poll(void *arg)
+{
+    _data_t *pdat;
+    long polled = 0;
+    int last = -1;
+
+    /* every poll deletes the current first element, so one thread sees keys in order */
+    while ((pdat = queue->poll(queue)) != NULL)
+    {
+        if (pdat->key < last)
+            fprintf(stderr, "SL Queue out of order : <%d> after <%d>\n", pdat->key, last);
+
+        last = pdat->key;
+        polled++;
+
+        /* a concurrent offer may still compare against it */
+        ebr_retire(&pdat->entry, reclaim);
+    }
+
+    return (void *)polled;
+}
+
+int main(int argc, const char *argv[])
+{
+    pthread_t tid[THREADS];
+    long i, polled = 0;
+    void *r;
+
+    queue = sl_queue(compare);
+
+    for (i = 0; i < THREADS; i++)
+        pthread_create(&tid[i], NULL, thread_sl_queue_offer, (void *)i);
+    for (i = 0; i < THREADS; i++)
+        pthread_join(tid[i], NULL);
+
+    printf("SL Queue size %u\n", queue->size(queue));
+
+    for (i = 0; i < THREADS; i++)
+        pthread_create(&tid[i], NULL, thread_sl_queue_poll, NULL);
+    for (i = 0; i < THREADS; i++)
+    {
+        pthread_join(tid[i], &r);
+        polled += (long)r;
+    }
+
+    printf("SL Queue polled %ld elements\n", polled);
+
+    queue->free(queue);
+
+    return 0;
+}
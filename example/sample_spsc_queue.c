@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "spsc_queue.h"
+#include "blocking_queue.h"
+
+#define ELEMENTS 100000
+
+/* the only consumer thread : poll, take and take_batch are called from here alone */
+void *thread_spsc_queue_take(void *arg)
+{
+    struct blocking_queue_t *queue = arg;
+    void *out[32];
+    uintptr_t expected = 1;
+    uint32_t i, k;
+
+    while (expected <= ELEMENTS)
+    {
+        k = queue->take_batch(queue, out, 1, 32, 0, NULL);
+
+        for (i = 0; i < k; i++, expected++)
+        {
+            if ((uintptr_t)out[i] != expected)
+                fprintf(stderr, "SPSC Queue out of order : [%lu] expected [%lu]\n", (unsigned long)(uintptr_t)out[i],
+                        (unsigned long)expected);
+        }
+    }
+
+    printf("SPSC Queue took %lu elements\n", (unsigned long)(expected - 1));
+
+    return NULL;
+}
+
+int main(int argc, const char *argv[])
+{
+    pthread_t tid;
+    uintptr_t i;
+    struct queue_stats_t stats;
+
+    struct blocking_queue_t *queue = spsc_queue(256);
+
+    pthread_create(&tid, NULL, thread_spsc_queue_take, queue);
+
+    /* the only producer thread : elements here are plain numbers, never freed */
+    for (i = 1; i <= ELEMENTS; i++)
+        queue->put(queue, (void *)i);
+
+    pthread_join(tid, NULL);
+
+    queue->stats(queue, &stats);
+    printf("SPSC Queue offers %lu takes %lu waits %lu\n", (unsigned long)stats.offers, (unsigned long)stats.takes,
+           (unsigned long)stats.waits);
+
+    queue->free(queue);
+
+    return 0;
+}
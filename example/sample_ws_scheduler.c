@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "ws_deque.h"
+#include "ws_scheduler.h"
+
+#define RANGE 1000000
+#define LEAF 1000
+
+typedef struct _range_s {
+    uint64_t begin;
+    uint64_t end;
+} _range_t;
+
+static struct ws_scheduler_t *scheduler;
+static atomic_uint_least64_t total;
+
+/* splits the range until it is small enough, the halves run on this worker unless stolen */
+void task_sum(void *arg)
+{
+    _range_t *range = arg;
+
+    if (range->end - range->begin > LEAF)
+    {
+        _range_t *half = (_range_t *)malloc(sizeof(_range_t));
+
+        half->begin = range->begin + (range->end - range->begin) / 2;
+        half->end = range->end;
+        range->end = half->begin;
+
+        ws_scheduler_submit(scheduler, task_sum, half);
+        ws_scheduler_submit(scheduler, task_sum, range);
+        return;
+    }
+
+    uint64_t sum = 0;
+    for (uint64_t i = range->begin; i < range->end; i++)
+        sum += i;
+
+    atomic_fetch_add(&total, sum);
+    free(range);
+}
+
+void *thread_ws_deque_steal(void *arg)
+{
+    struct ws_deque_t *deque = arg;
+    void *element;
+
+    /* a thief takes the oldest element */
+    while ((element = ws_deque_steal(deque)) != NULL)
+        printf("Deque steal : %lu\n", (unsigned long)(uintptr_t)element);
+
+    return NULL;
+}
+
+int main(int argc, const char *argv[])
+{
+    struct ws_deque_t *deque = ws_deque(4);
+    pthread_t tid;
+    uintptr_t i;
+
+    /* the owner pushes and pops at the bottom, the ring grows past 4 */
+    for (i = 1; i <= 8; i++)
+        ws_deque_push(deque, (void *)i);
+
+    printf("Deque pop : %lu\n", (unsigned long)(uintptr_t)ws_deque_pop(deque));
+
+    pthread_create(&tid, NULL, thread_ws_deque_steal, deque);
+    pthread_join(tid, NULL);
+
+    ws_deque_free(deque);
+
+    /* an unbounded lb_queue takes the submissions from this thread */
+    scheduler = ws_scheduler(4, NULL);
+
+    _range_t *range = (_range_t *)malloc(sizeof(_range_t));
+    range->begin = 0;
+    range->end = RANGE;
+    ws_scheduler_submit(scheduler, task_sum, range);
+
+    /* runs every task, including the ones the tasks submitted */
+    ws_scheduler_free(scheduler);
+
+    printf("Scheduler sum %lu expected %lu\n", (unsigned long)atomic_load(&total),
+           (unsigned long)((uint64_t)RANGE * (RANGE - 1) / 2));
+
+    return 0;
+}
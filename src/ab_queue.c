@@ -0,0 +1,1067 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "ab_queue.h"
+#include "event_fd.h"
+#include "queue_stats.h"
+#include "time_util.h"
+
+/**
+ * condition with its count of waiting threads, so a signaller wakes no more
+ * threads than wait
+ */
+struct _cond_t
+{
+    pthread_cond_t cond;
+
+    /* threads waiting on cond, guarded by the queue lock */
+    uint32_t waiters;
+};
+
+/**
+ * array block queue
+ *
+ * blocking queue based on a power-of-two ring of element pointers
+ */
+struct ab_queue_t
+{
+
+    /**
+     * Returns the number of elements in this collection.
+     *
+     * @param thiz this
+     * @return the number of elements in this collection
+     */
+    uint32_t (*size)(struct ab_queue_t *const thiz);
+
+    /**
+     * Removes all of the elements from this collection.
+     *
+     *  @param thiz this
+     */
+    void (*clear)(struct ab_queue_t *const thiz);
+
+    /**
+     * Free collection
+     *
+     * @param thiz this
+     */
+    void (*free)(struct ab_queue_t *const thiz);
+
+    /**
+     * Inserts the specified element into this queue if it is possible to do
+     * so immediately without violating capacity restrictions.
+     *
+     * @param thiz this
+     * @param element element
+     * @return true if the element was added to this queue, else false
+     */
+    bool (*offer)(struct ab_queue_t *const thiz, const void *const element);
+
+    /**
+     * Retrieves and removes the head of this queue,
+     * or returns NULL if this queue is empty.
+     *
+     * @param thiz this
+     * @return the head of this queue, or NULL if this queue is empty
+     */
+    void *(*poll)(struct ab_queue_t *const thiz);
+
+    /**
+     * Retrieves, but does not remove, the head of this queue,
+     * or returns NULL if this queue is empty.
+     *
+     * @param thiz this
+     * @return the head of this queue, or NULL if this queue is empty
+     */
+    void *(*peek)(struct ab_queue_t *const thiz);
+
+    /**
+     * Inserts the specified element into this queue, waiting if necessary for space to become available.
+     *
+     * @param thiz this
+     * @param element the element to add
+     */
+    bool (*put)(struct ab_queue_t *const thiz, const void *const element);
+
+    /**
+     * Inserts the specified element into this queue, waiting up to the
+     * specified wait time if necessary for space to become available.
+     *
+     * @param thiz this
+     * @param element the element to add
+     * @param timeout how long to wait before giving up, in units of unit
+     * @param unit a time_unit_t determining how to interpret the timeout parameter
+     * @return true if successful, or false if the specified waiting time elapses before space is available
+     */
+    bool (*offer_await)(struct ab_queue_t *const thiz, const void *const element, const uint64_t timeout, const struct time_unit_t *const unit);
+
+    /**
+     * Retrieves and removes the head of this queue, waiting if necessary until an element becomes available.
+     *
+     * @param thiz this
+     * @return the head of this queue
+     */
+    void *(*take)(struct ab_queue_t *const thiz);
+
+    /**
+     * Retrieves and removes the head of this queue, waiting up to the
+     * specified wait time if necessary for an element to become available.
+     *
+     * @param thiz this
+     * @param timeout how long to wait before giving up, in units of unit
+     * @param unit a time_unit_t determining how to interpret the timeout parameter
+     * @return the head of this queue, or NULL if the specified waiting time elapses before an element is available
+     */
+    void *(*poll_await)(struct ab_queue_t *const thiz, const uint64_t timeout, const struct time_unit_t *const unit);
+
+    /**
+     * Inserts as many of the specified elements as possible without waiting,
+     * in order, with a single acquisition of the queue.
+     *
+     * @param thiz this
+     * @param elements the elements to add
+     * @param n number of elements
+     * @return the number of elements added, always a prefix of elements
+     */
+    uint32_t (*offer_batch)(struct ab_queue_t *const thiz, void *const *elements, const uint32_t n);
+
+    /**
+     * Inserts all of the specified elements, in order, waiting if necessary for space to become available.
+     *
+     * @param thiz this
+     * @param elements the elements to add
+     * @param n number of elements
+     * @return the number of elements added, n unless an error occurred
+     */
+    uint32_t (*put_batch)(struct ab_queue_t *const thiz, void *const *elements, const uint32_t n);
+
+    /**
+     * Removes at most max available elements from this queue without waiting.
+     *
+     * @param thiz this
+     * @param out receives the removed elements in queue order
+     * @param max the maximum number of elements to remove
+     * @return the number of elements removed
+     */
+    uint32_t (*drain_to)(struct ab_queue_t *const thiz, void **out, const uint32_t max);
+
+    /**
+     * Removes at most max elements from this queue, waiting up to the
+     * specified wait time if necessary until at least min have been removed.
+     *
+     * @param thiz this
+     * @param out receives the removed elements in queue order
+     * @param min the number of elements to wait for
+     * @param max the maximum number of elements to remove
+     * @param timeout how long to wait before giving up, in units of unit
+     * @param unit a time_unit_t determining how to interpret the timeout parameter, or NULL to wait without limit
+     * @return the number of elements removed, less than min only if the waiting time elapsed
+     */
+    uint32_t (*take_batch)(struct ab_queue_t *const thiz, void **out, const uint32_t min, const uint32_t max,
+                           const uint64_t timeout, const struct time_unit_t *const unit);
+
+    /**
+     * Returns a non-blocking eventfd that becomes readable when this queue
+     * turns ready for the event, for use with poll/epoll. The descriptor is
+     * owned by the queue and closed by free. Read it before draining the
+     * queue, and drain until the queue reports nothing left.
+     *
+     * @param thiz this
+     * @param event QUEUE_EVENT_NOT_EMPTY or QUEUE_EVENT_NOT_FULL
+     * @return the descriptor, or -1 with errno set
+     */
+    int (*eventfd)(struct ab_queue_t *const thiz, const enum queue_event_t event);
+
+    /**
+     * Closes this queue and wakes every blocked thread. Later puts fail
+     * with errno EPIPE, takes return the remaining elements and then fail
+     * with errno EPIPE. A queue cannot be reopened.
+     *
+     * @param thiz this
+     */
+    void (*close)(struct ab_queue_t *const thiz);
+
+    /**
+     * Returns true if this queue has been closed.
+     *
+     * @param thiz this
+     * @return true if this queue has been closed
+     */
+    bool (*closed)(struct ab_queue_t *const thiz);
+
+    /**
+     * Reads the operational counters of this queue. The lock counters stay
+     * 0 unless built with ENABLE_CLQUEUE_LOCK_PROFILE.
+     *
+     * @param thiz this
+     * @param stats filled with the totals since the queue was created
+     */
+    void (*stats)(struct ab_queue_t *const thiz, struct queue_stats_t *const stats);
+
+    /**
+     * Inserts the specified element into this queue, waiting until the
+     * deadline if necessary for space to become available.
+     *
+     * @param thiz this
+     * @param element the element to add
+     * @param deadline absolute CLOCK_MONOTONIC time to give up at, or NULL to wait without limit
+     * @return true if successful, or false if the deadline passes before space is available
+     */
+    bool (*offer_until)(struct ab_queue_t *const thiz, const void *const element, const struct timespec *const deadline);
+
+    /**
+     * Retrieves and removes the head of this queue, waiting until the
+     * deadline if necessary for an element to become available.
+     *
+     * @param thiz this
+     * @param deadline absolute CLOCK_MONOTONIC time to give up at, or NULL to wait without limit
+     * @return the head of this queue, or NULL if the deadline passes before an element is available
+     */
+    void *(*poll_until)(struct ab_queue_t *const thiz, const struct timespec *const deadline);
+
+    /* queue capacity */
+    uint32_t _capacity;
+
+    /* Number of queue elements */
+    __sig_atomic_t volatile _count;
+
+    /* ring index mask, ring length minus one */
+    uint32_t _mask;
+
+    /* free running index of the head element */
+    uint32_t _head;
+
+    /* free running index of the next free slot */
+    uint32_t _tail;
+
+    /* element ring */
+    const void **_items;
+
+    /* mutex lock : main lock guarding all access */
+    pthread_mutex_t _lock;
+
+    /* conditional lock : queue non-empty */
+    struct _cond_t _not_empty;
+
+    /* conditional lock : queue non-full */
+    struct _cond_t _not_full;
+
+    /* readiness descriptor : queue non-empty */
+    struct event_fd_t _readable;
+
+    /* readiness descriptor : queue non-full */
+    struct event_fd_t _writable;
+
+    /* set once by close, under lock */
+    volatile bool _closed;
+
+    /* operational counters */
+    struct queue_counters_t *_stats;
+
+    /* lock hold start, for lock profiling */
+    uint64_t _since;
+};
+
+#define AB_QUEUE_MAX_CAPACITY 0x80000000U
+
+static inline void _acquire(struct ab_queue_t *const thiz)
+{
+    queue_counters_lock(thiz->_stats, &thiz->_lock, &thiz->_since);
+}
+
+static inline void _release(struct ab_queue_t *const thiz)
+{
+    queue_counters_unlock(thiz->_stats, &thiz->_lock, &thiz->_since);
+}
+
+/**
+ * Waits on a condition of the lock, counting the wait. Called only when
+ * holding lock.
+ *
+ * @param deadline absolute CLOCK_MONOTONIC deadline, or NULL to wait without limit
+ * @return 0, or ETIMEDOUT once the deadline has passed
+ */
+static inline int _wait(struct ab_queue_t *const thiz, struct _cond_t *const cond, const struct timespec *const deadline)
+{
+    const uint64_t start = queue_counters_wait_begin();
+    int r;
+
+    queue_counters_release(thiz->_stats, &thiz->_since);
+    cond->waiters++;
+    r = deadline ? pthread_cond_timedwait(&cond->cond, &thiz->_lock, deadline) : pthread_cond_wait(&cond->cond, &thiz->_lock);
+    cond->waiters--;
+    queue_counters_reacquire(&thiz->_since);
+
+    queue_counters_wait_end(thiz->_stats, start, r == ETIMEDOUT);
+
+    return r;
+}
+
+/**
+ * Wakes up to n threads waiting on cond, one per element inserted or
+ * removed. Called only when holding lock.
+ */
+static inline void _signal_n(struct ab_queue_t *const thiz, struct _cond_t *const cond, uint32_t n)
+{
+    if (n > cond->waiters)
+        n = cond->waiters;
+
+    for (uint32_t i = 0; i < n; i++)
+        pthread_cond_signal(&cond->cond);
+
+    if (n)
+        queue_counters_add(thiz->_stats, QUEUE_STAT_SIGNALS, n);
+}
+
+static inline void _signal(struct ab_queue_t *const thiz, struct _cond_t *const cond)
+{
+    _signal_n(thiz, cond, 1);
+}
+
+static inline void _broadcast(struct ab_queue_t *const thiz, struct _cond_t *const cond)
+{
+    if (!cond->waiters)
+        return;
+
+    pthread_cond_broadcast(&cond->cond);
+    queue_counters_add(thiz->_stats, QUEUE_STAT_SIGNALS, 1);
+}
+
+/**
+ * Counts elements an offer or put could not insert.
+ */
+static inline void _reject(struct ab_queue_t *const thiz, const uint32_t n)
+{
+    queue_counters_add(thiz->_stats, QUEUE_STAT_REJECTED, n);
+}
+
+/**
+ * Inserts element at the tail. Called only when holding lock.
+ */
+static inline void _enqueue(struct ab_queue_t *const thiz, const void *const element)
+{
+    thiz->_items[thiz->_tail++ & thiz->_mask] = element;
+    queue_counters_add(thiz->_stats, QUEUE_STAT_OFFERS, 1);
+    if (++thiz->_count == 1)
+        event_fd_signal(&thiz->_readable);
+    _signal(thiz, &thiz->_not_empty);
+}
+
+/**
+ * Extracts element at the head. Called only when holding lock.
+ */
+static inline void *_dequeue(struct ab_queue_t *const thiz)
+{
+    const uint32_t i = thiz->_head++ & thiz->_mask;
+    void *x = (void *)thiz->_items[i];
+    thiz->_items[i] = NULL;
+    queue_counters_add(thiz->_stats, QUEUE_STAT_TAKES, 1);
+    if ((uint32_t)--thiz->_count + 1 == thiz->_capacity)
+        event_fd_signal(&thiz->_writable);
+    _signal(thiz, &thiz->_not_full);
+
+    return x;
+}
+
+/**
+ * Inserts k elements at the tail, waking consumers once. Called only when holding lock.
+ */
+static inline void _enqueue_batch(struct ab_queue_t *const thiz, void *const *elements, const uint32_t k)
+{
+    for (uint32_t i = 0; i < k; i++)
+        thiz->_items[thiz->_tail++ & thiz->_mask] = elements[i];
+    thiz->_count += k;
+    queue_counters_add(thiz->_stats, QUEUE_STAT_OFFERS, k);
+    if ((uint32_t)thiz->_count == k && k > 0)
+        event_fd_signal(&thiz->_readable);
+
+    _signal_n(thiz, &thiz->_not_empty, k);
+}
+
+/**
+ * Extracts k elements at the head, waking producers once. Called only when holding lock.
+ */
+static inline void _dequeue_batch(struct ab_queue_t *const thiz, void **const out, const uint32_t k)
+{
+    for (uint32_t i = 0; i < k; i++)
+    {
+        const uint32_t j = thiz->_head++ & thiz->_mask;
+        out[i] = (void *)thiz->_items[j];
+        thiz->_items[j] = NULL;
+    }
+    thiz->_count -= k;
+    queue_counters_add(thiz->_stats, QUEUE_STAT_TAKES, k);
+    if ((uint32_t)thiz->_count + k == thiz->_capacity && k > 0)
+        event_fd_signal(&thiz->_writable);
+
+    _signal_n(thiz, &thiz->_not_full, k);
+}
+
+static bool _not_empty(void *arg)
+{
+    struct ab_queue_t *const thiz = (struct ab_queue_t *)arg;
+
+    return thiz->_count != 0 || thiz->_closed;
+}
+
+static bool _not_full(void *arg)
+{
+    struct ab_queue_t *const thiz = (struct ab_queue_t *)arg;
+
+    return (uint32_t)thiz->_count != thiz->_capacity || thiz->_closed;
+}
+
+static uint32_t ab_queue_size(struct ab_queue_t *const thiz)
+{
+    return thiz->_count;
+}
+
+static void ab_queue_clear(struct ab_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return;
+    }
+
+    uint32_t c;
+
+    _acquire(thiz);
+
+    for (; thiz->_head != thiz->_tail; thiz->_head++)
+    {
+        const uint32_t i = thiz->_head & thiz->_mask;
+
+        if (thiz->_items[i])
+            free((void *)thiz->_items[i]);
+
+        thiz->_items[i] = NULL;
+    }
+
+    c = thiz->_count;
+    thiz->_count = 0;
+    if (c == thiz->_capacity)
+        event_fd_signal(&thiz->_writable);
+    _broadcast(thiz, &thiz->_not_full);
+
+    _release(thiz);
+
+    return;
+}
+
+static void ab_queue_free(struct ab_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return;
+    }
+
+    thiz->clear(thiz);
+
+    pthread_cond_destroy(&thiz->_not_empty.cond);
+    pthread_cond_destroy(&thiz->_not_full.cond);
+    event_fd_destroy(&thiz->_readable);
+    event_fd_destroy(&thiz->_writable);
+    pthread_mutex_destroy(&thiz->_lock);
+
+    queue_counters_free(thiz->_stats);
+    free(thiz->_items);
+    free(thiz);
+}
+
+static bool ab_queue_offer(struct ab_queue_t *const thiz, const void *const element)
+{
+    if (!thiz || !element)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (thiz->_closed)
+    {
+        _reject(thiz, 1);
+        errno = EPIPE;
+        return false;
+    }
+
+    if (thiz->_count == thiz->_capacity)
+    {
+        _reject(thiz, 1);
+        return false;
+    }
+
+    bool r = false;
+
+    _acquire(thiz);
+
+    if (thiz->_closed)
+    {
+        errno = EPIPE;
+    }
+    else if (thiz->_count != thiz->_capacity)
+    {
+        _enqueue(thiz, element);
+        r = true;
+    }
+
+    _release(thiz);
+
+    if (!r)
+        _reject(thiz, 1);
+
+    return r;
+}
+
+static void *ab_queue_poll(struct ab_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if (thiz->_count == 0)
+    {
+        if (thiz->_closed)
+            errno = EPIPE;
+        return NULL;
+    }
+
+    void *item = NULL;
+
+    _acquire(thiz);
+
+    if (thiz->_count != 0)
+        item = _dequeue(thiz);
+
+    _release(thiz);
+
+    return item;
+}
+
+static void *ab_queue_peek(struct ab_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if (thiz->_count == 0)
+        return NULL;
+
+    void *item = NULL;
+    _acquire(thiz);
+    item = thiz->_count > 0 ? (void *)thiz->_items[thiz->_head & thiz->_mask] : NULL;
+    _release(thiz);
+
+    return item;
+}
+
+static bool ab_queue_put(struct ab_queue_t *const thiz, const void *const element)
+{
+    if (!thiz || !element)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    bool r = false;
+
+    _acquire(thiz);
+
+    while (thiz->_count == thiz->_capacity && !thiz->_closed)
+    {
+        _wait(thiz, &thiz->_not_full, NULL);
+    }
+
+    if (thiz->_closed)
+    {
+        errno = EPIPE;
+        goto result_r;
+    }
+
+    _enqueue(thiz, element);
+    r = true;
+
+result_r:
+    _release(thiz);
+
+    if (!r)
+        _reject(thiz, 1);
+
+    return r;
+}
+
+static void *ab_queue_take(struct ab_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    void *item = NULL;
+
+    _acquire(thiz);
+
+    while (thiz->_count == 0)
+    {
+        if (thiz->_closed)
+        {
+            errno = EPIPE;
+            goto result_r;
+        }
+
+        _wait(thiz, &thiz->_not_empty, NULL);
+    }
+
+    item = _dequeue(thiz);
+
+result_r:
+    _release(thiz);
+
+    return item;
+}
+
+static bool ab_queue_offer_until(struct ab_queue_t *const thiz, const void *const element, const struct timespec *const deadline)
+{
+    if (!thiz || !element)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    bool r = false;
+
+    _acquire(thiz);
+
+    while (thiz->_count == thiz->_capacity && !thiz->_closed)
+    {
+        if (_wait(thiz, &thiz->_not_full, deadline) == ETIMEDOUT)
+            goto result_r;
+    }
+
+    if (thiz->_closed)
+    {
+        errno = EPIPE;
+        goto result_r;
+    }
+
+    _enqueue(thiz, element);
+    r = true;
+
+result_r:
+    _release(thiz);
+
+    if (!r)
+        _reject(thiz, 1);
+
+    return r;
+}
+
+static bool ab_queue_offer_wait(struct ab_queue_t *const thiz, const void *const element,
+                                const uint64_t timeout, const struct time_unit_t *const unit)
+{
+    if (!thiz || !element || !unit)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    struct timespec timeo;
+
+    calc_timeout(&timeo, timeout, unit);
+
+    return ab_queue_offer_until(thiz, element, &timeo);
+}
+
+static void *ab_queue_poll_until(struct ab_queue_t *const thiz, const struct timespec *const deadline)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    void *item = NULL;
+
+    _acquire(thiz);
+
+    while (thiz->_count == 0)
+    {
+        if (thiz->_closed)
+        {
+            errno = EPIPE;
+            goto result_r;
+        }
+
+        if (_wait(thiz, &thiz->_not_empty, deadline) == ETIMEDOUT)
+            goto result_r;
+    }
+
+    item = _dequeue(thiz);
+
+result_r:
+    _release(thiz);
+
+    return item;
+}
+
+static void *ab_queue_poll_wait(struct ab_queue_t *const thiz, const uint64_t timeout, const struct time_unit_t *const unit)
+{
+    if (!thiz || !unit)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    struct timespec timeo;
+
+    calc_timeout(&timeo, timeout, unit);
+
+    return ab_queue_poll_until(thiz, &timeo);
+}
+
+static uint32_t ab_queue_offer_batch(struct ab_queue_t *const thiz, void *const *elements, const uint32_t n)
+{
+    if (!thiz || !elements)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (!elements[i])
+        {
+            errno = EINVAL;
+            return 0;
+        }
+    }
+
+    if (n == 0)
+        return 0;
+
+    if (thiz->_count == thiz->_capacity)
+    {
+        _reject(thiz, n);
+        return 0;
+    }
+
+    uint32_t k;
+
+    _acquire(thiz);
+
+    k = thiz->_capacity - (uint32_t)thiz->_count;
+    if (k > n)
+        k = n;
+
+    if (thiz->_closed)
+    {
+        errno = EPIPE;
+        k = 0;
+    }
+
+    _enqueue_batch(thiz, elements, k);
+
+    _release(thiz);
+
+    if (k < n)
+        _reject(thiz, n - k);
+
+    return k;
+}
+
+static uint32_t ab_queue_put_batch(struct ab_queue_t *const thiz, void *const *elements, const uint32_t n)
+{
+    if (!thiz || !elements)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (!elements[i])
+        {
+            errno = EINVAL;
+            return 0;
+        }
+    }
+
+    uint32_t k;
+    uint32_t done = 0;
+
+    _acquire(thiz);
+
+    while (done < n)
+    {
+        while (thiz->_count == thiz->_capacity && !thiz->_closed)
+        {
+            _wait(thiz, &thiz->_not_full, NULL);
+        }
+
+        if (thiz->_closed)
+        {
+            errno = EPIPE;
+            break;
+        }
+
+        k = thiz->_capacity - (uint32_t)thiz->_count;
+        if (k > n - done)
+            k = n - done;
+
+        _enqueue_batch(thiz, elements + done, k);
+        done += k;
+    }
+
+    _release(thiz);
+
+    if (done < n)
+        _reject(thiz, n - done);
+
+    return done;
+}
+
+static uint32_t ab_queue_drain_to(struct ab_queue_t *const thiz, void **out, const uint32_t max)
+{
+    if (!thiz || !out)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    if (max == 0)
+        return 0;
+
+    if (thiz->_count == 0)
+    {
+        if (thiz->_closed)
+            errno = EPIPE;
+        return 0;
+    }
+
+    uint32_t k;
+
+    _acquire(thiz);
+
+    k = (uint32_t)thiz->_count;
+    if (k > max)
+        k = max;
+
+    _dequeue_batch(thiz, out, k);
+
+    _release(thiz);
+
+    return k;
+}
+
+static uint32_t ab_queue_take_batch(struct ab_queue_t *const thiz, void **out, const uint32_t min, const uint32_t max,
+                                    const uint64_t timeout, const struct time_unit_t *const unit)
+{
+    if (!thiz || !out)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    uint32_t k;
+    uint32_t taken = 0;
+    uint32_t need = (min > max) ? max : min;
+    struct timespec timeo;
+
+    if (unit)
+        calc_timeout(&timeo, timeout, unit);
+
+    _acquire(thiz);
+
+    while (taken < max)
+    {
+        while (thiz->_count == 0)
+        {
+            if (taken >= need)
+                goto result_r;
+
+            if (thiz->_closed)
+            {
+                errno = EPIPE;
+                goto result_r;
+            }
+
+            if (!unit)
+                _wait(thiz, &thiz->_not_empty, NULL);
+            else if (_wait(thiz, &thiz->_not_empty, &timeo) == ETIMEDOUT)
+                goto result_r;
+        }
+
+        k = (uint32_t)thiz->_count;
+        if (k > max - taken)
+            k = max - taken;
+
+        _dequeue_batch(thiz, out + taken, k);
+        taken += k;
+
+        if (taken >= need)
+            break;
+    }
+
+result_r:
+    _release(thiz);
+
+    return taken;
+}
+
+static void ab_queue_close(struct ab_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = EINVAL;
+        return;
+    }
+
+    _acquire(thiz);
+
+    thiz->_closed = true;
+    _broadcast(thiz, &thiz->_not_empty);
+    _broadcast(thiz, &thiz->_not_full);
+    event_fd_signal(&thiz->_readable);
+    event_fd_signal(&thiz->_writable);
+
+    _release(thiz);
+}
+
+static bool ab_queue_closed(struct ab_queue_t *const thiz)
+{
+    return thiz->_closed;
+}
+
+static void ab_queue_stats(struct ab_queue_t *const thiz, struct queue_stats_t *const stats)
+{
+    if (!thiz || !stats)
+    {
+        errno = EINVAL;
+        return;
+    }
+
+    queue_counters_read(thiz->_stats, stats);
+}
+
+static int ab_queue_eventfd(struct ab_queue_t *const thiz, const enum queue_event_t event)
+{
+    if (!thiz)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int fd;
+
+    /* transitions happen under lock, so the initial state is exact */
+    _acquire(thiz);
+
+    switch (event)
+    {
+    case QUEUE_EVENT_NOT_EMPTY:
+        fd = event_fd_open(&thiz->_readable, _not_empty, thiz);
+        break;
+    case QUEUE_EVENT_NOT_FULL:
+        fd = event_fd_open(&thiz->_writable, _not_full, thiz);
+        break;
+    default:
+        errno = EINVAL;
+        fd = -1;
+        break;
+    }
+
+    _release(thiz);
+
+    return fd;
+}
+
+struct blocking_queue_t *ab_queue(const uint32_t capacity)
+{
+    pthread_condattr_t cond_attr;
+    uint32_t length = 1;
+
+    if (capacity == 0 || capacity > AB_QUEUE_MAX_CAPACITY)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    while (length < capacity)
+        length <<= 1;
+
+    struct ab_queue_t *const thiz = (struct ab_queue_t *)malloc(sizeof(struct ab_queue_t));
+    if (thiz == NULL)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    memset((void *)thiz, 0, sizeof(struct ab_queue_t));
+
+    thiz->_items = (const void **)calloc(length, sizeof(void *));
+    if (!thiz->_items)
+    {
+        free(thiz);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    thiz->_stats = queue_counters();
+    if (!thiz->_stats)
+    {
+        free(thiz->_items);
+        free(thiz);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    thiz->_capacity = capacity;
+    thiz->_mask = length - 1;
+
+    /* thread cond timeout block's way CLOCK_REALTIME --> CLOCK_MONOTONIC */
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+
+    pthread_mutex_init(&thiz->_lock, NULL);
+    pthread_cond_init(&thiz->_not_empty.cond, &cond_attr);
+    pthread_cond_init(&thiz->_not_full.cond, &cond_attr);
+
+    pthread_condattr_destroy(&cond_attr);
+
+    event_fd_init(&thiz->_readable);
+    event_fd_init(&thiz->_writable);
+
+    /* methods */
+    thiz->size = ab_queue_size;
+    thiz->clear = ab_queue_clear;
+    thiz->free = ab_queue_free;
+    thiz->offer = ab_queue_offer;
+    thiz->poll = ab_queue_poll;
+    thiz->peek = ab_queue_peek;
+    thiz->put = ab_queue_put;
+    thiz->offer_await = ab_queue_offer_wait;
+    thiz->take = ab_queue_take;
+    thiz->poll_await = ab_queue_poll_wait;
+    thiz->offer_batch = ab_queue_offer_batch;
+    thiz->put_batch = ab_queue_put_batch;
+    thiz->drain_to = ab_queue_drain_to;
+    thiz->take_batch = ab_queue_take_batch;
+    thiz->eventfd = ab_queue_eventfd;
+    thiz->close = ab_queue_close;
+    thiz->closed = ab_queue_closed;
+    thiz->stats = ab_queue_stats;
+    thiz->offer_until = ab_queue_offer_until;
+    thiz->poll_until = ab_queue_poll_until;
+
+    return (struct blocking_queue_t *)thiz;
+}
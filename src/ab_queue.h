@@ -0,0 +1,23 @@
+#ifndef _AB_QUEUE_H_
+#define _AB_QUEUE_H_
+
+#include <stdint.h>
+#include "blocking_queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Creates an array blocking queue.
+ *
+ * @param capacity the capacity of this queue, must be non-zero
+ * @return the queue, or NULL on failure
+ */
+extern struct blocking_queue_t *ab_queue(const uint32_t capacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -3,12 +3,25 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <time.h>
 #include "time_unit.h"
+#include "queue_stats.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * Queue readiness events
+ */
+enum queue_event_t {
+    /* an element can be taken */
+    QUEUE_EVENT_NOT_EMPTY,
+
+    /* an element can be put */
+    QUEUE_EVENT_NOT_FULL
+};
+
 /** 
  * Blocking Queue
  */
@@ -103,6 +116,116 @@ struct blocking_queue_t {
      * @return the head of this queue, or NULL if the specified waiting time elapses before an element is available
      */
     void *(*poll_await)(struct blocking_queue_t * const thiz, const uint64_t timeout, const struct time_unit_t *unit);
+
+    /**
+     * Inserts as many of the specified elements as possible without waiting,
+     * in order, with a single acquisition of the queue.
+     *
+     * @param thiz this
+     * @param elements the elements to add
+     * @param n number of elements
+     * @return the number of elements added, always a prefix of elements
+     */
+    uint32_t (*offer_batch)(struct blocking_queue_t * const thiz, void *const *elements, const uint32_t n);
+
+    /**
+     * Inserts all of the specified elements, in order, waiting if necessary for space to become available.
+     *
+     * @param thiz this
+     * @param elements the elements to add
+     * @param n number of elements
+     * @return the number of elements added, n unless an error occurred
+     */
+    uint32_t (*put_batch)(struct blocking_queue_t * const thiz, void *const *elements, const uint32_t n);
+
+    /**
+     * Removes at most max available elements from this queue without waiting.
+     *
+     * @param thiz this
+     * @param out receives the removed elements in queue order
+     * @param max the maximum number of elements to remove
+     * @return the number of elements removed
+     */
+    uint32_t (*drain_to)(struct blocking_queue_t * const thiz, void **out, const uint32_t max);
+
+    /**
+     * Removes at most max elements from this queue, waiting up to the
+     * specified wait time if necessary until at least min have been removed.
+     *
+     * @param thiz this
+     * @param out receives the removed elements in queue order
+     * @param min the number of elements to wait for
+     * @param max the maximum number of elements to remove
+     * @param timeout how long to wait before giving up, in units of unit
+     * @param unit a time_unit_t determining how to interpret the timeout parameter, or NULL to wait without limit
+     * @return the number of elements removed, less than min only if the waiting time elapsed
+     */
+    uint32_t (*take_batch)(struct blocking_queue_t * const thiz, void **out, const uint32_t min, const uint32_t max,
+                           const uint64_t timeout, const struct time_unit_t *unit);
+
+    /**
+     * Returns a non-blocking eventfd that becomes readable when this queue
+     * turns ready for the event, for use with poll/epoll. The descriptor is
+     * owned by the queue and closed by free. Read it before draining the
+     * queue, and drain until the queue reports nothing left.
+     *
+     * @param thiz this
+     * @param event QUEUE_EVENT_NOT_EMPTY or QUEUE_EVENT_NOT_FULL
+     * @return the descriptor, or -1 with errno set
+     */
+    int (*eventfd)(struct blocking_queue_t * const thiz, const enum queue_event_t event);
+
+    /**
+     * Closes this queue and wakes every blocked thread. Later puts fail
+     * with errno EPIPE, takes return the remaining elements and then fail
+     * with errno EPIPE. A queue cannot be reopened.
+     *
+     * @param thiz this
+     */
+    void (*close)(struct blocking_queue_t * const thiz);
+
+    /**
+     * Returns true if this queue has been closed.
+     *
+     * @param thiz this
+     * @return true if this queue has been closed
+     */
+    bool (*closed)(struct blocking_queue_t * const thiz);
+
+    /**
+     * Reads the operational counters of this queue. The lock counters stay
+     * 0 unless built with ENABLE_CLQUEUE_LOCK_PROFILE, all of them stay 0
+     * when built with DISABLE_CLQUEUE_STATS. Each of the first 63 threads
+     * alive at once counts into a slot of its own, allocated by the queue on
+     * that thread's first count, and the threads beyond share one slot, which
+     * they add to atomically.
+     *
+     * @param thiz this
+     * @param stats filled with the totals since the queue was created
+     */
+    void (*stats)(struct blocking_queue_t * const thiz, struct queue_stats_t *const stats);
+
+    /**
+     * Inserts the specified element into this queue, waiting until the
+     * deadline if necessary for space to become available. A caller that
+     * retries keeps one deadline across calls, see calc_timeout.
+     *
+     * @param thiz this
+     * @param element the element to add
+     * @param deadline absolute CLOCK_MONOTONIC time to give up at, or NULL to wait without limit
+     * @return true if successful, or false if the deadline passes before space is available
+     */
+    bool (*offer_until)(struct blocking_queue_t * const thiz, const void *element, const struct timespec *deadline);
+
+    /**
+     * Retrieves and removes the head of this queue, waiting until the
+     * deadline if necessary for an element to become available.
+     *
+     * @param thiz this
+     * @param deadline absolute CLOCK_MONOTONIC time to give up at, or NULL to wait without limit
+     * @return the head of this queue, or NULL if the deadline passes before an element is available
+     */
+    void *(*poll_until)(struct blocking_queue_t * const thiz, const struct timespec *deadline);
 };
 
 #ifdef __cplusplus
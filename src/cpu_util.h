@@ -0,0 +1,25 @@
+#ifndef _CPU_UTIL_H_
+#define _CPU_UTIL_H_
+
+#include <stdatomic.h>
+
+/* assumed cache line size, used to keep producer and consumer state apart */
+#define CACHE_LINE_SIZE 64
+
+#define CACHE_ALIGNED _Alignas(CACHE_LINE_SIZE)
+
+/**
+ * Hints the processor that the caller is spinning.
+ */
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield" ::: "memory");
+#else
+    atomic_signal_fence(memory_order_seq_cst);
+#endif
+}
+
+#endif
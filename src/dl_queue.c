@@ -0,0 +1,1568 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/timerfd.h>
+#include "dl_queue.h"
+#include "event_fd.h"
+#include "queue_stats.h"
+#include "time_util.h"
+
+/* wheel levels */
+#define DL_QUEUE_LEVELS 4
+
+/* bits of the expiry tick per level */
+#define DL_QUEUE_BITS 8
+
+/* slots per level */
+#define DL_QUEUE_SLOTS (1U << DL_QUEUE_BITS)
+
+/* list of the expired elements, in expiry order */
+#define DL_LIST_READY (DL_QUEUE_LEVELS * DL_QUEUE_SLOTS)
+
+/* list of the elements beyond the last level, placed again when it wraps */
+#define DL_LIST_FAR (DL_LIST_READY + 1)
+
+#define DL_LIST_COUNT (DL_LIST_FAR + 1)
+
+/* list of a free node */
+#define DL_LIST_NONE 0xFFFFU
+
+/* null node index */
+#define DL_NIL 0xFFFFFFFFU
+
+#define DL_QUEUE_MAX_CAPACITY 0x80000000U
+
+/* nodes allocated up front, doubled when they run out */
+#define DL_QUEUE_INITIAL_LENGTH 64
+
+/**
+ * condition with its count of waiting threads, so a signaller wakes no more
+ * threads than wait
+ */
+struct _cond_t
+{
+    pthread_cond_t cond;
+
+    /* threads waiting on cond, guarded by the queue lock */
+    uint32_t waiters;
+};
+
+/**
+ * element node, linked by index so the node array can grow
+ */
+struct _dl_node_t
+{
+    const void *item;
+
+    /* expiry tick */
+    uint64_t expires;
+
+    /* next node in the list, or in the free list */
+    uint32_t next;
+
+    /* previous node in the list */
+    uint32_t prev;
+
+    /* bumped on release, stale handles stop matching */
+    uint32_t gen;
+
+    /* list holding the node, DL_LIST_NONE while free */
+    uint16_t list;
+};
+
+struct _dl_list_t
+{
+    uint32_t head;
+    uint32_t tail;
+};
+
+/**
+ * delay block queue
+ *
+ * blocking queue of elements that become available at a deadline, based on
+ * a hierarchical timing wheel. an element waits in the level whose slot
+ * width covers the distance to its expiry tick and moves down one level
+ * each time the wheel reaches its slot.
+ */
+struct dl_queue_t
+{
+
+    /**
+     * Returns the number of elements in this collection.
+     *
+     * @param thiz this
+     * @return the number of elements in this collection
+     */
+    uint32_t (*size)(struct dl_queue_t *const thiz);
+
+    /**
+     * Removes all of the elements from this collection.
+     *
+     *  @param thiz this
+     */
+    void (*clear)(struct dl_queue_t *const thiz);
+
+    /**
+     * Free collection
+     *
+     * @param thiz this
+     */
+    void (*free)(struct dl_queue_t *const thiz);
+
+    /**
+     * Inserts the specified element into this queue if it is possible to do
+     * so immediately without violating capacity restrictions.
+     *
+     * @param thiz this
+     * @param element element
+     * @return true if the element was added to this queue, else false
+     */
+    bool (*offer)(struct dl_queue_t *const thiz, const void *const element);
+
+    /**
+     * Retrieves and removes the head of this queue,
+     * or returns NULL if this queue is empty.
+     *
+     * @param thiz this
+     * @return the head of this queue, or NULL if this queue is empty
+     */
+    void *(*poll)(struct dl_queue_t *const thiz);
+
+    /**
+     * Retrieves, but does not remove, the head of this queue,
+     * or returns NULL if this queue is empty.
+     *
+     * @param thiz this
+     * @return the head of this queue, or NULL if this queue is empty
+     */
+    void *(*peek)(struct dl_queue_t *const thiz);
+
+    /**
+     * Inserts the specified element into this queue, waiting if necessary for space to become available.
+     *
+     * @param thiz this
+     * @param element the element to add
+     */
+    bool (*put)(struct dl_queue_t *const thiz, const void *const element);
+
+    /**
+     * Inserts the specified element into this queue, waiting up to the
+     * specified wait time if necessary for space to become available.
+     *
+     * @param thiz this
+     * @param element the element to add
+     * @param timeout how long to wait before giving up, in units of unit
+     * @param unit a time_unit_t determining how to interpret the timeout parameter
+     * @return true if successful, or false if the specified waiting time elapses before space is available
+     */
+    bool (*offer_await)(struct dl_queue_t *const thiz, const void *const element, const uint64_t timeout, const struct time_unit_t *const unit);
+
+    /**
+     * Retrieves and removes the head of this queue, waiting if necessary until an element becomes available.
+     *
+     * @param thiz this
+     * @return the head of this queue
+     */
+    void *(*take)(struct dl_queue_t *const thiz);
+
+    /**
+     * Retrieves and removes the head of this queue, waiting up to the
+     * specified wait time if necessary for an element to become available.
+     *
+     * @param thiz this
+     * @param timeout how long to wait before giving up, in units of unit
+     * @param unit a time_unit_t determining how to interpret the timeout parameter
+     * @return the head of this queue, or NULL if the specified waiting time elapses before an element is available
+     */
+    void *(*poll_await)(struct dl_queue_t *const thiz, const uint64_t timeout, const struct time_unit_t *const unit);
+
+    /**
+     * Inserts as many of the specified elements as possible without waiting,
+     * in order, with a single acquisition of the queue.
+     *
+     * @param thiz this
+     * @param elements the elements to add
+     * @param n number of elements
+     * @return the number of elements added, always a prefix of elements
+     */
+    uint32_t (*offer_batch)(struct dl_queue_t *const thiz, void *const *elements, const uint32_t n);
+
+    /**
+     * Inserts all of the specified elements, in order, waiting if necessary for space to become available.
+     *
+     * @param thiz this
+     * @param elements the elements to add
+     * @param n number of elements
+     * @return the number of elements added, n unless an error occurred
+     */
+    uint32_t (*put_batch)(struct dl_queue_t *const thiz, void *const *elements, const uint32_t n);
+
+    /**
+     * Removes at most max available elements from this queue without waiting.
+     *
+     * @param thiz this
+     * @param out receives the removed elements in queue order
+     * @param max the maximum number of elements to remove
+     * @return the number of elements removed
+     */
+    uint32_t (*drain_to)(struct dl_queue_t *const thiz, void **out, const uint32_t max);
+
+    /**
+     * Removes at most max elements from this queue, waiting up to the
+     * specified wait time if necessary until at least min have been removed.
+     *
+     * @param thiz this
+     * @param out receives the removed elements in queue order
+     * @param min the number of elements to wait for
+     * @param max the maximum number of elements to remove
+     * @param timeout how long to wait before giving up, in units of unit
+     * @param unit a time_unit_t determining how to interpret the timeout parameter, or NULL to wait without limit
+     * @return the number of elements removed, less than min only if the waiting time elapsed
+     */
+    uint32_t (*take_batch)(struct dl_queue_t *const thiz, void **out, const uint32_t min, const uint32_t max,
+                           const uint64_t timeout, const struct time_unit_t *const unit);
+
+    /**
+     * Returns a non-blocking eventfd that becomes readable when this queue
+     * turns ready for the event, for use with poll/epoll. The descriptor is
+     * owned by the queue and closed by free. Read it before draining the
+     * queue, and drain until the queue reports nothing left.
+     *
+     * @param thiz this
+     * @param event QUEUE_EVENT_NOT_EMPTY or QUEUE_EVENT_NOT_FULL
+     * @return the descriptor, or -1 with errno set
+     */
+    int (*eventfd)(struct dl_queue_t *const thiz, const enum queue_event_t event);
+
+    /**
+     * Closes this queue and wakes every blocked thread. Later puts fail
+     * with errno EPIPE, takes return the remaining elements and then fail
+     * with errno EPIPE. A queue cannot be reopened.
+     *
+     * @param thiz this
+     */
+    void (*close)(struct dl_queue_t *const thiz);
+
+    /**
+     * Returns true if this queue has been closed.
+     *
+     * @param thiz this
+     * @return true if this queue has been closed
+     */
+    bool (*closed)(struct dl_queue_t *const thiz);
+
+    /**
+     * Reads the operational counters of this queue. The lock counters stay
+     * 0 unless built with ENABLE_CLQUEUE_LOCK_PROFILE.
+     *
+     * @param thiz this
+     * @param stats filled with the totals since the queue was created
+     */
+    void (*stats)(struct dl_queue_t *const thiz, struct queue_stats_t *const stats);
+
+    /**
+     * Inserts the specified element into this queue, waiting until the
+     * deadline if necessary for space to become available.
+     *
+     * @param thiz this
+     * @param element the element to add
+     * @param deadline absolute CLOCK_MONOTONIC time to give up at, or NULL to wait without limit
+     * @return true if successful, or false if the deadline passes before space is available
+     */
+    bool (*offer_until)(struct dl_queue_t *const thiz, const void *const element, const struct timespec *const deadline);
+
+    /**
+     * Retrieves and removes the head of this queue, waiting until the
+     * deadline if necessary for an element to become available.
+     *
+     * @param thiz this
+     * @param deadline absolute CLOCK_MONOTONIC time to give up at, or NULL to wait without limit
+     * @return the head of this queue, or NULL if the deadline passes before an element is available
+     */
+    void *(*poll_until)(struct dl_queue_t *const thiz, const struct timespec *const deadline);
+
+    /* queue capacity */
+    uint32_t _capacity;
+
+    /* Number of queue elements, waiting or expired */
+    __sig_atomic_t volatile _count;
+
+    /* number of expired elements */
+    uint32_t _ready;
+
+    /* element deadline function */
+    uint64_t (*_deadline)(const void *);
+
+    /* nanoseconds per tick */
+    uint64_t _tick;
+
+    /* CLOCK_MONOTONIC time of tick 0 */
+    uint64_t _origin;
+
+    /* current tick, the wheel has been processed up to it */
+    uint64_t _now;
+
+    /* node array */
+    struct _dl_node_t *_nodes;
+
+    /* allocated nodes */
+    uint32_t _length;
+
+    /* nodes ever used, the rest of the array is untouched */
+    uint32_t _used;
+
+    /* free node list */
+    uint32_t _free;
+
+    /* wheel slots level by level, then the ready and far lists */
+    struct _dl_list_t _lists[DL_LIST_COUNT];
+
+    /* non-empty slots of each level */
+    uint64_t _occupied[DL_QUEUE_LEVELS][DL_QUEUE_SLOTS / 64];
+
+    /* waiter sleeping until the next wheel event, NULL if none */
+    const void *_leader;
+
+    /* tick the leader sleeps until */
+    uint64_t _wake;
+
+    /* mutex lock : main lock guarding all access */
+    pthread_mutex_t _lock;
+
+    /* conditional lock : element expired, or a new leader is needed */
+    struct _cond_t _not_empty;
+
+    /* conditional lock : queue non-full */
+    struct _cond_t _not_full;
+
+    /* timerfd : element expired, -1 until requested */
+    int _timer;
+
+    /* tick the timerfd is armed for, UINT64_MAX if disarmed */
+    uint64_t _armed;
+
+    /* readiness descriptor : queue non-full */
+    struct event_fd_t _writable;
+
+    /* set once by close, under lock */
+    volatile bool _closed;
+
+    /* operational counters */
+    struct queue_counters_t *_stats;
+
+    /* lock hold start, for lock profiling */
+    uint64_t _since;
+};
+
+static inline uint32_t _digit(const uint64_t tick, const uint32_t level)
+{
+    return (uint32_t)(tick >> (DL_QUEUE_BITS * level)) & (DL_QUEUE_SLOTS - 1);
+}
+
+static inline void _mark(struct dl_queue_t *const thiz, const uint32_t list, const bool occupied)
+{
+    uint64_t *const word = &thiz->_occupied[list / DL_QUEUE_SLOTS][(list % DL_QUEUE_SLOTS) >> 6];
+
+    if (occupied)
+        *word |= 1ULL << (list & 63);
+    else
+        *word &= ~(1ULL << (list & 63));
+}
+
+/**
+ * Returns the first non-empty slot of a level from slot on, or DL_QUEUE_SLOTS.
+ */
+static inline uint32_t _next_slot(const uint64_t *const map, const uint32_t slot)
+{
+    for (uint32_t w = slot >> 6; w < DL_QUEUE_SLOTS / 64; w++)
+    {
+        uint64_t bits = map[w];
+
+        if (w == slot >> 6)
+            bits &= ~0ULL << (slot & 63);
+
+        if (bits)
+            return (w << 6) | (uint32_t)__builtin_ctzll(bits);
+    }
+
+    return DL_QUEUE_SLOTS;
+}
+
+static inline uint64_t _clock_tick(const struct dl_queue_t *const thiz)
+{
+    const uint64_t now = nano_time();
+
+    return (now > thiz->_origin) ? (now - thiz->_origin) / thiz->_tick : 0;
+}
+
+/**
+ * Returns the first tick starting at or after the deadline of element.
+ */
+static inline uint64_t _expiry(const struct dl_queue_t *const thiz, const void *const element)
+{
+    const uint64_t deadline = thiz->_deadline(element);
+
+    if (deadline <= thiz->_origin)
+        return 0;
+
+    return (deadline - thiz->_origin - 1) / thiz->_tick + 1;
+}
+
+static inline void _tick_to_timespec(const struct dl_queue_t *const thiz, const uint64_t tick, struct timespec *const time)
+{
+    const uint64_t limit = (UINT64_MAX - thiz->_origin) / thiz->_tick;
+
+    nano_to_timespec(time, thiz->_origin + ((tick < limit) ? tick : limit) * thiz->_tick);
+}
+
+static void _push(struct dl_queue_t *const thiz, const uint32_t list, const uint32_t i)
+{
+    struct _dl_list_t *const l = &thiz->_lists[list];
+    struct _dl_node_t *const node = &thiz->_nodes[i];
+
+    node->list = (uint16_t)list;
+    node->next = DL_NIL;
+    node->prev = l->tail;
+
+    if (l->tail == DL_NIL)
+    {
+        l->head = i;
+        if (list < DL_LIST_READY)
+            _mark(thiz, list, true);
+    }
+    else
+    {
+        thiz->_nodes[l->tail].next = i;
+    }
+
+    l->tail = i;
+
+    if (list == DL_LIST_READY)
+        thiz->_ready++;
+}
+
+static void _unlink(struct dl_queue_t *const thiz, const uint32_t i)
+{
+    struct _dl_node_t *const node = &thiz->_nodes[i];
+    struct _dl_list_t *const l = &thiz->_lists[node->list];
+
+    if (node->prev == DL_NIL)
+        l->head = node->next;
+    else
+        thiz->_nodes[node->prev].next = node->next;
+
+    if (node->next == DL_NIL)
+        l->tail = node->prev;
+    else
+        thiz->_nodes[node->next].prev = node->prev;
+
+    if (node->list == DL_LIST_READY)
+        thiz->_ready--;
+    else if (l->head == DL_NIL && node->list < DL_LIST_READY)
+        _mark(thiz, node->list, false);
+}
+
+/**
+ * Puts a node in the lowest level whose slots reach its expiry tick, that is
+ * the lowest level above which the expiry and the current tick agree.
+ */
+static void _place(struct dl_queue_t *const thiz, const uint32_t i)
+{
+    const uint64_t e = thiz->_nodes[i].expires;
+    const uint64_t now = thiz->_now;
+
+    if (e <= now)
+    {
+        _push(thiz, DL_LIST_READY, i);
+        return;
+    }
+
+    for (uint32_t level = 0; level < DL_QUEUE_LEVELS; level++)
+    {
+        const uint32_t shift = DL_QUEUE_BITS * (level + 1);
+
+        if ((e >> shift) == (now >> shift))
+        {
+            _push(thiz, level * DL_QUEUE_SLOTS + _digit(e, level), i);
+            return;
+        }
+    }
+
+    _push(thiz, DL_LIST_FAR, i);
+}
+
+/**
+ * Empties a list and places its nodes again against the current tick.
+ */
+static void _cascade(struct dl_queue_t *const thiz, const uint32_t list)
+{
+    struct _dl_list_t *const l = &thiz->_lists[list];
+    uint32_t i = l->head;
+
+    if (i == DL_NIL)
+        return;
+
+    l->head = l->tail = DL_NIL;
+    if (list < DL_LIST_READY)
+        _mark(thiz, list, false);
+
+    while (i != DL_NIL)
+    {
+        const uint32_t next = thiz->_nodes[i].next;
+
+        _place(thiz, i);
+        i = next;
+    }
+}
+
+/**
+ * Returns the next tick at which a node expires or moves down a level, or
+ * UINT64_MAX if no element is waiting. Slots at or before the current digit
+ * of a level are always empty, and a lower level always comes first.
+ */
+static uint64_t _next_event(const struct dl_queue_t *const thiz)
+{
+    const uint64_t now = thiz->_now;
+
+    for (uint32_t level = 0; level < DL_QUEUE_LEVELS; level++)
+    {
+        const uint32_t slot = _next_slot(thiz->_occupied[level], _digit(now, level) + 1);
+        const uint32_t shift = DL_QUEUE_BITS * (level + 1);
+
+        if (slot != DL_QUEUE_SLOTS)
+            return ((now >> shift) << shift) | ((uint64_t)slot << (DL_QUEUE_BITS * level));
+    }
+
+    if (thiz->_lists[DL_LIST_FAR].head != DL_NIL)
+        return ((now >> (DL_QUEUE_BITS * DL_QUEUE_LEVELS)) + 1) << (DL_QUEUE_BITS * DL_QUEUE_LEVELS);
+
+    return UINT64_MAX;
+}
+
+/**
+ * Points the timerfd at the next tick an element may expire, or at once if
+ * one has. Called only when holding lock.
+ */
+static void _arm(struct dl_queue_t *const thiz)
+{
+    if (thiz->_timer < 0)
+        return;
+
+    struct itimerspec its;
+    uint64_t target;
+
+    if (thiz->_ready != 0 || (thiz->_closed && thiz->_count == 0))
+        target = thiz->_now;
+    else
+        target = _next_event(thiz);
+
+    if (target == thiz->_armed)
+        return;
+
+    memset(&its, 0, sizeof(its));
+    if (target != UINT64_MAX)
+        _tick_to_timespec(thiz, target, &its.it_value);
+
+    if (timerfd_settime(thiz->_timer, TFD_TIMER_ABSTIME, &its, NULL) == 0)
+        thiz->_armed = target;
+}
+
+/**
+ * Moves the wheel to tick target, expiring and cascading nodes on the way.
+ * Stretches without events are skipped through the slot bitmaps. Called
+ * only when holding lock.
+ */
+static void _advance(struct dl_queue_t *const thiz, const uint64_t target)
+{
+    uint64_t t;
+
+    while ((t = _next_event(thiz)) <= target)
+    {
+        thiz->_now = t;
+
+        if ((t & ((1ULL << (DL_QUEUE_BITS * DL_QUEUE_LEVELS)) - 1)) == 0)
+            _cascade(thiz, DL_LIST_FAR);
+
+        for (uint32_t level = DL_QUEUE_LEVELS; level-- > 0;)
+        {
+            if ((t & ((1ULL << (DL_QUEUE_BITS * level)) - 1)) == 0)
+                _cascade(thiz, level * DL_QUEUE_SLOTS + _digit(t, level));
+        }
+    }
+
+    if (target > thiz->_now)
+        thiz->_now = target;
+
+    _arm(thiz);
+}
+
+/**
+ * Takes a free node, growing the node array if they are all in use.
+ */
+static uint32_t _node(struct dl_queue_t *const thiz)
+{
+    uint32_t i = thiz->_free;
+
+    if (i != DL_NIL)
+    {
+        thiz->_free = thiz->_nodes[i].next;
+        return i;
+    }
+
+    if (thiz->_used == thiz->_length)
+    {
+        const uint32_t length = (thiz->_length > DL_QUEUE_MAX_CAPACITY / 2) ? DL_QUEUE_MAX_CAPACITY : thiz->_length * 2;
+        struct _dl_node_t *nodes;
+
+        if (length == thiz->_length ||
+            (nodes = (struct _dl_node_t *)realloc(thiz->_nodes, (size_t)length * sizeof(struct _dl_node_t))) == NULL)
+        {
+            errno = ENOMEM;
+            return DL_NIL;
+        }
+
+        thiz->_nodes = nodes;
+        thiz->_length = length;
+    }
+
+    i = thiz->_used++;
+    thiz->_nodes[i].gen = 1;
+
+    return i;
+}
+
+static void _release(struct dl_queue_t *const thiz, const uint32_t i)
+{
+    struct _dl_node_t *const node = &thiz->_nodes[i];
+
+    node->item = NULL;
+    node->list = DL_LIST_NONE;
+
+    /* generation 0 is never handed out, handle 0 means failure */
+    if (++node->gen == 0)
+        node->gen = 1;
+
+    node->next = thiz->_free;
+    thiz->_free = i;
+}
+
+static inline void _lock_main(struct dl_queue_t *const thiz)
+{
+    queue_counters_lock(thiz->_stats, &thiz->_lock, &thiz->_since);
+}
+
+static inline void _unlock_main(struct dl_queue_t *const thiz)
+{
+    queue_counters_unlock(thiz->_stats, &thiz->_lock, &thiz->_since);
+}
+
+/**
+ * Waits on a condition of the lock, counting the wait but not a timeout:
+ * the leader's timed sleep ends at a wheel event, not at its caller's
+ * deadline. Called only when holding lock.
+ *
+ * @param deadline absolute CLOCK_MONOTONIC deadline, or NULL to wait without limit
+ * @return 0, or ETIMEDOUT once the deadline has passed
+ */
+static inline int _wait(struct dl_queue_t *const thiz, struct _cond_t *const cond, const struct timespec *const deadline)
+{
+    const uint64_t start = queue_counters_wait_begin();
+    int r;
+
+    queue_counters_release(thiz->_stats, &thiz->_since);
+    cond->waiters++;
+    r = deadline ? pthread_cond_timedwait(&cond->cond, &thiz->_lock, deadline) : pthread_cond_wait(&cond->cond, &thiz->_lock);
+    cond->waiters--;
+    queue_counters_reacquire(&thiz->_since);
+
+    queue_counters_wait_end(thiz->_stats, start, false);
+
+    return r;
+}
+
+/**
+ * Wakes up to n threads waiting on cond, one per element inserted or
+ * removed. Called only when holding lock.
+ */
+static inline void _signal_n(struct dl_queue_t *const thiz, struct _cond_t *const cond, uint32_t n)
+{
+    if (n > cond->waiters)
+        n = cond->waiters;
+
+    for (uint32_t i = 0; i < n; i++)
+        pthread_cond_signal(&cond->cond);
+
+    if (n)
+        queue_counters_add(thiz->_stats, QUEUE_STAT_SIGNALS, n);
+}
+
+static inline void _signal(struct dl_queue_t *const thiz, struct _cond_t *const cond)
+{
+    _signal_n(thiz, cond, 1);
+}
+
+static inline void _broadcast(struct dl_queue_t *const thiz, struct _cond_t *const cond)
+{
+    if (!cond->waiters)
+        return;
+
+    pthread_cond_broadcast(&cond->cond);
+    queue_counters_add(thiz->_stats, QUEUE_STAT_SIGNALS, 1);
+}
+
+/**
+ * Counts elements an offer or put could not insert.
+ */
+static inline void _reject(struct dl_queue_t *const thiz, const uint32_t n)
+{
+    queue_counters_add(thiz->_stats, QUEUE_STAT_REJECTED, n);
+}
+
+/**
+ * Inserts element into the wheel. Called only when holding lock.
+ *
+ * @return the node of element, or DL_NIL if memory is insufficient
+ */
+static inline uint32_t _enqueue(struct dl_queue_t *const thiz, const void *const element)
+{
+    const uint32_t i = _node(thiz);
+
+    if (i == DL_NIL)
+        return DL_NIL;
+
+    struct _dl_node_t *const node = &thiz->_nodes[i];
+
+    node->item = element;
+    node->expires = _expiry(thiz, element);
+
+    _place(thiz, i);
+    thiz->_count++;
+    queue_counters_add(thiz->_stats, QUEUE_STAT_OFFERS, 1);
+
+    /* the new deadline comes first, the leader has to sleep less */
+    if (!thiz->_leader || node->expires < thiz->_wake)
+    {
+        thiz->_leader = NULL;
+        _signal(thiz, &thiz->_not_empty);
+    }
+
+    _arm(thiz);
+
+    return i;
+}
+
+/**
+ * Removes a node. Called only when holding lock.
+ */
+static inline void *_remove(struct dl_queue_t *const thiz, const uint32_t i)
+{
+    void *x = (void *)thiz->_nodes[i].item;
+
+    _unlink(thiz, i);
+    _release(thiz, i);
+
+    if ((uint32_t)--thiz->_count + 1 == thiz->_capacity)
+        event_fd_signal(&thiz->_writable);
+    _signal(thiz, &thiz->_not_full);
+
+    return x;
+}
+
+/**
+ * Extracts the k first expired elements, waking producers once. Called only when holding lock.
+ */
+static inline void _dequeue_batch(struct dl_queue_t *const thiz, void **const out, const uint32_t k)
+{
+    uint32_t i;
+
+    for (uint32_t j = 0; j < k; j++)
+    {
+        i = thiz->_lists[DL_LIST_READY].head;
+        out[j] = (void *)thiz->_nodes[i].item;
+
+        _unlink(thiz, i);
+        _release(thiz, i);
+    }
+
+    thiz->_count -= k;
+    queue_counters_add(thiz->_stats, QUEUE_STAT_TAKES, k);
+    if ((uint32_t)thiz->_count + k == thiz->_capacity && k > 0)
+        event_fd_signal(&thiz->_writable);
+
+    _signal_n(thiz, &thiz->_not_full, k);
+
+    _arm(thiz);
+}
+
+/**
+ * Waits until an element has expired. One waiter, the leader, sleeps until
+ * the next wheel event, the others until they are signalled. Called only
+ * when holding lock.
+ *
+ * @param timeo absolute CLOCK_MONOTONIC deadline, or NULL to wait without limit
+ * @return true if an element has expired, false if the waiting time elapsed,
+ *         or with errno EPIPE once the queue is closed and empty
+ */
+static bool _await(struct dl_queue_t *const thiz, const struct timespec *const timeo)
+{
+    struct timespec wake;
+    const struct timespec *until;
+    uint64_t next;
+    int rc;
+
+    for (;;)
+    {
+        _advance(thiz, _clock_tick(thiz));
+
+        if (thiz->_ready != 0)
+            return true;
+
+        if (thiz->_closed && thiz->_count == 0)
+        {
+            errno = EPIPE;
+            return false;
+        }
+
+        next = _next_event(thiz);
+        until = timeo;
+
+        if (!thiz->_leader && next != UINT64_MAX)
+        {
+            _tick_to_timespec(thiz, next, &wake);
+            thiz->_leader = &wake;
+            thiz->_wake = next;
+
+            if (!timeo || timespec_to_nano(&wake) < timespec_to_nano(timeo))
+                until = &wake;
+        }
+
+        rc = _wait(thiz, &thiz->_not_empty, until);
+
+        if (thiz->_leader == &wake)
+            thiz->_leader = NULL;
+
+        if (rc == ETIMEDOUT && until == timeo)
+        {
+            _advance(thiz, _clock_tick(thiz));
+            if (thiz->_ready != 0)
+                return true;
+
+            queue_counters_add(thiz->_stats, QUEUE_STAT_TIMEOUTS, 1);
+            return false;
+        }
+    }
+}
+
+/**
+ * Hands the leader role on before a waiter leaves. Called only when holding lock.
+ */
+static inline void _handoff(struct dl_queue_t *const thiz)
+{
+    if (!thiz->_leader && thiz->_count != 0)
+        _signal(thiz, &thiz->_not_empty);
+}
+
+static bool _not_full(void *arg)
+{
+    struct dl_queue_t *const thiz = (struct dl_queue_t *)arg;
+
+    return (uint32_t)thiz->_count != thiz->_capacity || thiz->_closed;
+}
+
+static uint32_t dl_queue_size(struct dl_queue_t *const thiz)
+{
+    return thiz->_count;
+}
+
+static void dl_queue_clear(struct dl_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return;
+    }
+
+    uint32_t c;
+
+    _lock_main(thiz);
+
+    for (uint32_t i = 0; i < thiz->_used; i++)
+    {
+        if (thiz->_nodes[i].list == DL_LIST_NONE)
+            continue;
+
+        free((void *)thiz->_nodes[i].item);
+        _release(thiz, i);
+    }
+
+    for (uint32_t l = 0; l < DL_LIST_COUNT; l++)
+        thiz->_lists[l].head = thiz->_lists[l].tail = DL_NIL;
+
+    memset(thiz->_occupied, 0, sizeof(thiz->_occupied));
+    thiz->_ready = 0;
+
+    c = thiz->_count;
+    thiz->_count = 0;
+    if (c == thiz->_capacity)
+        event_fd_signal(&thiz->_writable);
+    _broadcast(thiz, &thiz->_not_full);
+
+    _arm(thiz);
+
+    _unlock_main(thiz);
+
+    return;
+}
+
+static void dl_queue_free(struct dl_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return;
+    }
+
+    thiz->clear(thiz);
+
+    pthread_cond_destroy(&thiz->_not_empty.cond);
+    pthread_cond_destroy(&thiz->_not_full.cond);
+    event_fd_destroy(&thiz->_writable);
+    pthread_mutex_destroy(&thiz->_lock);
+
+    if (thiz->_timer >= 0)
+        close(thiz->_timer);
+
+    queue_counters_free(thiz->_stats);
+    free(thiz->_nodes);
+    free(thiz);
+}
+
+static bool dl_queue_offer(struct dl_queue_t *const thiz, const void *const element)
+{
+    return dl_queue_schedule((struct blocking_queue_t *)thiz, element) != 0;
+}
+
+static void *dl_queue_poll(struct dl_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if (thiz->_count == 0)
+    {
+        if (thiz->_closed)
+            errno = EPIPE;
+        return NULL;
+    }
+
+    void *item = NULL;
+
+    _lock_main(thiz);
+
+    _advance(thiz, _clock_tick(thiz));
+
+    if (thiz->_ready != 0)
+    {
+        _dequeue_batch(thiz, &item, 1);
+    }
+    else if (thiz->_closed && thiz->_count == 0)
+    {
+        errno = EPIPE;
+    }
+
+    _unlock_main(thiz);
+
+    return item;
+}
+
+static void *dl_queue_peek(struct dl_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if (thiz->_count == 0)
+        return NULL;
+
+    void *item = NULL;
+
+    _lock_main(thiz);
+
+    _advance(thiz, _clock_tick(thiz));
+
+    if (thiz->_ready != 0)
+        item = (void *)thiz->_nodes[thiz->_lists[DL_LIST_READY].head].item;
+
+    _unlock_main(thiz);
+
+    return item;
+}
+
+static bool dl_queue_put(struct dl_queue_t *const thiz, const void *const element)
+{
+    if (!thiz || !element)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    bool r = false;
+
+    _lock_main(thiz);
+
+    while (thiz->_count == thiz->_capacity && !thiz->_closed)
+    {
+        _wait(thiz, &thiz->_not_full, NULL);
+    }
+
+    if (thiz->_closed)
+    {
+        errno = EPIPE;
+        goto result_r;
+    }
+
+    r = _enqueue(thiz, element) != DL_NIL;
+
+result_r:
+    _unlock_main(thiz);
+
+    if (!r)
+        _reject(thiz, 1);
+
+    return r;
+}
+
+static void *dl_queue_take(struct dl_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    void *item = NULL;
+
+    _lock_main(thiz);
+
+    if (_await(thiz, NULL))
+        _dequeue_batch(thiz, &item, 1);
+
+    _handoff(thiz);
+
+    _unlock_main(thiz);
+
+    return item;
+}
+
+static bool dl_queue_offer_until(struct dl_queue_t *const thiz, const void *const element, const struct timespec *const deadline)
+{
+    if (!thiz || !element)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    bool r = false;
+
+    _lock_main(thiz);
+
+    while (thiz->_count == thiz->_capacity && !thiz->_closed)
+    {
+        if (_wait(thiz, &thiz->_not_full, deadline) == ETIMEDOUT)
+        {
+            queue_counters_add(thiz->_stats, QUEUE_STAT_TIMEOUTS, 1);
+            goto result_r;
+        }
+    }
+
+    if (thiz->_closed)
+    {
+        errno = EPIPE;
+        goto result_r;
+    }
+
+    r = _enqueue(thiz, element) != DL_NIL;
+
+result_r:
+    _unlock_main(thiz);
+
+    if (!r)
+        _reject(thiz, 1);
+
+    return r;
+}
+
+static bool dl_queue_offer_wait(struct dl_queue_t *const thiz, const void *const element,
+                                const uint64_t timeout, const struct time_unit_t *const unit)
+{
+    if (!thiz || !element || !unit)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    struct timespec timeo;
+
+    calc_timeout(&timeo, timeout, unit);
+
+    return dl_queue_offer_until(thiz, element, &timeo);
+}
+
+static void *dl_queue_poll_until(struct dl_queue_t *const thiz, const struct timespec *const deadline)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    void *item = NULL;
+
+    _lock_main(thiz);
+
+    if (_await(thiz, deadline))
+        _dequeue_batch(thiz, &item, 1);
+
+    _handoff(thiz);
+
+    _unlock_main(thiz);
+
+    return item;
+}
+
+static void *dl_queue_poll_wait(struct dl_queue_t *const thiz, const uint64_t timeout, const struct time_unit_t *const unit)
+{
+    if (!thiz || !unit)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    struct timespec timeo;
+
+    calc_timeout(&timeo, timeout, unit);
+
+    return dl_queue_poll_until(thiz, &timeo);
+}
+
+static uint32_t dl_queue_offer_batch(struct dl_queue_t *const thiz, void *const *elements, const uint32_t n)
+{
+    if (!thiz || !elements)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (!elements[i])
+        {
+            errno = EINVAL;
+            return 0;
+        }
+    }
+
+    if (n == 0)
+        return 0;
+
+    if (thiz->_count == thiz->_capacity)
+    {
+        _reject(thiz, n);
+        return 0;
+    }
+
+    uint32_t k = 0;
+    uint32_t room;
+
+    _lock_main(thiz);
+
+    room = thiz->_capacity - (uint32_t)thiz->_count;
+    if (room > n)
+        room = n;
+
+    if (thiz->_closed)
+    {
+        errno = EPIPE;
+        room = 0;
+    }
+
+    while (k < room && _enqueue(thiz, elements[k]) != DL_NIL)
+        k++;
+
+    _unlock_main(thiz);
+
+    if (k < n)
+        _reject(thiz, n - k);
+
+    return k;
+}
+
+static uint32_t dl_queue_put_batch(struct dl_queue_t *const thiz, void *const *elements, const uint32_t n)
+{
+    if (!thiz || !elements)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (!elements[i])
+        {
+            errno = EINVAL;
+            return 0;
+        }
+    }
+
+    uint32_t done = 0;
+
+    _lock_main(thiz);
+
+    while (done < n)
+    {
+        while (thiz->_count == thiz->_capacity && !thiz->_closed)
+        {
+            _wait(thiz, &thiz->_not_full, NULL);
+        }
+
+        if (thiz->_closed)
+        {
+            errno = EPIPE;
+            break;
+        }
+
+        if (_enqueue(thiz, elements[done]) == DL_NIL)
+            break;
+
+        done++;
+    }
+
+    _unlock_main(thiz);
+
+    if (done < n)
+        _reject(thiz, n - done);
+
+    return done;
+}
+
+static uint32_t dl_queue_drain_to(struct dl_queue_t *const thiz, void **out, const uint32_t max)
+{
+    if (!thiz || !out)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    if (max == 0)
+        return 0;
+
+    if (thiz->_count == 0)
+    {
+        if (thiz->_closed)
+            errno = EPIPE;
+        return 0;
+    }
+
+    uint32_t k;
+
+    _lock_main(thiz);
+
+    _advance(thiz, _clock_tick(thiz));
+
+    k = thiz->_ready;
+    if (k > max)
+        k = max;
+
+    _dequeue_batch(thiz, out, k);
+
+    _unlock_main(thiz);
+
+    return k;
+}
+
+static uint32_t dl_queue_take_batch(struct dl_queue_t *const thiz, void **out, const uint32_t min, const uint32_t max,
+                                    const uint64_t timeout, const struct time_unit_t *const unit)
+{
+    if (!thiz || !out)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    uint32_t k;
+    uint32_t taken = 0;
+    uint32_t need = (min > max) ? max : min;
+    struct timespec timeo;
+
+    if (unit)
+        calc_timeout(&timeo, timeout, unit);
+
+    _lock_main(thiz);
+
+    while (taken < max)
+    {
+        if (thiz->_ready == 0)
+        {
+            if (taken >= need)
+                break;
+
+            if (!_await(thiz, unit ? &timeo : NULL))
+                break;
+        }
+
+        k = thiz->_ready;
+        if (k > max - taken)
+            k = max - taken;
+
+        _dequeue_batch(thiz, out + taken, k);
+        taken += k;
+
+        if (taken >= need)
+            break;
+    }
+
+    _handoff(thiz);
+
+    _unlock_main(thiz);
+
+    return taken;
+}
+
+static void dl_queue_close(struct dl_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = EINVAL;
+        return;
+    }
+
+    _lock_main(thiz);
+
+    thiz->_closed = true;
+    _broadcast(thiz, &thiz->_not_empty);
+    _broadcast(thiz, &thiz->_not_full);
+    event_fd_signal(&thiz->_writable);
+    _arm(thiz);
+
+    _unlock_main(thiz);
+}
+
+static bool dl_queue_closed(struct dl_queue_t *const thiz)
+{
+    return thiz->_closed;
+}
+
+static int dl_queue_eventfd(struct dl_queue_t *const thiz, const enum queue_event_t event)
+{
+    if (!thiz)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int fd;
+
+    /* transitions happen under lock, so the initial state is exact */
+    _lock_main(thiz);
+
+    switch (event)
+    {
+    case QUEUE_EVENT_NOT_EMPTY:
+        /* expiry is a matter of time, so readiness comes from a timer */
+        if (thiz->_timer < 0)
+        {
+            thiz->_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+            _advance(thiz, _clock_tick(thiz));
+        }
+        fd = thiz->_timer;
+        break;
+    case QUEUE_EVENT_NOT_FULL:
+        fd = event_fd_open(&thiz->_writable, _not_full, thiz);
+        break;
+    default:
+        errno = EINVAL;
+        fd = -1;
+        break;
+    }
+
+    _unlock_main(thiz);
+
+    return fd;
+}
+
+static void dl_queue_stats(struct dl_queue_t *const thiz, struct queue_stats_t *const stats)
+{
+    if (!thiz || !stats)
+    {
+        errno = EINVAL;
+        return;
+    }
+
+    queue_counters_read(thiz->_stats, stats);
+}
+
+uint64_t dl_queue_schedule(struct blocking_queue_t *const queue, const void *const element)
+{
+    struct dl_queue_t *const thiz = (struct dl_queue_t *)queue;
+
+    if (!thiz || !element)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    if (thiz->_closed)
+    {
+        _reject(thiz, 1);
+        errno = EPIPE;
+        return 0;
+    }
+
+    if (thiz->_count == thiz->_capacity)
+    {
+        _reject(thiz, 1);
+        return 0;
+    }
+
+    uint64_t handle = 0;
+    uint32_t i;
+
+    _lock_main(thiz);
+
+    if (thiz->_closed)
+    {
+        errno = EPIPE;
+    }
+    else if (thiz->_count != thiz->_capacity && (i = _enqueue(thiz, element)) != DL_NIL)
+    {
+        handle = ((uint64_t)thiz->_nodes[i].gen << 32) | i;
+    }
+
+    _unlock_main(thiz);
+
+    if (handle == 0)
+        _reject(thiz, 1);
+
+    return handle;
+}
+
+void *dl_queue_cancel(struct blocking_queue_t *const queue, const uint64_t handle)
+{
+    struct dl_queue_t *const thiz = (struct dl_queue_t *)queue;
+
+    if (!thiz || handle == 0)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    const uint32_t i = (uint32_t)handle;
+    void *item = NULL;
+
+    _lock_main(thiz);
+
+    if (i < thiz->_used && thiz->_nodes[i].gen == (uint32_t)(handle >> 32) && thiz->_nodes[i].list != DL_LIST_NONE)
+    {
+        item = _remove(thiz, i);
+        _arm(thiz);
+    }
+
+    _unlock_main(thiz);
+
+    return item;
+}
+
+struct blocking_queue_t *dl_queue(const uint32_t capacity, const uint64_t tick, const struct time_unit_t *const unit,
+                                  uint64_t (*const deadline)(const void *))
+{
+    pthread_condattr_t cond_attr;
+
+    if (!deadline || !unit || tick == 0 || time_unit_to_nano(unit, tick) == 0 || capacity > DL_QUEUE_MAX_CAPACITY)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct dl_queue_t *const thiz = (struct dl_queue_t *)malloc(sizeof(struct dl_queue_t));
+    if (thiz == NULL)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    memset((void *)thiz, 0, sizeof(struct dl_queue_t));
+
+    thiz->_capacity = (capacity == 0) ? DL_QUEUE_MAX_CAPACITY : capacity;
+    thiz->_length = (thiz->_capacity < DL_QUEUE_INITIAL_LENGTH) ? thiz->_capacity : DL_QUEUE_INITIAL_LENGTH;
+
+    thiz->_nodes = (struct _dl_node_t *)malloc((size_t)thiz->_length * sizeof(struct _dl_node_t));
+    if (!thiz->_nodes)
+    {
+        free(thiz);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    thiz->_stats = queue_counters();
+    if (!thiz->_stats)
+    {
+        free(thiz->_nodes);
+        free(thiz);
+        return NULL;
+    }
+
+    thiz->_deadline = deadline;
+    thiz->_tick = time_unit_to_nano(unit, tick);
+    thiz->_origin = nano_time();
+    thiz->_free = DL_NIL;
+    thiz->_timer = -1;
+    thiz->_armed = UINT64_MAX;
+
+    for (uint32_t l = 0; l < DL_LIST_COUNT; l++)
+        thiz->_lists[l].head = thiz->_lists[l].tail = DL_NIL;
+
+    /* thread cond timeout block's way CLOCK_REALTIME --> CLOCK_MONOTONIC */
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+
+    pthread_mutex_init(&thiz->_lock, NULL);
+    pthread_cond_init(&thiz->_not_empty.cond, &cond_attr);
+    pthread_cond_init(&thiz->_not_full.cond, &cond_attr);
+
+    pthread_condattr_destroy(&cond_attr);
+
+    event_fd_init(&thiz->_writable);
+
+    /* methods */
+    thiz->size = dl_queue_size;
+    thiz->clear = dl_queue_clear;
+    thiz->free = dl_queue_free;
+    thiz->offer = dl_queue_offer;
+    thiz->poll = dl_queue_poll;
+    thiz->peek = dl_queue_peek;
+    thiz->put = dl_queue_put;
+    thiz->offer_await = dl_queue_offer_wait;
+    thiz->take = dl_queue_take;
+    thiz->poll_await = dl_queue_poll_wait;
+    thiz->offer_batch = dl_queue_offer_batch;
+    thiz->put_batch = dl_queue_put_batch;
+    thiz->drain_to = dl_queue_drain_to;
+    thiz->take_batch = dl_queue_take_batch;
+    thiz->eventfd = dl_queue_eventfd;
+    thiz->close = dl_queue_close;
+    thiz->closed = dl_queue_closed;
+    thiz->stats = dl_queue_stats;
+    thiz->offer_until = dl_queue_offer_until;
+    thiz->poll_until = dl_queue_poll_until;
+
+    return (struct blocking_queue_t *)thiz;
+}
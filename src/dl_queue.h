@@ -0,0 +1,54 @@
+#ifndef _DL_QUEUE_H_
+#define _DL_QUEUE_H_
+
+#include <stdint.h>
+#include "blocking_queue.h"
+#include "time_unit.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Creates a delay queue. An element can be taken once its deadline has
+ * passed, takes sleep until the next deadline.
+ *
+ * elements wait in a hierarchical timing wheel of tick resolution, so
+ * inserts and cancels are O(1), and an element is taken at most one tick
+ * after its deadline, never before. size counts the waiting elements too,
+ * poll, peek and drain_to only see the expired ones. the NOT_EMPTY eventfd
+ * is a timerfd armed for the next deadline.
+ *
+ * @param capacity the capacity of this queue, 0 means unbounded
+ * @param tick wheel resolution, in units of unit, must be non-zero
+ * @param unit a time_unit_t determining how to interpret the tick parameter
+ * @param deadline returns the deadline of an element, an absolute
+ *                 CLOCK_MONOTONIC time in nanoseconds as nano_time returns it
+ * @return the queue, or NULL on failure
+ */
+extern struct blocking_queue_t *dl_queue(const uint32_t capacity, const uint64_t tick, const struct time_unit_t *const unit,
+                                         uint64_t (*const deadline)(const void *));
+
+/**
+ * Inserts an element like offer, and returns a handle to cancel it with.
+ *
+ * @param queue queue returned by dl_queue
+ * @param element element
+ * @return the handle, or 0 if the queue is full or on failure
+ */
+extern uint64_t dl_queue_schedule(struct blocking_queue_t *const queue, const void *const element);
+
+/**
+ * Removes a waiting or expired element before it is taken.
+ *
+ * @param queue queue returned by dl_queue
+ * @param handle handle returned by dl_queue_schedule
+ * @return the element, or NULL if it was already taken or cancelled
+ */
+extern void *dl_queue_cancel(struct blocking_queue_t *const queue, const uint64_t handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,249 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "ebr.h"
+#include "cpu_util.h"
+
+/* retires between two attempts to advance the global epoch */
+#define EBR_SCAN_THRESHOLD 64
+
+/* a node retired in epoch e is reclaimed once the global epoch reaches e + 2 */
+#define EBR_EPOCHS 3
+
+/**
+ * nodes retired by one thread during one epoch
+ */
+struct _ebr_bag_t
+{
+    uint32_t epoch;
+    struct ebr_entry_t *head;
+};
+
+/**
+ * per-thread record, never freed and reused by later threads
+ */
+struct _ebr_record_t
+{
+    /* epoch << 1 | 1 while inside a critical section, 0 outside */
+    CACHE_ALIGNED atomic_uint state;
+
+    /* record list */
+    struct _ebr_record_t *next;
+
+    /* owned by a live thread */
+    atomic_bool in_use;
+
+    /* critical section nesting depth */
+    uint32_t nesting;
+
+    /* retires since the last scan */
+    uint32_t retired;
+
+    /* retired nodes, indexed by epoch */
+    struct _ebr_bag_t limbo[EBR_EPOCHS];
+};
+
+static CACHE_ALIGNED atomic_uint _epoch;
+
+static _Atomic(struct _ebr_record_t *) _records;
+
+static pthread_once_t _once = PTHREAD_ONCE_INIT;
+
+static pthread_key_t _key;
+
+/* mutex lock : nodes left behind by exited threads */
+static pthread_mutex_t _orphan_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct _ebr_bag_t _orphans;
+
+static __thread struct _ebr_record_t *_record;
+
+static inline void _reclaim(struct ebr_entry_t *entry)
+{
+    for (struct ebr_entry_t *next; entry != NULL; entry = next)
+    {
+        next = entry->next;
+        entry->reclaim(entry);
+    }
+}
+
+/**
+ * Advances the global epoch if every active thread has observed it.
+ */
+static inline uint32_t _try_advance(void)
+{
+    uint32_t e = atomic_load(&_epoch);
+
+    for (struct _ebr_record_t *rec = atomic_load(&_records); rec != NULL; rec = rec->next)
+    {
+        const uint32_t s = atomic_load(&rec->state);
+
+        if ((s & 1) && (s >> 1) != e)
+            return e;
+    }
+
+    if (atomic_compare_exchange_strong(&_epoch, &e, e + 1))
+        return e + 1;
+
+    return e;
+}
+
+static inline void _collect(struct _ebr_record_t *const rec, const uint32_t epoch)
+{
+    for (int i = 0; i < EBR_EPOCHS; i++)
+    {
+        struct _ebr_bag_t *bag = &rec->limbo[i];
+
+        if (bag->head && bag->epoch + 2 <= epoch)
+        {
+            struct ebr_entry_t *head = bag->head;
+            bag->head = NULL;
+            _reclaim(head);
+        }
+    }
+
+    if (pthread_mutex_trylock(&_orphan_lock) == 0)
+    {
+        struct ebr_entry_t *head = NULL;
+
+        if (_orphans.head && _orphans.epoch + 2 <= epoch)
+        {
+            head = _orphans.head;
+            _orphans.head = NULL;
+        }
+
+        pthread_mutex_unlock(&_orphan_lock);
+
+        _reclaim(head);
+    }
+}
+
+static void _release(void *arg)
+{
+    struct _ebr_record_t *rec = (struct _ebr_record_t *)arg;
+    const uint32_t e = _try_advance();
+
+    _collect(rec, e);
+
+    /* whatever is still pending is adopted by the orphan bag */
+    pthread_mutex_lock(&_orphan_lock);
+
+    for (int i = 0; i < EBR_EPOCHS; i++)
+    {
+        struct _ebr_bag_t *bag = &rec->limbo[i];
+
+        for (struct ebr_entry_t *next, *entry = bag->head; entry != NULL; entry = next)
+        {
+            next = entry->next;
+            entry->next = _orphans.head;
+            _orphans.head = entry;
+        }
+
+        if (bag->head && (int32_t)(bag->epoch - _orphans.epoch) > 0)
+            _orphans.epoch = bag->epoch;
+
+        bag->head = NULL;
+    }
+
+    pthread_mutex_unlock(&_orphan_lock);
+
+    rec->retired = 0;
+    atomic_store(&rec->state, 0);
+
+    /* a later destructor of this thread that enters takes a record again,
+     * it must not go on using this one once another thread may own it */
+    _record = NULL;
+    atomic_store(&rec->in_use, false);
+}
+
+static void _init(void)
+{
+    pthread_key_create(&_key, _release);
+}
+
+static struct _ebr_record_t *_acquire(void)
+{
+    struct _ebr_record_t *rec;
+
+    pthread_once(&_once, _init);
+
+    for (rec = atomic_load(&_records); rec != NULL; rec = rec->next)
+    {
+        bool expected = false;
+
+        if (!atomic_load(&rec->in_use) && atomic_compare_exchange_strong(&rec->in_use, &expected, true))
+            goto acquire_r;
+    }
+
+    if (posix_memalign((void **)&rec, CACHE_LINE_SIZE, sizeof(struct _ebr_record_t)) != 0)
+    {
+        /* nothing sensible is left to do for a reader without a record */
+        abort();
+    }
+
+    memset((void *)rec, 0, sizeof(struct _ebr_record_t));
+    atomic_init(&rec->state, 0);
+    atomic_init(&rec->in_use, true);
+
+    rec->next = atomic_load(&_records);
+    while (!atomic_compare_exchange_weak(&_records, &rec->next, rec))
+        ;
+
+acquire_r:
+    pthread_setspecific(_key, rec);
+    _record = rec;
+
+    return rec;
+}
+
+void ebr_enter(void)
+{
+    struct _ebr_record_t *rec = _record ? _record : _acquire();
+
+    if (rec->nesting++ > 0)
+        return;
+
+    atomic_store_explicit(&rec->state, (atomic_load_explicit(&_epoch, memory_order_relaxed) << 1) | 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+void ebr_exit(void)
+{
+    struct _ebr_record_t *rec = _record;
+
+    if (--rec->nesting > 0)
+        return;
+
+    atomic_store_explicit(&rec->state, 0, memory_order_release);
+}
+
+void ebr_retire(struct ebr_entry_t *const entry, void (*const reclaim)(struct ebr_entry_t *const entry))
+{
+    struct _ebr_record_t *rec = _record ? _record : _acquire();
+    const uint32_t e = atomic_load(&_epoch);
+    struct _ebr_bag_t *bag = &rec->limbo[e % EBR_EPOCHS];
+
+    if (bag->epoch != e)
+    {
+        /* the bag was last filled in epoch e - 3 or earlier */
+        struct ebr_entry_t *head = bag->head;
+        bag->head = NULL;
+        bag->epoch = e;
+        _reclaim(head);
+    }
+
+    entry->reclaim = reclaim;
+    entry->next = bag->head;
+    bag->head = entry;
+
+    if (++rec->retired >= EBR_SCAN_THRESHOLD)
+    {
+        rec->retired = 0;
+        _collect(rec, _try_advance());
+    }
+}
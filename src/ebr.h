@@ -0,0 +1,48 @@
+#ifndef _EBR_H_
+#define _EBR_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Epoch Based Reclamation
+ *
+ * threads read shared nodes only between ebr_enter and ebr_exit. a node
+ * unlinked from every shared structure is handed to ebr_retire and is
+ * reclaimed once every thread has left the critical sections that might
+ * still reference it.
+ */
+
+/**
+ * retired node link, embedded in the retired structure
+ */
+struct ebr_entry_t
+{
+    struct ebr_entry_t *next;
+    void (*reclaim)(struct ebr_entry_t *const entry);
+};
+
+/**
+ * Enters a read-side critical section. Sections may nest.
+ */
+extern void ebr_enter(void);
+
+/**
+ * Leaves a read-side critical section.
+ */
+extern void ebr_exit(void);
+
+/**
+ * Defers reclaim of an unlinked node until no thread can reference it.
+ *
+ * @param entry link embedded in the node
+ * @param reclaim called with entry once the node may be freed
+ */
+extern void ebr_retire(struct ebr_entry_t *const entry, void (*const reclaim)(struct ebr_entry_t *const entry));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef _EVENT_FD_H_
+#define _EVENT_FD_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/eventfd.h>
+
+/**
+ * Event Fd
+ *
+ * readiness descriptor of a queue. the eventfd is created on first request,
+ * and until then signalling costs a single load. the queue signals it on the
+ * transition into the ready state only, so a consumer must read the
+ * descriptor before draining the queue, and drain until the queue reports
+ * nothing left.
+ */
+struct event_fd_t
+{
+    /* eventfd, -1 until requested */
+    atomic_int _fd;
+};
+
+static inline void event_fd_init(struct event_fd_t *const e)
+{
+    atomic_init(&e->_fd, -1);
+}
+
+static inline void event_fd_destroy(struct event_fd_t *const e)
+{
+    const int fd = atomic_load(&e->_fd);
+
+    if (fd >= 0)
+        close(fd);
+}
+
+/**
+ * @param e event
+ * @return true if a descriptor has been handed out
+ */
+static inline bool event_fd_armed(struct event_fd_t *const e)
+{
+    return atomic_load_explicit(&e->_fd, memory_order_relaxed) >= 0;
+}
+
+/**
+ * Makes the descriptor readable, if there is one.
+ *
+ * @param e event
+ */
+static inline void event_fd_signal(struct event_fd_t *const e)
+{
+    const int fd = atomic_load_explicit(&e->_fd, memory_order_acquire);
+    const uint64_t one = 1;
+
+    /* EAGAIN means the counter is saturated, which is readable anyway */
+    if (fd >= 0)
+        (void)!write(fd, &one, sizeof(one));
+}
+
+/**
+ * Orders the caller's earlier stores before the state check that follows it,
+ * pairing with the fence issued between a transition and event_fd_signal.
+ * Only needed while a descriptor is armed.
+ *
+ * @param e event
+ * @return true if a fence was issued and the state should be checked again
+ */
+static inline bool event_fd_fence(struct event_fd_t *const e)
+{
+    if (!event_fd_armed(e))
+        return false;
+
+    atomic_thread_fence(memory_order_seq_cst);
+
+    return true;
+}
+
+/**
+ * Returns the descriptor, creating it on first use. A descriptor created
+ * while the queue is already ready starts out readable.
+ *
+ * @param e event
+ * @param ready readiness condition, or NULL if the state is always ready
+ * @param arg condition argument
+ * @return the descriptor, or -1 with errno set if it could not be created
+ */
+static inline int event_fd_open(struct event_fd_t *const e, bool (*const ready)(void *), void *const arg)
+{
+    int fd = atomic_load(&e->_fd);
+
+    if (fd >= 0)
+        return fd;
+
+    int expected = -1;
+
+    fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    if (!atomic_compare_exchange_strong(&e->_fd, &expected, fd))
+    {
+        close(fd);
+        return expected;
+    }
+
+    /* a transition that raced with the creation saw no descriptor */
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (!ready || ready(arg))
+        event_fd_signal(e);
+
+    return fd;
+}
+
+#endif
@@ -0,0 +1,297 @@
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "executor.h"
+#include "lb_queue.h"
+#include "node_pool.h"
+#include "time_util.h"
+
+/* maximum number of tasks a worker takes from the queue at once */
+#define EXECUTOR_MAX_BATCH 32
+
+/**
+ * submitted task
+ */
+struct _task_t
+{
+    void (*fn)(void *);
+    void *arg;
+};
+
+struct executor_t
+{
+    /* worker threads */
+    pthread_t *_threads;
+
+    /* number of worker threads */
+    uint32_t _count;
+
+    /* task queue */
+    struct blocking_queue_t *_queue;
+
+    /* true if _queue was created by the executor */
+    bool _owned;
+
+    /* tasks a worker takes at once, from 1 to EXECUTOR_MAX_BATCH */
+    atomic_uint _batch;
+
+    /* task allocator */
+    struct node_pool_t *_tasks;
+
+    /* mutex lock : live workers */
+    pthread_mutex_t _lock;
+
+    /* conditional lock : every worker exited */
+    pthread_cond_t _exited;
+
+    /* workers still running */
+    uint32_t _live;
+};
+
+static void *_run(void *arg)
+{
+    struct executor_t *const thiz = (struct executor_t *)arg;
+    struct blocking_queue_t *const queue = thiz->_queue;
+    void *tasks[EXECUTOR_MAX_BATCH];
+    uint32_t n;
+
+    /* an empty batch means the queue was closed and drained */
+    while ((n = queue->take_batch(queue, tasks, 1, atomic_load_explicit(&thiz->_batch, memory_order_relaxed), 0, NULL)) > 0)
+    {
+        for (uint32_t i = 0; i < n; i++)
+        {
+            struct _task_t *const task = (struct _task_t *)tasks[i];
+
+            task->fn(task->arg);
+            node_pool_release(thiz->_tasks, task);
+        }
+    }
+
+    pthread_mutex_lock(&thiz->_lock);
+
+    if (--thiz->_live == 0)
+        pthread_cond_broadcast(&thiz->_exited);
+
+    pthread_mutex_unlock(&thiz->_lock);
+
+    return NULL;
+}
+
+/**
+ * Closes the queue, joins the first n workers and frees everything.
+ */
+static void _destroy(struct executor_t *const thiz, const uint32_t n)
+{
+    /* running workers only stop once the queue is closed */
+    if (n > 0)
+        thiz->_queue->close(thiz->_queue);
+
+    for (uint32_t i = 0; i < n; i++)
+        pthread_join(thiz->_threads[i], NULL);
+
+    if (thiz->_owned)
+        thiz->_queue->free(thiz->_queue);
+
+    if (thiz->_tasks)
+        node_pool_free(thiz->_tasks);
+
+    pthread_mutex_destroy(&thiz->_lock);
+    pthread_cond_destroy(&thiz->_exited);
+
+    free(thiz->_threads);
+    free(thiz);
+}
+
+struct executor_t *executor_create(const uint32_t threads, struct blocking_queue_t *const queue)
+{
+    struct executor_t *thiz;
+    pthread_condattr_t cond_attr;
+    uint32_t started = 0;
+
+    if (threads == 0)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    thiz = (struct executor_t *)calloc(1, sizeof(struct executor_t));
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    thiz->_count = threads;
+    thiz->_queue = queue;
+    atomic_init(&thiz->_batch, 1);
+
+    /* thread cond timeout block's way CLOCK_REALTIME --> CLOCK_MONOTONIC */
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+
+    pthread_mutex_init(&thiz->_lock, NULL);
+    pthread_cond_init(&thiz->_exited, &cond_attr);
+
+    pthread_condattr_destroy(&cond_attr);
+
+    if ((thiz->_threads = (pthread_t *)calloc(threads, sizeof(pthread_t))) == NULL)
+        goto fail_r;
+
+    if (!thiz->_queue)
+    {
+        if ((thiz->_queue = lb_queue(0)) == NULL)
+            goto fail_r;
+
+        thiz->_owned = true;
+    }
+
+    if ((thiz->_tasks = node_pool(sizeof(struct _task_t), EXECUTOR_PREALLOC)) == NULL)
+        goto fail_r;
+
+    thiz->_live = threads;
+
+    for (; started < threads; started++)
+    {
+        if (pthread_create(&thiz->_threads[started], NULL, _run, thiz) != 0)
+            goto fail_r;
+    }
+
+    return thiz;
+
+fail_r:
+    _destroy(thiz, started);
+    errno = ENOMEM;
+
+    return NULL;
+}
+
+bool executor_affinity(struct executor_t *const thiz, const int *const cpus, const uint32_t n)
+{
+    if (!thiz || !cpus || n == 0)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    cpu_set_t set;
+    bool r = true;
+    int rc;
+
+    for (uint32_t i = 0; i < thiz->_count; i++)
+    {
+        CPU_ZERO(&set);
+        CPU_SET(cpus[i % n], &set);
+
+        if ((rc = pthread_setaffinity_np(thiz->_threads[i], sizeof(set), &set)) != 0)
+        {
+            errno = rc;
+            r = false;
+        }
+    }
+
+    return r;
+}
+
+bool executor_batch(struct executor_t *const thiz, const uint32_t batch)
+{
+    if (!thiz || batch == 0 || batch > EXECUTOR_MAX_BATCH)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    atomic_store_explicit(&thiz->_batch, batch, memory_order_relaxed);
+
+    return true;
+}
+
+bool executor_submit(struct executor_t *const thiz, void (*const task)(void *), void *const arg)
+{
+    if (!thiz || !task)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    struct _task_t *t = (struct _task_t *)node_pool_alloc(thiz->_tasks);
+    if (!t)
+    {
+        errno = ENOMEM;
+        return false;
+    }
+
+    t->fn = task;
+    t->arg = arg;
+
+    if (!thiz->_queue->put(thiz->_queue, t))
+    {
+        const int err = errno;
+
+        node_pool_release(thiz->_tasks, t);
+        errno = err;
+
+        return false;
+    }
+
+    return true;
+}
+
+void executor_shutdown(struct executor_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = EINVAL;
+        return;
+    }
+
+    thiz->_queue->close(thiz->_queue);
+}
+
+bool executor_await(struct executor_t *const thiz, const uint64_t timeout, const struct time_unit_t *const unit)
+{
+    if (!thiz)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    struct timespec timeo;
+    bool r = true;
+
+    if (unit)
+        calc_timeout(&timeo, timeout, unit);
+
+    pthread_mutex_lock(&thiz->_lock);
+
+    while (thiz->_live > 0)
+    {
+        if (!unit)
+            pthread_cond_wait(&thiz->_exited, &thiz->_lock);
+        else if (pthread_cond_timedwait(&thiz->_exited, &thiz->_lock, &timeo) == ETIMEDOUT)
+        {
+            r = thiz->_live == 0;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&thiz->_lock);
+
+    return r;
+}
+
+void executor_free(struct executor_t *const thiz)
+{
+    if (!thiz)
+        return;
+
+    _destroy(thiz, thiz->_count);
+}
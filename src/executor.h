@@ -0,0 +1,99 @@
+#ifndef _EXECUTOR_H_
+#define _EXECUTOR_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "blocking_queue.h"
+#include "time_unit.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Executor
+ *
+ * a fixed pool of worker threads running tasks taken from a blocking queue.
+ * task records come from a preallocated node pool, workers take one task per
+ * wakeup, or up to executor_batch tasks, and park through the queue itself
+ * while it is empty.
+ */
+struct executor_t;
+
+/* task records allocated up front */
+#define EXECUTOR_PREALLOC 1024
+
+/**
+ * Creates an executor and starts its workers.
+ *
+ * @param threads number of worker threads, must be non-zero
+ * @param queue task queue, closed by executor_shutdown and freed by the
+ *              caller after executor_free, or NULL for an unbounded
+ *              lb_queue owned by the executor
+ * @return the executor, or NULL on failure
+ */
+extern struct executor_t *executor_create(const uint32_t threads, struct blocking_queue_t *const queue);
+
+/**
+ * Pins worker i to cpus[i % n].
+ *
+ * @param executor executor
+ * @param cpus cpu numbers
+ * @param n number of cpus
+ * @return true if every worker was pinned, else false with errno set
+ */
+extern bool executor_affinity(struct executor_t *const executor, const int *const cpus, const uint32_t n);
+
+/**
+ * Sets how many tasks a worker takes from the queue at once, 1 by default.
+ * A batch saves queue round trips when tasks are short, but the tasks of a
+ * batch run one after the other on one worker while the others may idle, so
+ * keep it near the usual queue length divided by the number of workers.
+ *
+ * @param executor executor
+ * @param batch tasks per take, from 1 to 32
+ * @return true if set, else false with errno EINVAL
+ */
+extern bool executor_batch(struct executor_t *const executor, const uint32_t batch);
+
+/**
+ * Submits a task, waiting for space in the queue if it is bounded and full.
+ *
+ * @param executor executor
+ * @param task task function
+ * @param arg task argument
+ * @return true if the task was submitted, else false, with errno EPIPE after shutdown
+ */
+extern bool executor_submit(struct executor_t *const executor, void (*const task)(void *), void *const arg);
+
+/**
+ * Stops accepting tasks by closing the queue. The workers run the tasks
+ * already submitted and exit.
+ *
+ * @param executor executor
+ */
+extern void executor_shutdown(struct executor_t *const executor);
+
+/**
+ * Waits up to the specified wait time for every worker to exit after
+ * executor_shutdown.
+ *
+ * @param executor executor
+ * @param timeout how long to wait before giving up, in units of unit
+ * @param unit a time_unit_t determining how to interpret the timeout parameter, or NULL to wait without limit
+ * @return true if every worker has exited, false if the waiting time elapsed
+ */
+extern bool executor_await(struct executor_t *const executor, const uint64_t timeout, const struct time_unit_t *const unit);
+
+/**
+ * Shuts the executor down, waits for its workers and frees it.
+ *
+ * @param executor executor
+ */
+extern void executor_free(struct executor_t *const executor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,202 @@
+#ifndef _HEAP_H_
+#define _HEAP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <errno.h>
+
+/* children per heap node */
+#define HEAP_ARITY 4
+
+/**
+ * heap slot
+ */
+struct heap_entry_t
+{
+    const void *item;
+
+    /* insertion order, breaks ties between equal elements */
+    uint64_t seq;
+};
+
+/**
+ * Heap
+ *
+ * array based 4-ary min heap of element pointers, ordered by the lp_queue
+ * compare contract: compare(a, b) > 0 places a after b. equal elements leave
+ * in insertion order. a 4-ary heap is half as deep as a binary one, so a pop
+ * touches half as many levels for two more comparisons per level. not
+ * thread-safe, the owner does the locking.
+ */
+struct heap_t
+{
+    /* slots, the root at index 0 */
+    struct heap_entry_t *_entries;
+
+    /* number of elements */
+    uint32_t _count;
+
+    /* allocated slots */
+    uint32_t _length;
+
+    /* next insertion sequence number */
+    uint64_t _seq;
+
+    /* sort condition function */
+    int32_t (*_compare)(const void *, const void *);
+};
+
+static inline bool _heap_before(const struct heap_t *const h, const struct heap_entry_t *const a, const struct heap_entry_t *const b)
+{
+    const int32_t c = h->_compare(a->item, b->item);
+
+    return c < 0 || (c == 0 && a->seq < b->seq);
+}
+
+/**
+ * @param h heap
+ * @param compare sort condition function
+ * @param length slots allocated up front, must be non-zero
+ * @return true on success, false if memory is insufficient
+ */
+static inline bool heap_init(struct heap_t *const h, int32_t (*const compare)(const void *, const void *), const uint32_t length)
+{
+    h->_entries = (struct heap_entry_t *)malloc((size_t)length * sizeof(struct heap_entry_t));
+    if (!h->_entries)
+        return false;
+
+    h->_count = 0;
+    h->_length = length;
+    h->_seq = 0;
+    h->_compare = compare;
+
+    return true;
+}
+
+static inline void heap_destroy(struct heap_t *const h)
+{
+    free(h->_entries);
+    h->_entries = NULL;
+    h->_count = h->_length = 0;
+}
+
+static inline uint32_t heap_size(const struct heap_t *const h)
+{
+    return h->_count;
+}
+
+/**
+ * Returns the i-th element in storage order, for iterating over all of them.
+ */
+static inline void *heap_at(const struct heap_t *const h, const uint32_t i)
+{
+    return (void *)h->_entries[i].item;
+}
+
+/**
+ * Drops every element without freeing it.
+ */
+static inline void heap_reset(struct heap_t *const h)
+{
+    h->_count = 0;
+}
+
+/**
+ * Inserts an element, doubling the slots if they are all in use.
+ *
+ * @return true on success, false with errno ENOMEM if the heap could not grow
+ */
+static inline bool heap_push(struct heap_t *const h, const void *const item)
+{
+    if (h->_count == h->_length)
+    {
+        const uint32_t length = (h->_length > UINT32_MAX / 2) ? UINT32_MAX : h->_length * 2;
+        struct heap_entry_t *entries;
+
+        if (length == h->_length ||
+            (entries = (struct heap_entry_t *)realloc(h->_entries, (size_t)length * sizeof(struct heap_entry_t))) == NULL)
+        {
+            errno = ENOMEM;
+            return false;
+        }
+
+        h->_entries = entries;
+        h->_length = length;
+    }
+
+    const struct heap_entry_t e = { item, h->_seq++ };
+    uint32_t i = h->_count++;
+
+    /* sift up, moving the hole instead of swapping */
+    while (i > 0)
+    {
+        const uint32_t p = (i - 1) / HEAP_ARITY;
+
+        if (!_heap_before(h, &e, &h->_entries[p]))
+            break;
+
+        h->_entries[i] = h->_entries[p];
+        i = p;
+    }
+
+    h->_entries[i] = e;
+
+    return true;
+}
+
+/**
+ * @return the first element, or NULL if the heap is empty
+ */
+static inline void *heap_peek(const struct heap_t *const h)
+{
+    return h->_count ? (void *)h->_entries[0].item : NULL;
+}
+
+/**
+ * Removes and returns the first element.
+ *
+ * @return the first element, or NULL if the heap is empty
+ */
+static inline void *heap_pop(struct heap_t *const h)
+{
+    if (h->_count == 0)
+        return NULL;
+
+    void *const top = (void *)h->_entries[0].item;
+    const uint32_t n = --h->_count;
+    const struct heap_entry_t last = h->_entries[n];
+    uint32_t i = 0;
+
+    /* sift the last element down from the root */
+    for (;;)
+    {
+        const uint64_t first = (uint64_t)i * HEAP_ARITY + 1;
+
+        if (first >= n)
+            break;
+
+        const uint32_t c = (uint32_t)first;
+        const uint32_t end = (n - c > HEAP_ARITY) ? c + HEAP_ARITY : n;
+        uint32_t best = c;
+
+        for (uint32_t j = c + 1; j < end; j++)
+        {
+            if (_heap_before(h, &h->_entries[j], &h->_entries[best]))
+                best = j;
+        }
+
+        if (!_heap_before(h, &h->_entries[best], &last))
+            break;
+
+        h->_entries[i] = h->_entries[best];
+        i = best;
+    }
+
+    if (n > 0)
+        h->_entries[i] = last;
+
+    return top;
+}
+
+#endif
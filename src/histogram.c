@@ -0,0 +1,222 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include "histogram.h"
+#include "cpu_util.h"
+
+/* buckets per power of two are 1 << HISTOGRAM_SUB_BITS */
+#define HISTOGRAM_SUB_BITS 5
+
+#define HISTOGRAM_SUB (1U << HISTOGRAM_SUB_BITS)
+
+/* values from 1 << HISTOGRAM_MAX_BITS on share the last bucket, in
+ * nanoseconds that is about 18 minutes */
+#define HISTOGRAM_MAX_BITS 40
+
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB)
+
+/* count shards, threads beyond this many share them */
+#define HISTOGRAM_SHARDS 8
+
+struct _histogram_shard_t
+{
+    CACHE_ALIGNED atomic_uint_least64_t counts[HISTOGRAM_BUCKETS];
+
+    atomic_uint_least64_t max;
+};
+
+struct histogram_t
+{
+    struct _histogram_shard_t shards[HISTOGRAM_SHARDS];
+};
+
+/* hands out shard indexes to threads in turn */
+static atomic_uint _next_shard;
+
+static __thread uint32_t _shard = UINT32_MAX;
+
+/**
+ * Returns the bucket of a value: values below twice HISTOGRAM_SUB have a
+ * bucket each, above that the top HISTOGRAM_SUB_BITS + 1 bits pick one.
+ */
+static inline uint32_t _bucket(uint64_t value)
+{
+    if (value >= (1ULL << HISTOGRAM_MAX_BITS))
+        return HISTOGRAM_BUCKETS - 1;
+
+    if (value < 2 * HISTOGRAM_SUB)
+        return (uint32_t)value;
+
+    const uint32_t shift = (uint32_t)(63 - __builtin_clzll(value)) - HISTOGRAM_SUB_BITS;
+
+    return shift * HISTOGRAM_SUB + (uint32_t)(value >> shift);
+}
+
+/**
+ * Returns the largest value falling into a bucket.
+ */
+static inline uint64_t _bucket_value(const uint32_t bucket)
+{
+    if (bucket < 2 * HISTOGRAM_SUB)
+        return bucket;
+
+    const uint32_t shift = bucket / HISTOGRAM_SUB - 1;
+
+    return (((uint64_t)(bucket - shift * HISTOGRAM_SUB) + 1) << shift) - 1;
+}
+
+/**
+ * Sums the shards into counts and returns the total.
+ */
+static uint64_t _merge(struct histogram_t *const h, uint64_t *const counts, uint64_t *const max)
+{
+    uint64_t total = 0;
+    uint64_t m = 0;
+
+    memset(counts, 0, HISTOGRAM_BUCKETS * sizeof(uint64_t));
+
+    for (uint32_t s = 0; s < HISTOGRAM_SHARDS; s++)
+    {
+        struct _histogram_shard_t *const shard = &h->shards[s];
+
+        for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+        {
+            const uint64_t c = atomic_load_explicit(&shard->counts[i], memory_order_relaxed);
+            counts[i] += c;
+            total += c;
+        }
+
+        const uint64_t v = atomic_load_explicit(&shard->max, memory_order_relaxed);
+        if (v > m)
+            m = v;
+    }
+
+    *max = m;
+
+    return total;
+}
+
+/**
+ * Walks the merged counts to the bucket holding the given share of total.
+ */
+static uint64_t _percentile(const uint64_t *const counts, const uint64_t total, const uint64_t max, const double percentile)
+{
+    if (total == 0)
+        return 0;
+
+    const double p = percentile < 0.0 ? 0.0 : (percentile > 100.0 ? 100.0 : percentile);
+    uint64_t rank = (uint64_t)(p / 100.0 * (double)total + 0.5);
+    uint64_t seen = 0;
+
+    if (rank == 0)
+        rank = 1;
+
+    for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        seen += counts[i];
+        if (seen >= rank)
+        {
+            const uint64_t v = _bucket_value(i);
+            return (v < max && i != HISTOGRAM_BUCKETS - 1) ? v : max;
+        }
+    }
+
+    return max;
+}
+
+void histogram_record(struct histogram_t *const h, const uint64_t value)
+{
+    if (__builtin_expect(_shard == UINT32_MAX, 0))
+        _shard = atomic_fetch_add_explicit(&_next_shard, 1, memory_order_relaxed) % HISTOGRAM_SHARDS;
+
+    struct _histogram_shard_t *const shard = &h->shards[_shard];
+
+    atomic_fetch_add_explicit(&shard->counts[_bucket(value)], 1, memory_order_relaxed);
+
+    uint64_t max = atomic_load_explicit(&shard->max, memory_order_relaxed);
+    while (value > max &&
+           !atomic_compare_exchange_weak_explicit(&shard->max, &max, value, memory_order_relaxed, memory_order_relaxed))
+        ;
+}
+
+uint64_t histogram_percentile(struct histogram_t *const h, const double percentile)
+{
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t max;
+
+    if (!h)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    const uint64_t total = _merge(h, counts, &max);
+
+    return _percentile(counts, total, max, percentile);
+}
+
+void histogram_summary(struct histogram_t *const h, struct histogram_summary_t *const summary)
+{
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t max;
+
+    if (!h || !summary)
+    {
+        errno = EINVAL;
+        return;
+    }
+
+    const uint64_t total = _merge(h, counts, &max);
+
+    summary->count = total;
+    summary->p50 = _percentile(counts, total, max, 50.0);
+    summary->p99 = _percentile(counts, total, max, 99.0);
+    summary->p999 = _percentile(counts, total, max, 99.9);
+    summary->max = max;
+}
+
+void histogram_reset(struct histogram_t *const h)
+{
+    if (!h)
+    {
+        errno = EINVAL;
+        return;
+    }
+
+    for (uint32_t s = 0; s < HISTOGRAM_SHARDS; s++)
+    {
+        for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+            atomic_store_explicit(&h->shards[s].counts[i], 0, memory_order_relaxed);
+
+        atomic_store_explicit(&h->shards[s].max, 0, memory_order_relaxed);
+    }
+}
+
+void histogram_free(struct histogram_t *const h)
+{
+    free(h);
+}
+
+struct histogram_t *histogram(void)
+{
+    struct histogram_t *h = NULL;
+
+    if (posix_memalign((void **)&h, CACHE_LINE_SIZE, sizeof(struct histogram_t)) != 0)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    for (uint32_t s = 0; s < HISTOGRAM_SHARDS; s++)
+    {
+        for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+            atomic_init(&h->shards[s].counts[i], 0);
+
+        atomic_init(&h->shards[s].max, 0);
+    }
+
+    return h;
+}
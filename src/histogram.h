@@ -0,0 +1,92 @@
+#ifndef _HISTOGRAM_H_
+#define _HISTOGRAM_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Histogram
+ *
+ * log-linear histogram of 64-bit values in the style of HdrHistogram: every
+ * power of two range is split into 32 buckets, so a value is reported
+ * within about 3% of what was recorded. counts are kept in a few shards that
+ * threads pick by a per-thread index, recording is a relaxed atomic add on
+ * a shard the thread rarely shares, and readers merge the shards.
+ */
+struct histogram_t;
+
+/**
+ * Percentiles read from a histogram.
+ */
+struct histogram_summary_t
+{
+    /* number of recorded values */
+    uint64_t count;
+
+    /* median */
+    uint64_t p50;
+
+    /* 99th percentile */
+    uint64_t p99;
+
+    /* 99.9th percentile */
+    uint64_t p999;
+
+    /* largest recorded value, exact */
+    uint64_t max;
+};
+
+/**
+ * Creates an empty histogram.
+ *
+ * @return the histogram, or NULL if memory is insufficient
+ */
+extern struct histogram_t *histogram(void);
+
+/**
+ * Records a value. Safe to call from any number of threads.
+ *
+ * @param h histogram
+ * @param value value
+ */
+extern void histogram_record(struct histogram_t *const h, const uint64_t value);
+
+/**
+ * Returns the value below which the given share of the recorded values fall.
+ *
+ * @param h histogram
+ * @param percentile share of the values, from 0 to 100
+ * @return the upper bound of the bucket holding that value, 0 if nothing was recorded
+ */
+extern uint64_t histogram_percentile(struct histogram_t *const h, const double percentile);
+
+/**
+ * Reads the count, p50, p99, p99.9 and max in one pass.
+ *
+ * @param h histogram
+ * @param summary filled with the percentiles
+ */
+extern void histogram_summary(struct histogram_t *const h, struct histogram_summary_t *const summary);
+
+/**
+ * Drops every recorded value. Values recorded concurrently may survive.
+ *
+ * @param h histogram
+ */
+extern void histogram_reset(struct histogram_t *const h);
+
+/**
+ * Free histogram
+ *
+ * @param h histogram
+ */
+extern void histogram_free(struct histogram_t *const h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -6,6 +6,12 @@
 #include <pthread.h>
 #include <stdatomic.h>
 #include "lb_queue.h"
+#include "node_pool.h"
+#include "histogram.h"
+#include "queue_stats.h"
+#include "queue_probe.h"
+#include "parker.h"
+#include "event_fd.h"
 #include "time_util.h"
 
 /** 
@@ -15,6 +21,9 @@ struct _node_t
 {
     const void *item;
     struct _node_t *next;
+
+    /* enqueue time while latency is recorded, else 0 */
+    uint64_t stamp;
 };
 
 /** 
@@ -114,6 +123,111 @@ struct lb_queue_t
      */
     void *(*poll_await)(struct lb_queue_t *const thiz, const uint64_t timeout, const struct time_unit_t *const unit);
 
+    /**
+     * Inserts as many of the specified elements as possible without waiting,
+     * in order, with a single acquisition of the queue.
+     *
+     * @param thiz this
+     * @param elements the elements to add
+     * @param n number of elements
+     * @return the number of elements added, always a prefix of elements
+     */
+    uint32_t (*offer_batch)(struct lb_queue_t *const thiz, void *const *elements, const uint32_t n);
+
+    /**
+     * Inserts all of the specified elements, in order, waiting if necessary for space to become available.
+     *
+     * @param thiz this
+     * @param elements the elements to add
+     * @param n number of elements
+     * @return the number of elements added, n unless an error occurred
+     */
+    uint32_t (*put_batch)(struct lb_queue_t *const thiz, void *const *elements, const uint32_t n);
+
+    /**
+     * Removes at most max available elements from this queue without waiting.
+     *
+     * @param thiz this
+     * @param out receives the removed elements in queue order
+     * @param max the maximum number of elements to remove
+     * @return the number of elements removed
+     */
+    uint32_t (*drain_to)(struct lb_queue_t *const thiz, void **out, const uint32_t max);
+
+    /**
+     * Removes at most max elements from this queue, waiting up to the
+     * specified wait time if necessary until at least min have been removed.
+     *
+     * @param thiz this
+     * @param out receives the removed elements in queue order
+     * @param min the number of elements to wait for
+     * @param max the maximum number of elements to remove
+     * @param timeout how long to wait before giving up, in units of unit
+     * @param unit a time_unit_t determining how to interpret the timeout parameter, or NULL to wait without limit
+     * @return the number of elements removed, less than min only if the waiting time elapsed
+     */
+    uint32_t (*take_batch)(struct lb_queue_t *const thiz, void **out, const uint32_t min, const uint32_t max,
+                           const uint64_t timeout, const struct time_unit_t *const unit);
+
+    /**
+     * Returns a non-blocking eventfd that becomes readable when this queue
+     * turns ready for the event, for use with poll/epoll. The descriptor is
+     * owned by the queue and closed by free. Read it before draining the
+     * queue, and drain until the queue reports nothing left.
+     *
+     * @param thiz this
+     * @param event QUEUE_EVENT_NOT_EMPTY or QUEUE_EVENT_NOT_FULL
+     * @return the descriptor, or -1 with errno set
+     */
+    int (*eventfd)(struct lb_queue_t *const thiz, const enum queue_event_t event);
+
+    /**
+     * Closes this queue and wakes every blocked thread. Later puts fail
+     * with errno EPIPE, takes return the remaining elements and then fail
+     * with errno EPIPE. A queue cannot be reopened.
+     *
+     * @param thiz this
+     */
+    void (*close)(struct lb_queue_t *const thiz);
+
+    /**
+     * Returns true if this queue has been closed.
+     *
+     * @param thiz this
+     * @return true if this queue has been closed
+     */
+    bool (*closed)(struct lb_queue_t *const thiz);
+
+    /**
+     * Reads the operational counters of this queue. The lock counters stay
+     * 0 unless built with ENABLE_CLQUEUE_LOCK_PROFILE.
+     *
+     * @param thiz this
+     * @param stats filled with the totals since the queue was created
+     */
+    void (*stats)(struct lb_queue_t *const thiz, struct queue_stats_t *const stats);
+
+    /**
+     * Inserts the specified element into this queue, waiting until the
+     * deadline if necessary for space to become available.
+     *
+     * @param thiz this
+     * @param element the element to add
+     * @param deadline absolute CLOCK_MONOTONIC time to give up at, or NULL to wait without limit
+     * @return true if successful, or false if the deadline passes before space is available
+     */
+    bool (*offer_until)(struct lb_queue_t *const thiz, const void *const element, const struct timespec *const deadline);
+
+    /**
+     * Retrieves and removes the head of this queue, waiting until the
+     * deadline if necessary for an element to become available.
+     *
+     * @param thiz this
+     * @param deadline absolute CLOCK_MONOTONIC time to give up at, or NULL to wait without limit
+     * @return the head of this queue, or NULL if the deadline passes before an element is available
+     */
+    void *(*poll_until)(struct lb_queue_t *const thiz, const struct timespec *const deadline);
+
     /* queue capacity */
     uint32_t _capacity;
 
@@ -129,25 +243,81 @@ struct lb_queue_t
     /* mutex lock : get element */
     pthread_mutex_t _take_lock;
 
-    /* conditional lock : queue non-empty */
-    pthread_cond_t _not_empty;
+    /* parked takers : queue non-empty */
+    struct parker_t _not_empty;
 
     /* mutex lock : add element */
     pthread_mutex_t _put_lock;
 
-    /* conditional lock : queue non-full */
-    pthread_cond_t _not_full;
+    /* parked putters : queue non-full */
+    struct parker_t _not_full;
+
+    /* readiness descriptor : queue non-empty */
+    struct event_fd_t _readable;
+
+    /* readiness descriptor : queue non-full */
+    struct event_fd_t _writable;
+
+    /* queue node allocator */
+    struct node_pool_t *_pool;
+
+    /* set once by close, under both locks */
+    atomic_bool _closed;
+
+    /* sojourn times, NULL until lb_queue_latency_enable */
+    _Atomic(struct histogram_t *) _latency;
+
+    /* operational counters */
+    struct queue_counters_t *_stats;
+
+    /* put lock hold start, for lock profiling */
+    uint64_t _put_since;
+
+    /* take lock hold start, for lock profiling */
+    uint64_t _take_since;
 };
 
 #define QUEUE_MAX_CAPACITY 0xFFFFFFFFU
 
+/* nodes lb_queue allocates up front at most, the pool grows on demand past it */
+#define LB_QUEUE_PREALLOC 1024U
+
+/**
+ * Returns the enqueue time to stamp nodes with, 0 if latency is not recorded.
+ */
+static inline uint64_t _stamp(struct lb_queue_t *const thiz)
+{
+    return atomic_load_explicit(&thiz->_latency, memory_order_relaxed) ? nano_time() : 0;
+}
+
+static inline struct _node_t *_node(struct lb_queue_t *const thiz, const void *const element, const uint64_t stamp)
+{
+    struct _node_t *node = (struct _node_t *)node_pool_alloc(thiz->_pool);
+    if (!node)
+        return NULL;
+
+    node->item = element;
+    node->next = NULL;
+    node->stamp = stamp;
+
+    return node;
+}
+
 static inline void _enqueue(struct lb_queue_t *const thiz, struct _node_t *node)
 {
     thiz->_last->next = node;
     thiz->_last = node;
+
+    queue_counters_add(thiz->_stats, QUEUE_STAT_OFFERS, 1);
+    QUEUE_PROBE3(enqueue, thiz, node->item, 1);
 }
 
-static inline void *_dequeue(struct lb_queue_t *const thiz)
+/**
+ * Unlinks the first element, recording its sojourn time if it was stamped.
+ *
+ * @param now current time, 0 to read the clock only if needed
+ */
+static inline void *_dequeue_at(struct lb_queue_t *const thiz, const uint64_t now)
 {
     struct _node_t *h = thiz->_head;
     struct _node_t *first = h->next;
@@ -156,17 +326,166 @@ static inline void *_dequeue(struct lb_queue_t *const thiz)
     void *x = (void *)first->item;
     first->item = NULL;
 
-    free(h);
+    if (first->stamp)
+    {
+        const uint64_t t = now ? now : nano_time();
+        histogram_record(atomic_load_explicit(&thiz->_latency, memory_order_acquire), t > first->stamp ? t - first->stamp : 0);
+    }
+
+    node_pool_release(thiz->_pool, h);
     return x;
 }
 
+static inline void *_dequeue(struct lb_queue_t *const thiz)
+{
+    void *x = _dequeue_at(thiz, 0);
+
+    queue_counters_add(thiz->_stats, QUEUE_STAT_TAKES, 1);
+    QUEUE_PROBE3(dequeue, thiz, x, 1);
+
+    return x;
+}
+
+/**
+ * Builds a chain of n nodes holding elements.
+ */
+static inline bool _chain(struct lb_queue_t *const thiz, void *const *elements, const uint32_t n,
+                          struct _node_t **const first, struct _node_t **const last)
+{
+    struct _node_t *head = NULL;
+    struct _node_t *tail = NULL;
+    const uint64_t stamp = _stamp(thiz);
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        struct _node_t *node = _node(thiz, elements[i], stamp);
+        if (!node)
+        {
+            for (struct _node_t *next; head != NULL; head = next)
+            {
+                next = head->next;
+                node_pool_release(thiz->_pool, head);
+            }
+            return false;
+        }
+
+        if (tail)
+            tail->next = node;
+        else
+            head = node;
+        tail = node;
+    }
+
+    *first = head;
+    *last = tail;
+
+    return true;
+}
+
+/**
+ * Links the first k nodes of a chain at the tail and returns the rest.
+ * Called only when holding put lock.
+ */
+static inline struct _node_t *_enqueue_chain(struct lb_queue_t *const thiz, struct _node_t *const first, const uint32_t k)
+{
+    struct _node_t *last = first;
+
+    for (uint32_t i = 1; i < k; i++)
+        last = last->next;
+
+    struct _node_t *rest = last->next;
+    last->next = NULL;
+
+    thiz->_last->next = first;
+    thiz->_last = last;
+
+    queue_counters_add(thiz->_stats, QUEUE_STAT_OFFERS, k);
+    QUEUE_PROBE3(enqueue, thiz, first->item, k);
+
+    return rest;
+}
+
+/**
+ * Unlinks k elements from the head. Called only when holding take lock.
+ */
+static inline void _dequeue_chain(struct lb_queue_t *const thiz, void **const out, const uint32_t k)
+{
+    const uint64_t now = _stamp(thiz);
+
+    for (uint32_t i = 0; i < k; i++)
+        out[i] = _dequeue_at(thiz, now);
+
+    queue_counters_add(thiz->_stats, QUEUE_STAT_TAKES, k);
+    QUEUE_PROBE3(dequeue, thiz, out[0], k);
+}
+
+static inline void _lock_put(struct lb_queue_t *const thiz)
+{
+    queue_counters_lock(thiz->_stats, &thiz->_put_lock, &thiz->_put_since);
+}
+
+static inline void _unlock_put(struct lb_queue_t *const thiz)
+{
+    queue_counters_unlock(thiz->_stats, &thiz->_put_lock, &thiz->_put_since);
+}
+
+static inline void _lock_take(struct lb_queue_t *const thiz)
+{
+    queue_counters_lock(thiz->_stats, &thiz->_take_lock, &thiz->_take_since);
+}
+
+static inline void _unlock_take(struct lb_queue_t *const thiz)
+{
+    queue_counters_unlock(thiz->_stats, &thiz->_take_lock, &thiz->_take_since);
+}
+
+/**
+ * Counts elements an offer or put could not insert.
+ *
+ * @param element the first of the n rejected elements
+ */
+static inline void _reject(struct lb_queue_t *const thiz, const void *const element, const uint32_t n)
+{
+    queue_counters_add(thiz->_stats, QUEUE_STAT_REJECTED, n);
+    QUEUE_PROBE3(reject, thiz, element, n);
+}
+
+/**
+ * Returns the event a parker of this queue waits for.
+ */
+static inline int _event(struct lb_queue_t *const thiz, struct parker_t *const p)
+{
+    return p == &thiz->_not_empty ? QUEUE_EVENT_NOT_EMPTY : QUEUE_EVENT_NOT_FULL;
+}
+
+/**
+ * Wakes one parked thread, counting the wakeup if one was sent.
+ */
+static inline void _notify(struct lb_queue_t *const thiz, struct parker_t *const p)
+{
+    if (parker_notify(p))
+    {
+        queue_counters_add(thiz->_stats, QUEUE_STAT_SIGNALS, 1);
+        QUEUE_PROBE2(signal, thiz, _event(thiz, p));
+    }
+}
+
+static inline void _notify_all(struct lb_queue_t *const thiz, struct parker_t *const p)
+{
+    if (parker_notify_all(p))
+    {
+        queue_counters_add(thiz->_stats, QUEUE_STAT_SIGNALS, 1);
+        QUEUE_PROBE2(signal, thiz, _event(thiz, p));
+    }
+}
+
 /**
  * Locks to prevent both puts and takes.
  */
 static inline void _fully_lock(struct lb_queue_t *const thiz)
 {
-    pthread_mutex_lock(&thiz->_take_lock);
-    pthread_mutex_lock(&thiz->_put_lock);
+    _lock_take(thiz);
+    _lock_put(thiz);
 }
 
 /**
@@ -174,25 +493,113 @@ static inline void _fully_lock(struct lb_queue_t *const thiz)
  */
 static inline void _fully_unlock(struct lb_queue_t *const thiz)
 {
-    pthread_mutex_unlock(&thiz->_put_lock);
-    pthread_mutex_unlock(&thiz->_take_lock);
+    _unlock_put(thiz);
+    _unlock_take(thiz);
 }
 
+/**
+ * Signals a waiting take. Called only from put/offer, on the empty to
+ * non-empty transition. The waiter count in the parker lets this return
+ * without a syscall when nobody is parked.
+ */
 static inline void _signal_not_empty(struct lb_queue_t *const thiz)
 {
-    pthread_mutex_lock(&thiz->_take_lock);
-    pthread_cond_signal(&thiz->_not_empty);
-    pthread_mutex_unlock(&thiz->_take_lock);
+    _notify(thiz, &thiz->_not_empty);
+    event_fd_signal(&thiz->_readable);
 }
 
 /**
- * Signals a waiting put. Called only from take/poll.
+ * Signals a waiting put. Called only from take/poll, on the full to
+ * non-full transition.
  */
 static inline void _signal_not_full(struct lb_queue_t *const thiz)
 {
-    pthread_mutex_lock(&thiz->_put_lock);
-    pthread_cond_signal(&thiz->_not_full);
-    pthread_mutex_unlock(&thiz->_put_lock);
+    _notify(thiz, &thiz->_not_full);
+    event_fd_signal(&thiz->_writable);
+}
+
+static bool _not_empty(void *arg)
+{
+    struct lb_queue_t *const thiz = (struct lb_queue_t *)arg;
+
+    return thiz->_count != 0 || atomic_load(&thiz->_closed);
+}
+
+static bool _not_full(void *arg)
+{
+    struct lb_queue_t *const thiz = (struct lb_queue_t *)arg;
+
+    return (uint32_t)thiz->_count != thiz->_capacity || atomic_load(&thiz->_closed);
+}
+
+/**
+ * Waits until the queue is non-empty or the deadline passes. Called with take
+ * lock held, which is released while the thread spins or parks.
+ *
+ * @return false on timeout, or with errno EPIPE once the queue is closed and empty
+ */
+static inline bool _await_not_empty(struct lb_queue_t *const thiz, const struct timespec *const deadline)
+{
+    while (thiz->_count == 0)
+    {
+        if (atomic_load(&thiz->_closed))
+        {
+            errno = EPIPE;
+            return false;
+        }
+
+        const uint64_t start = queue_counters_wait_begin();
+        QUEUE_PROBE2(wait_begin, thiz, QUEUE_EVENT_NOT_EMPTY);
+
+        _unlock_take(thiz);
+        const bool r = parker_await(&thiz->_not_empty, _not_empty, thiz, deadline);
+        _lock_take(thiz);
+
+        const bool timed_out = !r && thiz->_count == 0;
+
+        queue_counters_wait_end(thiz->_stats, start, timed_out);
+        QUEUE_PROBE3(wait_end, thiz, QUEUE_EVENT_NOT_EMPTY, timed_out);
+
+        if (timed_out)
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * Waits until the queue is non-full or the deadline passes. Called with put
+ * lock held, which is released while the thread spins or parks.
+ *
+ * @return false on timeout, or with errno EPIPE once the queue is closed
+ */
+static inline bool _await_not_full(struct lb_queue_t *const thiz, const struct timespec *const deadline)
+{
+    while (!atomic_load(&thiz->_closed) && thiz->_count == thiz->_capacity)
+    {
+        const uint64_t start = queue_counters_wait_begin();
+        QUEUE_PROBE2(wait_begin, thiz, QUEUE_EVENT_NOT_FULL);
+
+        _unlock_put(thiz);
+        const bool r = parker_await(&thiz->_not_full, _not_full, thiz, deadline);
+        _lock_put(thiz);
+
+        const bool timed_out = !r && !atomic_load(&thiz->_closed) && thiz->_count == thiz->_capacity;
+
+        queue_counters_wait_end(thiz->_stats, start, timed_out);
+        QUEUE_PROBE3(wait_end, thiz, QUEUE_EVENT_NOT_FULL, timed_out);
+
+        if (timed_out)
+            return false;
+    }
+
+    if (atomic_load(&thiz->_closed))
+    {
+        errno = EPIPE;
+        return false;
+    }
+
+    return true;
 }
 
 static uint32_t lb_queue_size(struct lb_queue_t *const thiz)
@@ -219,7 +626,7 @@ static void lb_queue_clear(struct lb_queue_t *const thiz)
         if (current->item)
             free((void *)current->item);
 
-        free(current);
+        node_pool_release(thiz->_pool, current);
     }
 
     thiz->_head->next = NULL;
@@ -227,7 +634,7 @@ static void lb_queue_clear(struct lb_queue_t *const thiz)
 
     c = atomic_fetch_and(&thiz->_count, 0x0);
     if (c == thiz->_capacity)
-        pthread_cond_signal(&thiz->_not_full);
+        _signal_not_full(thiz);
 
     _fully_unlock(thiz);
 
@@ -244,12 +651,17 @@ static void lb_queue_free(struct lb_queue_t *const thiz)
 
     thiz->clear(thiz);
 
-    pthread_cond_destroy(&thiz->_not_empty);
-    pthread_cond_destroy(&thiz->_not_full);
+    parker_destroy(&thiz->_not_empty);
+    parker_destroy(&thiz->_not_full);
+    event_fd_destroy(&thiz->_readable);
+    event_fd_destroy(&thiz->_writable);
     pthread_mutex_destroy(&thiz->_take_lock);
     pthread_mutex_destroy(&thiz->_put_lock);
 
-    free(thiz->_head);
+    node_pool_release(thiz->_pool, thiz->_head);
+    node_pool_free(thiz->_pool);
+    histogram_free(atomic_load(&thiz->_latency));
+    queue_counters_free(thiz->_stats);
     free(thiz);
 }
 
@@ -261,23 +673,36 @@ static bool lb_queue_offer(struct lb_queue_t *const thiz, const void *const elem
         return false;
     }
 
+    if (atomic_load(&thiz->_closed))
+    {
+        _reject(thiz, element, 1);
+        errno = EPIPE;
+        return false;
+    }
+
     if (thiz->_count == thiz->_capacity)
+    {
+        _reject(thiz, element, 1);
         return false;
+    }
 
     uint32_t c;
 
-    struct _node_t *new_node = (struct _node_t *)malloc(sizeof(struct _node_t));
+    struct _node_t *new_node = _node(thiz, element, _stamp(thiz));
     if (!new_node)
     {
         errno = ENOMEM;
         return false;
     }
 
-    new_node->item = element;
-    new_node->next = NULL;
-
     /* element enqueue */
-    pthread_mutex_lock(&thiz->_put_lock);
+    _lock_put(thiz);
+
+    if (atomic_load(&thiz->_closed))
+    {
+        errno = EPIPE;
+        goto insert_full;
+    }
 
     if (thiz->_count == thiz->_capacity)
         goto insert_full;
@@ -286,9 +711,9 @@ static bool lb_queue_offer(struct lb_queue_t *const thiz, const void *const elem
 
     c = atomic_fetch_add(&thiz->_count, 1);
     if ((c + 1) < thiz->_capacity)
-        pthread_cond_signal(&thiz->_not_full);
+        _notify(thiz, &thiz->_not_full);
 
-    pthread_mutex_unlock(&thiz->_put_lock);
+    _unlock_put(thiz);
 
     if (c == 0)
         _signal_not_empty(thiz);
@@ -296,8 +721,9 @@ static bool lb_queue_offer(struct lb_queue_t *const thiz, const void *const elem
     return true;
 
 insert_full:
-    pthread_mutex_unlock(&thiz->_put_lock);
-    free(new_node);
+    _unlock_put(thiz);
+    node_pool_release(thiz->_pool, new_node);
+    _reject(thiz, element, 1);
 
     return false;
 }
@@ -313,7 +739,7 @@ static void *lb_queue_poll(struct lb_queue_t *const thiz)
     void *item = NULL;
     uint32_t c;
 
-    pthread_mutex_lock(&thiz->_take_lock);
+    _lock_take(thiz);
 
     if (thiz->_count == 0)
         goto take_empty;
@@ -321,16 +747,19 @@ static void *lb_queue_poll(struct lb_queue_t *const thiz)
     item = _dequeue(thiz);
     c = atomic_fetch_sub(&thiz->_count, 1);
     if (c > 1)
-        pthread_cond_signal(&thiz->_not_empty);
+        _notify(thiz, &thiz->_not_empty);
 
-    pthread_mutex_unlock(&thiz->_take_lock);
+    _unlock_take(thiz);
     if (c == thiz->_capacity)
         _signal_not_full(thiz);
 
     return item;
 
 take_empty:
-    pthread_mutex_unlock(&thiz->_take_lock);
+    if (atomic_load(&thiz->_closed))
+        errno = EPIPE;
+
+    _unlock_take(thiz);
 
     return NULL;
 }
@@ -347,9 +776,9 @@ static void *lb_queue_peek(struct lb_queue_t *const thiz)
         return NULL;
 
     void *item = NULL;
-    pthread_mutex_lock(&thiz->_take_lock);
+    _lock_take(thiz);
     item = thiz->_count > 0 ? (void *)thiz->_head->next->item : NULL;
-    pthread_mutex_unlock(&thiz->_take_lock);
+    _unlock_take(thiz);
 
     return item;
 }
@@ -364,35 +793,37 @@ static bool lb_queue_put(struct lb_queue_t *const thiz, const void *const elemen
 
     int c;
 
-    struct _node_t *new_node = (struct _node_t *)malloc(sizeof(struct _node_t));
+    struct _node_t *new_node = _node(thiz, element, _stamp(thiz));
     if (!new_node)
     {
         errno = ENOMEM;
         return false;
     }
 
-    new_node->item = element;
-    new_node->next = NULL;
-
-    pthread_mutex_lock(&thiz->_put_lock);
+    _lock_put(thiz);
 
-    while (thiz->_count == thiz->_capacity)
-    {
-        pthread_cond_wait(&thiz->_not_full, &thiz->_put_lock);
-    }
+    if (!_await_not_full(thiz, NULL))
+        goto insert_closed;
 
     _enqueue(thiz, new_node);
 
     c = atomic_fetch_add(&thiz->_count, 1);
     if (c + 1 < thiz->_capacity)
-        pthread_cond_signal(&thiz->_not_full);
+        _notify(thiz, &thiz->_not_full);
 
-    pthread_mutex_unlock(&thiz->_put_lock);
+    _unlock_put(thiz);
 
     if (c == 0)
         _signal_not_empty(thiz);
 
     return true;
+
+insert_closed:
+    _unlock_put(thiz);
+    node_pool_release(thiz->_pool, new_node);
+    _reject(thiz, element, 1);
+
+    return false;
 }
 
 static void *lb_queue_take(struct lb_queue_t *const thiz)
@@ -406,20 +837,21 @@ static void *lb_queue_take(struct lb_queue_t *const thiz)
     int c;
     void *item = NULL;
 
-    pthread_mutex_lock(&thiz->_take_lock);
+    _lock_take(thiz);
 
-    while (thiz->_count == 0)
+    if (!_await_not_empty(thiz, NULL))
     {
-        pthread_cond_wait(&thiz->_not_empty, &thiz->_take_lock);
+        _unlock_take(thiz);
+        return NULL;
     }
 
     item = _dequeue(thiz);
 
     c = atomic_fetch_sub(&thiz->_count, 1);
     if (c > 1)
-        pthread_cond_signal(&thiz->_not_empty);
+        _notify(thiz, &thiz->_not_empty);
 
-    pthread_mutex_unlock(&thiz->_take_lock);
+    _unlock_take(thiz);
 
     if (c == thiz->_capacity)
         _signal_not_full(thiz);
@@ -427,10 +859,9 @@ static void *lb_queue_take(struct lb_queue_t *const thiz)
     return item;
 }
 
-static bool lb_queue_offer_wait(struct lb_queue_t *const thiz, const void *const element,
-                                const uint64_t timeout, const struct time_unit_t *const unit)
+static bool lb_queue_offer_until(struct lb_queue_t *const thiz, const void *const element, const struct timespec *const deadline)
 {
-    if (!thiz || !element || !unit)
+    if (!thiz || !element)
     {
         errno = EINVAL;
         return false;
@@ -438,45 +869,24 @@ static bool lb_queue_offer_wait(struct lb_queue_t *const thiz, const void *const
 
     int c;
 
-    pthread_mutex_lock(&thiz->_put_lock);
-    struct timespec timeo;
-    uint64_t nano_timeout;
-    uint64_t nanos;
-    int64_t nanotime;
-
-    calc_timeout(&timeo, timeout, unit);
-    nano_timeout = timespec_to_nano(&timeo);
-    nanos = nano_timeout;
-
-    while (thiz->_count == thiz->_capacity)
-    {
-        if (nanos <= 0)
-            goto result_r;
-
-        if (pthread_cond_timedwait(&thiz->_not_full, &thiz->_put_lock, &timeo) == ETIMEDOUT)
-            goto result_r;
+    _lock_put(thiz);
 
-        if ((nanotime = nano_time()) < 0)
-            goto result_r;
-
-        nanos = nano_timeout - nanotime;
-    }
+    if (!_await_not_full(thiz, deadline))
+        goto result_r;
 
-    struct _node_t *new_node = (struct _node_t *)malloc(sizeof(struct _node_t));
+    struct _node_t *new_node = _node(thiz, element, _stamp(thiz));
     if (!new_node)
     {
         errno = ENOMEM;
         goto result_r;
     }
-    new_node->item = element;
-    new_node->next = NULL;
 
     _enqueue(thiz, new_node);
     c = atomic_fetch_add(&thiz->_count, 1);
     if (c + 1 < thiz->_capacity)
-        pthread_cond_signal(&thiz->_not_full);
+        _notify(thiz, &thiz->_not_full);
 
-    pthread_mutex_unlock(&thiz->_put_lock);
+    _unlock_put(thiz);
 
     if (c == 0)
         _signal_not_empty(thiz);
@@ -484,14 +894,31 @@ static bool lb_queue_offer_wait(struct lb_queue_t *const thiz, const void *const
     return true;
 
 result_r:
-    pthread_mutex_unlock(&thiz->_put_lock);
+    _unlock_put(thiz);
+    _reject(thiz, element, 1);
 
     return false;
 }
 
-static void *lb_queue_poll_wait(struct lb_queue_t *const thiz, const uint64_t timeout, const struct time_unit_t *const unit)
+static bool lb_queue_offer_wait(struct lb_queue_t *const thiz, const void *const element,
+                                const uint64_t timeout, const struct time_unit_t *const unit)
 {
-    if (!thiz || !unit)
+    if (!thiz || !element || !unit)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    struct timespec timeo;
+
+    calc_timeout(&timeo, timeout, unit);
+
+    return lb_queue_offer_until(thiz, element, &timeo);
+}
+
+static void *lb_queue_poll_until(struct lb_queue_t *const thiz, const struct timespec *const deadline)
+{
+    if (!thiz)
     {
         errno = ENOMEM;
         return NULL;
@@ -500,53 +927,368 @@ static void *lb_queue_poll_wait(struct lb_queue_t *const thiz, const uint64_t ti
     void *item = NULL;
     int c;
 
-    pthread_mutex_lock(&thiz->_take_lock);
+    _lock_take(thiz);
+
+    if (!_await_not_empty(thiz, deadline))
+        goto result_r;
+
+    item = _dequeue(thiz);
+    c = atomic_fetch_sub(&thiz->_count, 1);
+    if (c > 1)
+        _notify(thiz, &thiz->_not_empty);
+
+    _unlock_take(thiz);
+
+    if (c == thiz->_capacity)
+        _signal_not_full(thiz);
+
+    return item;
+
+result_r:
+    _unlock_take(thiz);
+
+    return item;
+}
+
+static void *lb_queue_poll_wait(struct lb_queue_t *const thiz, const uint64_t timeout, const struct time_unit_t *const unit)
+{
+    if (!thiz || !unit)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
 
     struct timespec timeo;
-    uint64_t nano_timeout;
-    uint64_t nanos;
-    int64_t nanotime;
 
     calc_timeout(&timeo, timeout, unit);
-    nano_timeout = timespec_to_nano(&timeo);
-    nanos = nano_timeout;
 
-    while (thiz->_count == 0)
+    return lb_queue_poll_until(thiz, &timeo);
+}
+
+static uint32_t lb_queue_offer_batch(struct lb_queue_t *const thiz, void *const *elements, const uint32_t n)
+{
+    if (!thiz || !elements)
     {
-        if (nanos <= 0)
-            goto result_r;
+        errno = EINVAL;
+        return 0;
+    }
 
-        if (pthread_cond_timedwait(&thiz->_not_empty, &thiz->_take_lock, &timeo) == ETIMEDOUT)
-            goto result_r;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (!elements[i])
+        {
+            errno = EINVAL;
+            return 0;
+        }
+    }
 
-        if ((nanotime = nano_time()) < 0)
-            goto result_r;
+    if (n == 0)
+        return 0;
 
-        nanos = nano_timeout - nanotime;
+    if (thiz->_count == thiz->_capacity)
+    {
+        _reject(thiz, elements[0], n);
+        return 0;
     }
 
-    item = _dequeue(thiz);
-    c = atomic_fetch_sub(&thiz->_count, 1);
-    if (c > 1)
-        pthread_cond_signal(&thiz->_not_empty);
+    uint32_t c;
+    uint32_t k;
+    struct _node_t *first;
+    struct _node_t *last;
+    struct _node_t *rest;
+
+    if (!_chain(thiz, elements, n, &first, &last))
+    {
+        errno = ENOMEM;
+        return 0;
+    }
+
+    _lock_put(thiz);
 
-    pthread_mutex_unlock(&thiz->_take_lock);
+    k = thiz->_capacity - (uint32_t)thiz->_count;
+    if (k > n)
+        k = n;
+
+    if (atomic_load(&thiz->_closed))
+    {
+        errno = EPIPE;
+        k = 0;
+    }
+
+    if (k == 0)
+    {
+        rest = first;
+        goto insert_full;
+    }
+
+    rest = _enqueue_chain(thiz, first, k);
+
+    c = atomic_fetch_add(&thiz->_count, k);
+    if (c + k < thiz->_capacity)
+        _notify(thiz, &thiz->_not_full);
+
+    _unlock_put(thiz);
+
+    if (c == 0)
+        _signal_not_empty(thiz);
+
+    goto result_r;
+
+insert_full:
+    _unlock_put(thiz);
+
+result_r:
+    for (struct _node_t *next; rest != NULL; rest = next)
+    {
+        next = rest->next;
+        node_pool_release(thiz->_pool, rest);
+    }
+
+    if (k < n)
+        _reject(thiz, elements[k], n - k);
+
+    return k;
+}
+
+static uint32_t lb_queue_put_batch(struct lb_queue_t *const thiz, void *const *elements, const uint32_t n)
+{
+    if (!thiz || !elements)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (!elements[i])
+        {
+            errno = EINVAL;
+            return 0;
+        }
+    }
+
+    if (n == 0)
+        return 0;
+
+    uint32_t c;
+    uint32_t k;
+    uint32_t done = 0;
+    struct _node_t *first;
+    struct _node_t *last;
+
+    if (!_chain(thiz, elements, n, &first, &last))
+    {
+        errno = ENOMEM;
+        return 0;
+    }
+
+    /* one lock hold per run of free space, a single one unless the queue fills up */
+    while (done < n)
+    {
+        _lock_put(thiz);
+
+        if (!_await_not_full(thiz, NULL))
+            goto insert_closed;
+
+        k = thiz->_capacity - (uint32_t)thiz->_count;
+        if (k > n - done)
+            k = n - done;
+
+        first = _enqueue_chain(thiz, first, k);
+
+        c = atomic_fetch_add(&thiz->_count, k);
+        if (c + k < thiz->_capacity)
+            _notify(thiz, &thiz->_not_full);
+
+        _unlock_put(thiz);
+
+        if (c == 0)
+            _signal_not_empty(thiz);
+
+        done += k;
+    }
+
+    return done;
+
+insert_closed:
+    _unlock_put(thiz);
+
+    for (struct _node_t *next; first != NULL; first = next)
+    {
+        next = first->next;
+        node_pool_release(thiz->_pool, first);
+    }
+
+    _reject(thiz, elements[done], n - done);
+
+    return done;
+}
+
+static uint32_t lb_queue_drain_to(struct lb_queue_t *const thiz, void **out, const uint32_t max)
+{
+    if (!thiz || !out)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    if (max == 0)
+        return 0;
+
+    if (thiz->_count == 0)
+    {
+        if (atomic_load(&thiz->_closed))
+            errno = EPIPE;
+        return 0;
+    }
+
+    uint32_t c;
+    uint32_t k;
+
+    _lock_take(thiz);
+
+    k = (uint32_t)thiz->_count;
+    if (k > max)
+        k = max;
+
+    if (k == 0)
+        goto take_empty;
+
+    _dequeue_chain(thiz, out, k);
+
+    c = atomic_fetch_sub(&thiz->_count, k);
+    if (c > k)
+        _notify(thiz, &thiz->_not_empty);
+
+    _unlock_take(thiz);
 
     if (c == thiz->_capacity)
-        pthread_cond_signal(&thiz->_not_full);
+        _signal_not_full(thiz);
 
-    return item;
+    return k;
+
+take_empty:
+    _unlock_take(thiz);
+
+    return 0;
+}
+
+static uint32_t lb_queue_take_batch(struct lb_queue_t *const thiz, void **out, const uint32_t min, const uint32_t max,
+                                    const uint64_t timeout, const struct time_unit_t *const unit)
+{
+    if (!thiz || !out)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    uint32_t c;
+    uint32_t k;
+    uint32_t taken = 0;
+    uint32_t need = (min > max) ? max : min;
+    struct timespec timeo;
+
+    if (unit)
+        calc_timeout(&timeo, timeout, unit);
+
+    _lock_take(thiz);
+
+    while (taken < max)
+    {
+        if (thiz->_count == 0 && (taken >= need || !_await_not_empty(thiz, unit ? &timeo : NULL)))
+            goto result_r;
+
+        k = (uint32_t)thiz->_count;
+        if (k > max - taken)
+            k = max - taken;
+
+        _dequeue_chain(thiz, out + taken, k);
+        taken += k;
+
+        c = atomic_fetch_sub(&thiz->_count, k);
+        if (c > k && taken >= need)
+            _notify(thiz, &thiz->_not_empty);
+
+        /* producers must not stay blocked while this thread waits for more */
+        if (c == thiz->_capacity)
+            _signal_not_full(thiz);
+
+        if (taken >= need)
+            break;
+    }
 
 result_r:
-    pthread_mutex_unlock(&thiz->_take_lock);
+    _unlock_take(thiz);
 
-    return item;
+    return taken;
+}
+
+static void lb_queue_close(struct lb_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = EINVAL;
+        return;
+    }
+
+    /* a put that passed its check under put lock completes before close returns */
+    _fully_lock(thiz);
+    atomic_store(&thiz->_closed, true);
+    _fully_unlock(thiz);
+
+    _notify_all(thiz, &thiz->_not_empty);
+    _notify_all(thiz, &thiz->_not_full);
+    event_fd_signal(&thiz->_readable);
+    event_fd_signal(&thiz->_writable);
+}
+
+static bool lb_queue_closed(struct lb_queue_t *const thiz)
+{
+    return atomic_load(&thiz->_closed);
+}
+
+static void lb_queue_stats(struct lb_queue_t *const thiz, struct queue_stats_t *const stats)
+{
+    if (!thiz || !stats)
+    {
+        errno = EINVAL;
+        return;
+    }
+
+    queue_counters_read(thiz->_stats, stats);
+}
+
+static int lb_queue_eventfd(struct lb_queue_t *const thiz, const enum queue_event_t event)
+{
+    if (!thiz)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    switch (event)
+    {
+    case QUEUE_EVENT_NOT_EMPTY:
+        return event_fd_open(&thiz->_readable, _not_empty, thiz);
+    case QUEUE_EVENT_NOT_FULL:
+        return event_fd_open(&thiz->_writable, _not_full, thiz);
+    default:
+        errno = EINVAL;
+        return -1;
+    }
 }
 
 struct blocking_queue_t *lb_queue(const uint32_t capacity)
 {
-    pthread_condattr_t cond_attr;
+    /* capacity nodes plus the head node, an unbounded queue grows on demand */
+    if (capacity == 0)
+        return lb_queue_prealloc(0, 0);
+
+    return lb_queue_prealloc(capacity, capacity < LB_QUEUE_PREALLOC ? capacity + 1 : LB_QUEUE_PREALLOC);
+}
 
+struct blocking_queue_t *lb_queue_prealloc(const uint32_t capacity, const uint32_t prealloc)
+{
     struct lb_queue_t *const thiz = (struct lb_queue_t *)malloc(sizeof(struct lb_queue_t));
     if (thiz == NULL)
     {
@@ -558,23 +1300,38 @@ struct blocking_queue_t *lb_queue(const uint32_t capacity)
 
     thiz->_capacity = (capacity == 0) ? QUEUE_MAX_CAPACITY : capacity;
 
-    /* thread cond timeout block's way CLOCK_REALTIME --> CLOCK_MONOTONIC */
-    pthread_condattr_init(&cond_attr);
-    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
-
     pthread_mutex_init(&thiz->_take_lock, NULL);
-    pthread_cond_init(&thiz->_not_empty, &cond_attr);
+    parker_init(&thiz->_not_empty);
     pthread_mutex_init(&thiz->_put_lock, NULL);
-    pthread_cond_init(&thiz->_not_full, &cond_attr);
+    parker_init(&thiz->_not_full);
+    event_fd_init(&thiz->_readable);
+    event_fd_init(&thiz->_writable);
 
-    pthread_condattr_destroy(&cond_attr);
+    thiz->_pool = node_pool(sizeof(struct _node_t), prealloc);
+    if (!thiz->_pool)
+    {
+        errno = ENOMEM;
+        goto lbQueue_err_1;
+    }
 
-    thiz->_head = (struct _node_t *)malloc(sizeof(struct _node_t));
-    thiz->_head->next = NULL;
-    thiz->_head->item = NULL;
+    thiz->_head = _node(thiz, NULL, 0);
+    if (!thiz->_head)
+    {
+        errno = ENOMEM;
+        goto lbQueue_err_2;
+    }
     thiz->_last = thiz->_head;
 
+    thiz->_stats = queue_counters();
+    if (!thiz->_stats)
+    {
+        errno = ENOMEM;
+        goto lbQueue_err_2;
+    }
+
     atomic_fetch_and(&thiz->_count, 0x0);
+    atomic_init(&thiz->_closed, false);
+    atomic_init(&thiz->_latency, NULL);
 
     /* methods */
     thiz->size = lb_queue_size;
@@ -587,7 +1344,94 @@ struct blocking_queue_t *lb_queue(const uint32_t capacity)
     thiz->offer_await = lb_queue_offer_wait;
     thiz->take = lb_queue_take;
     thiz->poll_await = lb_queue_poll_wait;
+    thiz->offer_batch = lb_queue_offer_batch;
+    thiz->put_batch = lb_queue_put_batch;
+    thiz->drain_to = lb_queue_drain_to;
+    thiz->take_batch = lb_queue_take_batch;
+    thiz->eventfd = lb_queue_eventfd;
+    thiz->close = lb_queue_close;
+    thiz->closed = lb_queue_closed;
+    thiz->stats = lb_queue_stats;
+    thiz->offer_until = lb_queue_offer_until;
+    thiz->poll_until = lb_queue_poll_until;
 
     return (struct blocking_queue_t *)thiz;
+
+lbQueue_err_2:
+    node_pool_free(thiz->_pool);
+
+lbQueue_err_1:
+    parker_destroy(&thiz->_not_empty);
+    parker_destroy(&thiz->_not_full);
+    event_fd_destroy(&thiz->_readable);
+    event_fd_destroy(&thiz->_writable);
+    pthread_mutex_destroy(&thiz->_take_lock);
+    pthread_mutex_destroy(&thiz->_put_lock);
+    free(thiz);
+
+    return NULL;
+}
+
+void lb_queue_spin(struct blocking_queue_t *const queue, const uint64_t timeout, const struct time_unit_t *const unit)
+{
+    struct lb_queue_t *const thiz = (struct lb_queue_t *)queue;
+
+    if (!thiz || !unit)
+    {
+        errno = EINVAL;
+        return;
+    }
+
+    const uint64_t nanos = time_unit_to_nano(unit, timeout);
+    const uint32_t spin = nanos > UINT32_MAX ? UINT32_MAX : (uint32_t)nanos;
+
+    parker_spin(&thiz->_not_empty, spin);
+    parker_spin(&thiz->_not_full, spin);
 }
 
+bool lb_queue_latency_enable(struct blocking_queue_t *const queue)
+{
+    struct lb_queue_t *const thiz = (struct lb_queue_t *)queue;
+    struct histogram_t *expected = NULL;
+
+    if (!thiz)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (atomic_load(&thiz->_latency))
+        return true;
+
+    struct histogram_t *const h = histogram();
+    if (!h)
+        return false;
+
+    /* a racing call may have won, keep its histogram */
+    if (!atomic_compare_exchange_strong_explicit(&thiz->_latency, &expected, h, memory_order_release, memory_order_relaxed))
+        histogram_free(h);
+
+    return true;
+}
+
+bool lb_queue_latency(struct blocking_queue_t *const queue, struct histogram_summary_t *const summary)
+{
+    struct lb_queue_t *const thiz = (struct lb_queue_t *)queue;
+
+    if (!thiz || !summary)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    struct histogram_t *const h = atomic_load_explicit(&thiz->_latency, memory_order_acquire);
+    if (!h)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    histogram_summary(h, summary);
+
+    return true;
+}
@@ -2,14 +2,64 @@
 #define _LB_QUEUE_H_
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "blocking_queue.h"
+#include "histogram.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * Creates a linked blocking queue. A bounded queue allocates the nodes of
+ * its first 1024 elements up front and the rest as they are needed, the
+ * capacity is only a limit.
+ *
+ * @param capacity the capacity of this queue, 0 means unbounded
+ * @return the queue, or NULL on failure
+ */
 extern struct blocking_queue_t *lb_queue(const uint32_t capacity);
 
+/**
+ * Creates a linked blocking queue with prealloc nodes allocated and touched
+ * up front, so the first puts neither allocate nor fault pages in. A queue
+ * holding n elements uses n + 1 nodes.
+ *
+ * @param capacity the capacity of this queue, 0 means unbounded
+ * @param prealloc number of nodes allocated up front, 0 for none
+ * @return the queue, or NULL on failure
+ */
+extern struct blocking_queue_t *lb_queue_prealloc(const uint32_t capacity, const uint32_t prealloc);
+
+/**
+ * Sets how long a blocked put or take spins before it parks on a futex.
+ *
+ * @param queue queue returned by lb_queue
+ * @param timeout spin time, in units of unit, 0 to park right away
+ * @param unit a time_unit_t determining how to interpret the timeout parameter
+ */
+extern void lb_queue_spin(struct blocking_queue_t *const queue, const uint64_t timeout, const struct time_unit_t *const unit);
+
+/**
+ * Starts recording how long elements wait in the queue, from the put to the
+ * take, into a sharded histogram. Elements already queued are not counted,
+ * and recording stays on until the queue is freed. Each recorded element
+ * costs two nano_time reads, one per batch for the batch methods.
+ *
+ * @param queue queue returned by lb_queue
+ * @return true on success, false if memory is insufficient
+ */
+extern bool lb_queue_latency_enable(struct blocking_queue_t *const queue);
+
+/**
+ * Reads the recorded wait percentiles, in nanoseconds.
+ *
+ * @param queue queue returned by lb_queue
+ * @param summary filled with the count, p50, p99, p99.9 and max
+ * @return true on success, false with errno EINVAL if recording is off
+ */
+extern bool lb_queue_latency(struct blocking_queue_t *const queue, struct histogram_summary_t *const summary);
+
 #ifdef __cplusplus
 }
 #endif
@@ -4,20 +4,14 @@
 #include <errno.h>
 #include <string.h>
 #include "lp_queue.h"
-
-/** 
- * queue node structure
- */
-struct _node_t
-{
-    const void *item;
-    struct _node_t *next;
-};
+#include "heap.h"
+#include "queue_probe.h"
 
 /** 
  * list priority queue
  * 
- * priority queue based on linked list
+ * priority queue based on an array heap of element pointers, offer and poll
+ * are O(log n)
  */
 struct lp_queue_t
 {
@@ -72,61 +66,21 @@ struct lp_queue_t
      */
     void *(*peek)(struct lp_queue_t *const thiz);
 
-    /*  queue sort condition function */
-    int32_t (*_compare)(const void *, const void *);
-
     /* queue capacity */
     uint32_t _capacity;
 
-    /* Number of queue elements */
-    uint32_t _count;
-
-    /* queue head node pointer */
-    struct _node_t *_head;
+    /* queue elements, ordered by the sort condition function */
+    struct heap_t _heap;
 };
 
 #define QUEUE_MAX_CAPACITY 0xFFFFFFFFU
 
-static inline void _enqueue(struct lp_queue_t *const thiz, struct _node_t *const node)
-{
-    struct _node_t *tmp = thiz->_head->next;
-    struct _node_t *prev = thiz->_head;
-    for (; tmp != NULL;)
-    {
-        if (thiz->_compare(tmp->item, node->item) > 0)
-            break;
-
-        prev = prev->next;
-        tmp = tmp->next;
-    }
-
-    if (!tmp)
-    {
-        prev->next = node;
-    }
-    else
-    {
-        node->next = tmp;
-        prev->next = node;
-    }
-}
-
-static inline void *_dequeue(struct lp_queue_t *const thiz)
-{
-    struct _node_t *h = thiz->_head;
-    struct _node_t *first = h->next;
-    h->next = NULL;
-    thiz->_head = first;
-    void *x = (void *)first->item;
-    first->item = NULL;
-
-    free(h);
-    return x;
-}
+/* heap slots allocated up front, the heap doubles from there */
+#define QUEUE_INITIAL_LENGTH 64
 
 static uint32_t lp_queue_size(struct lp_queue_t *const thiz)
 {
-    return thiz->_count;
+    return heap_size(&thiz->_heap);
 }
 
 static void lp_queue_clear(struct lp_queue_t *const thiz)
@@ -137,20 +91,10 @@ static void lp_queue_clear(struct lp_queue_t *const thiz)
         return;
     }
 
-    if (thiz->_count == 0)
-        return;
-
-    for (struct _node_t *t, *p = thiz->_head->next; p != NULL;)
-    {
-        t = p;
-        p = t->next;
-
-        if (t->item)
-            free((void *)t->item);
-        free(t);
-    }
+    for (uint32_t i = 0; i < heap_size(&thiz->_heap); i++)
+        free(heap_at(&thiz->_heap, i));
 
-    thiz->_count = 0;
+    heap_reset(&thiz->_heap);
 
     return;
 }
@@ -165,7 +109,7 @@ static void lp_queue_free(struct lp_queue_t *const thiz)
 
     thiz->clear(thiz);
 
-    free(thiz->_head);
+    heap_destroy(&thiz->_heap);
     free(thiz);
 }
 
@@ -177,21 +121,16 @@ static bool lp_queue_offer(struct lp_queue_t *const thiz, const void *const elem
         return false;
     }
 
-    if (thiz->_count == thiz->_capacity)
-        return false;
-
-    struct _node_t *new_node = (struct _node_t *)malloc(sizeof(struct _node_t));
-    if (!new_node)
+    if (heap_size(&thiz->_heap) == thiz->_capacity)
     {
-        errno = ENOMEM;
+        QUEUE_PROBE3(reject, thiz, element, 1);
         return false;
     }
-    new_node->item = element;
-    new_node->next = NULL;
 
-    _enqueue(thiz, new_node);
+    if (!heap_push(&thiz->_heap, element))
+        return false;
 
-    thiz->_count++;
+    QUEUE_PROBE3(enqueue, thiz, element, 1);
 
     return true;
 }
@@ -204,14 +143,12 @@ static void *lp_queue_poll(struct lp_queue_t *const thiz)
         return NULL;
     }
 
-    if (thiz->_count == 0)
-        return NULL;
-
-    void *item = _dequeue(thiz);
+    void *x = heap_pop(&thiz->_heap);
 
-    thiz->_count--;
+    if (x)
+        QUEUE_PROBE3(dequeue, thiz, x, 1);
 
-    return item;
+    return x;
 }
 
 static void *lp_queue_peek(struct lp_queue_t *const thiz)
@@ -222,17 +159,17 @@ static void *lp_queue_peek(struct lp_queue_t *const thiz)
         return NULL;
     }
 
-    if (thiz->_count == 0)
-        return NULL;
-
-    void *item = NULL;
-    item = thiz->_count > 0 ? (void *)thiz->_head->next : NULL;
-
-    return item;
+    return heap_peek(&thiz->_heap);
 }
 
 struct queue_t *lp_queue(const uint32_t capacity, int32_t (*const compare)(const void *, const void *))
 {
+    if (!compare)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
     struct lp_queue_t *thiz = (struct lp_queue_t *)malloc(sizeof(struct lp_queue_t));
     if (!thiz)
     {
@@ -244,13 +181,11 @@ struct queue_t *lp_queue(const uint32_t capacity, int32_t (*const compare)(const
 
     thiz->_capacity = (capacity == 0) ? QUEUE_MAX_CAPACITY : capacity;
 
-    thiz->_head = (struct _node_t *)malloc(sizeof(struct _node_t)); /* singly linked list with head node */
-    if (!thiz->_head)
+    if (!heap_init(&thiz->_heap, compare, (thiz->_capacity < QUEUE_INITIAL_LENGTH) ? thiz->_capacity : QUEUE_INITIAL_LENGTH))
     {
         errno = ENOMEM;
         goto lpQueue_err_1;
     }
-    thiz->_count = 0;
 
     /* methods */
     thiz->size = lp_queue_size;
@@ -259,7 +194,6 @@ struct queue_t *lp_queue(const uint32_t capacity, int32_t (*const compare)(const
     thiz->offer = lp_queue_offer;
     thiz->poll = lp_queue_poll;
     thiz->peek = lp_queue_peek;
-    thiz->_compare = compare;
 
     goto lpQueue_err_0;
 
@@ -0,0 +1,1429 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "ml_queue.h"
+#include "node_pool.h"
+#include "queue_stats.h"
+#include "parker.h"
+#include "event_fd.h"
+#include "time_util.h"
+
+/** 
+ * queue node structure
+ */
+struct _node_t
+{
+    const void *item;
+    struct _node_t *next;
+
+    /* priority level, the lane the node goes to */
+    uint32_t level;
+};
+
+/**
+ * FIFO lane of one priority level, a linked list with a head node like
+ * lb_queue, so puts touch only last and takes only head
+ */
+struct _lane_t
+{
+    /* head node, its next is the first element */
+    struct _node_t *head;
+
+    /* tail node */
+    struct _node_t *last;
+
+    /* number of elements, changed after linking and after unlinking */
+    atomic_uint count;
+};
+
+/** 
+ * multi-level block queue
+ * 
+ * blocking queue of FIFO lanes, one per priority level, with a bitmap of the
+ * non-empty lanes. takes serve the highest non-empty level, found with one
+ * count-leading-zeros on the bitmap.
+ */
+struct ml_queue_t
+{
+
+    /** 
+     * Returns the number of elements in this collection.
+     *
+     * @param thiz this
+     * @return the number of elements in this collection
+     */
+    uint32_t (*size)(struct ml_queue_t *const thiz);
+
+    /**
+     * Removes all of the elements from this collection.
+     *
+     *  @param thiz this
+     */
+    void (*clear)(struct ml_queue_t *const thiz);
+
+    /**
+     * Free collection
+     *
+     * @param thiz this
+     */
+    void (*free)(struct ml_queue_t *const thiz);
+
+    /** 
+     * Inserts the specified element into this queue if it is possible to do
+     * so immediately without violating capacity restrictions.
+     *
+     * @param thiz this
+     * @param element element
+     * @return true if the element was added to this queue, else false
+     */
+    bool (*offer)(struct ml_queue_t *const thiz, const void *const element);
+
+    /** 
+     * Retrieves and removes the head of this queue,
+     * or returns NULL if this queue is empty.
+     *
+     * @param thiz this
+     * @return the head of this queue, or NULL if this queue is empty 
+     */
+    void *(*poll)(struct ml_queue_t *const thiz);
+
+    /** 
+     * Retrieves, but does not remove, the head of this queue,
+     * or returns NULL if this queue is empty.
+     *
+     * @param thiz this
+     * @return the head of this queue, or NULL if this queue is empty
+     */
+    void *(*peek)(struct ml_queue_t *const thiz);
+
+    /**
+     * Inserts the specified element into this queue, waiting if necessary for space to become available.
+     *
+     * @param thiz this
+     * @param element the element to add
+     */
+    bool (*put)(struct ml_queue_t *const thiz, const void *const element);
+
+    /** 
+     * Inserts the specified element into this queue, waiting up to the
+     * specified wait time if necessary for space to become available.
+     *
+     * @param thiz this
+     * @param element the element to add
+     * @param timeout how long to wait before giving up, in units of unit
+     * @param unit a time_unit_t determining how to interpret the timeout parameter
+     * @return true if successful, or false if the specified waiting time elapses before space is available
+     */
+    bool (*offer_await)(struct ml_queue_t *const thiz, const void *const element, const uint64_t timeout, const struct time_unit_t *const unit);
+
+    /** 
+     * Retrieves and removes the head of this queue, waiting if necessary until an element becomes available.
+     *
+     * @param thiz this
+     * @return the head of this queue
+     */
+    void *(*take)(struct ml_queue_t *const thiz);
+
+    /** 
+     * Retrieves and removes the head of this queue, waiting up to the
+     * specified wait time if necessary for an element to become available.
+     *
+     * @param thiz this
+     * @param timeout how long to wait before giving up, in units of unit
+     * @param unit a time_unit_t determining how to interpret the timeout parameter
+     * @return the head of this queue, or NULL if the specified waiting time elapses before an element is available
+     */
+    void *(*poll_await)(struct ml_queue_t *const thiz, const uint64_t timeout, const struct time_unit_t *const unit);
+
+    /**
+     * Inserts as many of the specified elements as possible without waiting,
+     * in order, with a single acquisition of the queue.
+     *
+     * @param thiz this
+     * @param elements the elements to add
+     * @param n number of elements
+     * @return the number of elements added, always a prefix of elements
+     */
+    uint32_t (*offer_batch)(struct ml_queue_t *const thiz, void *const *elements, const uint32_t n);
+
+    /**
+     * Inserts all of the specified elements, in order, waiting if necessary for space to become available.
+     *
+     * @param thiz this
+     * @param elements the elements to add
+     * @param n number of elements
+     * @return the number of elements added, n unless an error occurred
+     */
+    uint32_t (*put_batch)(struct ml_queue_t *const thiz, void *const *elements, const uint32_t n);
+
+    /**
+     * Removes at most max available elements from this queue without waiting.
+     *
+     * @param thiz this
+     * @param out receives the removed elements in queue order
+     * @param max the maximum number of elements to remove
+     * @return the number of elements removed
+     */
+    uint32_t (*drain_to)(struct ml_queue_t *const thiz, void **out, const uint32_t max);
+
+    /**
+     * Removes at most max elements from this queue, waiting up to the
+     * specified wait time if necessary until at least min have been removed.
+     *
+     * @param thiz this
+     * @param out receives the removed elements in queue order
+     * @param min the number of elements to wait for
+     * @param max the maximum number of elements to remove
+     * @param timeout how long to wait before giving up, in units of unit
+     * @param unit a time_unit_t determining how to interpret the timeout parameter, or NULL to wait without limit
+     * @return the number of elements removed, less than min only if the waiting time elapsed
+     */
+    uint32_t (*take_batch)(struct ml_queue_t *const thiz, void **out, const uint32_t min, const uint32_t max,
+                           const uint64_t timeout, const struct time_unit_t *const unit);
+
+    /**
+     * Returns a non-blocking eventfd that becomes readable when this queue
+     * turns ready for the event, for use with poll/epoll. The descriptor is
+     * owned by the queue and closed by free. Read it before draining the
+     * queue, and drain until the queue reports nothing left.
+     *
+     * @param thiz this
+     * @param event QUEUE_EVENT_NOT_EMPTY or QUEUE_EVENT_NOT_FULL
+     * @return the descriptor, or -1 with errno set
+     */
+    int (*eventfd)(struct ml_queue_t *const thiz, const enum queue_event_t event);
+
+    /**
+     * Closes this queue and wakes every blocked thread. Later puts fail
+     * with errno EPIPE, takes return the remaining elements and then fail
+     * with errno EPIPE. A queue cannot be reopened.
+     *
+     * @param thiz this
+     */
+    void (*close)(struct ml_queue_t *const thiz);
+
+    /**
+     * Returns true if this queue has been closed.
+     *
+     * @param thiz this
+     * @return true if this queue has been closed
+     */
+    bool (*closed)(struct ml_queue_t *const thiz);
+
+    /**
+     * Reads the operational counters of this queue. The lock counters stay
+     * 0 unless built with ENABLE_CLQUEUE_LOCK_PROFILE.
+     *
+     * @param thiz this
+     * @param stats filled with the totals since the queue was created
+     */
+    void (*stats)(struct ml_queue_t *const thiz, struct queue_stats_t *const stats);
+
+    /**
+     * Inserts the specified element into this queue, waiting until the
+     * deadline if necessary for space to become available.
+     *
+     * @param thiz this
+     * @param element the element to add
+     * @param deadline absolute CLOCK_MONOTONIC time to give up at, or NULL to wait without limit
+     * @return true if successful, or false if the deadline passes before space is available
+     */
+    bool (*offer_until)(struct ml_queue_t *const thiz, const void *const element, const struct timespec *const deadline);
+
+    /**
+     * Retrieves and removes the head of this queue, waiting until the
+     * deadline if necessary for an element to become available.
+     *
+     * @param thiz this
+     * @param deadline absolute CLOCK_MONOTONIC time to give up at, or NULL to wait without limit
+     * @return the head of this queue, or NULL if the deadline passes before an element is available
+     */
+    void *(*poll_until)(struct ml_queue_t *const thiz, const struct timespec *const deadline);
+
+    /* queue capacity */
+    uint32_t _capacity;
+
+    /* Number of queue elements */
+    __sig_atomic_t volatile _count;
+
+    /* number of priority levels */
+    uint32_t _levels;
+
+    /* element level function, NULL puts every element at level 0 */
+    uint32_t (*_level)(const void *);
+
+    /* lanes, indexed by level */
+    struct _lane_t *_lanes;
+
+    /* non-empty lanes, bit i for level i */
+    atomic_uint_least64_t _occupied;
+
+    /* mutex lock : get element */
+    pthread_mutex_t _take_lock;
+
+    /* parked takers : queue non-empty */
+    struct parker_t _not_empty;
+
+    /* mutex lock : add element */
+    pthread_mutex_t _put_lock;
+
+    /* parked putters : queue non-full */
+    struct parker_t _not_full;
+
+    /* readiness descriptor : queue non-empty */
+    struct event_fd_t _readable;
+
+    /* readiness descriptor : queue non-full */
+    struct event_fd_t _writable;
+
+    /* queue node allocator */
+    struct node_pool_t *_pool;
+
+    /* set once by close, under both locks */
+    atomic_bool _closed;
+
+    /* operational counters */
+    struct queue_counters_t *_stats;
+
+    /* put lock hold start, for lock profiling */
+    uint64_t _put_since;
+
+    /* take lock hold start, for lock profiling */
+    uint64_t _take_since;
+};
+
+#define QUEUE_MAX_CAPACITY 0xFFFFFFFFU
+
+#define ML_QUEUE_MAX_LEVELS 64
+
+/* nodes ml_queue allocates up front at most, the pool grows on demand past it */
+#define ML_QUEUE_PREALLOC 1024U
+
+static inline struct _node_t *_node(struct ml_queue_t *const thiz, const void *const element, const uint32_t level)
+{
+    struct _node_t *node = (struct _node_t *)node_pool_alloc(thiz->_pool);
+    if (!node)
+        return NULL;
+
+    node->item = element;
+    node->next = NULL;
+    node->level = level;
+
+    return node;
+}
+
+/**
+ * Returns the level of element, or _levels if the level function gives an invalid one.
+ */
+static inline uint32_t _level_of(struct ml_queue_t *const thiz, const void *const element)
+{
+    const uint32_t level = thiz->_level ? thiz->_level(element) : 0;
+
+    return (level < thiz->_levels) ? level : thiz->_levels;
+}
+
+/**
+ * Returns the highest non-empty lane. Called only when holding take lock
+ * with a non-zero count.
+ */
+static inline struct _lane_t *_first_lane(struct ml_queue_t *const thiz)
+{
+    const uint64_t occupied = atomic_load(&thiz->_occupied);
+
+    return &thiz->_lanes[63 - __builtin_clzll(occupied)];
+}
+
+static inline void _enqueue(struct ml_queue_t *const thiz, struct _node_t *node)
+{
+    struct _lane_t *const lane = &thiz->_lanes[node->level];
+
+    lane->last->next = node;
+    lane->last = node;
+
+    if (atomic_fetch_add(&lane->count, 1) == 0)
+        atomic_fetch_or(&thiz->_occupied, 1ULL << node->level);
+
+    queue_counters_add(thiz->_stats, QUEUE_STAT_OFFERS, 1);
+}
+
+static inline void *_dequeue(struct ml_queue_t *const thiz)
+{
+    struct _lane_t *const lane = _first_lane(thiz);
+    struct _node_t *h = lane->head;
+    struct _node_t *first = h->next;
+    h->next = NULL;
+    lane->head = first;
+    void *x = (void *)first->item;
+    first->item = NULL;
+
+    node_pool_release(thiz->_pool, h);
+    queue_counters_add(thiz->_stats, QUEUE_STAT_TAKES, 1);
+
+    /* a put may refill the lane between the decrement and the clear, then
+     * either its own bit set comes after the clear or the count check here
+     * sees its element */
+    if (atomic_fetch_sub(&lane->count, 1) == 1)
+    {
+        const uint64_t bit = 1ULL << (uint32_t)(lane - thiz->_lanes);
+
+        atomic_fetch_and(&thiz->_occupied, ~bit);
+        if (atomic_load(&lane->count) != 0)
+            atomic_fetch_or(&thiz->_occupied, bit);
+    }
+
+    return x;
+}
+
+/**
+ * Builds a chain of n nodes holding elements.
+ *
+ * @return false with errno EINVAL if an element has an invalid level, or ENOMEM
+ */
+static inline bool _chain(struct ml_queue_t *const thiz, void *const *elements, const uint32_t n,
+                          struct _node_t **const first, struct _node_t **const last)
+{
+    struct _node_t *head = NULL;
+    struct _node_t *tail = NULL;
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        const uint32_t level = _level_of(thiz, elements[i]);
+        struct _node_t *node = (level < thiz->_levels) ? _node(thiz, elements[i], level) : NULL;
+        if (!node)
+        {
+            errno = (level < thiz->_levels) ? ENOMEM : EINVAL;
+
+            for (struct _node_t *next; head != NULL; head = next)
+            {
+                next = head->next;
+                node_pool_release(thiz->_pool, head);
+            }
+            return false;
+        }
+
+        if (tail)
+            tail->next = node;
+        else
+            head = node;
+        tail = node;
+    }
+
+    *first = head;
+    *last = tail;
+
+    return true;
+}
+
+/**
+ * Links the first k nodes of a chain at the tails of their lanes and returns
+ * the rest. Called only when holding put lock.
+ */
+static inline struct _node_t *_enqueue_chain(struct ml_queue_t *const thiz, struct _node_t *first, const uint32_t k)
+{
+    struct _node_t *node;
+
+    for (uint32_t i = 0; i < k; i++)
+    {
+        node = first;
+        first = node->next;
+        node->next = NULL;
+
+        _enqueue(thiz, node);
+    }
+
+    return first;
+}
+
+/**
+ * Unlinks k elements from the head. Called only when holding take lock.
+ */
+static inline void _dequeue_chain(struct ml_queue_t *const thiz, void **const out, const uint32_t k)
+{
+    for (uint32_t i = 0; i < k; i++)
+        out[i] = _dequeue(thiz);
+}
+
+static inline void _lock_put(struct ml_queue_t *const thiz)
+{
+    queue_counters_lock(thiz->_stats, &thiz->_put_lock, &thiz->_put_since);
+}
+
+static inline void _unlock_put(struct ml_queue_t *const thiz)
+{
+    queue_counters_unlock(thiz->_stats, &thiz->_put_lock, &thiz->_put_since);
+}
+
+static inline void _lock_take(struct ml_queue_t *const thiz)
+{
+    queue_counters_lock(thiz->_stats, &thiz->_take_lock, &thiz->_take_since);
+}
+
+static inline void _unlock_take(struct ml_queue_t *const thiz)
+{
+    queue_counters_unlock(thiz->_stats, &thiz->_take_lock, &thiz->_take_since);
+}
+
+/**
+ * Counts elements an offer or put could not insert.
+ */
+static inline void _reject(struct ml_queue_t *const thiz, const uint32_t n)
+{
+    queue_counters_add(thiz->_stats, QUEUE_STAT_REJECTED, n);
+}
+
+/**
+ * Wakes one parked thread, counting the wakeup if one was sent.
+ */
+static inline void _notify(struct ml_queue_t *const thiz, struct parker_t *const p)
+{
+    if (parker_notify(p))
+        queue_counters_add(thiz->_stats, QUEUE_STAT_SIGNALS, 1);
+}
+
+static inline void _notify_all(struct ml_queue_t *const thiz, struct parker_t *const p)
+{
+    if (parker_notify_all(p))
+        queue_counters_add(thiz->_stats, QUEUE_STAT_SIGNALS, 1);
+}
+
+/**
+ * Locks to prevent both puts and takes.
+ */
+static inline void _fully_lock(struct ml_queue_t *const thiz)
+{
+    _lock_take(thiz);
+    _lock_put(thiz);
+}
+
+/**
+ * Unlocks to allow both puts and takes.
+ */
+static inline void _fully_unlock(struct ml_queue_t *const thiz)
+{
+    _unlock_put(thiz);
+    _unlock_take(thiz);
+}
+
+/**
+ * Signals a waiting take. Called only from put/offer, on the empty to
+ * non-empty transition. The waiter count in the parker lets this return
+ * without a syscall when nobody is parked.
+ */
+static inline void _signal_not_empty(struct ml_queue_t *const thiz)
+{
+    _notify(thiz, &thiz->_not_empty);
+    event_fd_signal(&thiz->_readable);
+}
+
+/**
+ * Signals a waiting put. Called only from take/poll, on the full to
+ * non-full transition.
+ */
+static inline void _signal_not_full(struct ml_queue_t *const thiz)
+{
+    _notify(thiz, &thiz->_not_full);
+    event_fd_signal(&thiz->_writable);
+}
+
+static bool _not_empty(void *arg)
+{
+    struct ml_queue_t *const thiz = (struct ml_queue_t *)arg;
+
+    return thiz->_count != 0 || atomic_load(&thiz->_closed);
+}
+
+static bool _not_full(void *arg)
+{
+    struct ml_queue_t *const thiz = (struct ml_queue_t *)arg;
+
+    return (uint32_t)thiz->_count != thiz->_capacity || atomic_load(&thiz->_closed);
+}
+
+/**
+ * Waits until the queue is non-empty or the deadline passes. Called with take
+ * lock held, which is released while the thread spins or parks.
+ *
+ * @return false on timeout, or with errno EPIPE once the queue is closed and empty
+ */
+static inline bool _await_not_empty(struct ml_queue_t *const thiz, const struct timespec *const deadline)
+{
+    while (thiz->_count == 0)
+    {
+        if (atomic_load(&thiz->_closed))
+        {
+            errno = EPIPE;
+            return false;
+        }
+
+        const uint64_t start = queue_counters_wait_begin();
+
+        _unlock_take(thiz);
+        const bool r = parker_await(&thiz->_not_empty, _not_empty, thiz, deadline);
+        _lock_take(thiz);
+
+        const bool timed_out = !r && thiz->_count == 0;
+
+        queue_counters_wait_end(thiz->_stats, start, timed_out);
+
+        if (timed_out)
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * Waits until the queue is non-full or the deadline passes. Called with put
+ * lock held, which is released while the thread spins or parks.
+ *
+ * @return false on timeout, or with errno EPIPE once the queue is closed
+ */
+static inline bool _await_not_full(struct ml_queue_t *const thiz, const struct timespec *const deadline)
+{
+    while (!atomic_load(&thiz->_closed) && thiz->_count == thiz->_capacity)
+    {
+        const uint64_t start = queue_counters_wait_begin();
+
+        _unlock_put(thiz);
+        const bool r = parker_await(&thiz->_not_full, _not_full, thiz, deadline);
+        _lock_put(thiz);
+
+        const bool timed_out = !r && !atomic_load(&thiz->_closed) && thiz->_count == thiz->_capacity;
+
+        queue_counters_wait_end(thiz->_stats, start, timed_out);
+
+        if (timed_out)
+            return false;
+    }
+
+    if (atomic_load(&thiz->_closed))
+    {
+        errno = EPIPE;
+        return false;
+    }
+
+    return true;
+}
+
+static uint32_t ml_queue_size(struct ml_queue_t *const thiz)
+{
+    return thiz->_count;
+}
+
+static void ml_queue_clear(struct ml_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return;
+    }
+
+    int c;
+
+    _fully_lock(thiz);
+
+    for (uint32_t i = 0; i < thiz->_levels; i++)
+    {
+        struct _lane_t *const lane = &thiz->_lanes[i];
+
+        for (struct _node_t *next, *current = lane->head->next; current != NULL; current = next)
+        {
+            next = current->next;
+
+            if (current->item)
+                free((void *)current->item);
+
+            node_pool_release(thiz->_pool, current);
+        }
+
+        lane->head->next = NULL;
+        lane->last = lane->head;
+        atomic_store(&lane->count, 0);
+    }
+
+    atomic_store(&thiz->_occupied, 0);
+
+    c = atomic_fetch_and(&thiz->_count, 0x0);
+    if (c == thiz->_capacity)
+        _signal_not_full(thiz);
+
+    _fully_unlock(thiz);
+
+    return;
+}
+
+static void ml_queue_free(struct ml_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return;
+    }
+
+    thiz->clear(thiz);
+
+    parker_destroy(&thiz->_not_empty);
+    parker_destroy(&thiz->_not_full);
+    event_fd_destroy(&thiz->_readable);
+    event_fd_destroy(&thiz->_writable);
+    pthread_mutex_destroy(&thiz->_take_lock);
+    pthread_mutex_destroy(&thiz->_put_lock);
+
+    for (uint32_t i = 0; i < thiz->_levels; i++)
+        node_pool_release(thiz->_pool, thiz->_lanes[i].head);
+
+    node_pool_free(thiz->_pool);
+    queue_counters_free(thiz->_stats);
+    free(thiz->_lanes);
+    free(thiz);
+}
+
+static bool _offer(struct ml_queue_t *const thiz, const void *const element, const uint32_t level)
+{
+    if (!thiz || !element || level >= thiz->_levels)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (atomic_load(&thiz->_closed))
+    {
+        _reject(thiz, 1);
+        errno = EPIPE;
+        return false;
+    }
+
+    if (thiz->_count == thiz->_capacity)
+    {
+        _reject(thiz, 1);
+        return false;
+    }
+
+    uint32_t c;
+
+    struct _node_t *new_node = _node(thiz, element, level);
+    if (!new_node)
+    {
+        errno = ENOMEM;
+        return false;
+    }
+
+    /* element enqueue */
+    _lock_put(thiz);
+
+    if (atomic_load(&thiz->_closed))
+    {
+        errno = EPIPE;
+        goto insert_full;
+    }
+
+    if (thiz->_count == thiz->_capacity)
+        goto insert_full;
+
+    _enqueue(thiz, new_node);
+
+    c = atomic_fetch_add(&thiz->_count, 1);
+    if ((c + 1) < thiz->_capacity)
+        _notify(thiz, &thiz->_not_full);
+
+    _unlock_put(thiz);
+
+    if (c == 0)
+        _signal_not_empty(thiz);
+
+    return true;
+
+insert_full:
+    _unlock_put(thiz);
+    node_pool_release(thiz->_pool, new_node);
+    _reject(thiz, 1);
+
+    return false;
+}
+
+static void *ml_queue_poll(struct ml_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    void *item = NULL;
+    uint32_t c;
+
+    _lock_take(thiz);
+
+    if (thiz->_count == 0)
+        goto take_empty;
+
+    item = _dequeue(thiz);
+    c = atomic_fetch_sub(&thiz->_count, 1);
+    if (c > 1)
+        _notify(thiz, &thiz->_not_empty);
+
+    _unlock_take(thiz);
+    if (c == thiz->_capacity)
+        _signal_not_full(thiz);
+
+    return item;
+
+take_empty:
+    if (atomic_load(&thiz->_closed))
+        errno = EPIPE;
+
+    _unlock_take(thiz);
+
+    return NULL;
+}
+
+static void *ml_queue_peek(struct ml_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if (thiz->_count == 0)
+        return NULL;
+
+    void *item = NULL;
+    _lock_take(thiz);
+    item = thiz->_count > 0 ? (void *)_first_lane(thiz)->head->next->item : NULL;
+    _unlock_take(thiz);
+
+    return item;
+}
+
+static bool _put(struct ml_queue_t *const thiz, const void *const element, const uint32_t level)
+{
+    if (!thiz || !element || level >= thiz->_levels)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    int c;
+
+    struct _node_t *new_node = _node(thiz, element, level);
+    if (!new_node)
+    {
+        errno = ENOMEM;
+        return false;
+    }
+
+    _lock_put(thiz);
+
+    if (!_await_not_full(thiz, NULL))
+        goto insert_closed;
+
+    _enqueue(thiz, new_node);
+
+    c = atomic_fetch_add(&thiz->_count, 1);
+    if (c + 1 < thiz->_capacity)
+        _notify(thiz, &thiz->_not_full);
+
+    _unlock_put(thiz);
+
+    if (c == 0)
+        _signal_not_empty(thiz);
+
+    return true;
+
+insert_closed:
+    _unlock_put(thiz);
+    node_pool_release(thiz->_pool, new_node);
+    _reject(thiz, 1);
+
+    return false;
+}
+
+static bool ml_queue_offer(struct ml_queue_t *const thiz, const void *const element)
+{
+    return _offer(thiz, element, thiz ? _level_of(thiz, element) : 0);
+}
+
+static bool ml_queue_put(struct ml_queue_t *const thiz, const void *const element)
+{
+    return _put(thiz, element, thiz ? _level_of(thiz, element) : 0);
+}
+
+static void *ml_queue_take(struct ml_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    int c;
+    void *item = NULL;
+
+    _lock_take(thiz);
+
+    if (!_await_not_empty(thiz, NULL))
+    {
+        _unlock_take(thiz);
+        return NULL;
+    }
+
+    item = _dequeue(thiz);
+
+    c = atomic_fetch_sub(&thiz->_count, 1);
+    if (c > 1)
+        _notify(thiz, &thiz->_not_empty);
+
+    _unlock_take(thiz);
+
+    if (c == thiz->_capacity)
+        _signal_not_full(thiz);
+
+    return item;
+}
+
+static bool ml_queue_offer_until(struct ml_queue_t *const thiz, const void *const element, const struct timespec *const deadline)
+{
+    if (!thiz || !element)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    const uint32_t level = _level_of(thiz, element);
+    if (level == thiz->_levels)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    int c;
+
+    _lock_put(thiz);
+
+    if (!_await_not_full(thiz, deadline))
+        goto result_r;
+
+    struct _node_t *new_node = _node(thiz, element, level);
+    if (!new_node)
+    {
+        errno = ENOMEM;
+        goto result_r;
+    }
+
+    _enqueue(thiz, new_node);
+    c = atomic_fetch_add(&thiz->_count, 1);
+    if (c + 1 < thiz->_capacity)
+        _notify(thiz, &thiz->_not_full);
+
+    _unlock_put(thiz);
+
+    if (c == 0)
+        _signal_not_empty(thiz);
+
+    return true;
+
+result_r:
+    _unlock_put(thiz);
+    _reject(thiz, 1);
+
+    return false;
+}
+
+static bool ml_queue_offer_wait(struct ml_queue_t *const thiz, const void *const element,
+                                const uint64_t timeout, const struct time_unit_t *const unit)
+{
+    if (!thiz || !element || !unit)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    struct timespec timeo;
+
+    calc_timeout(&timeo, timeout, unit);
+
+    return ml_queue_offer_until(thiz, element, &timeo);
+}
+
+static void *ml_queue_poll_until(struct ml_queue_t *const thiz, const struct timespec *const deadline)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    void *item = NULL;
+    int c;
+
+    _lock_take(thiz);
+
+    if (!_await_not_empty(thiz, deadline))
+        goto result_r;
+
+    item = _dequeue(thiz);
+    c = atomic_fetch_sub(&thiz->_count, 1);
+    if (c > 1)
+        _notify(thiz, &thiz->_not_empty);
+
+    _unlock_take(thiz);
+
+    if (c == thiz->_capacity)
+        _signal_not_full(thiz);
+
+    return item;
+
+result_r:
+    _unlock_take(thiz);
+
+    return item;
+}
+
+static void *ml_queue_poll_wait(struct ml_queue_t *const thiz, const uint64_t timeout, const struct time_unit_t *const unit)
+{
+    if (!thiz || !unit)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    struct timespec timeo;
+
+    calc_timeout(&timeo, timeout, unit);
+
+    return ml_queue_poll_until(thiz, &timeo);
+}
+
+static uint32_t ml_queue_offer_batch(struct ml_queue_t *const thiz, void *const *elements, const uint32_t n)
+{
+    if (!thiz || !elements)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (!elements[i])
+        {
+            errno = EINVAL;
+            return 0;
+        }
+    }
+
+    if (n == 0)
+        return 0;
+
+    if (thiz->_count == thiz->_capacity)
+    {
+        _reject(thiz, n);
+        return 0;
+    }
+
+    uint32_t c;
+    uint32_t k;
+    struct _node_t *first;
+    struct _node_t *last;
+    struct _node_t *rest;
+
+    if (!_chain(thiz, elements, n, &first, &last))
+        return 0;
+
+    _lock_put(thiz);
+
+    k = thiz->_capacity - (uint32_t)thiz->_count;
+    if (k > n)
+        k = n;
+
+    if (atomic_load(&thiz->_closed))
+    {
+        errno = EPIPE;
+        k = 0;
+    }
+
+    if (k == 0)
+    {
+        rest = first;
+        goto insert_full;
+    }
+
+    rest = _enqueue_chain(thiz, first, k);
+
+    c = atomic_fetch_add(&thiz->_count, k);
+    if (c + k < thiz->_capacity)
+        _notify(thiz, &thiz->_not_full);
+
+    _unlock_put(thiz);
+
+    if (c == 0)
+        _signal_not_empty(thiz);
+
+    goto result_r;
+
+insert_full:
+    _unlock_put(thiz);
+
+result_r:
+    for (struct _node_t *next; rest != NULL; rest = next)
+    {
+        next = rest->next;
+        node_pool_release(thiz->_pool, rest);
+    }
+
+    if (k < n)
+        _reject(thiz, n - k);
+
+    return k;
+}
+
+static uint32_t ml_queue_put_batch(struct ml_queue_t *const thiz, void *const *elements, const uint32_t n)
+{
+    if (!thiz || !elements)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (!elements[i])
+        {
+            errno = EINVAL;
+            return 0;
+        }
+    }
+
+    if (n == 0)
+        return 0;
+
+    uint32_t c;
+    uint32_t k;
+    uint32_t done = 0;
+    struct _node_t *first;
+    struct _node_t *last;
+
+    if (!_chain(thiz, elements, n, &first, &last))
+        return 0;
+
+    /* one lock hold per run of free space, a single one unless the queue fills up */
+    while (done < n)
+    {
+        _lock_put(thiz);
+
+        if (!_await_not_full(thiz, NULL))
+            goto insert_closed;
+
+        k = thiz->_capacity - (uint32_t)thiz->_count;
+        if (k > n - done)
+            k = n - done;
+
+        first = _enqueue_chain(thiz, first, k);
+
+        c = atomic_fetch_add(&thiz->_count, k);
+        if (c + k < thiz->_capacity)
+            _notify(thiz, &thiz->_not_full);
+
+        _unlock_put(thiz);
+
+        if (c == 0)
+            _signal_not_empty(thiz);
+
+        done += k;
+    }
+
+    return done;
+
+insert_closed:
+    _unlock_put(thiz);
+
+    for (struct _node_t *next; first != NULL; first = next)
+    {
+        next = first->next;
+        node_pool_release(thiz->_pool, first);
+    }
+
+    _reject(thiz, n - done);
+
+    return done;
+}
+
+static uint32_t ml_queue_drain_to(struct ml_queue_t *const thiz, void **out, const uint32_t max)
+{
+    if (!thiz || !out)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    if (max == 0)
+        return 0;
+
+    if (thiz->_count == 0)
+    {
+        if (atomic_load(&thiz->_closed))
+            errno = EPIPE;
+        return 0;
+    }
+
+    uint32_t c;
+    uint32_t k;
+
+    _lock_take(thiz);
+
+    k = (uint32_t)thiz->_count;
+    if (k > max)
+        k = max;
+
+    if (k == 0)
+        goto take_empty;
+
+    _dequeue_chain(thiz, out, k);
+
+    c = atomic_fetch_sub(&thiz->_count, k);
+    if (c > k)
+        _notify(thiz, &thiz->_not_empty);
+
+    _unlock_take(thiz);
+
+    if (c == thiz->_capacity)
+        _signal_not_full(thiz);
+
+    return k;
+
+take_empty:
+    _unlock_take(thiz);
+
+    return 0;
+}
+
+static uint32_t ml_queue_take_batch(struct ml_queue_t *const thiz, void **out, const uint32_t min, const uint32_t max,
+                                    const uint64_t timeout, const struct time_unit_t *const unit)
+{
+    if (!thiz || !out)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    uint32_t c;
+    uint32_t k;
+    uint32_t taken = 0;
+    uint32_t need = (min > max) ? max : min;
+    struct timespec timeo;
+
+    if (unit)
+        calc_timeout(&timeo, timeout, unit);
+
+    _lock_take(thiz);
+
+    while (taken < max)
+    {
+        if (thiz->_count == 0 && (taken >= need || !_await_not_empty(thiz, unit ? &timeo : NULL)))
+            goto result_r;
+
+        k = (uint32_t)thiz->_count;
+        if (k > max - taken)
+            k = max - taken;
+
+        _dequeue_chain(thiz, out + taken, k);
+        taken += k;
+
+        c = atomic_fetch_sub(&thiz->_count, k);
+        if (c > k && taken >= need)
+            _notify(thiz, &thiz->_not_empty);
+
+        /* producers must not stay blocked while this thread waits for more */
+        if (c == thiz->_capacity)
+            _signal_not_full(thiz);
+
+        if (taken >= need)
+            break;
+    }
+
+result_r:
+    _unlock_take(thiz);
+
+    return taken;
+}
+
+static void ml_queue_close(struct ml_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = EINVAL;
+        return;
+    }
+
+    /* a put that passed its check under put lock completes before close returns */
+    _fully_lock(thiz);
+    atomic_store(&thiz->_closed, true);
+    _fully_unlock(thiz);
+
+    _notify_all(thiz, &thiz->_not_empty);
+    _notify_all(thiz, &thiz->_not_full);
+    event_fd_signal(&thiz->_readable);
+    event_fd_signal(&thiz->_writable);
+}
+
+static bool ml_queue_closed(struct ml_queue_t *const thiz)
+{
+    return atomic_load(&thiz->_closed);
+}
+
+static void ml_queue_stats(struct ml_queue_t *const thiz, struct queue_stats_t *const stats)
+{
+    if (!thiz || !stats)
+    {
+        errno = EINVAL;
+        return;
+    }
+
+    queue_counters_read(thiz->_stats, stats);
+}
+
+static int ml_queue_eventfd(struct ml_queue_t *const thiz, const enum queue_event_t event)
+{
+    if (!thiz)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    switch (event)
+    {
+    case QUEUE_EVENT_NOT_EMPTY:
+        return event_fd_open(&thiz->_readable, _not_empty, thiz);
+    case QUEUE_EVENT_NOT_FULL:
+        return event_fd_open(&thiz->_writable, _not_full, thiz);
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+struct blocking_queue_t *ml_queue(const uint32_t capacity, const uint32_t levels, uint32_t (*const level)(const void *))
+{
+    uint32_t i;
+
+    if (levels == 0 || levels > ML_QUEUE_MAX_LEVELS)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct ml_queue_t *const thiz = (struct ml_queue_t *)malloc(sizeof(struct ml_queue_t));
+    if (thiz == NULL)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    memset((void *)thiz, 0, sizeof(struct ml_queue_t));
+
+    thiz->_capacity = (capacity == 0) ? QUEUE_MAX_CAPACITY : capacity;
+    thiz->_levels = levels;
+    thiz->_level = level;
+
+    pthread_mutex_init(&thiz->_take_lock, NULL);
+    parker_init(&thiz->_not_empty);
+    pthread_mutex_init(&thiz->_put_lock, NULL);
+    parker_init(&thiz->_not_full);
+    event_fd_init(&thiz->_readable);
+    event_fd_init(&thiz->_writable);
+
+    thiz->_lanes = (struct _lane_t *)calloc(levels, sizeof(struct _lane_t));
+    if (!thiz->_lanes)
+    {
+        errno = ENOMEM;
+        goto mlQueue_err_1;
+    }
+
+    /* capacity nodes plus a head node per lane up to a bound, an unbounded queue grows on demand */
+    thiz->_pool = node_pool(sizeof(struct _node_t), (thiz->_capacity == QUEUE_MAX_CAPACITY) ? 0 :
+                            (thiz->_capacity < ML_QUEUE_PREALLOC ? thiz->_capacity + levels : ML_QUEUE_PREALLOC));
+    if (!thiz->_pool)
+    {
+        errno = ENOMEM;
+        goto mlQueue_err_1;
+    }
+
+    for (i = 0; i < levels; i++)
+    {
+        thiz->_lanes[i].head = _node(thiz, NULL, i);
+        if (!thiz->_lanes[i].head)
+        {
+            errno = ENOMEM;
+            goto mlQueue_err_2;
+        }
+
+        thiz->_lanes[i].last = thiz->_lanes[i].head;
+        atomic_init(&thiz->_lanes[i].count, 0);
+    }
+
+    thiz->_stats = queue_counters();
+    if (!thiz->_stats)
+    {
+        errno = ENOMEM;
+        goto mlQueue_err_2;
+    }
+
+    atomic_fetch_and(&thiz->_count, 0x0);
+    atomic_init(&thiz->_occupied, 0);
+    atomic_init(&thiz->_closed, false);
+
+    /* methods */
+    thiz->size = ml_queue_size;
+    thiz->clear = ml_queue_clear;
+    thiz->free = ml_queue_free;
+    thiz->offer = ml_queue_offer;
+    thiz->poll = ml_queue_poll;
+    thiz->peek = ml_queue_peek;
+    thiz->put = ml_queue_put;
+    thiz->offer_await = ml_queue_offer_wait;
+    thiz->take = ml_queue_take;
+    thiz->poll_await = ml_queue_poll_wait;
+    thiz->offer_batch = ml_queue_offer_batch;
+    thiz->put_batch = ml_queue_put_batch;
+    thiz->drain_to = ml_queue_drain_to;
+    thiz->take_batch = ml_queue_take_batch;
+    thiz->eventfd = ml_queue_eventfd;
+    thiz->close = ml_queue_close;
+    thiz->closed = ml_queue_closed;
+    thiz->stats = ml_queue_stats;
+    thiz->offer_until = ml_queue_offer_until;
+    thiz->poll_until = ml_queue_poll_until;
+
+    return (struct blocking_queue_t *)thiz;
+
+mlQueue_err_2:
+    while (i-- > 0)
+        node_pool_release(thiz->_pool, thiz->_lanes[i].head);
+    node_pool_free(thiz->_pool);
+
+mlQueue_err_1:
+    parker_destroy(&thiz->_not_empty);
+    parker_destroy(&thiz->_not_full);
+    event_fd_destroy(&thiz->_readable);
+    event_fd_destroy(&thiz->_writable);
+    pthread_mutex_destroy(&thiz->_take_lock);
+    pthread_mutex_destroy(&thiz->_put_lock);
+    free(thiz->_lanes);
+    free(thiz);
+
+    return NULL;
+}
+
+bool ml_queue_offer_level(struct blocking_queue_t *const queue, const void *const element, const uint32_t level)
+{
+    return _offer((struct ml_queue_t *)queue, element, level);
+}
+
+bool ml_queue_put_level(struct blocking_queue_t *const queue, const void *const element, const uint32_t level)
+{
+    return _put((struct ml_queue_t *)queue, element, level);
+}
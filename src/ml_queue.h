@@ -0,0 +1,48 @@
+#ifndef _ML_QUEUE_H_
+#define _ML_QUEUE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "blocking_queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Creates a multi-level blocking queue. Takes return the oldest element of
+ * the highest non-empty level, level levels - 1 first.
+ *
+ * @param capacity the capacity of this queue, shared by all levels, 0 means unbounded
+ * @param levels number of priority levels, 1 to 64
+ * @param level returns the level of an element for offer, put and the batch
+ *              methods, or NULL to put them all at level 0
+ * @return the queue, or NULL on failure
+ */
+extern struct blocking_queue_t *ml_queue(const uint32_t capacity, const uint32_t levels, uint32_t (*const level)(const void *));
+
+/**
+ * Inserts an element at a level like offer.
+ *
+ * @param queue queue returned by ml_queue
+ * @param element element
+ * @param level priority level, less than levels
+ * @return true if the element was added to this queue, else false
+ */
+extern bool ml_queue_offer_level(struct blocking_queue_t *const queue, const void *const element, const uint32_t level);
+
+/**
+ * Inserts an element at a level like put, waiting if necessary for space to become available.
+ *
+ * @param queue queue returned by ml_queue
+ * @param element element
+ * @param level priority level, less than levels
+ * @return true if the element was added to this queue, else false
+ */
+extern bool ml_queue_put_level(struct blocking_queue_t *const queue, const void *const element, const uint32_t level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
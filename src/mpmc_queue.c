@@ -0,0 +1,1026 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include "mpmc_queue.h"
+#include "cpu_util.h"
+#include "parker.h"
+#include "event_fd.h"
+#include "queue_stats.h"
+#include "time_util.h"
+
+/**
+ * queue slot structure
+ *
+ * seq equals the position of the next enqueue into this slot while it is
+ * free, and that position plus one once the element is published.
+ */
+struct _slot_t
+{
+    atomic_size_t seq;
+    const void *item;
+};
+
+/**
+ * multi-producer multi-consumer queue
+ *
+ * bounded ring where producers and consumers claim positions with a single
+ * CAS and hand slots over through the per-slot sequence numbers.
+ */
+struct mpmc_queue_t
+{
+
+    /**
+     * Returns the number of elements in this collection.
+     *
+     * @param thiz this
+     * @return the number of elements in this collection
+     */
+    uint32_t (*size)(struct mpmc_queue_t *const thiz);
+
+    /**
+     * Removes all of the elements from this collection.
+     *
+     *  @param thiz this
+     */
+    void (*clear)(struct mpmc_queue_t *const thiz);
+
+    /**
+     * Free collection
+     *
+     * @param thiz this
+     */
+    void (*free)(struct mpmc_queue_t *const thiz);
+
+    /**
+     * Inserts the specified element into this queue if it is possible to do
+     * so immediately without violating capacity restrictions.
+     *
+     * @param thiz this
+     * @param element element
+     * @return true if the element was added to this queue, else false
+     */
+    bool (*offer)(struct mpmc_queue_t *const thiz, const void *const element);
+
+    /**
+     * Retrieves and removes the head of this queue,
+     * or returns NULL if this queue is empty.
+     *
+     * @param thiz this
+     * @return the head of this queue, or NULL if this queue is empty
+     */
+    void *(*poll)(struct mpmc_queue_t *const thiz);
+
+    /**
+     * Retrieves, but does not remove, the head of this queue,
+     * or returns NULL if this queue is empty.
+     *
+     * @param thiz this
+     * @return the head of this queue, or NULL if this queue is empty
+     */
+    void *(*peek)(struct mpmc_queue_t *const thiz);
+
+    /**
+     * Inserts the specified element into this queue, waiting if necessary for space to become available.
+     *
+     * @param thiz this
+     * @param element the element to add
+     */
+    bool (*put)(struct mpmc_queue_t *const thiz, const void *const element);
+
+    /**
+     * Inserts the specified element into this queue, waiting up to the
+     * specified wait time if necessary for space to become available.
+     *
+     * @param thiz this
+     * @param element the element to add
+     * @param timeout how long to wait before giving up, in units of unit
+     * @param unit a time_unit_t determining how to interpret the timeout parameter
+     * @return true if successful, or false if the specified waiting time elapses before space is available
+     */
+    bool (*offer_await)(struct mpmc_queue_t *const thiz, const void *const element, const uint64_t timeout, const struct time_unit_t *const unit);
+
+    /**
+     * Retrieves and removes the head of this queue, waiting if necessary until an element becomes available.
+     *
+     * @param thiz this
+     * @return the head of this queue
+     */
+    void *(*take)(struct mpmc_queue_t *const thiz);
+
+    /**
+     * Retrieves and removes the head of this queue, waiting up to the
+     * specified wait time if necessary for an element to become available.
+     *
+     * @param thiz this
+     * @param timeout how long to wait before giving up, in units of unit
+     * @param unit a time_unit_t determining how to interpret the timeout parameter
+     * @return the head of this queue, or NULL if the specified waiting time elapses before an element is available
+     */
+    void *(*poll_await)(struct mpmc_queue_t *const thiz, const uint64_t timeout, const struct time_unit_t *const unit);
+
+    /**
+     * Inserts as many of the specified elements as possible without waiting,
+     * in order, with a single acquisition of the queue.
+     *
+     * @param thiz this
+     * @param elements the elements to add
+     * @param n number of elements
+     * @return the number of elements added, always a prefix of elements
+     */
+    uint32_t (*offer_batch)(struct mpmc_queue_t *const thiz, void *const *elements, const uint32_t n);
+
+    /**
+     * Inserts all of the specified elements, in order, waiting if necessary for space to become available.
+     *
+     * @param thiz this
+     * @param elements the elements to add
+     * @param n number of elements
+     * @return the number of elements added, n unless an error occurred
+     */
+    uint32_t (*put_batch)(struct mpmc_queue_t *const thiz, void *const *elements, const uint32_t n);
+
+    /**
+     * Removes at most max available elements from this queue without waiting.
+     *
+     * @param thiz this
+     * @param out receives the removed elements in queue order
+     * @param max the maximum number of elements to remove
+     * @return the number of elements removed
+     */
+    uint32_t (*drain_to)(struct mpmc_queue_t *const thiz, void **out, const uint32_t max);
+
+    /**
+     * Removes at most max elements from this queue, waiting up to the
+     * specified wait time if necessary until at least min have been removed.
+     *
+     * @param thiz this
+     * @param out receives the removed elements in queue order
+     * @param min the number of elements to wait for
+     * @param max the maximum number of elements to remove
+     * @param timeout how long to wait before giving up, in units of unit
+     * @param unit a time_unit_t determining how to interpret the timeout parameter, or NULL to wait without limit
+     * @return the number of elements removed, less than min only if the waiting time elapsed
+     */
+    uint32_t (*take_batch)(struct mpmc_queue_t *const thiz, void **out, const uint32_t min, const uint32_t max,
+                           const uint64_t timeout, const struct time_unit_t *const unit);
+
+    /**
+     * Returns a non-blocking eventfd that becomes readable when this queue
+     * turns ready for the event, for use with poll/epoll. The descriptor is
+     * owned by the queue and closed by free. Read it before draining the
+     * queue, and drain until the queue reports nothing left.
+     *
+     * @param thiz this
+     * @param event QUEUE_EVENT_NOT_EMPTY or QUEUE_EVENT_NOT_FULL
+     * @return the descriptor, or -1 with errno set
+     */
+    int (*eventfd)(struct mpmc_queue_t *const thiz, const enum queue_event_t event);
+
+    /**
+     * Closes this queue and wakes every blocked thread. Later puts fail
+     * with errno EPIPE, takes return the remaining elements and then fail
+     * with errno EPIPE. A queue cannot be reopened.
+     *
+     * @param thiz this
+     */
+    void (*close)(struct mpmc_queue_t *const thiz);
+
+    /**
+     * Returns true if this queue has been closed.
+     *
+     * @param thiz this
+     * @return true if this queue has been closed
+     */
+    bool (*closed)(struct mpmc_queue_t *const thiz);
+
+    /**
+     * Reads the operational counters of this queue. The lock counters stay
+     * 0, there is no lock.
+     *
+     * @param thiz this
+     * @param stats filled with the totals since the queue was created
+     */
+    void (*stats)(struct mpmc_queue_t *const thiz, struct queue_stats_t *const stats);
+
+    /**
+     * Inserts the specified element into this queue, waiting until the
+     * deadline if necessary for space to become available.
+     *
+     * @param thiz this
+     * @param element the element to add
+     * @param deadline absolute CLOCK_MONOTONIC time to give up at, or NULL to wait without limit
+     * @return true if successful, or false if the deadline passes before space is available
+     */
+    bool (*offer_until)(struct mpmc_queue_t *const thiz, const void *const element, const struct timespec *const deadline);
+
+    /**
+     * Retrieves and removes the head of this queue, waiting until the
+     * deadline if necessary for an element to become available.
+     *
+     * @param thiz this
+     * @param deadline absolute CLOCK_MONOTONIC time to give up at, or NULL to wait without limit
+     * @return the head of this queue, or NULL if the deadline passes before an element is available
+     */
+    void *(*poll_until)(struct mpmc_queue_t *const thiz, const struct timespec *const deadline);
+
+    /* queue capacity, ring length */
+    uint32_t _capacity;
+
+    /* ring index mask */
+    size_t _mask;
+
+    /* slot ring */
+    struct _slot_t *_slots;
+
+    /* parked consumers : queue non-empty */
+    struct parker_t _not_empty;
+
+    /* parked producers : queue non-full */
+    struct parker_t _not_full;
+
+    /* readiness descriptor : queue non-empty */
+    struct event_fd_t _readable;
+
+    /* readiness descriptor : queue non-full */
+    struct event_fd_t _writable;
+
+    /* set once by close */
+    atomic_bool _closed;
+
+    /* operational counters */
+    struct queue_counters_t *_stats;
+
+    /* position of the next enqueue */
+    CACHE_ALIGNED atomic_size_t _enqueue_pos;
+
+    /* position of the next dequeue */
+    CACHE_ALIGNED atomic_size_t _dequeue_pos;
+};
+
+#define MPMC_QUEUE_MAX_CAPACITY 0x80000000U
+
+static bool _not_empty(void *arg)
+{
+    struct mpmc_queue_t *const thiz = (struct mpmc_queue_t *)arg;
+
+    if (atomic_load(&thiz->_closed))
+        return true;
+    const size_t pos = atomic_load_explicit(&thiz->_dequeue_pos, memory_order_relaxed);
+
+    return atomic_load_explicit(&thiz->_slots[pos & thiz->_mask].seq, memory_order_acquire) == pos + 1;
+}
+
+static bool _not_full(void *arg)
+{
+    struct mpmc_queue_t *const thiz = (struct mpmc_queue_t *)arg;
+
+    if (atomic_load(&thiz->_closed))
+        return true;
+    const size_t pos = atomic_load_explicit(&thiz->_enqueue_pos, memory_order_relaxed);
+
+    return atomic_load_explicit(&thiz->_slots[pos & thiz->_mask].seq, memory_order_acquire) == pos;
+}
+
+static inline bool _push(struct mpmc_queue_t *const thiz, const void *const element, size_t *const at)
+{
+    struct _slot_t *slot;
+    size_t pos = atomic_load_explicit(&thiz->_enqueue_pos, memory_order_relaxed);
+
+    for (;;)
+    {
+        slot = &thiz->_slots[pos & thiz->_mask];
+
+        const size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        const intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+
+        if (dif == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&thiz->_enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if (dif < 0)
+        {
+            /* slot still holds the element of the previous lap */
+            return false;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&thiz->_enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    slot->item = element;
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+
+    *at = pos;
+
+    return true;
+}
+
+static inline void *_pop(struct mpmc_queue_t *const thiz, size_t *const at)
+{
+    struct _slot_t *slot;
+    size_t pos = atomic_load_explicit(&thiz->_dequeue_pos, memory_order_relaxed);
+
+    for (;;)
+    {
+        slot = &thiz->_slots[pos & thiz->_mask];
+
+        const size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        const intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+
+        if (dif == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&thiz->_dequeue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if (dif < 0)
+        {
+            /* slot not published yet */
+            return NULL;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&thiz->_dequeue_pos, memory_order_relaxed);
+        }
+    }
+
+    void *x = (void *)slot->item;
+    atomic_store_explicit(&slot->seq, pos + thiz->_mask + 1, memory_order_release);
+
+    *at = pos;
+
+    return x;
+}
+
+/**
+ * Signals the readiness descriptor if consumers had reached position pos, the
+ * first one published by the caller. Called after parker_notify, whose fence
+ * orders the slot store before the position load.
+ */
+static inline void _signal_readable(struct mpmc_queue_t *const thiz, const size_t pos)
+{
+    if (event_fd_armed(&thiz->_readable) &&
+        (intptr_t)(atomic_load_explicit(&thiz->_dequeue_pos, memory_order_relaxed) - pos) >= 0)
+        event_fd_signal(&thiz->_readable);
+}
+
+/**
+ * Signals the readiness descriptor if producers had reached the lap after
+ * position pos, the first one consumed by the caller. Called after
+ * parker_notify as well.
+ */
+static inline void _signal_writable(struct mpmc_queue_t *const thiz, const size_t pos)
+{
+    if (event_fd_armed(&thiz->_writable) &&
+        (intptr_t)(atomic_load_explicit(&thiz->_enqueue_pos, memory_order_relaxed) - (pos + thiz->_mask + 1)) >= 0)
+        event_fd_signal(&thiz->_writable);
+}
+
+/**
+ * Waits for ready, counting the wait when the queue is not ready at once.
+ *
+ * @return the last value returned by ready, false once the deadline has passed
+ */
+static inline bool _await(struct mpmc_queue_t *const thiz, struct parker_t *const p, bool (*const ready)(void *),
+                          const struct timespec *const deadline)
+{
+    if (ready(thiz))
+        return true;
+
+    const uint64_t start = queue_counters_wait_begin();
+    const bool r = parker_await(p, ready, thiz, deadline);
+
+    queue_counters_wait_end(thiz->_stats, start, !r);
+
+    return r;
+}
+
+/**
+ * Wakes one parked thread, counting the wakeup if one was sent.
+ */
+static inline void _notify(struct mpmc_queue_t *const thiz, struct parker_t *const p)
+{
+    if (parker_notify(p))
+        queue_counters_add(thiz->_stats, QUEUE_STAT_SIGNALS, 1);
+}
+
+/**
+ * Wakes up to n parked threads, one per element published or consumed.
+ */
+static inline void _notify_n(struct mpmc_queue_t *const thiz, struct parker_t *const p, const uint32_t n)
+{
+    if (parker_notify_n(p, n))
+        queue_counters_add(thiz->_stats, QUEUE_STAT_SIGNALS, 1);
+}
+
+static inline void _notify_all(struct mpmc_queue_t *const thiz, struct parker_t *const p)
+{
+    if (parker_notify_all(p))
+        queue_counters_add(thiz->_stats, QUEUE_STAT_SIGNALS, 1);
+}
+
+/**
+ * Counts elements an offer or put could not insert.
+ */
+static inline void _reject(struct mpmc_queue_t *const thiz, const uint32_t n)
+{
+    queue_counters_add(thiz->_stats, QUEUE_STAT_REJECTED, n);
+}
+
+static inline bool _enqueue(struct mpmc_queue_t *const thiz, const void *const element)
+{
+    size_t pos;
+
+    /* a full ring seen by an armed producer is confirmed after a fence */
+    if (!_push(thiz, element, &pos) && !(event_fd_fence(&thiz->_writable) && _push(thiz, element, &pos)))
+        return false;
+
+    _notify(thiz, &thiz->_not_empty);
+    _signal_readable(thiz, pos);
+
+    return true;
+}
+
+static inline void *_dequeue(struct mpmc_queue_t *const thiz)
+{
+    size_t pos;
+    void *x = _pop(thiz, &pos);
+
+    /* an empty ring seen by an armed consumer is confirmed after a fence */
+    if (!x && event_fd_fence(&thiz->_readable))
+        x = _pop(thiz, &pos);
+
+    if (x)
+    {
+        _notify(thiz, &thiz->_not_full);
+        _signal_writable(thiz, pos);
+    }
+
+    return x;
+}
+
+/**
+ * Publishes up to n elements, waking up to as many parked consumers.
+ */
+static inline uint32_t _enqueue_batch(struct mpmc_queue_t *const thiz, void *const *elements, const uint32_t n)
+{
+    uint32_t k = 0;
+    size_t first = 0, pos;
+
+    while (k < n && _push(thiz, elements[k], &pos))
+    {
+        if (k++ == 0)
+            first = pos;
+    }
+
+    if (k == 0 && n > 0 && event_fd_fence(&thiz->_writable) && _push(thiz, elements[0], &first))
+        k++;
+
+    if (k > 0)
+    {
+        _notify_n(thiz, &thiz->_not_empty, k);
+        _signal_readable(thiz, first);
+    }
+
+    return k;
+}
+
+/**
+ * Consumes up to max elements, waking up to as many parked producers.
+ */
+static inline uint32_t _dequeue_batch(struct mpmc_queue_t *const thiz, void **const out, const uint32_t max)
+{
+    uint32_t k = 0;
+    size_t first = 0, pos;
+
+    while (k < max && (out[k] = _pop(thiz, &pos)) != NULL)
+    {
+        if (k++ == 0)
+            first = pos;
+    }
+
+    if (k == 0 && max > 0 && event_fd_fence(&thiz->_readable) && (out[0] = _pop(thiz, &first)) != NULL)
+        k++;
+
+    if (k > 0)
+    {
+        _notify_n(thiz, &thiz->_not_full, k);
+        _signal_writable(thiz, first);
+    }
+
+    return k;
+}
+
+static uint32_t mpmc_queue_size(struct mpmc_queue_t *const thiz)
+{
+    const size_t d = atomic_load_explicit(&thiz->_dequeue_pos, memory_order_acquire);
+    const intptr_t c = (intptr_t)(atomic_load_explicit(&thiz->_enqueue_pos, memory_order_acquire) - d);
+
+    if (c < 0)
+        return 0;
+
+    return c > thiz->_capacity ? thiz->_capacity : (uint32_t)c;
+}
+
+static void mpmc_queue_clear(struct mpmc_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return;
+    }
+
+    for (void *item; (item = _dequeue(thiz)) != NULL;)
+        free(item);
+
+    return;
+}
+
+static void mpmc_queue_free(struct mpmc_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return;
+    }
+
+    thiz->clear(thiz);
+
+    parker_destroy(&thiz->_not_empty);
+    parker_destroy(&thiz->_not_full);
+    event_fd_destroy(&thiz->_readable);
+    event_fd_destroy(&thiz->_writable);
+
+    queue_counters_free(thiz->_stats);
+    free(thiz->_slots);
+    free(thiz);
+}
+
+static bool mpmc_queue_offer(struct mpmc_queue_t *const thiz, const void *const element)
+{
+    if (!thiz || !element)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (atomic_load(&thiz->_closed))
+    {
+        _reject(thiz, 1);
+        errno = EPIPE;
+        return false;
+    }
+
+    if (!_enqueue(thiz, element))
+    {
+        _reject(thiz, 1);
+        return false;
+    }
+
+    return true;
+}
+
+static void *mpmc_queue_poll(struct mpmc_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    /* read before trying, so elements put before close are still taken */
+    const bool closed = atomic_load(&thiz->_closed);
+    void *item = _dequeue(thiz);
+
+    if (!item && closed)
+        errno = EPIPE;
+
+    return item;
+}
+
+static void *mpmc_queue_peek(struct mpmc_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    const size_t pos = atomic_load_explicit(&thiz->_dequeue_pos, memory_order_relaxed);
+    struct _slot_t *slot = &thiz->_slots[pos & thiz->_mask];
+
+    if (atomic_load_explicit(&slot->seq, memory_order_acquire) != pos + 1)
+        return NULL;
+
+    return (void *)slot->item;
+}
+
+static bool mpmc_queue_put(struct mpmc_queue_t *const thiz, const void *const element)
+{
+    if (!thiz || !element)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    while (!atomic_load(&thiz->_closed))
+    {
+        if (_enqueue(thiz, element))
+            return true;
+        _await(thiz, &thiz->_not_full, _not_full, NULL);
+    }
+
+    _reject(thiz, 1);
+    errno = EPIPE;
+    return false;
+}
+
+static void *mpmc_queue_take(struct mpmc_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    void *item;
+    bool closed;
+
+    for (;;)
+    {
+        closed = atomic_load(&thiz->_closed);
+        if ((item = _dequeue(thiz)) != NULL || closed)
+            break;
+        _await(thiz, &thiz->_not_empty, _not_empty, NULL);
+    }
+
+    if (!item)
+        errno = EPIPE;
+
+    return item;
+}
+
+static bool mpmc_queue_offer_until(struct mpmc_queue_t *const thiz, const void *const element, const struct timespec *const deadline)
+{
+    if (!thiz || !element)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (atomic_load(&thiz->_closed))
+        goto offer_closed;
+
+    if (_enqueue(thiz, element))
+        return true;
+
+    while (_await(thiz, &thiz->_not_full, _not_full, deadline))
+    {
+        if (atomic_load(&thiz->_closed))
+            goto offer_closed;
+
+        if (_enqueue(thiz, element))
+            return true;
+    }
+
+    _reject(thiz, 1);
+    return false;
+
+offer_closed:
+    _reject(thiz, 1);
+    errno = EPIPE;
+    return false;
+}
+
+static bool mpmc_queue_offer_wait(struct mpmc_queue_t *const thiz, const void *const element,
+                                  const uint64_t timeout, const struct time_unit_t *const unit)
+{
+    if (!thiz || !element || !unit)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    /* the deadline is only needed once the queue turns out full */
+    if (!atomic_load(&thiz->_closed) && _enqueue(thiz, element))
+        return true;
+
+    struct timespec timeo;
+
+    calc_timeout(&timeo, timeout, unit);
+
+    return mpmc_queue_offer_until(thiz, element, &timeo);
+}
+
+static void *mpmc_queue_poll_until(struct mpmc_queue_t *const thiz, const struct timespec *const deadline)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    bool closed = atomic_load(&thiz->_closed);
+    void *item;
+
+    if ((item = _dequeue(thiz)) != NULL)
+        return item;
+
+    while (!closed && _await(thiz, &thiz->_not_empty, _not_empty, deadline))
+    {
+        closed = atomic_load(&thiz->_closed);
+        if ((item = _dequeue(thiz)) != NULL)
+            return item;
+    }
+
+    if (closed)
+        errno = EPIPE;
+
+    return NULL;
+}
+
+static void *mpmc_queue_poll_wait(struct mpmc_queue_t *const thiz, const uint64_t timeout, const struct time_unit_t *const unit)
+{
+    if (!thiz || !unit)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    void *item;
+
+    /* the deadline is only needed once the queue turns out empty */
+    if ((item = _dequeue(thiz)) != NULL)
+        return item;
+
+    struct timespec timeo;
+
+    calc_timeout(&timeo, timeout, unit);
+
+    return mpmc_queue_poll_until(thiz, &timeo);
+}
+
+static uint32_t mpmc_queue_offer_batch(struct mpmc_queue_t *const thiz, void *const *elements, const uint32_t n)
+{
+    if (!thiz || !elements)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (!elements[i])
+        {
+            errno = EINVAL;
+            return 0;
+        }
+    }
+
+    if (atomic_load(&thiz->_closed))
+    {
+        _reject(thiz, n);
+        errno = EPIPE;
+        return 0;
+    }
+
+    const uint32_t k = _enqueue_batch(thiz, elements, n);
+
+    if (k < n)
+        _reject(thiz, n - k);
+
+    return k;
+}
+
+static uint32_t mpmc_queue_put_batch(struct mpmc_queue_t *const thiz, void *const *elements, const uint32_t n)
+{
+    if (!thiz || !elements)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (!elements[i])
+        {
+            errno = EINVAL;
+            return 0;
+        }
+    }
+
+    uint32_t done = 0;
+
+    while (!atomic_load(&thiz->_closed))
+    {
+        done += _enqueue_batch(thiz, elements + done, n - done);
+        if (done == n)
+            return done;
+        _await(thiz, &thiz->_not_full, _not_full, NULL);
+    }
+
+    _reject(thiz, n - done);
+    errno = EPIPE;
+    return done;
+}
+
+static uint32_t mpmc_queue_drain_to(struct mpmc_queue_t *const thiz, void **out, const uint32_t max)
+{
+    if (!thiz || !out)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    const bool closed = atomic_load(&thiz->_closed);
+    const uint32_t k = _dequeue_batch(thiz, out, max);
+
+    if (k == 0 && max > 0 && closed)
+        errno = EPIPE;
+
+    return k;
+}
+
+static uint32_t mpmc_queue_take_batch(struct mpmc_queue_t *const thiz, void **out, const uint32_t min, const uint32_t max,
+                                      const uint64_t timeout, const struct time_unit_t *const unit)
+{
+    if (!thiz || !out)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    uint32_t need = (min > max) ? max : min;
+    bool closed = atomic_load(&thiz->_closed);
+    uint32_t taken = _dequeue_batch(thiz, out, max);
+    struct timespec timeo;
+
+    if (taken >= need)
+        return taken;
+
+    if (unit)
+        calc_timeout(&timeo, timeout, unit);
+
+    while (taken < need && !closed && _await(thiz, &thiz->_not_empty, _not_empty, unit ? &timeo : NULL))
+    {
+        closed = atomic_load(&thiz->_closed);
+        taken += _dequeue_batch(thiz, out + taken, max - taken);
+    }
+
+    if (taken < need && closed)
+        errno = EPIPE;
+
+    return taken;
+}
+
+static int mpmc_queue_eventfd(struct mpmc_queue_t *const thiz, const enum queue_event_t event)
+{
+    if (!thiz)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    switch (event)
+    {
+    case QUEUE_EVENT_NOT_EMPTY:
+        return event_fd_open(&thiz->_readable, _not_empty, thiz);
+    case QUEUE_EVENT_NOT_FULL:
+        return event_fd_open(&thiz->_writable, _not_full, thiz);
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+static void mpmc_queue_close(struct mpmc_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = EINVAL;
+        return;
+    }
+
+    if (atomic_exchange(&thiz->_closed, true))
+        return;
+
+    _notify_all(thiz, &thiz->_not_empty);
+    _notify_all(thiz, &thiz->_not_full);
+    event_fd_signal(&thiz->_readable);
+    event_fd_signal(&thiz->_writable);
+}
+
+static bool mpmc_queue_closed(struct mpmc_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    return atomic_load(&thiz->_closed);
+}
+
+static void mpmc_queue_stats(struct mpmc_queue_t *const thiz, struct queue_stats_t *const stats)
+{
+    if (!thiz || !stats)
+    {
+        errno = EINVAL;
+        return;
+    }
+
+    queue_counters_read(thiz->_stats, stats);
+
+#ifndef DISABLE_CLQUEUE_STATS
+    /* a position is only taken by the element filling or emptying it */
+    stats->offers = atomic_load_explicit(&thiz->_enqueue_pos, memory_order_relaxed);
+    stats->takes = atomic_load_explicit(&thiz->_dequeue_pos, memory_order_relaxed);
+#endif
+}
+
+struct blocking_queue_t *mpmc_queue(const uint32_t capacity)
+{
+    struct mpmc_queue_t *thiz = NULL;
+    uint32_t length = 2;
+
+    if (capacity == 0 || capacity > MPMC_QUEUE_MAX_CAPACITY)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    while (length < capacity)
+        length <<= 1;
+
+    if (posix_memalign((void **)&thiz, CACHE_LINE_SIZE, sizeof(struct mpmc_queue_t)) != 0)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    memset((void *)thiz, 0, sizeof(struct mpmc_queue_t));
+
+    if (posix_memalign((void **)&thiz->_slots, CACHE_LINE_SIZE, length * sizeof(struct _slot_t)) != 0)
+    {
+        free(thiz);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    thiz->_stats = queue_counters();
+    if (!thiz->_stats)
+    {
+        free(thiz->_slots);
+        free(thiz);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < length; i++)
+    {
+        atomic_init(&thiz->_slots[i].seq, i);
+        thiz->_slots[i].item = NULL;
+    }
+
+    thiz->_capacity = length;
+    thiz->_mask = length - 1;
+
+    atomic_init(&thiz->_enqueue_pos, 0);
+    atomic_init(&thiz->_dequeue_pos, 0);
+
+    parker_init(&thiz->_not_empty);
+    parker_init(&thiz->_not_full);
+    event_fd_init(&thiz->_readable);
+    event_fd_init(&thiz->_writable);
+    atomic_init(&thiz->_closed, false);
+
+    /* methods */
+    thiz->size = mpmc_queue_size;
+    thiz->clear = mpmc_queue_clear;
+    thiz->free = mpmc_queue_free;
+    thiz->offer = mpmc_queue_offer;
+    thiz->poll = mpmc_queue_poll;
+    thiz->peek = mpmc_queue_peek;
+    thiz->put = mpmc_queue_put;
+    thiz->offer_await = mpmc_queue_offer_wait;
+    thiz->take = mpmc_queue_take;
+    thiz->poll_await = mpmc_queue_poll_wait;
+    thiz->offer_batch = mpmc_queue_offer_batch;
+    thiz->put_batch = mpmc_queue_put_batch;
+    thiz->drain_to = mpmc_queue_drain_to;
+    thiz->take_batch = mpmc_queue_take_batch;
+    thiz->eventfd = mpmc_queue_eventfd;
+    thiz->close = mpmc_queue_close;
+    thiz->closed = mpmc_queue_closed;
+    thiz->stats = mpmc_queue_stats;
+    thiz->offer_until = mpmc_queue_offer_until;
+    thiz->poll_until = mpmc_queue_poll_until;
+
+    return (struct blocking_queue_t *)thiz;
+}
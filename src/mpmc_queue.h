@@ -0,0 +1,26 @@
+#ifndef _MPMC_QUEUE_H_
+#define _MPMC_QUEUE_H_
+
+#include <stdint.h>
+#include "blocking_queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Creates a multi-producer multi-consumer blocking queue.
+ *
+ * offer and poll never take a lock. peek is only a hint while other
+ * consumers are running, the returned element may already be taken.
+ *
+ * @param capacity the capacity of this queue, rounded up to a power of two
+ * @return the queue, or NULL on failure
+ */
+extern struct blocking_queue_t *mpmc_queue(const uint32_t capacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
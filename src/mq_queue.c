@@ -0,0 +1,511 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include "mq_queue.h"
+#include "cpu_util.h"
+#include "heap.h"
+#include "time_util.h"
+
+/* heaps per online cpu when the caller leaves it to us */
+#define MQ_QUEUE_HEAPS_PER_CPU 2
+
+/* random picks poll makes before it scans every heap in turn */
+#define MQ_QUEUE_TRIES 8
+
+/* one poll in this many per thread measures its rank error */
+#define MQ_QUEUE_SAMPLE 64
+
+/* elements a sample counts per heap at most, bounding the time it holds the lock */
+#define MQ_QUEUE_SAMPLE_LIMIT 1024
+
+/* heap slots allocated up front, each heap doubles from there */
+#define MQ_QUEUE_INITIAL_LENGTH 64
+
+/**
+ * sequential heap with its lock, one per cache line
+ */
+struct _mq_heap_t
+{
+    CACHE_ALIGNED atomic_bool lock;
+
+    /* heap size readable without the lock, so empty heaps are skipped */
+    atomic_uint count;
+
+    struct heap_t heap;
+};
+
+/**
+ * multi priority queue
+ *
+ * relaxed concurrent priority queue over try-locked sequential heaps
+ */
+struct mq_queue_t
+{
+
+    /**
+     * Returns the number of elements in this collection.
+     *
+     * @param thiz this
+     * @return the number of elements in this collection
+     */
+    uint32_t (*size)(struct mq_queue_t *const thiz);
+
+    /**
+     * Removes all of the elements from this collection.
+     *
+     *  @param thiz this
+     */
+    void (*clear)(struct mq_queue_t *const thiz);
+
+    /**
+     * Free collection
+     *
+     * @param thiz this
+     */
+    void (*free)(struct mq_queue_t *const thiz);
+
+    /**
+     * Inserts the specified element into this queue if it is possible to do
+     * so immediately without violating capacity restrictions.
+     *
+     * @param thiz this
+     * @param element element
+     * @return true if the element was added to this queue, else false
+     */
+    bool (*offer)(struct mq_queue_t *const thiz, const void *const element);
+
+    /**
+     * Retrieves and removes the head of this queue,
+     * or returns NULL if this queue is empty.
+     *
+     * @param thiz this
+     * @return the head of this queue, or NULL if this queue is empty
+     */
+    void *(*poll)(struct mq_queue_t *const thiz);
+
+    /**
+     * Retrieves, but does not remove, the head of this queue,
+     * or returns NULL if this queue is empty.
+     *
+     * @param thiz this
+     * @return the head of this queue, or NULL if this queue is empty
+     */
+    void *(*peek)(struct mq_queue_t *const thiz);
+
+    /* sort condition function */
+    int32_t (*_compare)(const void *, const void *);
+
+    /* heaps */
+    struct _mq_heap_t *_heaps;
+
+    /* number of heaps */
+    uint32_t _length;
+
+    /* number of enqueued elements */
+    CACHE_ALIGNED atomic_size_t _enqueued;
+
+    /* number of dequeued elements */
+    CACHE_ALIGNED atomic_size_t _dequeued;
+
+    /* sampled polls and the better elements they counted, see _sample */
+    CACHE_ALIGNED atomic_size_t _samples;
+    atomic_size_t _ranks;
+};
+
+static inline bool _try_lock(struct _mq_heap_t *const h)
+{
+    return !atomic_load_explicit(&h->lock, memory_order_relaxed) &&
+           !atomic_exchange_explicit(&h->lock, true, memory_order_acquire);
+}
+
+static inline void _lock(struct _mq_heap_t *const h)
+{
+    while (!_try_lock(h))
+        cpu_relax();
+}
+
+static inline void _unlock(struct _mq_heap_t *const h)
+{
+    atomic_store_explicit(&h->count, heap_size(&h->heap), memory_order_relaxed);
+    atomic_store_explicit(&h->lock, false, memory_order_release);
+}
+
+static inline bool _empty(struct _mq_heap_t *const h)
+{
+    return atomic_load_explicit(&h->count, memory_order_relaxed) == 0;
+}
+
+/**
+ * Returns a random heap.
+ */
+static inline struct _mq_heap_t *_random(struct mq_queue_t *const thiz)
+{
+    static __thread uint32_t seed;
+
+    if (seed == 0)
+        seed = ((uint32_t)(uintptr_t)&seed ^ (uint32_t)nano_time()) | 1;
+
+    /* xorshift32 */
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+
+    return &thiz->_heaps[((uint64_t)seed * thiz->_length) >> 32];
+}
+
+/**
+ * Locks the heap holding the head to take, the better of two random heaps,
+ * or every heap in turn once random picks keep missing.
+ *
+ * @return the locked heap, or NULL if every heap was empty
+ */
+static struct _mq_heap_t *_acquire(struct mq_queue_t *const thiz)
+{
+    struct _mq_heap_t *a;
+    struct _mq_heap_t *b;
+    struct _mq_heap_t *t;
+
+    for (uint32_t tries = 0; tries < MQ_QUEUE_TRIES; tries++)
+    {
+        a = _random(thiz);
+        b = _random(thiz);
+
+        /* empty heaps are passed over without locking */
+        if (b == a || _empty(b))
+            b = NULL;
+
+        if (_empty(a))
+        {
+            a = b;
+            b = NULL;
+        }
+
+        if (!a || !_try_lock(a))
+            continue;
+
+        /* the other heap is busy, take from this one alone */
+        if (b && !_try_lock(b))
+            b = NULL;
+
+        if (b)
+        {
+            if (heap_size(&a->heap) == 0 ||
+                (heap_size(&b->heap) > 0 && thiz->_compare(heap_peek(&b->heap), heap_peek(&a->heap)) < 0))
+            {
+                t = a;
+                a = b;
+                b = t;
+            }
+
+            _unlock(b);
+        }
+
+        if (heap_size(&a->heap) > 0)
+            return a;
+
+        _unlock(a);
+    }
+
+    /* scan from a random heap so scanning threads spread out */
+    t = _random(thiz);
+    for (uint32_t i = 0; i < thiz->_length; i++)
+    {
+        a = &thiz->_heaps[(t - thiz->_heaps + i) % thiz->_length];
+        if (_empty(a))
+            continue;
+
+        _lock(a);
+
+        if (heap_size(&a->heap) > 0)
+            return a;
+
+        _unlock(a);
+    }
+
+    return NULL;
+}
+
+/**
+ * Counts the elements of the subheap at i that come before item, up to
+ * limit. A node after item hides its whole subheap, so only the counted
+ * elements and their children are visited.
+ */
+static uint32_t _before(struct mq_queue_t *const thiz, const struct heap_t *const heap, const uint32_t i,
+                        const void *const item, const uint32_t limit)
+{
+    uint32_t n = 1;
+
+    if (i >= heap_size(heap) || thiz->_compare(heap_at(heap, i), item) >= 0)
+        return 0;
+
+    for (uint64_t c = (uint64_t)i * HEAP_ARITY + 1; c <= (uint64_t)i * HEAP_ARITY + HEAP_ARITY && n < limit; c++)
+    {
+        if (c >= heap_size(heap))
+            break;
+
+        n += _before(thiz, heap, (uint32_t)c, item, limit - n);
+    }
+
+    return n;
+}
+
+/**
+ * Counts the queued elements that come before a polled element, how many
+ * ranks it lies behind the first one. Busy heaps are skipped, so this is a
+ * lower bound.
+ */
+static void _sample(struct mq_queue_t *const thiz, const void *const item)
+{
+    struct _mq_heap_t *h;
+    size_t ranks = 0;
+
+    for (uint32_t i = 0; i < thiz->_length; i++)
+    {
+        h = &thiz->_heaps[i];
+        if (_empty(h) || !_try_lock(h))
+            continue;
+
+        ranks += _before(thiz, &h->heap, 0, item, MQ_QUEUE_SAMPLE_LIMIT);
+
+        _unlock(h);
+    }
+
+    atomic_fetch_add_explicit(&thiz->_ranks, ranks, memory_order_relaxed);
+    atomic_fetch_add_explicit(&thiz->_samples, 1, memory_order_relaxed);
+}
+
+static uint32_t mq_queue_size(struct mq_queue_t *const thiz)
+{
+    const size_t d = atomic_load_explicit(&thiz->_dequeued, memory_order_relaxed);
+    const intptr_t c = (intptr_t)(atomic_load_explicit(&thiz->_enqueued, memory_order_relaxed) - d);
+
+    if (c < 0)
+        return 0;
+
+    return c > UINT32_MAX ? UINT32_MAX : (uint32_t)c;
+}
+
+static void mq_queue_clear(struct mq_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return;
+    }
+
+    struct _mq_heap_t *h;
+    uint32_t n;
+
+    for (uint32_t i = 0; i < thiz->_length; i++)
+    {
+        h = &thiz->_heaps[i];
+
+        _lock(h);
+
+        n = heap_size(&h->heap);
+        for (uint32_t j = 0; j < n; j++)
+            free(heap_at(&h->heap, j));
+
+        heap_reset(&h->heap);
+
+        _unlock(h);
+
+        atomic_fetch_add_explicit(&thiz->_dequeued, n, memory_order_relaxed);
+    }
+
+    return;
+}
+
+static void mq_queue_free(struct mq_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return;
+    }
+
+    thiz->clear(thiz);
+
+    for (uint32_t i = 0; i < thiz->_length; i++)
+        heap_destroy(&thiz->_heaps[i].heap);
+
+    free(thiz->_heaps);
+    free(thiz);
+}
+
+static bool mq_queue_offer(struct mq_queue_t *const thiz, const void *const element)
+{
+    if (!thiz || !element)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    struct _mq_heap_t *h;
+    bool ret;
+
+    do
+    {
+        h = _random(thiz);
+    } while (!_try_lock(h));
+
+    ret = heap_push(&h->heap, element);
+
+    _unlock(h);
+
+    if (ret)
+        atomic_fetch_add_explicit(&thiz->_enqueued, 1, memory_order_relaxed);
+
+    return ret;
+}
+
+static void *mq_queue_poll(struct mq_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if (thiz->size(thiz) == 0)
+        return NULL;
+
+    struct _mq_heap_t *h = _acquire(thiz);
+    if (!h)
+        return NULL;
+
+    static __thread uint32_t polls;
+
+    void *item = heap_pop(&h->heap);
+
+    _unlock(h);
+
+    atomic_fetch_add_explicit(&thiz->_dequeued, 1, memory_order_relaxed);
+
+    if (++polls % MQ_QUEUE_SAMPLE == 0)
+        _sample(thiz, item);
+
+    return item;
+}
+
+static void *mq_queue_peek(struct mq_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if (thiz->size(thiz) == 0)
+        return NULL;
+
+    struct _mq_heap_t *h = _acquire(thiz);
+    if (!h)
+        return NULL;
+
+    void *item = heap_peek(&h->heap);
+
+    _unlock(h);
+
+    return item;
+}
+
+struct queue_t *mq_queue(const uint32_t heaps, int32_t (*const compare)(const void *, const void *))
+{
+    struct mq_queue_t *thiz = NULL;
+    uint32_t length = heaps;
+    uint32_t i = 0;
+
+    if (!compare)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (length == 0)
+    {
+        const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        length = (uint32_t)(cpus > 0 ? cpus : 1) * MQ_QUEUE_HEAPS_PER_CPU;
+    }
+
+    if (posix_memalign((void **)&thiz, CACHE_LINE_SIZE, sizeof(struct mq_queue_t)) != 0)
+    {
+        errno = ENOMEM;
+        thiz = NULL;
+        goto mqQueue_err_0;
+    }
+
+    memset((void *)thiz, 0, sizeof(struct mq_queue_t));
+
+    if (posix_memalign((void **)&thiz->_heaps, CACHE_LINE_SIZE, (size_t)length * sizeof(struct _mq_heap_t)) != 0)
+    {
+        errno = ENOMEM;
+        goto mqQueue_err_1;
+    }
+
+    for (i = 0; i < length; i++)
+    {
+        atomic_init(&thiz->_heaps[i].lock, false);
+        atomic_init(&thiz->_heaps[i].count, 0);
+
+        if (!heap_init(&thiz->_heaps[i].heap, compare, MQ_QUEUE_INITIAL_LENGTH))
+        {
+            errno = ENOMEM;
+            goto mqQueue_err_2;
+        }
+    }
+
+    thiz->_compare = compare;
+    thiz->_length = length;
+    atomic_init(&thiz->_enqueued, 0);
+    atomic_init(&thiz->_dequeued, 0);
+    atomic_init(&thiz->_samples, 0);
+    atomic_init(&thiz->_ranks, 0);
+
+    /* methods */
+    thiz->size = mq_queue_size;
+    thiz->clear = mq_queue_clear;
+    thiz->free = mq_queue_free;
+    thiz->offer = mq_queue_offer;
+    thiz->poll = mq_queue_poll;
+    thiz->peek = mq_queue_peek;
+
+    goto mqQueue_err_0;
+
+mqQueue_err_2:
+    while (i-- > 0)
+        heap_destroy(&thiz->_heaps[i].heap);
+
+    free(thiz->_heaps);
+
+mqQueue_err_1:
+    free(thiz);
+    thiz = NULL;
+
+mqQueue_err_0:
+    return (struct queue_t *)thiz;
+}
+
+double mq_queue_rank_error(struct queue_t *const queue)
+{
+    struct mq_queue_t *const thiz = (struct mq_queue_t *)queue;
+
+    if (!thiz)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    const size_t samples = atomic_load_explicit(&thiz->_samples, memory_order_relaxed);
+
+    if (samples == 0)
+        return 0;
+
+    return (double)atomic_load_explicit(&thiz->_ranks, memory_order_relaxed) / (double)samples;
+}
@@ -0,0 +1,49 @@
+#ifndef _MQ_QUEUE_H_
+#define _MQ_QUEUE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Creates an unbounded relaxed priority queue that any number of threads
+ * may share.
+ *
+ * a MultiQueue: elements are spread over several sequential heaps, each
+ * behind its own try-lock. offer pushes into a random heap, poll takes the
+ * better head of two random heaps, and a thread that finds a heap locked
+ * picks another one instead of waiting. poll returns one of the first
+ * elements rather than the first one, on average about heaps ranks behind
+ * it, and only returns NULL after finding every heap empty. peek picks a
+ * head the same way, so it need not be the element the next poll returns.
+ *
+ * @param heaps number of heaps, 0 means twice the number of online cpus,
+ *              about two per thread sharing the queue keeps locks uncontended
+ * @param compare sort condition function, the same contract as lp_queue:
+ *                compare(a, b) > 0 places a after b
+ * @return the queue, or NULL on failure
+ */
+extern struct queue_t *mq_queue(const uint32_t heaps, int32_t (*const compare)(const void *, const void *));
+
+/**
+ * Returns the sampled rank error of poll: one poll in 64 per thread counts
+ * the queued elements that come before the element it returned, skipping
+ * heaps busy at that moment. The mean estimates how many ranks polls land
+ * behind the first element. With two random heaps per poll it stays in
+ * O(heaps), independent of the queue size; a value growing well past heaps
+ * means too few polling threads or heaps kept busy by offers.
+ *
+ * @param queue queue returned by mq_queue
+ * @return the mean number of better elements per sampled poll, 0 before the first sample
+ */
+extern double mq_queue_rank_error(struct queue_t *const queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
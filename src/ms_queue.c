@@ -0,0 +1,994 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include "ms_queue.h"
+#include "cpu_util.h"
+#include "ebr.h"
+#include "node_pool.h"
+#include "parker.h"
+#include "event_fd.h"
+#include "queue_stats.h"
+#include "time_util.h"
+
+/**
+ * queue node structure
+ */
+struct _node_t
+{
+    const void *item;
+    _Atomic(struct _node_t *) next;
+    struct ebr_entry_t entry;
+
+    /* owner queue, whose pool the node goes back to once reclaimed */
+    struct ms_queue_t *queue;
+};
+
+/**
+ * Michael-Scott queue
+ *
+ * unbounded lock-free linked queue with a head sentinel node. nodes come
+ * from a node pool, dequeued sentinels go back to it through epoch based
+ * reclamation.
+ */
+struct ms_queue_t
+{
+
+    /**
+     * Returns the number of elements in this collection.
+     *
+     * @param thiz this
+     * @return the number of elements in this collection
+     */
+    uint32_t (*size)(struct ms_queue_t *const thiz);
+
+    /**
+     * Removes all of the elements from this collection.
+     *
+     *  @param thiz this
+     */
+    void (*clear)(struct ms_queue_t *const thiz);
+
+    /**
+     * Free collection
+     *
+     * @param thiz this
+     */
+    void (*free)(struct ms_queue_t *const thiz);
+
+    /**
+     * Inserts the specified element into this queue if it is possible to do
+     * so immediately without violating capacity restrictions.
+     *
+     * @param thiz this
+     * @param element element
+     * @return true if the element was added to this queue, else false
+     */
+    bool (*offer)(struct ms_queue_t *const thiz, const void *const element);
+
+    /**
+     * Retrieves and removes the head of this queue,
+     * or returns NULL if this queue is empty.
+     *
+     * @param thiz this
+     * @return the head of this queue, or NULL if this queue is empty
+     */
+    void *(*poll)(struct ms_queue_t *const thiz);
+
+    /**
+     * Retrieves, but does not remove, the head of this queue,
+     * or returns NULL if this queue is empty.
+     *
+     * @param thiz this
+     * @return the head of this queue, or NULL if this queue is empty
+     */
+    void *(*peek)(struct ms_queue_t *const thiz);
+
+    /**
+     * Inserts the specified element into this queue, waiting if necessary for space to become available.
+     *
+     * @param thiz this
+     * @param element the element to add
+     */
+    bool (*put)(struct ms_queue_t *const thiz, const void *const element);
+
+    /**
+     * Inserts the specified element into this queue, waiting up to the
+     * specified wait time if necessary for space to become available.
+     *
+     * @param thiz this
+     * @param element the element to add
+     * @param timeout how long to wait before giving up, in units of unit
+     * @param unit a time_unit_t determining how to interpret the timeout parameter
+     * @return true if successful, or false if the specified waiting time elapses before space is available
+     */
+    bool (*offer_await)(struct ms_queue_t *const thiz, const void *const element, const uint64_t timeout, const struct time_unit_t *const unit);
+
+    /**
+     * Retrieves and removes the head of this queue, waiting if necessary until an element becomes available.
+     *
+     * @param thiz this
+     * @return the head of this queue
+     */
+    void *(*take)(struct ms_queue_t *const thiz);
+
+    /**
+     * Retrieves and removes the head of this queue, waiting up to the
+     * specified wait time if necessary for an element to become available.
+     *
+     * @param thiz this
+     * @param timeout how long to wait before giving up, in units of unit
+     * @param unit a time_unit_t determining how to interpret the timeout parameter
+     * @return the head of this queue, or NULL if the specified waiting time elapses before an element is available
+     */
+    void *(*poll_await)(struct ms_queue_t *const thiz, const uint64_t timeout, const struct time_unit_t *const unit);
+
+    /**
+     * Inserts as many of the specified elements as possible without waiting,
+     * in order, with a single acquisition of the queue.
+     *
+     * @param thiz this
+     * @param elements the elements to add
+     * @param n number of elements
+     * @return the number of elements added, always a prefix of elements
+     */
+    uint32_t (*offer_batch)(struct ms_queue_t *const thiz, void *const *elements, const uint32_t n);
+
+    /**
+     * Inserts all of the specified elements, in order, waiting if necessary for space to become available.
+     *
+     * @param thiz this
+     * @param elements the elements to add
+     * @param n number of elements
+     * @return the number of elements added, n unless an error occurred
+     */
+    uint32_t (*put_batch)(struct ms_queue_t *const thiz, void *const *elements, const uint32_t n);
+
+    /**
+     * Removes at most max available elements from this queue without waiting.
+     *
+     * @param thiz this
+     * @param out receives the removed elements in queue order
+     * @param max the maximum number of elements to remove
+     * @return the number of elements removed
+     */
+    uint32_t (*drain_to)(struct ms_queue_t *const thiz, void **out, const uint32_t max);
+
+    /**
+     * Removes at most max elements from this queue, waiting up to the
+     * specified wait time if necessary until at least min have been removed.
+     *
+     * @param thiz this
+     * @param out receives the removed elements in queue order
+     * @param min the number of elements to wait for
+     * @param max the maximum number of elements to remove
+     * @param timeout how long to wait before giving up, in units of unit
+     * @param unit a time_unit_t determining how to interpret the timeout parameter, or NULL to wait without limit
+     * @return the number of elements removed, less than min only if the waiting time elapsed
+     */
+    uint32_t (*take_batch)(struct ms_queue_t *const thiz, void **out, const uint32_t min, const uint32_t max,
+                           const uint64_t timeout, const struct time_unit_t *const unit);
+
+    /**
+     * Returns a non-blocking eventfd that becomes readable when this queue
+     * turns ready for the event, for use with poll/epoll. The descriptor is
+     * owned by the queue and closed by free. Read it before draining the
+     * queue, and drain until the queue reports nothing left.
+     *
+     * @param thiz this
+     * @param event QUEUE_EVENT_NOT_EMPTY or QUEUE_EVENT_NOT_FULL
+     * @return the descriptor, or -1 with errno set
+     */
+    int (*eventfd)(struct ms_queue_t *const thiz, const enum queue_event_t event);
+
+    /**
+     * Closes this queue and wakes every blocked thread. Later puts fail
+     * with errno EPIPE, takes return the remaining elements and then fail
+     * with errno EPIPE. A queue cannot be reopened.
+     *
+     * @param thiz this
+     */
+    void (*close)(struct ms_queue_t *const thiz);
+
+    /**
+     * Returns true if this queue has been closed.
+     *
+     * @param thiz this
+     * @return true if this queue has been closed
+     */
+    bool (*closed)(struct ms_queue_t *const thiz);
+
+    /**
+     * Reads the operational counters of this queue. The lock counters stay
+     * 0, there is no lock.
+     *
+     * @param thiz this
+     * @param stats filled with the totals since the queue was created
+     */
+    void (*stats)(struct ms_queue_t *const thiz, struct queue_stats_t *const stats);
+
+    /**
+     * Inserts the specified element into this queue, waiting until the
+     * deadline if necessary for space to become available.
+     *
+     * @param thiz this
+     * @param element the element to add
+     * @param deadline absolute CLOCK_MONOTONIC time to give up at, or NULL to wait without limit
+     * @return true if successful, or false if the deadline passes before space is available
+     */
+    bool (*offer_until)(struct ms_queue_t *const thiz, const void *const element, const struct timespec *const deadline);
+
+    /**
+     * Retrieves and removes the head of this queue, waiting until the
+     * deadline if necessary for an element to become available.
+     *
+     * @param thiz this
+     * @param deadline absolute CLOCK_MONOTONIC time to give up at, or NULL to wait without limit
+     * @return the head of this queue, or NULL if the deadline passes before an element is available
+     */
+    void *(*poll_until)(struct ms_queue_t *const thiz, const struct timespec *const deadline);
+
+    /* parked consumers : queue non-empty */
+    struct parker_t _not_empty;
+
+    /* readiness descriptor : queue non-empty */
+    struct event_fd_t _readable;
+
+    /* readiness descriptor : queue non-full, always ready */
+    struct event_fd_t _writable;
+
+    /* set once by close */
+    atomic_bool _closed;
+
+    /* operational counters */
+    struct queue_counters_t *_stats;
+
+    /* node allocator */
+    struct node_pool_t *_pool;
+
+    /* queue head node pointer */
+    CACHE_ALIGNED _Atomic(struct _node_t *) _head;
+
+    /* number of dequeued elements */
+    atomic_size_t _dequeued;
+
+    /* reclaimed sentinels, once freed minus every retired one */
+    atomic_int_least64_t _reclaimed;
+
+    /* queue tail node pointer */
+    CACHE_ALIGNED _Atomic(struct _node_t *) _last;
+
+    /* number of enqueued elements */
+    atomic_size_t _enqueued;
+};
+
+static void _destroy(struct ms_queue_t *const thiz)
+{
+    node_pool_free(thiz->_pool);
+    queue_counters_free(thiz->_stats);
+    free(thiz);
+}
+
+/**
+ * Gives a retired sentinel back to the pool. Sentinels may still wait in
+ * the limbo bags of other threads when the queue is freed, the last one
+ * reclaimed then destroys the queue.
+ */
+static void _reclaim(struct ebr_entry_t *const entry)
+{
+    struct _node_t *const node = (struct _node_t *)((char *)entry - offsetof(struct _node_t, entry));
+    struct ms_queue_t *const thiz = node->queue;
+
+    node_pool_release(thiz->_pool, node);
+
+    if (atomic_fetch_add_explicit(&thiz->_reclaimed, 1, memory_order_acq_rel) == -1)
+        _destroy(thiz);
+}
+
+static bool _not_empty(void *arg)
+{
+    struct ms_queue_t *const thiz = (struct ms_queue_t *)arg;
+    bool r;
+
+    if (atomic_load(&thiz->_closed))
+        return true;
+
+    ebr_enter();
+    r = atomic_load_explicit(&atomic_load(&thiz->_head)->next, memory_order_acquire) != NULL;
+    ebr_exit();
+
+    return r;
+}
+
+static inline struct _node_t *_node(struct ms_queue_t *const thiz, const void *const element)
+{
+    struct _node_t *node = (struct _node_t *)node_pool_alloc(thiz->_pool);
+    if (!node)
+        return NULL;
+
+    node->item = element;
+    node->queue = thiz;
+    atomic_init(&node->next, NULL);
+
+    return node;
+}
+
+/**
+ * Appends the chain first..last with a single CAS on the tail node.
+ *
+ * @return true if the chain was linked behind the head node, onto an empty queue
+ */
+static inline bool _link(struct ms_queue_t *const thiz, struct _node_t *const first, struct _node_t *const last)
+{
+    ebr_enter();
+
+    struct _node_t *tail;
+
+    for (;;)
+    {
+        tail = atomic_load(&thiz->_last);
+        struct _node_t *next = atomic_load(&tail->next);
+
+        if (tail != atomic_load(&thiz->_last))
+            continue;
+
+        if (next == NULL)
+        {
+            if (atomic_compare_exchange_weak(&tail->next, &next, first))
+                break;
+        }
+        else
+        {
+            /* help a lagging producer swing the tail */
+            atomic_compare_exchange_weak(&thiz->_last, &tail, next);
+        }
+    }
+
+    /* still inside the critical section, so tail cannot have been recycled */
+    const bool empty = (atomic_load(&thiz->_head) == tail);
+
+    atomic_compare_exchange_strong(&thiz->_last, &tail, last);
+
+    ebr_exit();
+
+    return empty;
+}
+
+/**
+ * Waits for ready, counting the wait when the queue is not ready at once.
+ *
+ * @return the last value returned by ready, false once the deadline has passed
+ */
+static inline bool _await(struct ms_queue_t *const thiz, struct parker_t *const p, bool (*const ready)(void *),
+                          const struct timespec *const deadline)
+{
+    if (ready(thiz))
+        return true;
+
+    const uint64_t start = queue_counters_wait_begin();
+    const bool r = parker_await(p, ready, thiz, deadline);
+
+    queue_counters_wait_end(thiz->_stats, start, !r);
+
+    return r;
+}
+
+/**
+ * Wakes one parked thread, counting the wakeup if one was sent.
+ */
+static inline void _notify(struct ms_queue_t *const thiz, struct parker_t *const p)
+{
+    if (parker_notify(p))
+        queue_counters_add(thiz->_stats, QUEUE_STAT_SIGNALS, 1);
+}
+
+static inline void _notify_all(struct ms_queue_t *const thiz, struct parker_t *const p)
+{
+    if (parker_notify_all(p))
+        queue_counters_add(thiz->_stats, QUEUE_STAT_SIGNALS, 1);
+}
+
+/**
+ * Counts elements an offer or put could not insert.
+ */
+static inline void _reject(struct ms_queue_t *const thiz, const uint32_t n)
+{
+    queue_counters_add(thiz->_stats, QUEUE_STAT_REJECTED, n);
+}
+
+static inline bool _enqueue(struct ms_queue_t *const thiz, const void *const element)
+{
+    struct _node_t *node = _node(thiz, element);
+    if (!node)
+    {
+        errno = ENOMEM;
+        return false;
+    }
+
+    const bool empty = _link(thiz, node, node);
+
+    atomic_fetch_add_explicit(&thiz->_enqueued, 1, memory_order_relaxed);
+
+    /* only the empty to non-empty transition wakes a consumer, the consumers
+     * pass the wakeup on while elements remain */
+    if (empty)
+    {
+        _notify(thiz, &thiz->_not_empty);
+        event_fd_signal(&thiz->_readable);
+    }
+
+    return true;
+}
+
+/**
+ * Links n elements as one chain, waking at most one parked consumer.
+ */
+static inline uint32_t _enqueue_batch(struct ms_queue_t *const thiz, void *const *elements, const uint32_t n)
+{
+    struct _node_t *first = NULL;
+    struct _node_t *last = NULL;
+
+    if (n == 0)
+        return 0;
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        struct _node_t *node = _node(thiz, elements[i]);
+        if (!node)
+        {
+            for (struct _node_t *next; first != NULL; first = next)
+            {
+                next = atomic_load_explicit(&first->next, memory_order_relaxed);
+                node_pool_release(thiz->_pool, first);
+            }
+            errno = ENOMEM;
+            return 0;
+        }
+
+        if (last)
+            atomic_store_explicit(&last->next, node, memory_order_relaxed);
+        else
+            first = node;
+        last = node;
+    }
+
+    const bool empty = _link(thiz, first, last);
+
+    atomic_fetch_add_explicit(&thiz->_enqueued, n, memory_order_relaxed);
+
+    if (empty)
+    {
+        _notify(thiz, &thiz->_not_empty);
+        event_fd_signal(&thiz->_readable);
+    }
+
+    return n;
+}
+
+static inline void *_dequeue(struct ms_queue_t *const thiz)
+{
+    struct _node_t *head;
+    struct _node_t *next;
+    void *x;
+
+    ebr_enter();
+
+    for (;;)
+    {
+        head = atomic_load(&thiz->_head);
+        struct _node_t *last = atomic_load(&thiz->_last);
+        next = atomic_load(&head->next);
+
+        if (head != atomic_load(&thiz->_head))
+            continue;
+
+        if (next == NULL)
+        {
+            ebr_exit();
+            return NULL;
+        }
+
+        if (head == last)
+        {
+            atomic_compare_exchange_weak(&thiz->_last, &last, next);
+            continue;
+        }
+
+        x = (void *)next->item;
+
+        if (atomic_compare_exchange_weak(&thiz->_head, &head, next))
+            break;
+    }
+
+    /* elements left behind this one, pass the wakeup on to a parked
+     * consumer, still inside the critical section so next is not recycled */
+    if (atomic_load_explicit(&next->next, memory_order_acquire) != NULL)
+        _notify(thiz, &thiz->_not_empty);
+
+    ebr_retire(&head->entry, _reclaim);
+
+    ebr_exit();
+
+    atomic_fetch_add_explicit(&thiz->_dequeued, 1, memory_order_relaxed);
+
+    return x;
+}
+
+static uint32_t ms_queue_size(struct ms_queue_t *const thiz)
+{
+    const size_t d = atomic_load_explicit(&thiz->_dequeued, memory_order_relaxed);
+    const intptr_t c = (intptr_t)(atomic_load_explicit(&thiz->_enqueued, memory_order_relaxed) - d);
+
+    if (c < 0)
+        return 0;
+
+    return c > UINT32_MAX ? UINT32_MAX : (uint32_t)c;
+}
+
+static void ms_queue_clear(struct ms_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return;
+    }
+
+    for (void *item; (item = _dequeue(thiz)) != NULL;)
+        free(item);
+
+    return;
+}
+
+static void ms_queue_free(struct ms_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return;
+    }
+
+    thiz->clear(thiz);
+
+    parker_destroy(&thiz->_not_empty);
+    event_fd_destroy(&thiz->_readable);
+    event_fd_destroy(&thiz->_writable);
+
+    /* no thread may use the queue any more, the sentinel goes back directly */
+    node_pool_release(thiz->_pool, atomic_load(&thiz->_head));
+
+    /* every dequeue retired one sentinel, wait for those still in limbo */
+    const int64_t retired = (int64_t)atomic_load(&thiz->_dequeued);
+
+    if (atomic_fetch_sub_explicit(&thiz->_reclaimed, retired, memory_order_acq_rel) == retired)
+        _destroy(thiz);
+}
+
+static bool ms_queue_offer(struct ms_queue_t *const thiz, const void *const element)
+{
+    if (!thiz || !element)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (atomic_load(&thiz->_closed))
+    {
+        _reject(thiz, 1);
+        errno = EPIPE;
+        return false;
+    }
+
+    if (!_enqueue(thiz, element))
+    {
+        _reject(thiz, 1);
+        return false;
+    }
+
+    return true;
+}
+
+static void *ms_queue_poll(struct ms_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    /* read before trying, so elements put before close are still taken */
+    const bool closed = atomic_load(&thiz->_closed);
+    void *item = _dequeue(thiz);
+
+    if (!item && closed)
+        errno = EPIPE;
+
+    return item;
+}
+
+static void *ms_queue_peek(struct ms_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    void *item = NULL;
+
+    ebr_enter();
+
+    struct _node_t *next = atomic_load(&atomic_load(&thiz->_head)->next);
+    if (next)
+        item = (void *)next->item;
+
+    ebr_exit();
+
+    return item;
+}
+
+static bool ms_queue_put(struct ms_queue_t *const thiz, const void *const element)
+{
+    if (!thiz || !element)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (atomic_load(&thiz->_closed))
+    {
+        _reject(thiz, 1);
+        errno = EPIPE;
+        return false;
+    }
+
+    if (!_enqueue(thiz, element))
+    {
+        _reject(thiz, 1);
+        return false;
+    }
+
+    return true;
+}
+
+static void *ms_queue_take(struct ms_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    void *item;
+    bool closed;
+
+    for (;;)
+    {
+        closed = atomic_load(&thiz->_closed);
+        if ((item = _dequeue(thiz)) != NULL || closed)
+            break;
+        _await(thiz, &thiz->_not_empty, _not_empty, NULL);
+    }
+
+    if (!item)
+        errno = EPIPE;
+
+    return item;
+}
+
+static bool ms_queue_offer_until(struct ms_queue_t *const thiz, const void *const element, const struct timespec *const deadline)
+{
+    if (!thiz || !element)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (atomic_load(&thiz->_closed))
+    {
+        _reject(thiz, 1);
+        errno = EPIPE;
+        return false;
+    }
+
+    /* never full, there is nothing to wait for */
+    if (!_enqueue(thiz, element))
+    {
+        _reject(thiz, 1);
+        return false;
+    }
+
+    return true;
+}
+
+static bool ms_queue_offer_wait(struct ms_queue_t *const thiz, const void *const element,
+                                const uint64_t timeout, const struct time_unit_t *const unit)
+{
+    if (!thiz || !element || !unit)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    /* never full, no deadline to compute */
+    return ms_queue_offer_until(thiz, element, NULL);
+}
+
+static void *ms_queue_poll_until(struct ms_queue_t *const thiz, const struct timespec *const deadline)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    bool closed = atomic_load(&thiz->_closed);
+    void *item;
+
+    if ((item = _dequeue(thiz)) != NULL)
+        return item;
+
+    while (!closed && _await(thiz, &thiz->_not_empty, _not_empty, deadline))
+    {
+        closed = atomic_load(&thiz->_closed);
+        if ((item = _dequeue(thiz)) != NULL)
+            return item;
+    }
+
+    if (closed)
+        errno = EPIPE;
+
+    return NULL;
+}
+
+static void *ms_queue_poll_wait(struct ms_queue_t *const thiz, const uint64_t timeout, const struct time_unit_t *const unit)
+{
+    if (!thiz || !unit)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    void *item;
+
+    /* the deadline is only needed once the queue turns out empty */
+    if ((item = _dequeue(thiz)) != NULL)
+        return item;
+
+    struct timespec timeo;
+
+    calc_timeout(&timeo, timeout, unit);
+
+    return ms_queue_poll_until(thiz, &timeo);
+}
+
+static uint32_t ms_queue_offer_batch(struct ms_queue_t *const thiz, void *const *elements, const uint32_t n)
+{
+    if (!thiz || !elements)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (!elements[i])
+        {
+            errno = EINVAL;
+            return 0;
+        }
+    }
+
+    if (atomic_load(&thiz->_closed))
+    {
+        _reject(thiz, n);
+        errno = EPIPE;
+        return 0;
+    }
+
+    const uint32_t k = _enqueue_batch(thiz, elements, n);
+
+    if (k < n)
+        _reject(thiz, n - k);
+
+    return k;
+}
+
+static uint32_t ms_queue_put_batch(struct ms_queue_t *const thiz, void *const *elements, const uint32_t n)
+{
+    /* never full, there is nothing to wait for */
+    return ms_queue_offer_batch(thiz, elements, n);
+}
+
+static uint32_t ms_queue_drain_to(struct ms_queue_t *const thiz, void **out, const uint32_t max)
+{
+    if (!thiz || !out)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    const bool closed = atomic_load(&thiz->_closed);
+    uint32_t k = 0;
+
+    while (k < max && (out[k] = _dequeue(thiz)) != NULL)
+        k++;
+
+    if (k == 0 && max > 0 && closed)
+        errno = EPIPE;
+
+    return k;
+}
+
+static uint32_t ms_queue_take_batch(struct ms_queue_t *const thiz, void **out, const uint32_t min, const uint32_t max,
+                                    const uint64_t timeout, const struct time_unit_t *const unit)
+{
+    if (!thiz || !out)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    uint32_t need = (min > max) ? max : min;
+    bool closed = atomic_load(&thiz->_closed);
+    uint32_t taken = ms_queue_drain_to(thiz, out, max);
+    struct timespec timeo;
+
+    if (taken >= need)
+        return taken;
+
+    if (unit)
+        calc_timeout(&timeo, timeout, unit);
+
+    while (taken < need && !closed && _await(thiz, &thiz->_not_empty, _not_empty, unit ? &timeo : NULL))
+    {
+        closed = atomic_load(&thiz->_closed);
+        taken += ms_queue_drain_to(thiz, out + taken, max - taken);
+    }
+
+    if (taken < need && closed)
+        errno = EPIPE;
+
+    return taken;
+}
+
+static int ms_queue_eventfd(struct ms_queue_t *const thiz, const enum queue_event_t event)
+{
+    if (!thiz)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    switch (event)
+    {
+    case QUEUE_EVENT_NOT_EMPTY:
+        return event_fd_open(&thiz->_readable, _not_empty, thiz);
+    case QUEUE_EVENT_NOT_FULL:
+        /* never full, the descriptor is readable from the start */
+        return event_fd_open(&thiz->_writable, NULL, NULL);
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+static void ms_queue_close(struct ms_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = EINVAL;
+        return;
+    }
+
+    if (atomic_exchange(&thiz->_closed, true))
+        return;
+
+    _notify_all(thiz, &thiz->_not_empty);
+    event_fd_signal(&thiz->_readable);
+    event_fd_signal(&thiz->_writable);
+}
+
+static bool ms_queue_closed(struct ms_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    return atomic_load(&thiz->_closed);
+}
+
+static void ms_queue_stats(struct ms_queue_t *const thiz, struct queue_stats_t *const stats)
+{
+    if (!thiz || !stats)
+    {
+        errno = EINVAL;
+        return;
+    }
+
+    queue_counters_read(thiz->_stats, stats);
+
+#ifndef DISABLE_CLQUEUE_STATS
+    /* elements are counted for size already */
+    stats->offers = atomic_load_explicit(&thiz->_enqueued, memory_order_relaxed);
+    stats->takes = atomic_load_explicit(&thiz->_dequeued, memory_order_relaxed);
+#endif
+}
+
+struct blocking_queue_t *ms_queue(void)
+{
+    struct ms_queue_t *thiz = NULL;
+
+    if (posix_memalign((void **)&thiz, CACHE_LINE_SIZE, sizeof(struct ms_queue_t)) != 0)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    memset((void *)thiz, 0, sizeof(struct ms_queue_t));
+
+    thiz->_pool = node_pool(sizeof(struct _node_t), 0);
+    if (!thiz->_pool)
+    {
+        free(thiz);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    struct _node_t *head = _node(thiz, NULL);
+    if (!head)
+    {
+        node_pool_free(thiz->_pool);
+        free(thiz);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    thiz->_stats = queue_counters();
+    if (!thiz->_stats)
+    {
+        node_pool_free(thiz->_pool);
+        free(thiz);
+        return NULL;
+    }
+
+    atomic_init(&thiz->_head, head);
+    atomic_init(&thiz->_last, head);
+    atomic_init(&thiz->_enqueued, 0);
+    atomic_init(&thiz->_dequeued, 0);
+    atomic_init(&thiz->_reclaimed, 0);
+
+    parker_init(&thiz->_not_empty);
+    event_fd_init(&thiz->_readable);
+    event_fd_init(&thiz->_writable);
+    atomic_init(&thiz->_closed, false);
+
+    /* methods */
+    thiz->size = ms_queue_size;
+    thiz->clear = ms_queue_clear;
+    thiz->free = ms_queue_free;
+    thiz->offer = ms_queue_offer;
+    thiz->poll = ms_queue_poll;
+    thiz->peek = ms_queue_peek;
+    thiz->put = ms_queue_put;
+    thiz->offer_await = ms_queue_offer_wait;
+    thiz->take = ms_queue_take;
+    thiz->poll_await = ms_queue_poll_wait;
+    thiz->offer_batch = ms_queue_offer_batch;
+    thiz->put_batch = ms_queue_put_batch;
+    thiz->drain_to = ms_queue_drain_to;
+    thiz->take_batch = ms_queue_take_batch;
+    thiz->eventfd = ms_queue_eventfd;
+    thiz->close = ms_queue_close;
+    thiz->closed = ms_queue_closed;
+    thiz->stats = ms_queue_stats;
+    thiz->offer_until = ms_queue_offer_until;
+    thiz->poll_until = ms_queue_poll_until;
+
+    return (struct blocking_queue_t *)thiz;
+}
@@ -0,0 +1,25 @@
+#ifndef _MS_QUEUE_H_
+#define _MS_QUEUE_H_
+
+#include <stdint.h>
+#include "blocking_queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Creates an unbounded lock-free blocking queue.
+ *
+ * offer and put only fail when memory is exhausted, take and poll_await
+ * park while the queue is empty.
+ *
+ * @return the queue, or NULL on failure
+ */
+extern struct blocking_queue_t *ms_queue(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,452 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "node_pool.h"
+
+/* nodes moved between a thread cache and the depot at a time */
+#define NODE_POOL_BATCH 32
+
+/* minimum number of nodes carved from the system when the pool grows */
+#define NODE_POOL_SLAB_NODES 256
+
+/**
+ * free node layout
+ *
+ * free nodes are chained into batches through next, the first node of a
+ * batch links the batches kept by the depot through batch.
+ */
+struct _free_node_t
+{
+    struct _free_node_t *next;
+    struct _free_node_t *batch;
+};
+
+/**
+ * slab, one system allocation holding many nodes
+ */
+struct _slab_t
+{
+    struct _slab_t *next;
+};
+
+#define SLAB_HEADER_SIZE ((sizeof(struct _slab_t) + 15) & ~(size_t)15)
+
+/**
+ * per-thread node cache
+ *
+ * a thread keeps one cache per pool it used, chained through tnext. the
+ * pool also lists its caches, so node_pool_free can detach them from a pool
+ * that goes away while their threads live on.
+ */
+struct _cache_t
+{
+    /* owner pool, NULL once the pool was freed */
+    _Atomic(struct node_pool_t *) pool;
+
+    /* pool cache list */
+    struct _cache_t *prev;
+    struct _cache_t *next;
+
+    /* thread cache list */
+    struct _cache_t *tnext;
+
+    /* number of cached nodes */
+    uint32_t count;
+
+    /* cached nodes, at most two batches */
+    void *nodes[NODE_POOL_BATCH * 2];
+};
+
+struct node_pool_t
+{
+    /* node size, rounded to hold a free node */
+    size_t _node_size;
+
+    /* mutex lock : depot, slabs and cache list */
+    pthread_mutex_t _lock;
+
+    /* stack of free node batches */
+    struct _free_node_t *_depot;
+
+    /* every slab allocated by this pool */
+    struct _slab_t *_slabs;
+
+    /* first uncarved node of the newest slab */
+    char *_cursor;
+
+    /* number of uncarved nodes of the newest slab */
+    uint32_t _remain;
+
+    /* every thread cache of this pool */
+    struct _cache_t *_caches;
+};
+
+static inline bool _grow(struct node_pool_t *const pool, uint32_t count)
+{
+    if (count < NODE_POOL_SLAB_NODES)
+        count = NODE_POOL_SLAB_NODES;
+
+    struct _slab_t *slab = (struct _slab_t *)malloc(SLAB_HEADER_SIZE + pool->_node_size * count);
+    if (!slab)
+        return false;
+
+    slab->next = pool->_slabs;
+    pool->_slabs = slab;
+    pool->_cursor = (char *)slab + SLAB_HEADER_SIZE;
+    pool->_remain = count;
+
+    return true;
+}
+
+/**
+ * Carves up to count nodes out of the newest slab. Called with _lock held.
+ */
+static inline uint32_t _carve(struct node_pool_t *const pool, void **const nodes, uint32_t count)
+{
+    if (pool->_remain == 0 && !_grow(pool, count))
+        return 0;
+
+    if (count > pool->_remain)
+        count = pool->_remain;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        nodes[i] = pool->_cursor;
+        pool->_cursor += pool->_node_size;
+    }
+    pool->_remain -= count;
+
+    return count;
+}
+
+/**
+ * Pushes a chain of free nodes onto the depot. Called with _lock held.
+ */
+static inline void _depot_push(struct node_pool_t *const pool, void **const nodes, const uint32_t count)
+{
+    struct _free_node_t *head = (struct _free_node_t *)nodes[0];
+
+    for (uint32_t i = 0; i < count; i++)
+        ((struct _free_node_t *)nodes[i])->next = (i + 1 < count) ? (struct _free_node_t *)nodes[i + 1] : NULL;
+
+    head->batch = pool->_depot;
+    pool->_depot = head;
+}
+
+/**
+ * Pops one batch off the depot. Called with _lock held.
+ */
+static inline uint32_t _depot_pop(struct node_pool_t *const pool, void **const nodes)
+{
+    struct _free_node_t *head = pool->_depot;
+    uint32_t count = 0;
+
+    if (!head)
+        return 0;
+
+    pool->_depot = head->batch;
+
+    for (struct _free_node_t *n = head; n != NULL; n = n->next)
+        nodes[count++] = n;
+
+    return count;
+}
+
+/* one key for every pool, only there to run _thread_exit */
+static pthread_key_t _key;
+
+/* false if the key could not be created, every call then goes through the depots */
+static bool _keyed;
+
+static pthread_once_t _once = PTHREAD_ONCE_INIT;
+
+/* orders thread exits against node_pool_free */
+static pthread_mutex_t _exit_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* caches of this thread, the most recently used first */
+static __thread struct _cache_t *_caches;
+
+/**
+ * TLS destructor, hands the cached nodes back to the depots of the pools
+ * still alive and frees the caches of the exiting thread.
+ */
+static void _thread_exit(void *arg)
+{
+    struct _cache_t *cache = _caches;
+
+    _caches = NULL;
+
+    pthread_mutex_lock(&_exit_lock);
+
+    for (struct _cache_t *tnext; cache != NULL; cache = tnext)
+    {
+        struct node_pool_t *pool = atomic_load_explicit(&cache->pool, memory_order_relaxed);
+
+        tnext = cache->tnext;
+
+        if (pool)
+        {
+            pthread_mutex_lock(&pool->_lock);
+
+            for (uint32_t off = 0; off < cache->count; off += NODE_POOL_BATCH)
+            {
+                uint32_t n = cache->count - off;
+                _depot_push(pool, &cache->nodes[off], n < NODE_POOL_BATCH ? n : NODE_POOL_BATCH);
+            }
+
+            if (cache->prev)
+                cache->prev->next = cache->next;
+            else
+                pool->_caches = cache->next;
+            if (cache->next)
+                cache->next->prev = cache->prev;
+
+            pthread_mutex_unlock(&pool->_lock);
+        }
+
+        free(cache);
+    }
+
+    pthread_mutex_unlock(&_exit_lock);
+}
+
+static void _init(void)
+{
+    _keyed = (pthread_key_create(&_key, _thread_exit) == 0);
+}
+
+/**
+ * Returns the cache of this thread for pool, creating it on first use. Caches
+ * of freed pools met on the way are dropped.
+ */
+static inline struct _cache_t *_cache(struct node_pool_t *const pool)
+{
+    struct _cache_t *cache = _caches;
+
+    if (cache && atomic_load_explicit(&cache->pool, memory_order_acquire) == pool)
+        return cache;
+
+    for (struct _cache_t **link = &_caches; (cache = *link) != NULL;)
+    {
+        struct node_pool_t *const owner = atomic_load_explicit(&cache->pool, memory_order_acquire);
+
+        if (owner == pool)
+        {
+            /* move to front, a thread mostly uses one or two pools */
+            *link = cache->tnext;
+            cache->tnext = _caches;
+            _caches = cache;
+            return cache;
+        }
+
+        if (!owner)
+        {
+            *link = cache->tnext;
+            free(cache);
+            continue;
+        }
+
+        link = &cache->tnext;
+    }
+
+    pthread_once(&_once, _init);
+    if (!_keyed)
+        return NULL;
+
+    cache = (struct _cache_t *)malloc(sizeof(struct _cache_t));
+    if (!cache)
+        return NULL;
+
+    atomic_init(&cache->pool, pool);
+    cache->prev = NULL;
+    cache->count = 0;
+    cache->tnext = _caches;
+
+    /* any non-NULL value, the list itself lives in _caches */
+    if (!_caches && pthread_setspecific(_key, cache) != 0)
+    {
+        free(cache);
+        return NULL;
+    }
+
+    _caches = cache;
+
+    pthread_mutex_lock(&pool->_lock);
+    cache->next = pool->_caches;
+    if (pool->_caches)
+        pool->_caches->prev = cache;
+    pool->_caches = cache;
+    pthread_mutex_unlock(&pool->_lock);
+
+    return cache;
+}
+
+void *node_pool_alloc(struct node_pool_t *const pool)
+{
+    if (!pool)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct _cache_t *cache = _cache(pool);
+    void *node = NULL;
+
+    if (!cache)
+    {
+        /* no thread cache, take a single node from the depot */
+        pthread_mutex_lock(&pool->_lock);
+
+        struct _free_node_t *head = pool->_depot;
+        if (head)
+        {
+            if (head->next)
+            {
+                head->next->batch = head->batch;
+                pool->_depot = head->next;
+            }
+            else
+            {
+                pool->_depot = head->batch;
+            }
+            node = head;
+        }
+        else
+        {
+            _carve(pool, &node, 1);
+        }
+
+        pthread_mutex_unlock(&pool->_lock);
+
+        goto alloc_r;
+    }
+
+    if (cache->count == 0)
+    {
+        pthread_mutex_lock(&pool->_lock);
+
+        cache->count = _depot_pop(pool, cache->nodes);
+        if (cache->count == 0)
+            cache->count = _carve(pool, cache->nodes, NODE_POOL_BATCH);
+
+        pthread_mutex_unlock(&pool->_lock);
+
+        if (cache->count == 0)
+            goto alloc_r;
+    }
+
+    node = cache->nodes[--cache->count];
+
+alloc_r:
+    if (!node)
+        errno = ENOMEM;
+
+    return node;
+}
+
+void node_pool_release(struct node_pool_t *const pool, void *const node)
+{
+    if (!pool || !node)
+    {
+        errno = EINVAL;
+        return;
+    }
+
+    struct _cache_t *cache = _cache(pool);
+
+    if (!cache)
+    {
+        void *nodes[1] = {node};
+
+        pthread_mutex_lock(&pool->_lock);
+        _depot_push(pool, nodes, 1);
+        pthread_mutex_unlock(&pool->_lock);
+
+        return;
+    }
+
+    if (cache->count == NODE_POOL_BATCH * 2)
+    {
+        /* hand the older half to the depot, keep the recently used half */
+        pthread_mutex_lock(&pool->_lock);
+        _depot_push(pool, cache->nodes, NODE_POOL_BATCH);
+        pthread_mutex_unlock(&pool->_lock);
+
+        memmove(cache->nodes, &cache->nodes[NODE_POOL_BATCH], NODE_POOL_BATCH * sizeof(void *));
+        cache->count = NODE_POOL_BATCH;
+    }
+
+    cache->nodes[cache->count++] = node;
+}
+
+void node_pool_free(struct node_pool_t *const pool)
+{
+    if (!pool)
+    {
+        errno = EINVAL;
+        return;
+    }
+
+    /* the caches belong to their threads, which drop them on next use or exit */
+    pthread_mutex_lock(&_exit_lock);
+    for (struct _cache_t *next, *cache = pool->_caches; cache != NULL; cache = next)
+    {
+        /* the owner may free it as soon as it sees NULL */
+        next = cache->next;
+        atomic_store_explicit(&cache->pool, NULL, memory_order_release);
+    }
+    pthread_mutex_unlock(&_exit_lock);
+
+    for (struct _slab_t *next, *slab = pool->_slabs; slab != NULL; slab = next)
+    {
+        next = slab->next;
+        free(slab);
+    }
+
+    pthread_mutex_destroy(&pool->_lock);
+
+    free(pool);
+}
+
+struct node_pool_t *node_pool(const size_t node_size, const uint32_t prealloc)
+{
+    void *nodes[NODE_POOL_BATCH];
+
+    struct node_pool_t *pool = (struct node_pool_t *)malloc(sizeof(struct node_pool_t));
+    if (!pool)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    memset((void *)pool, 0, sizeof(struct node_pool_t));
+
+    pool->_node_size = node_size < sizeof(struct _free_node_t) ? sizeof(struct _free_node_t) : node_size;
+    pool->_node_size = (pool->_node_size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+
+    pthread_mutex_init(&pool->_lock, NULL);
+
+    if (prealloc == 0)
+        return pool;
+
+    if (!_grow(pool, prealloc))
+    {
+        node_pool_free(pool);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    /* touch every node now so the first offers do not fault pages in */
+    while (pool->_remain > 0)
+    {
+        uint32_t n = _carve(pool, nodes, NODE_POOL_BATCH);
+        _depot_push(pool, nodes, n);
+    }
+
+    return pool;
+}
@@ -0,0 +1,62 @@
+#ifndef _NODE_POOL_H_
+#define _NODE_POOL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Node Pool
+ *
+ * fixed size node allocator. free nodes are kept in per-thread caches and
+ * moved in batches through a shared depot, so threads that only allocate
+ * (producers) and threads that only release (consumers) touch the shared
+ * depot once per batch instead of once per node.
+ *
+ * all pools share one thread-specific key. a thread that exits hands its
+ * cached nodes back to the depots, a pool freed before its threads exit
+ * leaves their caches to be dropped on their next pool call or exit.
+ */
+struct node_pool_t;
+
+/**
+ * Creates a node pool.
+ *
+ * @param node_size size of one node in bytes
+ * @param prealloc number of nodes allocated up front, 0 for none
+ * @return the node pool, or NULL if memory is insufficient
+ */
+extern struct node_pool_t *node_pool(const size_t node_size, const uint32_t prealloc);
+
+/**
+ * Takes a node from the pool, growing the pool if it is exhausted.
+ *
+ * @param pool pool
+ * @return the node, or NULL if memory is insufficient (ENOMEM) or pool is NULL (EINVAL)
+ */
+extern void *node_pool_alloc(struct node_pool_t *const pool);
+
+/**
+ * Gives a node back to the pool.
+ *
+ * @param pool pool
+ * @param node node returned by node_pool_alloc, EINVAL if it or pool is NULL
+ */
+extern void node_pool_release(struct node_pool_t *const pool, void *const node);
+
+/**
+ * Free the pool and every node it has handed out. no thread may be inside
+ * another call on the same pool, threads that used it may still be running.
+ *
+ * @param pool pool, EINVAL if NULL
+ */
+extern void node_pool_free(struct node_pool_t *const pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
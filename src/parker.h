@@ -0,0 +1,200 @@
+#ifndef _PARKER_H_
+#define _PARKER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <linux/membarrier.h>
+#include "cpu_util.h"
+#include "time_util.h"
+
+/* default time spent spinning before a thread parks */
+#define PARKER_SPIN_NANOS 20000U
+
+/**
+ * Parker
+ *
+ * parks threads on a futex until a condition published by another thread
+ * holds. a waiter spins for a bounded time first, and notifiers only pay
+ * for a fence and a load while nobody is parked, or just the load once
+ * parker_asymmetric moved the fence to the waiters.
+ */
+struct parker_t
+{
+    /* futex word, advanced by every notify that finds parked threads */
+    atomic_uint _seq;
+
+    /* number of parked threads */
+    atomic_uint _waiters;
+
+    /* nanoseconds to spin before parking */
+    uint32_t _spin;
+
+    /* notifiers skip the fence, a parking waiter issues a membarrier instead */
+    bool _asymmetric;
+};
+
+static inline long _futex(atomic_uint *const addr, const int op, const uint32_t val, const struct timespec *const timeout)
+{
+    return syscall(SYS_futex, (uint32_t *)addr, op, val, timeout, NULL, FUTEX_BITSET_MATCH_ANY);
+}
+
+static inline void parker_init(struct parker_t *const p)
+{
+    atomic_init(&p->_seq, 0);
+    atomic_init(&p->_waiters, 0);
+
+    /* spinning only helps when the notifier runs on another cpu */
+    p->_spin = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ? PARKER_SPIN_NANOS : 0;
+    p->_asymmetric = false;
+}
+
+static inline void parker_destroy(struct parker_t *const p)
+{
+    (void)p;
+}
+
+/**
+ * Sets how long a waiter spins before it parks.
+ *
+ * @param p parker
+ * @param nanos spin time in nanoseconds, 0 to park at once
+ */
+static inline void parker_spin(struct parker_t *const p, const uint32_t nanos)
+{
+    p->_spin = nanos;
+}
+
+/**
+ * Moves the fence of every notify to the threads that park: a notifier only
+ * keeps the compiler from reordering its stores past the waiter check, and a
+ * thread about to park issues a process wide membarrier, which orders the
+ * stores of every running notifier before its own condition check. For a
+ * notifier called far more often than threads park. Called before the
+ * parker is shared.
+ *
+ * @param p parker
+ * @return true if enabled, false if membarrier is not available and notify keeps its fence
+ */
+static inline bool parker_asymmetric(struct parker_t *const p)
+{
+    const long cmds = syscall(SYS_membarrier, MEMBARRIER_CMD_QUERY, 0, 0);
+
+    if (cmds < 0 || !(cmds & MEMBARRIER_CMD_PRIVATE_EXPEDITED) ||
+        syscall(SYS_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) < 0)
+        return false;
+
+    p->_asymmetric = true;
+
+    return true;
+}
+
+/**
+ * Blocks until ready returns true or the deadline passes.
+ *
+ * @param p parker
+ * @param ready condition, evaluated by the waiting thread
+ * @param arg condition argument
+ * @param deadline absolute CLOCK_MONOTONIC deadline, or NULL to wait forever
+ * @return the last value returned by ready
+ */
+static inline bool parker_await(struct parker_t *const p, bool (*const ready)(void *), void *const arg,
+                                const struct timespec *const deadline)
+{
+    if (ready(arg))
+        return true;
+
+    if (p->_spin)
+    {
+        const uint64_t start = nano_time();
+
+        for (uint32_t i = 1;; i++)
+        {
+            cpu_relax();
+
+            if (ready(arg))
+                return true;
+
+            /* the clock is read every 64 rounds only */
+            if ((i & 63) == 0 && nano_time() - start >= p->_spin)
+                break;
+        }
+    }
+
+    for (;;)
+    {
+        const uint32_t seq = atomic_load_explicit(&p->_seq, memory_order_acquire);
+
+        atomic_fetch_add(&p->_waiters, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        if (p->_asymmetric)
+            syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0);
+
+        if (ready(arg))
+        {
+            atomic_fetch_sub(&p->_waiters, 1);
+            return true;
+        }
+
+        const long rc = _futex(&p->_seq, FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG, seq, deadline);
+        const int err = errno;
+
+        atomic_fetch_sub(&p->_waiters, 1);
+
+        if (ready(arg))
+            return true;
+
+        if (rc < 0 && err == ETIMEDOUT)
+            return false;
+    }
+}
+
+/**
+ * Wakes up to n parked threads. Called after the condition was published.
+ *
+ * @return true if a thread was parked and a wakeup was sent
+ */
+static inline bool parker_notify_n(struct parker_t *const p, const uint32_t n)
+{
+    if (p->_asymmetric)
+        atomic_signal_fence(memory_order_seq_cst);
+    else
+        atomic_thread_fence(memory_order_seq_cst);
+
+    if (atomic_load_explicit(&p->_waiters, memory_order_relaxed) == 0)
+        return false;
+
+    atomic_fetch_add(&p->_seq, 1);
+    _futex(&p->_seq, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, n > INT_MAX ? INT_MAX : n, NULL);
+
+    return true;
+}
+
+/**
+ * Wakes one parked thread, if any. Called after the condition was published.
+ *
+ * @return true if a thread was parked and a wakeup was sent
+ */
+static inline bool parker_notify(struct parker_t *const p)
+{
+    return parker_notify_n(p, 1);
+}
+
+/**
+ * Wakes every parked thread. Called after the condition was published.
+ *
+ * @return true if a thread was parked and a wakeup was sent
+ */
+static inline bool parker_notify_all(struct parker_t *const p)
+{
+    return parker_notify_n(p, UINT32_MAX);
+}
+
+#endif
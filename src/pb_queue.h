@@ -0,0 +1,26 @@
+#ifndef _PB_QUEUE_H_
+#define _PB_QUEUE_H_
+
+#include <stdint.h>
+#include "blocking_queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Creates a priority blocking queue. Takes return the first element in
+ * compare order, equal elements in insertion order.
+ *
+ * @param capacity the capacity of this queue, 0 means unbounded
+ * @param compare sort condition function, the same contract as lp_queue:
+ *                compare(a, b) > 0 places a after b
+ * @return the queue, or NULL on failure
+ */
+extern struct blocking_queue_t *pb_queue(const uint32_t capacity, int32_t (*const compare)(const void *, const void *));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
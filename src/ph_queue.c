@@ -0,0 +1,341 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include "ph_queue.h"
+
+/**
+ * heap node, handed out as the element handle
+ */
+struct ph_handle_t
+{
+    const void *item;
+
+    /* first child */
+    struct ph_handle_t *child;
+
+    /* next sibling */
+    struct ph_handle_t *next;
+
+    /* previous sibling, or the parent for a first child, NULL for the root */
+    struct ph_handle_t *prev;
+};
+
+struct ph_queue_t
+{
+    /* sort condition function */
+    int32_t (*_compare)(const void *, const void *);
+
+    /* root node, the head of this queue */
+    struct ph_handle_t *_root;
+
+    /* number of elements */
+    uint32_t _count;
+};
+
+/**
+ * Links two detached trees, the later root becomes the first child of the
+ * other one.
+ */
+static struct ph_handle_t *_link(struct ph_queue_t *const thiz, struct ph_handle_t *a, struct ph_handle_t *b)
+{
+    if (!a)
+        return b;
+    if (!b)
+        return a;
+
+    if (thiz->_compare(a->item, b->item) > 0)
+    {
+        struct ph_handle_t *const t = a;
+        a = b;
+        b = t;
+    }
+
+    b->next = a->child;
+    if (a->child)
+        a->child->prev = b;
+    b->prev = a;
+    a->child = b;
+
+    return a;
+}
+
+/**
+ * Combines a sibling list into one tree: links pairs left to right, then
+ * links the results right to left.
+ */
+static struct ph_handle_t *_combine(struct ph_queue_t *const thiz, struct ph_handle_t *first)
+{
+    struct ph_handle_t *pairs = NULL;
+    struct ph_handle_t *a, *b, *r;
+
+    /* first pass, the linked pairs are chained through prev in reverse */
+    while (first)
+    {
+        a = first;
+        b = a->next;
+        first = b ? b->next : NULL;
+
+        a->next = a->prev = NULL;
+        if (b)
+            b->next = b->prev = NULL;
+
+        r = _link(thiz, a, b);
+        r->prev = pairs;
+        pairs = r;
+    }
+
+    /* second pass */
+    r = NULL;
+    while (pairs)
+    {
+        a = pairs;
+        pairs = a->prev;
+        a->prev = NULL;
+
+        r = _link(thiz, a, r);
+    }
+
+    return r;
+}
+
+/**
+ * Cuts a non-root node with its subtree out of the heap.
+ */
+static void _cut(struct ph_handle_t *const node)
+{
+    if (node->prev->child == node)
+        node->prev->child = node->next;
+    else
+        node->prev->next = node->next;
+
+    if (node->next)
+        node->next->prev = node->prev;
+
+    node->next = node->prev = NULL;
+}
+
+/**
+ * Takes a node out of the heap, its children stay in.
+ */
+static void _detach(struct ph_queue_t *const thiz, struct ph_handle_t *const node)
+{
+    struct ph_handle_t *const children = node->child;
+
+    node->child = NULL;
+
+    if (node == thiz->_root)
+    {
+        thiz->_root = _combine(thiz, children);
+    }
+    else
+    {
+        _cut(node);
+        thiz->_root = _link(thiz, thiz->_root, _combine(thiz, children));
+    }
+}
+
+struct ph_queue_t *ph_queue(int32_t (*const compare)(const void *, const void *))
+{
+    struct ph_queue_t *thiz;
+
+    if (!compare)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    thiz = (struct ph_queue_t *)malloc(sizeof(struct ph_queue_t));
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    memset((void *)thiz, 0, sizeof(struct ph_queue_t));
+
+    thiz->_compare = compare;
+
+    return thiz;
+}
+
+uint32_t ph_queue_size(struct ph_queue_t *const thiz)
+{
+    if (!thiz)
+        return 0;
+
+    return thiz->_count;
+}
+
+struct ph_handle_t *ph_queue_offer(struct ph_queue_t *const thiz, const void *const element)
+{
+    if (!thiz || !element)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (thiz->_count == UINT32_MAX)
+        return NULL;
+
+    struct ph_handle_t *node = (struct ph_handle_t *)malloc(sizeof(struct ph_handle_t));
+    if (!node)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    node->item = element;
+    node->child = node->next = node->prev = NULL;
+
+    thiz->_root = _link(thiz, thiz->_root, node);
+    thiz->_count++;
+
+    return node;
+}
+
+void *ph_queue_poll(struct ph_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (!thiz->_root)
+        return NULL;
+
+    return ph_queue_remove(thiz, thiz->_root);
+}
+
+void *ph_queue_peek(struct ph_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return thiz->_root ? (void *)thiz->_root->item : NULL;
+}
+
+void *ph_queue_remove(struct ph_queue_t *const thiz, struct ph_handle_t *const handle)
+{
+    if (!thiz || !handle)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    void *item = (void *)handle->item;
+
+    _detach(thiz, handle);
+    thiz->_count--;
+
+    free(handle);
+
+    return item;
+}
+
+void ph_queue_update(struct ph_queue_t *const thiz, struct ph_handle_t *const handle)
+{
+    if (!thiz || !handle)
+    {
+        errno = EINVAL;
+        return;
+    }
+
+    /* a non-root node still ahead of its children moves with its subtree */
+    if (handle != thiz->_root)
+    {
+        struct ph_handle_t *c = handle->child;
+
+        for (; c; c = c->next)
+        {
+            if (thiz->_compare(handle->item, c->item) > 0)
+                break;
+        }
+
+        if (!c)
+        {
+            _cut(handle);
+            thiz->_root = _link(thiz, thiz->_root, handle);
+            return;
+        }
+    }
+
+    _detach(thiz, handle);
+    thiz->_root = _link(thiz, thiz->_root, handle);
+}
+
+void *ph_queue_element(const struct ph_handle_t *const handle)
+{
+    if (!handle)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return (void *)handle->item;
+}
+
+void ph_queue_meld(struct ph_queue_t *const thiz, struct ph_queue_t *const source)
+{
+    if (!thiz || !source || thiz == source)
+    {
+        errno = EINVAL;
+        return;
+    }
+
+    thiz->_root = _link(thiz, thiz->_root, source->_root);
+    thiz->_count += source->_count;
+
+    source->_root = NULL;
+    source->_count = 0;
+}
+
+void ph_queue_clear(struct ph_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = EINVAL;
+        return;
+    }
+
+    struct ph_handle_t *p = thiz->_root;
+    struct ph_handle_t *c;
+
+    /* rotate each child list into the sibling chain and free along it */
+    while (p)
+    {
+        if (p->child)
+        {
+            c = p->child;
+            p->child = c->next;
+            c->next = p;
+            p = c;
+        }
+        else
+        {
+            c = p->next;
+            free((void *)p->item);
+            free(p);
+            p = c;
+        }
+    }
+
+    thiz->_root = NULL;
+    thiz->_count = 0;
+}
+
+void ph_queue_free(struct ph_queue_t *const thiz)
+{
+    if (!thiz)
+        return;
+
+    ph_queue_clear(thiz);
+    free(thiz);
+}
@@ -0,0 +1,119 @@
+#ifndef _PH_QUEUE_H_
+#define _PH_QUEUE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Pairing Heap Queue
+ *
+ * addressable priority queue based on a pairing heap. offer returns a handle
+ * to the element, which can then be removed or moved to a new position after
+ * its key changed. offer, peek and meld are O(1), poll, remove and update are
+ * O(log n) amortized. the same compare contract as lp_queue: compare(a, b) > 0
+ * places a after b, equal elements leave in no particular order. it should
+ * not be used in multithreading scenarios.
+ */
+struct ph_queue_t;
+
+/**
+ * element handle, valid until the element is polled or removed
+ */
+struct ph_handle_t;
+
+/**
+ * Creates a pairing heap queue.
+ *
+ * @param compare sort condition function
+ * @return the queue, or NULL on failure
+ */
+extern struct ph_queue_t *ph_queue(int32_t (*const compare)(const void *, const void *));
+
+/**
+ * @param queue queue
+ * @return the number of elements
+ */
+extern uint32_t ph_queue_size(struct ph_queue_t *const queue);
+
+/**
+ * Inserts an element.
+ *
+ * @param queue queue
+ * @param element element
+ * @return the handle of the element, or NULL on failure
+ */
+extern struct ph_handle_t *ph_queue_offer(struct ph_queue_t *const queue, const void *const element);
+
+/**
+ * Retrieves and removes the head of this queue.
+ *
+ * @param queue queue
+ * @return the head of this queue, or NULL if this queue is empty
+ */
+extern void *ph_queue_poll(struct ph_queue_t *const queue);
+
+/**
+ * Retrieves, but does not remove, the head of this queue.
+ *
+ * @param queue queue
+ * @return the head of this queue, or NULL if this queue is empty
+ */
+extern void *ph_queue_peek(struct ph_queue_t *const queue);
+
+/**
+ * Removes the element of a handle. The handle is invalid afterwards.
+ *
+ * @param queue the queue holding the handle
+ * @param handle handle
+ * @return the element
+ */
+extern void *ph_queue_remove(struct ph_queue_t *const queue, struct ph_handle_t *const handle);
+
+/**
+ * Moves the element of a handle to its new position after its key was
+ * changed, either way.
+ *
+ * @param queue the queue holding the handle
+ * @param handle handle
+ */
+extern void ph_queue_update(struct ph_queue_t *const queue, struct ph_handle_t *const handle);
+
+/**
+ * @param handle handle
+ * @return the element of the handle
+ */
+extern void *ph_queue_element(const struct ph_handle_t *const handle);
+
+/**
+ * Moves every element of source into queue, leaving source empty. The
+ * handles of the moved elements stay valid and belong to queue from now on.
+ * Both queues must use the same sort condition function.
+ *
+ * @param queue destination queue
+ * @param source source queue
+ */
+extern void ph_queue_meld(struct ph_queue_t *const queue, struct ph_queue_t *const source);
+
+/**
+ * Removes and frees all of the elements.
+ *
+ * @param queue queue
+ */
+extern void ph_queue_clear(struct ph_queue_t *const queue);
+
+/**
+ * Frees the remaining elements and the queue.
+ *
+ * @param queue queue
+ */
+extern void ph_queue_free(struct ph_queue_t *const queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef _QUEUE_PROBE_H_
+#define _QUEUE_PROBE_H_
+
+/**
+ * Queue Probes
+ *
+ * USDT probes of provider clqueue, for perf, bpftrace or systemtap to attach
+ * to. built with ENABLE_CLQUEUE_USDT a probe is a single nop plus a note in
+ * the ELF, without it the probes compile to nothing.
+ *
+ *   enqueue(queue, element, n)         n elements inserted, element the first
+ *   dequeue(queue, element, n)         n elements removed, element the first
+ *   reject(queue, element, n)          n elements an offer or put could not insert
+ *   wait_begin(queue, event)           a thread starts to wait for a queue_event_t
+ *   wait_end(queue, event, timed_out)  the wait is over, timed_out 1 at its deadline
+ *   signal(queue, event)               a waiting thread was woken for event
+ *
+ * e.g. bpftrace -e 'usdt:./app:clqueue:reject { @[arg0] = sum(arg2); }'
+ */
+#ifdef ENABLE_CLQUEUE_USDT
+
+#include <sys/sdt.h>
+
+#define QUEUE_PROBE2(name, a1, a2) STAP_PROBE2(clqueue, name, a1, a2)
+#define QUEUE_PROBE3(name, a1, a2, a3) STAP_PROBE3(clqueue, name, a1, a2, a3)
+
+#else
+
+#define QUEUE_PROBE2(name, a1, a2) do {} while (0)
+#define QUEUE_PROBE3(name, a1, a2, a3) do {} while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,141 @@
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include "queue_select.h"
+#include "time_util.h"
+
+/**
+ * Hands an event read from fd on to the next waiter.
+ */
+static inline void _signal(const int fd)
+{
+    const uint64_t one = 1;
+
+    (void)!write(fd, &one, sizeof(one));
+}
+
+/**
+ * Tries the queues in preference order. A closed and empty queue is dropped
+ * from the poll set by negating its descriptor.
+ *
+ * @return index of the ready queue, or -1 if none is ready
+ */
+static int _try(struct blocking_queue_t *const *queues, struct pollfd *const fds, const uint32_t n, void **element,
+                uint32_t *const open)
+{
+    for (uint32_t i = 0; i < n; i++)
+    {
+        struct blocking_queue_t *const q = queues[i];
+
+        if (fds[i].fd < 0)
+            continue;
+
+        /* read before trying, so elements put before close are still taken */
+        const bool closed = q->closed(q);
+        bool ready;
+
+        if (element)
+            ready = (*element = q->poll(q)) != NULL;
+        else
+            ready = q->size(q) > 0;
+
+        if (ready)
+        {
+            /* the event read from the descriptor may have been meant for another waiter too */
+            if ((fds[i].revents & POLLIN) && (!element || q->size(q) > 0))
+                _signal(fds[i].fd);
+
+            return (int)i;
+        }
+
+        if (closed)
+        {
+            /* closing signals once, leave the descriptor readable for every other waiter */
+            if (fds[i].revents & POLLIN)
+                _signal(fds[i].fd);
+
+            fds[i].fd = -1;
+            (*open)--;
+        }
+    }
+
+    return -1;
+}
+
+int blocking_queue_select(struct blocking_queue_t *const *queues, const uint32_t n, void **element,
+                          const uint64_t timeout, const struct time_unit_t *const unit)
+{
+    if (!queues || n == 0 || n > QUEUE_SELECT_MAX)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    struct pollfd fds[QUEUE_SELECT_MAX];
+    struct timespec timeo;
+    uint64_t deadline = 0;
+    uint64_t now;
+    uint32_t open = n;
+    uint64_t value;
+    int r;
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (!queues[i])
+        {
+            errno = EINVAL;
+            return -1;
+        }
+
+        fds[i].fd = queues[i]->eventfd(queues[i], QUEUE_EVENT_NOT_EMPTY);
+        if (fds[i].fd < 0)
+            return -1;
+
+        fds[i].events = POLLIN;
+        fds[i].revents = 0;
+    }
+
+    if (unit)
+        deadline = nano_time() + time_unit_to_nano(unit, timeout);
+
+    while ((r = _try(queues, fds, n, element, &open)) < 0)
+    {
+        if (open == 0)
+        {
+            errno = EPIPE;
+            return -1;
+        }
+
+        if (unit)
+        {
+            now = nano_time();
+            nano_to_timespec(&timeo, (now < deadline) ? deadline - now : 0);
+        }
+
+        r = ppoll(fds, n, unit ? &timeo : NULL, NULL);
+        if (r < 0 && errno != EINTR)
+            return -1;
+
+        if (r == 0)
+        {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+
+        /* consume the events before trying again, later transitions signal anew */
+        for (uint32_t i = 0; i < n; i++)
+        {
+            if (r < 0 || !(fds[i].revents & POLLIN) || read(fds[i].fd, &value, sizeof(value)) != sizeof(value))
+                fds[i].revents = 0;
+        }
+    }
+
+    return r;
+}
@@ -0,0 +1,39 @@
+#ifndef _QUEUE_SELECT_H_
+#define _QUEUE_SELECT_H_
+
+#include <stdint.h>
+#include "blocking_queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* maximum number of queues one select call can wait on */
+#define QUEUE_SELECT_MAX 64
+
+/**
+ * Waits up to the specified wait time until one of the queues has an element.
+ *
+ * queues are checked in array order, so when several are ready the earliest
+ * one wins and the array is the preference order. the calling thread parks in
+ * ppoll on the QUEUE_EVENT_NOT_EMPTY eventfd of every queue, which it leaves
+ * with the queues, so each queue must support eventfd.
+ *
+ * @param queues the queues, in preference order
+ * @param n number of queues, at most QUEUE_SELECT_MAX
+ * @param element receives the element taken from the ready queue, or NULL to
+ *                only report a queue that is not empty and leave the element in it
+ * @param timeout how long to wait before giving up, in units of unit
+ * @param unit a time_unit_t determining how to interpret the timeout parameter, or NULL to wait without limit
+ * @return index of the ready queue, or -1 with errno ETIMEDOUT if the waiting
+ *         time elapsed, EPIPE if every queue is closed and empty, or another
+ *         errno on failure
+ */
+extern int blocking_queue_select(struct blocking_queue_t *const *queues, const uint32_t n, void **element,
+                                 const uint64_t timeout, const struct time_unit_t *const unit);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,84 @@
+#include <stdint.h>
+#include <pthread.h>
+#include "queue_stats.h"
+
+/* slots a thread can own, every slot but the shared one */
+#define QUEUE_STATS_OWNED_MASK ((1ULL << QUEUE_STATS_SHARED) - 1)
+
+__thread uint32_t queue_stats_slot_id = UINT32_MAX;
+
+static pthread_mutex_t _lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_once_t _once = PTHREAD_ONCE_INIT;
+
+/* releases the slot of an exiting thread */
+static pthread_key_t _key;
+
+/* slots owned by live threads */
+static uint64_t _used;
+
+/**
+ * TLS destructor, frees the slot for the next thread. The slot keeps its
+ * counts, the next owner goes on adding to them. A later destructor of the
+ * same thread that counts takes a slot again.
+ */
+static void _release(void *arg)
+{
+    const uint32_t slot = (uint32_t)(uintptr_t)arg - 1;
+
+    queue_stats_slot_id = UINT32_MAX;
+
+    pthread_mutex_lock(&_lock);
+    _used &= ~(1ULL << slot);
+    pthread_mutex_unlock(&_lock);
+}
+
+static void _init(void)
+{
+    pthread_key_create(&_key, _release);
+}
+
+uint32_t queue_stats_slot_acquire(void)
+{
+    uint32_t slot = QUEUE_STATS_SHARED;
+
+    pthread_once(&_once, _init);
+
+    pthread_mutex_lock(&_lock);
+
+    const uint64_t free_slots = ~_used & QUEUE_STATS_OWNED_MASK;
+    if (free_slots)
+    {
+        slot = (uint32_t)__builtin_ctzll(free_slots);
+        _used |= 1ULL << slot;
+    }
+
+    pthread_mutex_unlock(&_lock);
+
+    /* the mutex orders the previous owner's last counts before ours */
+    if (slot != QUEUE_STATS_SHARED && pthread_setspecific(_key, (void *)(uintptr_t)(slot + 1)) != 0)
+    {
+        pthread_mutex_lock(&_lock);
+        _used &= ~(1ULL << slot);
+        pthread_mutex_unlock(&_lock);
+
+        slot = QUEUE_STATS_SHARED;
+    }
+
+    queue_stats_slot_id = slot;
+
+    return slot;
+}
+
+struct _queue_stats_slot_t *queue_stats_slot_alloc(struct queue_counters_t *const c, const uint32_t slot)
+{
+    struct _queue_stats_slot_t *s = _queue_stats_slot_new();
+
+    if (!s)
+        return atomic_load_explicit(&c->_slots[QUEUE_STATS_SHARED], memory_order_relaxed);
+
+    /* only the thread owning the slot fills it, the release publishes the zeroed counters to readers */
+    atomic_store_explicit(&c->_slots[slot], s, memory_order_release);
+
+    return s;
+}
@@ -0,0 +1,349 @@
+#ifndef _QUEUE_STATS_H_
+#define _QUEUE_STATS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "cpu_util.h"
+#include "time_util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Operational counters of a blocking queue, totals since it was created.
+ */
+struct queue_stats_t
+{
+    /* elements inserted */
+    uint64_t offers;
+
+    /* elements removed */
+    uint64_t takes;
+
+    /* elements an offer or put failed to insert, the queue was full or closed */
+    uint64_t rejected;
+
+    /* timed waits that gave up at their deadline */
+    uint64_t timeouts;
+
+    /* waits for a non-empty or non-full queue that found it not ready */
+    uint64_t waits;
+
+    /* time spent in those waits, spinning or parked */
+    uint64_t wait_nanos;
+
+    /* condition signals, on parker based queues only those that found a parked thread */
+    uint64_t signals;
+
+    /* lock acquisitions that found the lock held, ENABLE_CLQUEUE_LOCK_PROFILE only */
+    uint64_t lock_contended;
+
+    /* time spent acquiring locks, ENABLE_CLQUEUE_LOCK_PROFILE only */
+    uint64_t lock_wait_nanos;
+
+    /* time locks were held, ENABLE_CLQUEUE_LOCK_PROFILE only */
+    uint64_t lock_hold_nanos;
+};
+
+/**
+ * counter indexes
+ */
+enum queue_stat_e {
+    QUEUE_STAT_OFFERS,
+    QUEUE_STAT_TAKES,
+    QUEUE_STAT_REJECTED,
+    QUEUE_STAT_TIMEOUTS,
+    QUEUE_STAT_WAITS,
+    QUEUE_STAT_WAIT_NANOS,
+    QUEUE_STAT_SIGNALS,
+    QUEUE_STAT_LOCK_CONTENDED,
+    QUEUE_STAT_LOCK_WAIT_NANOS,
+    QUEUE_STAT_LOCK_HOLD_NANOS,
+    QUEUE_STAT_COUNT
+};
+
+#ifdef DISABLE_CLQUEUE_STATS
+/* counters compiled out, a single slot that stays 0 */
+#define QUEUE_STATS_SLOTS 1
+#else
+/* counter slots, at most 64 as the free slots are kept in a 64-bit mask */
+#define QUEUE_STATS_SLOTS 64
+#endif
+
+/* the last slot is shared by the threads that found no free one */
+#define QUEUE_STATS_SHARED (QUEUE_STATS_SLOTS - 1)
+
+#if defined(ENABLE_CLQUEUE_LOCK_PROFILE) && !defined(DISABLE_CLQUEUE_STATS)
+#define _QUEUE_LOCK_PROFILE
+#endif
+
+struct _queue_stats_slot_t
+{
+    CACHE_ALIGNED atomic_uint_least64_t v[QUEUE_STAT_COUNT];
+};
+
+/**
+ * Queue Counters
+ *
+ * counters kept in cache line aligned slots, one per thread. a thread only
+ * writes its own slot, with a plain load and store, so counting costs no
+ * atomic read-modify-write and threads do not bounce each other's cache
+ * lines. threads beyond QUEUE_STATS_SHARED live at once share the last slot
+ * and add to it atomically. a reader sums the slots.
+ *
+ * a queue allocates the slot of a thread the first time that thread counts
+ * on it, so a queue used by a few threads holds a few slots, not all of them.
+ *
+ * built with DISABLE_CLQUEUE_STATS the counters are compiled out and stats()
+ * reads zeros.
+ */
+struct queue_counters_t
+{
+    /* NULL until a thread of that slot counts, the shared slot is allocated up front */
+    _Atomic(struct _queue_stats_slot_t *) _slots[QUEUE_STATS_SLOTS];
+};
+
+/* slot of the calling thread, UINT32_MAX until its first count */
+extern __thread uint32_t queue_stats_slot_id;
+
+/**
+ * Gives the calling thread a slot of its own, which goes back to the free
+ * slots when the thread exits, or the shared slot if none is free.
+ *
+ * @return the slot
+ */
+extern uint32_t queue_stats_slot_acquire(void);
+
+/**
+ * Allocates the slot of the calling thread on first use, called by its
+ * owner only.
+ *
+ * @return the slot, or the shared slot if memory is insufficient
+ */
+extern struct _queue_stats_slot_t *queue_stats_slot_alloc(struct queue_counters_t *const c, const uint32_t slot);
+
+static inline struct _queue_stats_slot_t *_queue_stats_slot_new(void)
+{
+    struct _queue_stats_slot_t *s = NULL;
+
+    if (posix_memalign((void **)&s, CACHE_LINE_SIZE, sizeof(struct _queue_stats_slot_t)) != 0)
+        return NULL;
+
+    for (uint32_t i = 0; i < QUEUE_STAT_COUNT; i++)
+        atomic_init(&s->v[i], 0);
+
+    return s;
+}
+
+/**
+ * @return the counters, or NULL if memory is insufficient
+ */
+static inline struct queue_counters_t *queue_counters(void)
+{
+    struct queue_counters_t *c = (struct queue_counters_t *)malloc(sizeof(struct queue_counters_t));
+    struct _queue_stats_slot_t *shared = _queue_stats_slot_new();
+
+    if (!c || !shared)
+    {
+        free(c);
+        free(shared);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    for (uint32_t s = 0; s < QUEUE_STATS_SLOTS; s++)
+        atomic_init(&c->_slots[s], NULL);
+
+    atomic_init(&c->_slots[QUEUE_STATS_SHARED], shared);
+
+    return c;
+}
+
+static inline void queue_counters_free(struct queue_counters_t *const c)
+{
+    if (!c)
+        return;
+
+    for (uint32_t s = 0; s < QUEUE_STATS_SLOTS; s++)
+        free(atomic_load_explicit(&c->_slots[s], memory_order_relaxed));
+
+    free(c);
+}
+
+static inline void queue_counters_add(struct queue_counters_t *const c, const enum queue_stat_e stat, const uint64_t n)
+{
+#ifdef DISABLE_CLQUEUE_STATS
+    (void)c;
+    (void)stat;
+    (void)n;
+#else
+    uint32_t slot = queue_stats_slot_id;
+
+    if (__builtin_expect(slot == UINT32_MAX, 0))
+        slot = queue_stats_slot_acquire();
+
+    struct _queue_stats_slot_t *s = atomic_load_explicit(&c->_slots[slot], memory_order_acquire);
+
+    if (__builtin_expect(s == NULL, 0))
+    {
+        s = queue_stats_slot_alloc(c, slot);
+        slot = (s == atomic_load_explicit(&c->_slots[QUEUE_STATS_SHARED], memory_order_relaxed)) ? QUEUE_STATS_SHARED : slot;
+    }
+
+    atomic_uint_least64_t *const v = &s->v[stat];
+
+    /* the only writer of its slot, the store just has to be atomic for readers */
+    if (__builtin_expect(slot != QUEUE_STATS_SHARED, 1))
+        atomic_store_explicit(v, atomic_load_explicit(v, memory_order_relaxed) + n, memory_order_relaxed);
+    else
+        atomic_fetch_add_explicit(v, n, memory_order_relaxed);
+#endif
+}
+
+/**
+ * Sums the slots. Counters added concurrently may or may not be included.
+ */
+static inline void queue_counters_read(struct queue_counters_t *const c, struct queue_stats_t *const stats)
+{
+    uint64_t v[QUEUE_STAT_COUNT] = { 0 };
+    struct _queue_stats_slot_t *slot;
+
+    for (uint32_t s = 0; s < QUEUE_STATS_SLOTS; s++)
+    {
+        if ((slot = atomic_load_explicit(&c->_slots[s], memory_order_acquire)) == NULL)
+            continue;
+
+        for (uint32_t i = 0; i < QUEUE_STAT_COUNT; i++)
+            v[i] += atomic_load_explicit(&slot->v[i], memory_order_relaxed);
+    }
+
+    stats->offers = v[QUEUE_STAT_OFFERS];
+    stats->takes = v[QUEUE_STAT_TAKES];
+    stats->rejected = v[QUEUE_STAT_REJECTED];
+    stats->timeouts = v[QUEUE_STAT_TIMEOUTS];
+    stats->waits = v[QUEUE_STAT_WAITS];
+    stats->wait_nanos = v[QUEUE_STAT_WAIT_NANOS];
+    stats->signals = v[QUEUE_STAT_SIGNALS];
+    stats->lock_contended = v[QUEUE_STAT_LOCK_CONTENDED];
+    stats->lock_wait_nanos = v[QUEUE_STAT_LOCK_WAIT_NANOS];
+    stats->lock_hold_nanos = v[QUEUE_STAT_LOCK_HOLD_NANOS];
+}
+
+/**
+ * Starts timing a wait, returns the start time for queue_counters_wait_end.
+ */
+static inline uint64_t queue_counters_wait_begin(void)
+{
+#ifdef DISABLE_CLQUEUE_STATS
+    return 0;
+#else
+    return nano_time();
+#endif
+}
+
+/**
+ * Counts a wait that started at start.
+ *
+ * @param timed_out true if the wait gave up at its deadline
+ */
+static inline void queue_counters_wait_end(struct queue_counters_t *const c, const uint64_t start, const bool timed_out)
+{
+#ifdef DISABLE_CLQUEUE_STATS
+    (void)c;
+    (void)start;
+    (void)timed_out;
+#else
+    queue_counters_add(c, QUEUE_STAT_WAITS, 1);
+    queue_counters_add(c, QUEUE_STAT_WAIT_NANOS, nano_time() - start);
+
+    if (timed_out)
+        queue_counters_add(c, QUEUE_STAT_TIMEOUTS, 1);
+#endif
+}
+
+/**
+ * Locks a mutex. With ENABLE_CLQUEUE_LOCK_PROFILE, a contended acquisition
+ * is timed and the hold time starts, otherwise this is pthread_mutex_lock.
+ *
+ * @param since start of the hold, kept next to the mutex and only touched
+ *              by its owner
+ * @return what pthread_mutex_lock returned, EOWNERDEAD for a robust mutex
+ *         whose owner died
+ */
+static inline int queue_counters_lock(struct queue_counters_t *const c, pthread_mutex_t *const mutex, uint64_t *const since)
+{
+#ifdef _QUEUE_LOCK_PROFILE
+    int r = pthread_mutex_trylock(mutex);
+
+    if (r == EBUSY)
+    {
+        const uint64_t start = nano_time();
+
+        r = pthread_mutex_lock(mutex);
+
+        *since = nano_time();
+        queue_counters_add(c, QUEUE_STAT_LOCK_CONTENDED, 1);
+        queue_counters_add(c, QUEUE_STAT_LOCK_WAIT_NANOS, *since - start);
+        return r;
+    }
+
+    *since = nano_time();
+
+    return r;
+#else
+    (void)c;
+    (void)since;
+
+    return pthread_mutex_lock(mutex);
+#endif
+}
+
+/**
+ * Unlocks a mutex locked by queue_counters_lock.
+ */
+static inline void queue_counters_unlock(struct queue_counters_t *const c, pthread_mutex_t *const mutex, uint64_t *const since)
+{
+#ifdef _QUEUE_LOCK_PROFILE
+    queue_counters_add(c, QUEUE_STAT_LOCK_HOLD_NANOS, nano_time() - *since);
+#else
+    (void)c;
+    (void)since;
+#endif
+    pthread_mutex_unlock(mutex);
+}
+
+/**
+ * Ends the hold before a condition wait releases the mutex.
+ */
+static inline void queue_counters_release(struct queue_counters_t *const c, uint64_t *const since)
+{
+#ifdef _QUEUE_LOCK_PROFILE
+    queue_counters_add(c, QUEUE_STAT_LOCK_HOLD_NANOS, nano_time() - *since);
+#else
+    (void)c;
+    (void)since;
+#endif
+}
+
+/**
+ * Starts the hold again once a condition wait has reacquired the mutex.
+ */
+static inline void queue_counters_reacquire(uint64_t *const since)
+{
+#ifdef _QUEUE_LOCK_PROFILE
+    *since = nano_time();
+#else
+    (void)since;
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1729 @@
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "shm_queue.h"
+#include "cpu_util.h"
+#include "event_fd.h"
+#include "queue_stats.h"
+#include "time_util.h"
+
+/* "SHMQ", stored last by the creator */
+#define SHM_QUEUE_MAGIC 0x53484d51U
+
+#define SHM_QUEUE_MAX_CAPACITY 0x80000000U
+
+/**
+ * process-shared condition with its count of waiting threads, so a signaller
+ * wakes no more threads than wait
+ */
+struct _shm_cond_t
+{
+    pthread_cond_t cond;
+
+    /* threads waiting on cond, guarded by the region lock */
+    uint32_t waiters;
+};
+
+/**
+ * shared region header
+ *
+ * everything the processes share, followed by the used ring, the free ring
+ * and the element arena. rings hold block offsets from the region start,
+ * which every process maps at a different address. each operation commits
+ * with a single index store, so the rings stay consistent when a process
+ * dies holding the lock. the owner table names the process holding each
+ * block outside the rings, so the blocks of a dead process can be recovered.
+ */
+struct _shm_region_t
+{
+    /* SHM_QUEUE_MAGIC once the region is initialized */
+    atomic_uint magic;
+
+    /* queue capacity, also the number of element blocks */
+    uint32_t capacity;
+
+    /* element block size, a multiple of the cache line */
+    uint32_t block_size;
+
+    /* ring index mask, ring length minus one */
+    uint32_t mask;
+
+    /* mapping length */
+    uint64_t size;
+
+    /* offset of the used ring */
+    uint64_t ring;
+
+    /* offset of the free ring */
+    uint64_t blocks;
+
+    /* offset of the owner table, the pid holding each block, 0 while it is in a ring */
+    uint64_t owners;
+
+    /* offset of the first element block */
+    uint64_t arena;
+
+    /* pid namespace of the creator, the owner pids are only meaningful in it */
+    uint64_t pidns;
+
+    /* set once a process outside pidns, or of unknown namespace, has owned a block */
+    uint32_t foreign;
+
+    /* robust process-shared mutex lock : main lock guarding all access */
+    pthread_mutex_t lock;
+
+    /* conditional lock : queue non-empty */
+    struct _shm_cond_t not_empty;
+
+    /* conditional lock : queue non-full */
+    struct _shm_cond_t not_full;
+
+    /* conditional lock : free block available */
+    struct _shm_cond_t released;
+
+    /* free running index of the head element */
+    uint32_t head;
+
+    /* free running index of the next free slot */
+    uint32_t tail;
+
+    /* free running index of the first free block */
+    uint32_t free_head;
+
+    /* free running index of the next free block slot */
+    uint32_t free_tail;
+
+    /* set once by close */
+    uint32_t closed;
+
+    /* eventfd watchers of all processes, transitions are published while non-zero */
+    atomic_uint watchers;
+
+    /* bumped on each empty to non-empty transition and on close, futex word */
+    atomic_uint readable;
+
+    /* bumped on each full to non-full transition and on close, futex word */
+    atomic_uint writable;
+};
+
+struct shm_queue_t;
+
+/**
+ * eventfd watcher
+ *
+ * an eventfd belongs to one process, so each process relays the shared
+ * transition words to a descriptor of its own from a thread parked on the
+ * word.
+ */
+struct _shm_watch_t
+{
+    /* the process local view */
+    struct shm_queue_t *queue;
+
+    /* shared transition word */
+    atomic_uint *word;
+
+    /* descriptor handed out */
+    struct event_fd_t fd;
+
+    /* relaying thread */
+    pthread_t thread;
+
+    /* value of word the thread starts from */
+    uint32_t seen;
+
+    /* process that started the thread, 0 until started */
+    pid_t pid;
+};
+
+/**
+ * shared memory queue
+ *
+ * process local view of a shared region
+ */
+struct shm_queue_t
+{
+
+
+    /**
+     * Returns the number of elements in this collection.
+     *
+     * @param thiz this
+     * @return the number of elements in this collection
+     */
+    uint32_t (*size)(struct shm_queue_t *const thiz);
+
+    /**
+     * Removes all of the elements from this collection.
+     *
+     *  @param thiz this
+     */
+    void (*clear)(struct shm_queue_t *const thiz);
+
+    /**
+     * Free collection
+     *
+     * @param thiz this
+     */
+    void (*free)(struct shm_queue_t *const thiz);
+
+    /**
+     * Inserts the specified element into this queue if it is possible to do
+     * so immediately without violating capacity restrictions.
+     *
+     * @param thiz this
+     * @param element element
+     * @return true if the element was added to this queue, else false
+     */
+    bool (*offer)(struct shm_queue_t *const thiz, const void *const element);
+
+    /**
+     * Retrieves and removes the head of this queue,
+     * or returns NULL if this queue is empty.
+     *
+     * @param thiz this
+     * @return the head of this queue, or NULL if this queue is empty
+     */
+    void *(*poll)(struct shm_queue_t *const thiz);
+
+    /**
+     * Retrieves, but does not remove, the head of this queue,
+     * or returns NULL if this queue is empty.
+     *
+     * @param thiz this
+     * @return the head of this queue, or NULL if this queue is empty
+     */
+    void *(*peek)(struct shm_queue_t *const thiz);
+
+    /**
+     * Inserts the specified element into this queue, waiting if necessary for space to become available.
+     *
+     * @param thiz this
+     * @param element the element to add
+     */
+    bool (*put)(struct shm_queue_t *const thiz, const void *const element);
+
+    /**
+     * Inserts the specified element into this queue, waiting up to the
+     * specified wait time if necessary for space to become available.
+     *
+     * @param thiz this
+     * @param element the element to add
+     * @param timeout how long to wait before giving up, in units of unit
+     * @param unit a time_unit_t determining how to interpret the timeout parameter
+     * @return true if successful, or false if the specified waiting time elapses before space is available
+     */
+    bool (*offer_await)(struct shm_queue_t *const thiz, const void *const element, const uint64_t timeout, const struct time_unit_t *const unit);
+
+    /**
+     * Retrieves and removes the head of this queue, waiting if necessary until an element becomes available.
+     *
+     * @param thiz this
+     * @return the head of this queue
+     */
+    void *(*take)(struct shm_queue_t *const thiz);
+
+    /**
+     * Retrieves and removes the head of this queue, waiting up to the
+     * specified wait time if necessary for an element to become available.
+     *
+     * @param thiz this
+     * @param timeout how long to wait before giving up, in units of unit
+     * @param unit a time_unit_t determining how to interpret the timeout parameter
+     * @return the head of this queue, or NULL if the specified waiting time elapses before an element is available
+     */
+    void *(*poll_await)(struct shm_queue_t *const thiz, const uint64_t timeout, const struct time_unit_t *const unit);
+
+    /**
+     * Inserts as many of the specified elements as possible without waiting,
+     * in order, with a single acquisition of the queue.
+     *
+     * @param thiz this
+     * @param elements the elements to add
+     * @param n number of elements
+     * @return the number of elements added, always a prefix of elements
+     */
+    uint32_t (*offer_batch)(struct shm_queue_t *const thiz, void *const *elements, const uint32_t n);
+
+    /**
+     * Inserts all of the specified elements, in order, waiting if necessary for space to become available.
+     *
+     * @param thiz this
+     * @param elements the elements to add
+     * @param n number of elements
+     * @return the number of elements added, n unless an error occurred
+     */
+    uint32_t (*put_batch)(struct shm_queue_t *const thiz, void *const *elements, const uint32_t n);
+
+    /**
+     * Removes at most max available elements from this queue without waiting.
+     *
+     * @param thiz this
+     * @param out receives the removed elements in queue order
+     * @param max the maximum number of elements to remove
+     * @return the number of elements removed
+     */
+    uint32_t (*drain_to)(struct shm_queue_t *const thiz, void **out, const uint32_t max);
+
+    /**
+     * Removes at most max elements from this queue, waiting up to the
+     * specified wait time if necessary until at least min have been removed.
+     *
+     * @param thiz this
+     * @param out receives the removed elements in queue order
+     * @param min the number of elements to wait for
+     * @param max the maximum number of elements to remove
+     * @param timeout how long to wait before giving up, in units of unit
+     * @param unit a time_unit_t determining how to interpret the timeout parameter, or NULL to wait without limit
+     * @return the number of elements removed, less than min only if the waiting time elapsed
+     */
+    uint32_t (*take_batch)(struct shm_queue_t *const thiz, void **out, const uint32_t min, const uint32_t max,
+                           const uint64_t timeout, const struct time_unit_t *const unit);
+
+    /**
+     * Returns a non-blocking eventfd that becomes readable when this queue
+     * turns ready for the event, for use with poll/epoll. The descriptor is
+     * owned by the queue and closed by free. Read it before draining the
+     * queue, and drain until the queue reports nothing left.
+     *
+     * @param thiz this
+     * @param event QUEUE_EVENT_NOT_EMPTY or QUEUE_EVENT_NOT_FULL
+     * @return the descriptor, or -1 with errno set
+     */
+    int (*eventfd)(struct shm_queue_t *const thiz, const enum queue_event_t event);
+
+    /**
+     * Closes this queue and wakes every blocked thread. Later puts fail
+     * with errno EPIPE, takes return the remaining elements and then fail
+     * with errno EPIPE. A queue cannot be reopened.
+     *
+     * @param thiz this
+     */
+    void (*close)(struct shm_queue_t *const thiz);
+
+    /**
+     * Returns true if this queue has been closed.
+     *
+     * @param thiz this
+     * @return true if this queue has been closed
+     */
+    bool (*closed)(struct shm_queue_t *const thiz);
+
+    /**
+     * Reads the operational counters of this process, other processes
+     * sharing the queue keep their own. The lock counters stay 0 unless
+     * built with ENABLE_CLQUEUE_LOCK_PROFILE.
+     *
+     * @param thiz this
+     * @param stats filled with the totals since the queue was created or attached
+     */
+    void (*stats)(struct shm_queue_t *const thiz, struct queue_stats_t *const stats);
+
+    /**
+     * Inserts the specified element into this queue, waiting until the
+     * deadline if necessary for space to become available.
+     *
+     * @param thiz this
+     * @param element the element to add
+     * @param deadline absolute CLOCK_MONOTONIC time to give up at, or NULL to wait without limit
+     * @return true if successful, or false if the deadline passes before space is available
+     */
+    bool (*offer_until)(struct shm_queue_t *const thiz, const void *const element, const struct timespec *const deadline);
+
+    /**
+     * Retrieves and removes the head of this queue, waiting until the
+     * deadline if necessary for an element to become available.
+     *
+     * @param thiz this
+     * @param deadline absolute CLOCK_MONOTONIC time to give up at, or NULL to wait without limit
+     * @return the head of this queue, or NULL if the deadline passes before an element is available
+     */
+    void *(*poll_until)(struct shm_queue_t *const thiz, const struct timespec *const deadline);
+
+    /* shared region, mapped at a process local address */
+    struct _shm_region_t *_region;
+
+    /* used ring, block offsets */
+    uint64_t *_ring;
+
+    /* free ring, block offsets */
+    uint64_t *_blocks;
+
+    /* owner table, by block index */
+    uint32_t *_owners;
+
+    /* mapping descriptor */
+    int _fd;
+
+    /* operational counters of this process */
+    struct queue_counters_t *_stats;
+
+    /* lock hold start, for lock profiling */
+    uint64_t _since;
+
+    /* eventfd watchers, by queue_event_t */
+    struct _shm_watch_t _watch[2];
+
+    /* guards starting the watchers */
+    pthread_mutex_t _watch_lock;
+
+    /* tells the watchers to exit */
+    atomic_bool _stop;
+};
+
+static uint32_t _recover(struct shm_queue_t *const thiz);
+
+/**
+ * Locks the region. A previous owner that died holding the lock left the
+ * rings consistent, so the lock is marked consistent again and the blocks
+ * the dead process held go back to the free ring.
+ */
+static inline void _lock(struct shm_queue_t *const thiz)
+{
+    if (queue_counters_lock(thiz->_stats, &thiz->_region->lock, &thiz->_since) == EOWNERDEAD)
+    {
+        pthread_mutex_consistent(&thiz->_region->lock);
+        _recover(thiz);
+    }
+}
+
+static inline void _unlock(struct shm_queue_t *const thiz)
+{
+    queue_counters_unlock(thiz->_stats, &thiz->_region->lock, &thiz->_since);
+}
+
+/**
+ * Waits on cond until signalled or the deadline passes. Called only when holding lock.
+ *
+ * @return 0 if signalled, ETIMEDOUT if the deadline passed
+ */
+static inline int _wait(struct shm_queue_t *const thiz, struct _shm_cond_t *const cond, const struct timespec *const deadline)
+{
+    const uint64_t start = queue_counters_wait_begin();
+    int r;
+
+    queue_counters_release(thiz->_stats, &thiz->_since);
+
+    cond->waiters++;
+
+    if (deadline)
+        r = pthread_cond_timedwait(&cond->cond, &thiz->_region->lock, deadline);
+    else
+        r = pthread_cond_wait(&cond->cond, &thiz->_region->lock);
+
+    cond->waiters--;
+
+    queue_counters_reacquire(&thiz->_since);
+    queue_counters_wait_end(thiz->_stats, start, r == ETIMEDOUT);
+
+    if (r == EOWNERDEAD)
+    {
+        pthread_mutex_consistent(&thiz->_region->lock);
+        _recover(thiz);
+        r = 0;
+    }
+
+    return r;
+}
+
+/**
+ * Wakes up to n threads waiting on cond, one per element published, consumed
+ * or released. Called only when holding lock.
+ */
+static inline void _signal_n(struct shm_queue_t *const thiz, struct _shm_cond_t *const cond, uint32_t n)
+{
+    if (n > cond->waiters)
+        n = cond->waiters;
+
+    for (uint32_t i = 0; i < n; i++)
+        pthread_cond_signal(&cond->cond);
+
+    if (n)
+        queue_counters_add(thiz->_stats, QUEUE_STAT_SIGNALS, n);
+}
+
+static inline void _signal(struct shm_queue_t *const thiz, struct _shm_cond_t *const cond)
+{
+    _signal_n(thiz, cond, 1);
+}
+
+static inline void _broadcast(struct shm_queue_t *const thiz, struct _shm_cond_t *const cond)
+{
+    if (!cond->waiters)
+        return;
+
+    pthread_cond_broadcast(&cond->cond);
+    queue_counters_add(thiz->_stats, QUEUE_STAT_SIGNALS, 1);
+}
+
+static inline long _futex(atomic_uint *const word, const int op, const uint32_t val)
+{
+    /* not private, the word is shared between processes */
+    return syscall(SYS_futex, word, op, val, NULL, NULL, 0);
+}
+
+/**
+ * Publishes a transition to the eventfd watchers of every process. Called
+ * only when holding lock, which orders it after a watcher's registration.
+ */
+static inline void _transition(struct shm_queue_t *const thiz, atomic_uint *const word)
+{
+    if (!atomic_load_explicit(&thiz->_region->watchers, memory_order_relaxed))
+        return;
+
+    atomic_fetch_add_explicit(word, 1, memory_order_release);
+    _futex(word, FUTEX_WAKE, INT_MAX);
+}
+
+/**
+ * Counts elements an offer or put could not insert.
+ */
+static inline void _reject(struct shm_queue_t *const thiz, const uint32_t n)
+{
+    queue_counters_add(thiz->_stats, QUEUE_STAT_REJECTED, n);
+}
+
+static inline uint32_t _count(struct shm_queue_t *const thiz)
+{
+    return thiz->_region->tail - thiz->_region->head;
+}
+
+/**
+ * Converts an element block address to its offset, 0 if it is not a block.
+ */
+static inline uint64_t _offset(struct shm_queue_t *const thiz, const void *const element)
+{
+    const struct _shm_region_t *r = thiz->_region;
+    const uint64_t off = (uint64_t)((const char *)element - (const char *)r);
+
+    if ((const char *)element < (const char *)r || off < r->arena ||
+        off >= r->arena + (uint64_t)r->capacity * r->block_size || (off - r->arena) % r->block_size != 0)
+        return 0;
+
+    return off;
+}
+
+static inline void *_element(struct shm_queue_t *const thiz, const uint64_t off)
+{
+    return (char *)thiz->_region + off;
+}
+
+/* pid of this process, refreshed in a forked child */
+static pid_t _pid;
+
+/* pid namespace of this process, refreshed with _pid */
+static uint64_t _pidns;
+
+static pthread_once_t _pid_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Returns the pid namespace inode of this process, 0 if it cannot be told.
+ */
+static uint64_t _namespace(void)
+{
+    struct stat st;
+    const int e = errno;
+
+    if (stat("/proc/self/ns/pid", &st) < 0)
+    {
+        errno = e;
+        return 0;
+    }
+
+    return (uint64_t)st.st_ino;
+}
+
+static void _forked(void)
+{
+    _pid = getpid();
+    _pidns = _namespace();
+}
+
+static void _pid_init(void)
+{
+    _pid = getpid();
+    _pidns = _namespace();
+    pthread_atfork(NULL, NULL, _forked);
+}
+
+/**
+ * Records the owner of a block. A block is owned only outside the rings: the
+ * owner is set after the index store taking it from a ring and cleared
+ * before the one putting it into a ring, so a process dying in between
+ * leaks the block at worst and never has it recovered twice. Called only
+ * when holding lock.
+ */
+static inline void _own(struct shm_queue_t *const thiz, const uint64_t off, const uint32_t pid)
+{
+    /* a pid from another namespace could name a live process of ours as dead */
+    if (pid && _pidns != thiz->_region->pidns)
+        thiz->_region->foreign = 1;
+
+    /* orders the store against the index store, as seen by the next lock owner */
+    atomic_signal_fence(memory_order_seq_cst);
+    thiz->_owners[(off - thiz->_region->arena) / thiz->_region->block_size] = pid;
+    atomic_signal_fence(memory_order_seq_cst);
+}
+
+/**
+ * Inserts element at the tail. Called only when holding lock.
+ */
+static inline void _enqueue(struct shm_queue_t *const thiz, const uint64_t off)
+{
+    struct _shm_region_t *r = thiz->_region;
+
+    if (r->tail == r->head)
+        _transition(thiz, &r->readable);
+
+    _own(thiz, off, 0);
+    thiz->_ring[r->tail & r->mask] = off;
+    r->tail++;
+    queue_counters_add(thiz->_stats, QUEUE_STAT_OFFERS, 1);
+    _signal(thiz, &r->not_empty);
+}
+
+/**
+ * Extracts element at the head. Called only when holding lock.
+ */
+static inline void *_dequeue(struct shm_queue_t *const thiz)
+{
+    struct _shm_region_t *r = thiz->_region;
+    const uint64_t off = thiz->_ring[r->head & r->mask];
+
+    if (_count(thiz) == r->capacity)
+        _transition(thiz, &r->writable);
+
+    r->head++;
+    _own(thiz, off, _pid);
+    queue_counters_add(thiz->_stats, QUEUE_STAT_TAKES, 1);
+    _signal(thiz, &r->not_full);
+
+    return _element(thiz, off);
+}
+
+/**
+ * Inserts k elements at the tail, waking up to k consumers. Called only when holding lock.
+ */
+static inline void _enqueue_batch(struct shm_queue_t *const thiz, void *const *elements, const uint32_t k)
+{
+    struct _shm_region_t *r = thiz->_region;
+
+    if (k && r->tail == r->head)
+        _transition(thiz, &r->readable);
+
+    for (uint32_t i = 0; i < k; i++)
+    {
+        const uint64_t off = _offset(thiz, elements[i]);
+
+        _own(thiz, off, 0);
+        thiz->_ring[(r->tail + i) & r->mask] = off;
+    }
+    r->tail += k;
+    queue_counters_add(thiz->_stats, QUEUE_STAT_OFFERS, k);
+
+    _signal_n(thiz, &r->not_empty, k);
+}
+
+/**
+ * Extracts k elements at the head, waking up to k producers. Called only when holding lock.
+ */
+static inline void _dequeue_batch(struct shm_queue_t *const thiz, void **const out, const uint32_t k)
+{
+    struct _shm_region_t *r = thiz->_region;
+
+    if (k && _count(thiz) == r->capacity)
+        _transition(thiz, &r->writable);
+
+    const uint32_t head = r->head;
+
+    r->head += k;
+    for (uint32_t i = 0; i < k; i++)
+    {
+        const uint64_t off = thiz->_ring[(head + i) & r->mask];
+
+        _own(thiz, off, _pid);
+        out[i] = _element(thiz, off);
+    }
+    queue_counters_add(thiz->_stats, QUEUE_STAT_TAKES, k);
+
+    _signal_n(thiz, &r->not_full, k);
+}
+
+/**
+ * Returns a block to the free ring. Called only when holding lock.
+ */
+static inline void _release(struct shm_queue_t *const thiz, const uint64_t off)
+{
+    struct _shm_region_t *r = thiz->_region;
+
+    _own(thiz, off, 0);
+    thiz->_blocks[r->free_tail & r->mask] = off;
+    r->free_tail++;
+    _signal(thiz, &r->released);
+}
+
+/**
+ * Returns the blocks held by processes that no longer exist to the free ring.
+ * A pid reused by a new process keeps its blocks leaked. Nothing is recovered
+ * once processes of several pid namespaces have shared the region, their pids
+ * cannot be told apart. Called only when holding lock.
+ *
+ * @return the number of blocks recovered
+ */
+static uint32_t _recover(struct shm_queue_t *const thiz)
+{
+    struct _shm_region_t *r = thiz->_region;
+    const int e = errno;
+    uint32_t n = 0;
+
+    if (r->foreign || _pidns != r->pidns)
+        return 0;
+
+    for (uint32_t i = 0; i < r->capacity; i++)
+    {
+        const pid_t pid = (pid_t)thiz->_owners[i];
+
+        if (pid && kill(pid, 0) < 0 && errno == ESRCH)
+        {
+            _release(thiz, r->arena + (uint64_t)i * r->block_size);
+            n++;
+        }
+    }
+
+    errno = e;
+
+    return n;
+}
+
+static inline bool _valid(struct shm_queue_t *const thiz, void *const *elements, const uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (!_offset(thiz, elements[i]))
+            return false;
+    }
+
+    return true;
+}
+
+static uint32_t shm_queue_size(struct shm_queue_t *const thiz)
+{
+    uint32_t c;
+
+    _lock(thiz);
+    c = _count(thiz);
+    _unlock(thiz);
+
+    return c;
+}
+
+static void shm_queue_clear(struct shm_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return;
+    }
+
+    struct _shm_region_t *r;
+
+    _lock(thiz);
+
+    r = thiz->_region;
+    if (_count(thiz) == r->capacity)
+        _transition(thiz, &r->writable);
+
+    for (; r->head != r->tail; r->head++)
+        _release(thiz, thiz->_ring[r->head & r->mask]);
+
+    _broadcast(thiz, &r->not_full);
+    _broadcast(thiz, &r->released);
+
+    _unlock(thiz);
+
+    return;
+}
+
+static void shm_queue_free(struct shm_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return;
+    }
+
+    atomic_store(&thiz->_stop, true);
+
+    for (int i = 0; i < 2; i++)
+    {
+        struct _shm_watch_t *const w = &thiz->_watch[i];
+
+        /* a child forked with this view has no watcher of its own */
+        if (w->pid == getpid())
+        {
+            /* the spurious transition seen by other processes is harmless */
+            atomic_fetch_add(w->word, 1);
+            _futex(w->word, FUTEX_WAKE, INT_MAX);
+            pthread_join(w->thread, NULL);
+            atomic_fetch_sub(&thiz->_region->watchers, 1);
+        }
+
+        event_fd_destroy(&w->fd);
+    }
+
+    pthread_mutex_destroy(&thiz->_watch_lock);
+
+    /* other processes may still use the region, only this view goes away */
+    munmap(thiz->_region, thiz->_region->size);
+    close(thiz->_fd);
+
+    queue_counters_free(thiz->_stats);
+    free(thiz);
+}
+
+static bool shm_queue_offer(struct shm_queue_t *const thiz, const void *const element)
+{
+    if (!thiz || !element)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    const uint64_t off = _offset(thiz, element);
+    if (!off)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    bool r = false;
+
+    _lock(thiz);
+
+    if (thiz->_region->closed)
+        errno = EPIPE;
+    else if (_count(thiz) != thiz->_region->capacity)
+    {
+        _enqueue(thiz, off);
+        r = true;
+    }
+
+    _unlock(thiz);
+
+    if (!r)
+        _reject(thiz, 1);
+
+    return r;
+}
+
+static void *shm_queue_poll(struct shm_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    void *item = NULL;
+
+    _lock(thiz);
+
+    if (_count(thiz) > 0)
+        item = _dequeue(thiz);
+    else if (thiz->_region->closed)
+        errno = EPIPE;
+
+    _unlock(thiz);
+
+    return item;
+}
+
+static void *shm_queue_peek(struct shm_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    void *item = NULL;
+
+    _lock(thiz);
+
+    if (_count(thiz) > 0)
+        item = _element(thiz, thiz->_ring[thiz->_region->head & thiz->_region->mask]);
+
+    _unlock(thiz);
+
+    return item;
+}
+
+static bool shm_queue_put(struct shm_queue_t *const thiz, const void *const element)
+{
+    if (!thiz || !element)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    const uint64_t off = _offset(thiz, element);
+    if (!off)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    bool r = false;
+
+    _lock(thiz);
+
+    while (_count(thiz) == thiz->_region->capacity && !thiz->_region->closed)
+    {
+        _wait(thiz, &thiz->_region->not_full, NULL);
+    }
+
+    if (thiz->_region->closed)
+        errno = EPIPE;
+    else
+    {
+        _enqueue(thiz, off);
+        r = true;
+    }
+
+    _unlock(thiz);
+
+    if (!r)
+        _reject(thiz, 1);
+
+    return r;
+}
+
+static void *shm_queue_take(struct shm_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    void *item = NULL;
+
+    _lock(thiz);
+
+    while (_count(thiz) == 0 && !thiz->_region->closed)
+    {
+        _wait(thiz, &thiz->_region->not_empty, NULL);
+    }
+
+    if (_count(thiz) > 0)
+        item = _dequeue(thiz);
+    else
+        errno = EPIPE;
+
+    _unlock(thiz);
+
+    return item;
+}
+
+static bool shm_queue_offer_until(struct shm_queue_t *const thiz, const void *const element, const struct timespec *const deadline)
+{
+    if (!thiz || !element)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    const uint64_t off = _offset(thiz, element);
+    if (!off)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    bool r = false;
+
+    _lock(thiz);
+
+    while (_count(thiz) == thiz->_region->capacity && !thiz->_region->closed)
+    {
+        if (_wait(thiz, &thiz->_region->not_full, deadline) == ETIMEDOUT)
+            goto result_r;
+    }
+
+    if (thiz->_region->closed)
+    {
+        errno = EPIPE;
+        goto result_r;
+    }
+
+    _enqueue(thiz, off);
+    r = true;
+
+result_r:
+    _unlock(thiz);
+
+    if (!r)
+        _reject(thiz, 1);
+
+    return r;
+}
+
+static bool shm_queue_offer_wait(struct shm_queue_t *const thiz, const void *const element,
+                                 const uint64_t timeout, const struct time_unit_t *const unit)
+{
+    if (!thiz || !element || !unit)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    struct timespec timeo;
+
+    calc_timeout(&timeo, timeout, unit);
+
+    return shm_queue_offer_until(thiz, element, &timeo);
+}
+
+static void *shm_queue_poll_until(struct shm_queue_t *const thiz, const struct timespec *const deadline)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    void *item = NULL;
+
+    _lock(thiz);
+
+    while (_count(thiz) == 0)
+    {
+        if (thiz->_region->closed)
+        {
+            errno = EPIPE;
+            goto result_r;
+        }
+
+        if (_wait(thiz, &thiz->_region->not_empty, deadline) == ETIMEDOUT)
+            goto result_r;
+    }
+
+    item = _dequeue(thiz);
+
+result_r:
+    _unlock(thiz);
+
+    return item;
+}
+
+static void *shm_queue_poll_wait(struct shm_queue_t *const thiz, const uint64_t timeout, const struct time_unit_t *const unit)
+{
+    if (!thiz || !unit)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    struct timespec timeo;
+
+    calc_timeout(&timeo, timeout, unit);
+
+    return shm_queue_poll_until(thiz, &timeo);
+}
+
+static uint32_t shm_queue_offer_batch(struct shm_queue_t *const thiz, void *const *elements, const uint32_t n)
+{
+    if (!thiz || !elements || !_valid(thiz, elements, n))
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    if (n == 0)
+        return 0;
+
+    uint32_t k;
+
+    _lock(thiz);
+
+    if (thiz->_region->closed)
+    {
+        errno = EPIPE;
+        k = 0;
+    }
+    else
+    {
+        k = thiz->_region->capacity - _count(thiz);
+        if (k > n)
+            k = n;
+
+        _enqueue_batch(thiz, elements, k);
+    }
+
+    _unlock(thiz);
+
+    if (k < n)
+        _reject(thiz, n - k);
+
+    return k;
+}
+
+static uint32_t shm_queue_put_batch(struct shm_queue_t *const thiz, void *const *elements, const uint32_t n)
+{
+    if (!thiz || !elements || !_valid(thiz, elements, n))
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    uint32_t k;
+    uint32_t done = 0;
+
+    _lock(thiz);
+
+    while (done < n)
+    {
+        while (_count(thiz) == thiz->_region->capacity && !thiz->_region->closed)
+        {
+            _wait(thiz, &thiz->_region->not_full, NULL);
+        }
+
+        if (thiz->_region->closed)
+        {
+            errno = EPIPE;
+            break;
+        }
+
+        k = thiz->_region->capacity - _count(thiz);
+        if (k > n - done)
+            k = n - done;
+
+        _enqueue_batch(thiz, elements + done, k);
+        done += k;
+    }
+
+    _unlock(thiz);
+
+    if (done < n)
+        _reject(thiz, n - done);
+
+    return done;
+}
+
+static uint32_t shm_queue_drain_to(struct shm_queue_t *const thiz, void **out, const uint32_t max)
+{
+    if (!thiz || !out)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    if (max == 0)
+        return 0;
+
+    uint32_t k;
+
+    _lock(thiz);
+
+    k = _count(thiz);
+    if (k > max)
+        k = max;
+    else if (k == 0 && thiz->_region->closed)
+        errno = EPIPE;
+
+    _dequeue_batch(thiz, out, k);
+
+    _unlock(thiz);
+
+    return k;
+}
+
+static uint32_t shm_queue_take_batch(struct shm_queue_t *const thiz, void **out, const uint32_t min, const uint32_t max,
+                                     const uint64_t timeout, const struct time_unit_t *const unit)
+{
+    if (!thiz || !out)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    uint32_t k;
+    uint32_t taken = 0;
+    uint32_t need = (min > max) ? max : min;
+    struct timespec timeo;
+
+    if (unit)
+        calc_timeout(&timeo, timeout, unit);
+
+    _lock(thiz);
+
+    while (taken < max)
+    {
+        while (_count(thiz) == 0)
+        {
+            if (taken >= need)
+                goto result_r;
+
+            if (thiz->_region->closed)
+            {
+                errno = EPIPE;
+                goto result_r;
+            }
+
+            if (_wait(thiz, &thiz->_region->not_empty, unit ? &timeo : NULL) == ETIMEDOUT)
+                goto result_r;
+        }
+
+        k = _count(thiz);
+        if (k > max - taken)
+            k = max - taken;
+
+        _dequeue_batch(thiz, out + taken, k);
+        taken += k;
+
+        if (taken >= need)
+            break;
+    }
+
+result_r:
+    _unlock(thiz);
+
+    return taken;
+}
+
+static bool _not_empty(void *arg)
+{
+    struct shm_queue_t *const thiz = (struct shm_queue_t *)arg;
+    bool r;
+
+    _lock(thiz);
+    r = _count(thiz) != 0 || thiz->_region->closed;
+    _unlock(thiz);
+
+    return r;
+}
+
+static bool _not_full(void *arg)
+{
+    struct shm_queue_t *const thiz = (struct shm_queue_t *)arg;
+    bool r;
+
+    _lock(thiz);
+    r = _count(thiz) != thiz->_region->capacity || thiz->_region->closed;
+    _unlock(thiz);
+
+    return r;
+}
+
+/**
+ * Relays the transitions published on the shared word to the descriptor of
+ * this process, until the view is freed.
+ */
+static void *_watch(void *arg)
+{
+    struct _shm_watch_t *const w = (struct _shm_watch_t *)arg;
+    uint32_t seen = w->seen;
+
+    while (!atomic_load(&w->queue->_stop))
+    {
+        _futex(w->word, FUTEX_WAIT, seen);
+
+        const uint32_t now = atomic_load_explicit(w->word, memory_order_acquire);
+        if (now != seen)
+        {
+            seen = now;
+            event_fd_signal(&w->fd);
+        }
+    }
+
+    return NULL;
+}
+
+static int shm_queue_eventfd(struct shm_queue_t *const thiz, const enum queue_event_t event)
+{
+    if (!thiz || (event != QUEUE_EVENT_NOT_EMPTY && event != QUEUE_EVENT_NOT_FULL))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    struct _shm_watch_t *const w = &thiz->_watch[event];
+    int fd = -1;
+
+    pthread_mutex_lock(&thiz->_watch_lock);
+
+    if (w->pid)
+    {
+        if (w->pid == getpid())
+            fd = event_fd_open(&w->fd, NULL, NULL);
+        else
+            errno = EBUSY;
+
+        goto result_r;
+    }
+
+    /* transitions from here on are published, earlier ones show in the state */
+    _lock(thiz);
+    atomic_fetch_add(&thiz->_region->watchers, 1);
+    w->seen = atomic_load(w->word);
+    _unlock(thiz);
+
+    if ((errno = pthread_create(&w->thread, NULL, _watch, w)) != 0)
+    {
+        atomic_fetch_sub(&thiz->_region->watchers, 1);
+        goto result_r;
+    }
+
+    w->pid = getpid();
+
+    fd = event_fd_open(&w->fd, event == QUEUE_EVENT_NOT_FULL ? _not_full : _not_empty, thiz);
+
+result_r:
+    pthread_mutex_unlock(&thiz->_watch_lock);
+
+    return fd;
+}
+
+static void shm_queue_close(struct shm_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = EINVAL;
+        return;
+    }
+
+    _lock(thiz);
+
+    thiz->_region->closed = 1;
+
+    _broadcast(thiz, &thiz->_region->not_empty);
+    _broadcast(thiz, &thiz->_region->not_full);
+    _broadcast(thiz, &thiz->_region->released);
+
+    _transition(thiz, &thiz->_region->readable);
+    _transition(thiz, &thiz->_region->writable);
+
+    _unlock(thiz);
+}
+
+static bool shm_queue_closed(struct shm_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    bool r;
+
+    _lock(thiz);
+    r = thiz->_region->closed != 0;
+    _unlock(thiz);
+
+    return r;
+}
+
+static void shm_queue_stats(struct shm_queue_t *const thiz, struct queue_stats_t *const stats)
+{
+    if (!thiz || !stats)
+    {
+        errno = EINVAL;
+        return;
+    }
+
+    queue_counters_read(thiz->_stats, stats);
+}
+
+/**
+ * Initializes a fresh region of the given layout.
+ */
+static int _format(struct _shm_region_t *const r, const uint32_t capacity, const uint32_t block_size,
+                   const uint32_t length, const uint64_t size)
+{
+    pthread_mutexattr_t mutex_attr;
+    pthread_condattr_t cond_attr;
+    uint64_t *blocks;
+
+    pthread_once(&_pid_once, _pid_init);
+
+    r->capacity = capacity;
+    r->block_size = block_size;
+    r->mask = length - 1;
+    r->size = size;
+    r->ring = (sizeof(struct _shm_region_t) + CACHE_LINE_SIZE - 1) & ~(uint64_t)(CACHE_LINE_SIZE - 1);
+    r->blocks = r->ring + (uint64_t)length * sizeof(uint64_t);
+    r->owners = r->blocks + (uint64_t)length * sizeof(uint64_t);
+    r->arena = (r->owners + (uint64_t)capacity * sizeof(uint32_t) + CACHE_LINE_SIZE - 1) & ~(uint64_t)(CACHE_LINE_SIZE - 1);
+
+    blocks = (uint64_t *)((char *)r + r->blocks);
+    for (uint32_t i = 0; i < capacity; i++)
+        blocks[i] = r->arena + (uint64_t)i * block_size;
+
+    r->head = r->tail = 0;
+    r->free_head = 0;
+    r->free_tail = capacity;
+    r->closed = 0;
+    r->pidns = _pidns;
+    r->foreign = (_pidns == 0);
+    r->not_empty.waiters = r->not_full.waiters = r->released.waiters = 0;
+    atomic_init(&r->watchers, 0);
+    atomic_init(&r->readable, 0);
+    atomic_init(&r->writable, 0);
+
+    pthread_mutexattr_init(&mutex_attr);
+    pthread_mutexattr_setpshared(&mutex_attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&mutex_attr, PTHREAD_MUTEX_ROBUST);
+
+    /* thread cond timeout block's way CLOCK_REALTIME --> CLOCK_MONOTONIC */
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setpshared(&cond_attr, PTHREAD_PROCESS_SHARED);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+
+    if (pthread_mutex_init(&r->lock, &mutex_attr) != 0 ||
+        pthread_cond_init(&r->not_empty.cond, &cond_attr) != 0 ||
+        pthread_cond_init(&r->not_full.cond, &cond_attr) != 0 ||
+        pthread_cond_init(&r->released.cond, &cond_attr) != 0)
+    {
+        pthread_mutexattr_destroy(&mutex_attr);
+        pthread_condattr_destroy(&cond_attr);
+        return -1;
+    }
+
+    pthread_mutexattr_destroy(&mutex_attr);
+    pthread_condattr_destroy(&cond_attr);
+
+    atomic_store_explicit(&r->magic, SHM_QUEUE_MAGIC, memory_order_release);
+
+    return 0;
+}
+
+/**
+ * Builds the process local view of a mapped region, taking over fd.
+ */
+static struct blocking_queue_t *_queue(struct _shm_region_t *const r, const int fd)
+{
+    struct shm_queue_t *const thiz = (struct shm_queue_t *)malloc(sizeof(struct shm_queue_t));
+    if (thiz == NULL)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    memset((void *)thiz, 0, sizeof(struct shm_queue_t));
+
+    thiz->_stats = queue_counters();
+    if (!thiz->_stats)
+    {
+        free(thiz);
+        return NULL;
+    }
+
+    thiz->_region = r;
+    thiz->_ring = (uint64_t *)((char *)r + r->ring);
+    thiz->_blocks = (uint64_t *)((char *)r + r->blocks);
+    thiz->_owners = (uint32_t *)((char *)r + r->owners);
+    thiz->_fd = fd;
+
+    pthread_once(&_pid_once, _pid_init);
+
+    pthread_mutex_init(&thiz->_watch_lock, NULL);
+    for (int i = 0; i < 2; i++)
+    {
+        thiz->_watch[i].queue = thiz;
+        event_fd_init(&thiz->_watch[i].fd);
+    }
+    thiz->_watch[QUEUE_EVENT_NOT_EMPTY].word = &r->readable;
+    thiz->_watch[QUEUE_EVENT_NOT_FULL].word = &r->writable;
+
+    /* methods */
+    thiz->size = shm_queue_size;
+    thiz->clear = shm_queue_clear;
+    thiz->free = shm_queue_free;
+    thiz->offer = shm_queue_offer;
+    thiz->poll = shm_queue_poll;
+    thiz->peek = shm_queue_peek;
+    thiz->put = shm_queue_put;
+    thiz->offer_await = shm_queue_offer_wait;
+    thiz->take = shm_queue_take;
+    thiz->poll_await = shm_queue_poll_wait;
+    thiz->offer_batch = shm_queue_offer_batch;
+    thiz->put_batch = shm_queue_put_batch;
+    thiz->drain_to = shm_queue_drain_to;
+    thiz->take_batch = shm_queue_take_batch;
+    thiz->eventfd = shm_queue_eventfd;
+    thiz->close = shm_queue_close;
+    thiz->closed = shm_queue_closed;
+    thiz->stats = shm_queue_stats;
+    thiz->offer_until = shm_queue_offer_until;
+    thiz->poll_until = shm_queue_poll_until;
+
+    return (struct blocking_queue_t *)thiz;
+}
+
+struct blocking_queue_t *shm_queue(const char *const name, const uint32_t capacity, const uint32_t element_size)
+{
+    struct _shm_region_t *r;
+    struct blocking_queue_t *queue;
+    uint32_t length = 1;
+
+    if (capacity == 0 || capacity > SHM_QUEUE_MAX_CAPACITY || element_size == 0 ||
+        element_size > UINT32_MAX - CACHE_LINE_SIZE)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    while (length < capacity)
+        length <<= 1;
+
+    /* header, two rings of offsets, the owner table, then the cache line aligned blocks */
+    const uint32_t block_size = (element_size + CACHE_LINE_SIZE - 1) & ~(uint32_t)(CACHE_LINE_SIZE - 1);
+    const uint64_t size = ((sizeof(struct _shm_region_t) + CACHE_LINE_SIZE - 1) & ~(uint64_t)(CACHE_LINE_SIZE - 1)) +
+                          ((2 * (uint64_t)length * sizeof(uint64_t) + (uint64_t)capacity * sizeof(uint32_t) +
+                            CACHE_LINE_SIZE - 1) & ~(uint64_t)(CACHE_LINE_SIZE - 1)) +
+                          (uint64_t)capacity * block_size;
+
+    const int fd = name ? shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600) : memfd_create("shm_queue", MFD_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    if (ftruncate(fd, (off_t)size) < 0)
+        goto shmQueue_err_1;
+
+    r = (struct _shm_region_t *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (r == MAP_FAILED)
+        goto shmQueue_err_1;
+
+    if (_format(r, capacity, block_size, length, size) < 0)
+    {
+        errno = ENOMEM;
+        goto shmQueue_err_2;
+    }
+
+    queue = _queue(r, fd);
+    if (!queue)
+        goto shmQueue_err_2;
+
+    return queue;
+
+shmQueue_err_2:
+    munmap(r, size);
+
+shmQueue_err_1:
+    {
+        const int e = errno;
+
+        close(fd);
+        if (name)
+            shm_unlink(name);
+        errno = e;
+    }
+
+    return NULL;
+}
+
+/**
+ * Maps an initialized region, taking over fd.
+ */
+static struct blocking_queue_t *_attach(const int fd)
+{
+    struct stat st;
+    struct _shm_region_t *r;
+    struct blocking_queue_t *queue;
+
+    if (fstat(fd, &st) < 0)
+        goto attach_err_1;
+
+    /* the creator has not sized the object yet */
+    if ((uint64_t)st.st_size < sizeof(struct _shm_region_t))
+    {
+        errno = EAGAIN;
+        goto attach_err_1;
+    }
+
+    r = (struct _shm_region_t *)mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (r == MAP_FAILED)
+        goto attach_err_1;
+
+    if (atomic_load_explicit(&r->magic, memory_order_acquire) != SHM_QUEUE_MAGIC)
+    {
+        errno = EAGAIN;
+        goto attach_err_2;
+    }
+
+    if (r->size != (uint64_t)st.st_size)
+    {
+        errno = EINVAL;
+        goto attach_err_2;
+    }
+
+    queue = _queue(r, fd);
+    if (!queue)
+        goto attach_err_2;
+
+    return queue;
+
+attach_err_2:
+    {
+        const int e = errno;
+
+        munmap(r, st.st_size);
+        errno = e;
+    }
+
+attach_err_1:
+    {
+        const int e = errno;
+
+        close(fd);
+        errno = e;
+    }
+
+    return NULL;
+}
+
+struct blocking_queue_t *shm_queue_attach(const char *const name)
+{
+    if (!name)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    const int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0)
+        return NULL;
+
+    return _attach(fd);
+}
+
+struct blocking_queue_t *shm_queue_attach_fd(const int fd)
+{
+    const int dup_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (dup_fd < 0)
+        return NULL;
+
+    return _attach(dup_fd);
+}
+
+int shm_queue_fd(struct blocking_queue_t *const queue)
+{
+    struct shm_queue_t *const thiz = (struct shm_queue_t *)queue;
+
+    if (!thiz)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return thiz->_fd;
+}
+
+void *shm_queue_element(struct blocking_queue_t *const queue, const uint64_t timeout, const struct time_unit_t *const unit)
+{
+    struct shm_queue_t *const thiz = (struct shm_queue_t *)queue;
+
+    if (!thiz)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct _shm_region_t *r = thiz->_region;
+    struct timespec timeo;
+    void *element = NULL;
+
+    if (unit)
+        calc_timeout(&timeo, timeout, unit);
+
+    _lock(thiz);
+
+    while (r->free_head == r->free_tail && !r->closed)
+    {
+        if (_wait(thiz, &r->released, unit ? &timeo : NULL) == ETIMEDOUT)
+            goto result_r;
+    }
+
+    if (r->closed)
+    {
+        errno = EPIPE;
+        goto result_r;
+    }
+
+    const uint64_t off = thiz->_blocks[r->free_head & r->mask];
+
+    r->free_head++;
+    _own(thiz, off, _pid);
+    element = _element(thiz, off);
+
+result_r:
+    _unlock(thiz);
+
+    return element;
+}
+
+void shm_queue_release(struct blocking_queue_t *const queue, void *const element)
+{
+    struct shm_queue_t *const thiz = (struct shm_queue_t *)queue;
+
+    if (!thiz || !element)
+    {
+        errno = EINVAL;
+        return;
+    }
+
+    const uint64_t off = _offset(thiz, element);
+    if (!off)
+    {
+        errno = EINVAL;
+        return;
+    }
+
+    _lock(thiz);
+    _release(thiz, off);
+    _unlock(thiz);
+}
+
+uint32_t shm_queue_recover(struct blocking_queue_t *const queue)
+{
+    struct shm_queue_t *const thiz = (struct shm_queue_t *)queue;
+    uint32_t n;
+
+    if (!thiz)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    _lock(thiz);
+    n = _recover(thiz);
+    _unlock(thiz);
+
+    return n;
+}
+
+int shm_queue_unlink(const char *const name)
+{
+    if (!name)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return shm_unlink(name);
+}
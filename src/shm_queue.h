@@ -0,0 +1,104 @@
+#ifndef _SHM_QUEUE_H_
+#define _SHM_QUEUE_H_
+
+#include <stdint.h>
+#include "blocking_queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Creates a shared memory blocking queue.
+ *
+ * the queue, its process-shared robust lock and an arena of capacity element
+ * blocks live in one mapping. elements are blocks taken from the arena with
+ * shm_queue_element, so a put in one process and a take in another pass the
+ * element without copying it. free only detaches the calling process.
+ *
+ * an eventfd belongs to the process that asked for it: a thread of that
+ * process parks on a shared transition word and relays each transition to
+ * the descriptor. a child forked with the view gets EBUSY from eventfd and
+ * attaches a view of its own to watch the queue.
+ *
+ * @param name POSIX shared memory object name such as "/ingest", created
+ *             exclusively, or NULL for an anonymous memfd shared through
+ *             shm_queue_fd
+ * @param capacity the capacity of this queue and number of element blocks, must be non-zero
+ * @param element_size size of one element block in bytes, must be non-zero
+ * @return the queue, or NULL on failure
+ */
+extern struct blocking_queue_t *shm_queue(const char *const name, const uint32_t capacity, const uint32_t element_size);
+
+/**
+ * Attaches to a queue created by shm_queue in another process.
+ *
+ * @param name name given to shm_queue
+ * @return the queue, or NULL on failure, with errno EAGAIN if the creator has not finished
+ */
+extern struct blocking_queue_t *shm_queue_attach(const char *const name);
+
+/**
+ * Attaches to a queue through a descriptor of its mapping, as returned by
+ * shm_queue_fd and inherited or passed over a unix socket. The descriptor is
+ * duplicated and stays owned by the caller.
+ *
+ * @param fd descriptor of the queue mapping
+ * @return the queue, or NULL on failure
+ */
+extern struct blocking_queue_t *shm_queue_attach_fd(const int fd);
+
+/**
+ * @param queue queue returned by shm_queue or shm_queue_attach
+ * @return the descriptor of the queue mapping, or -1 on failure
+ */
+extern int shm_queue_fd(struct blocking_queue_t *const queue);
+
+/**
+ * Takes a free element block from the arena, waiting up to the specified wait
+ * time if necessary for one to be released.
+ *
+ * @param queue queue
+ * @param timeout how long to wait before giving up, in units of unit
+ * @param unit a time_unit_t determining how to interpret the timeout parameter, or NULL to wait without limit
+ * @return the element block, or NULL if the specified waiting time elapses before a block is released,
+ *         or with errno EPIPE once the queue is closed
+ */
+extern void *shm_queue_element(struct blocking_queue_t *const queue, const uint64_t timeout, const struct time_unit_t *const unit);
+
+/**
+ * Gives an element block, taken from this queue or returned by
+ * shm_queue_element and never put, back to the arena.
+ *
+ * @param queue queue
+ * @param element the element block
+ */
+extern void shm_queue_release(struct blocking_queue_t *const queue, void *const element);
+
+/**
+ * Returns the element blocks held by processes that have exited to the
+ * arena. The next process to take the lock after one died holding it does
+ * this by itself; a process that died outside the lock is only noticed here.
+ * A block whose owner's pid has been reused stays with it. Liveness is told
+ * by pid, so processes must share one pid namespace: once a process of
+ * another namespace has held a block, nothing is recovered any more.
+ *
+ * @param queue queue
+ * @return the number of blocks recovered
+ */
+extern uint32_t shm_queue_recover(struct blocking_queue_t *const queue);
+
+/**
+ * Removes the name of a queue created by shm_queue. The mapping lives on
+ * until every attached process has freed its queue.
+ *
+ * @param name name given to shm_queue
+ * @return 0 on success, -1 on failure
+ */
+extern int shm_queue_unlink(const char *const name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
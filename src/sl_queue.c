@@ -0,0 +1,499 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include "sl_queue.h"
+#include "cpu_util.h"
+#include "ebr.h"
+#include "time_util.h"
+
+/* skiplist levels, the head is this tall */
+#define SL_QUEUE_LEVELS 32
+
+/* deleted nodes in front of the first element before poll unlinks them */
+#define SL_QUEUE_BOUND_OFFSET 32
+
+/**
+ * skiplist node
+ */
+struct _node_t
+{
+    /* retire link */
+    struct ebr_entry_t entry;
+
+    const void *item;
+
+    /* set until every level is linked, the node is not reclaimed before */
+    atomic_bool inserting;
+
+    /* set once polled, the element may be freed and is not compared again */
+    atomic_bool deleted;
+
+    /* number of levels */
+    uint32_t height;
+
+    /* successors by level, the low bit of next[0] marks the successor deleted */
+    _Atomic(uintptr_t) next[];
+};
+
+/**
+ * skip list priority queue
+ *
+ * lock-free priority queue based on a skiplist. deleted nodes always form a
+ * prefix of the bottom level, so poll only has to mark the first live node.
+ */
+struct sl_queue_t
+{
+
+    /**
+     * Returns the number of elements in this collection.
+     *
+     * @param thiz this
+     * @return the number of elements in this collection
+     */
+    uint32_t (*size)(struct sl_queue_t *const thiz);
+
+    /**
+     * Removes all of the elements from this collection.
+     *
+     *  @param thiz this
+     */
+    void (*clear)(struct sl_queue_t *const thiz);
+
+    /**
+     * Free collection
+     *
+     * @param thiz this
+     */
+    void (*free)(struct sl_queue_t *const thiz);
+
+    /**
+     * Inserts the specified element into this queue if it is possible to do
+     * so immediately without violating capacity restrictions.
+     *
+     * @param thiz this
+     * @param element element
+     * @return true if the element was added to this queue, else false
+     */
+    bool (*offer)(struct sl_queue_t *const thiz, const void *const element);
+
+    /**
+     * Retrieves and removes the head of this queue,
+     * or returns NULL if this queue is empty.
+     *
+     * @param thiz this
+     * @return the head of this queue, or NULL if this queue is empty
+     */
+    void *(*poll)(struct sl_queue_t *const thiz);
+
+    /**
+     * Retrieves, but does not remove, the head of this queue,
+     * or returns NULL if this queue is empty.
+     *
+     * @param thiz this
+     * @return the head of this queue, or NULL if this queue is empty
+     */
+    void *(*peek)(struct sl_queue_t *const thiz);
+
+    /* sort condition function */
+    int32_t (*_compare)(const void *, const void *);
+
+    /* head sentinel, before every node */
+    struct _node_t *_head;
+
+    /* tail sentinel, after every node */
+    struct _node_t *_tail;
+
+    /* number of enqueued elements */
+    CACHE_ALIGNED atomic_size_t _enqueued;
+
+    /* number of dequeued elements */
+    CACHE_ALIGNED atomic_size_t _dequeued;
+};
+
+static inline bool _marked(const uintptr_t p)
+{
+    return p & 1;
+}
+
+static inline struct _node_t *_ref(const uintptr_t p)
+{
+    return (struct _node_t *)(p & ~(uintptr_t)1);
+}
+
+static inline bool _cas(_Atomic(uintptr_t) *const p, uintptr_t expected, const uintptr_t desired)
+{
+    return atomic_compare_exchange_strong(p, &expected, desired);
+}
+
+static struct _node_t *_node(const void *const item, const uint32_t height)
+{
+    struct _node_t *node = (struct _node_t *)malloc(sizeof(struct _node_t) + height * sizeof(_Atomic(uintptr_t)));
+    if (!node)
+        return NULL;
+
+    node->item = item;
+    node->height = height;
+    atomic_init(&node->inserting, false);
+    atomic_init(&node->deleted, false);
+
+    for (uint32_t i = 0; i < height; i++)
+        atomic_init(&node->next[i], 0);
+
+    return node;
+}
+
+static void _reclaim(struct ebr_entry_t *const entry)
+{
+    free((struct _node_t *)entry);
+}
+
+/**
+ * Returns a random height, level i + 1 is taken with probability 1/2.
+ */
+static inline uint32_t _height(void)
+{
+    static __thread uint32_t seed;
+
+    if (seed == 0)
+        seed = ((uint32_t)(uintptr_t)&seed ^ (uint32_t)nano_time()) | 1;
+
+    /* xorshift32 */
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+
+    return (uint32_t)__builtin_ctz(seed | (1U << (SL_QUEUE_LEVELS - 1))) + 1;
+}
+
+/**
+ * Finds the predecessor and successor of element on every level, passing
+ * deleted nodes and nodes not placed after element.
+ *
+ * @return the last node found deleted on the bottom level, or NULL
+ */
+static struct _node_t *_locate(struct sl_queue_t *const thiz, const void *const element,
+                               struct _node_t **const preds, struct _node_t **const succs)
+{
+    struct _node_t *x = thiz->_head;
+    struct _node_t *x_next;
+    struct _node_t *del = NULL;
+    uintptr_t p;
+    bool d;
+
+    for (int32_t i = SL_QUEUE_LEVELS - 1; i >= 0; i--)
+    {
+        p = atomic_load(&x->next[i]);
+        d = _marked(p);
+        x_next = _ref(p);
+
+        /* deleted nodes are checked first, their elements may be gone */
+        while (x_next != thiz->_tail &&
+               (d || _marked(atomic_load(&x_next->next[0])) || atomic_load(&x_next->deleted) ||
+                thiz->_compare(x_next->item, element) <= 0))
+        {
+            if (d)
+                del = x_next;
+
+            x = x_next;
+            p = atomic_load(&x->next[i]);
+            d = _marked(p);
+            x_next = _ref(p);
+        }
+
+        preds[i] = x;
+        succs[i] = x_next;
+    }
+
+    return del;
+}
+
+/**
+ * Moves the upper levels of the head past the deleted prefix.
+ */
+static void _restructure(struct sl_queue_t *const thiz)
+{
+    struct _node_t *const head = thiz->_head;
+    struct _node_t *pred = head;
+    struct _node_t *h;
+    struct _node_t *cur;
+    int32_t i = SL_QUEUE_LEVELS - 1;
+
+    while (i > 0)
+    {
+        h = _ref(atomic_load(&head->next[i]));
+        cur = _ref(atomic_load(&pred->next[i]));
+
+        if (!_marked(atomic_load(&h->next[0])))
+        {
+            i--;
+            continue;
+        }
+
+        while (_marked(atomic_load(&cur->next[0])))
+        {
+            pred = cur;
+            cur = _ref(atomic_load(&pred->next[i]));
+        }
+
+        if (_cas(&head->next[i], (uintptr_t)h, atomic_load(&pred->next[i])))
+            i--;
+    }
+}
+
+static uint32_t sl_queue_size(struct sl_queue_t *const thiz)
+{
+    const size_t d = atomic_load_explicit(&thiz->_dequeued, memory_order_relaxed);
+    const intptr_t c = (intptr_t)(atomic_load_explicit(&thiz->_enqueued, memory_order_relaxed) - d);
+
+    if (c < 0)
+        return 0;
+
+    return c > UINT32_MAX ? UINT32_MAX : (uint32_t)c;
+}
+
+static void sl_queue_clear(struct sl_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return;
+    }
+
+    void *item;
+
+    while ((item = thiz->poll(thiz)) != NULL)
+        free(item);
+}
+
+static void sl_queue_free(struct sl_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return;
+    }
+
+    thiz->clear(thiz);
+
+    /* the deleted prefix still hanging off the head */
+    for (struct _node_t *next, *node = thiz->_head; node != thiz->_tail; node = next)
+    {
+        next = _ref(atomic_load(&node->next[0]));
+        free(node);
+    }
+
+    free(thiz->_tail);
+    free(thiz);
+}
+
+static bool sl_queue_offer(struct sl_queue_t *const thiz, const void *const element)
+{
+    if (!thiz || !element)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    struct _node_t *preds[SL_QUEUE_LEVELS];
+    struct _node_t *succs[SL_QUEUE_LEVELS];
+    struct _node_t *del;
+    const uint32_t height = _height();
+
+    struct _node_t *node = _node(element, height);
+    if (!node)
+    {
+        errno = ENOMEM;
+        return false;
+    }
+
+    atomic_store(&node->inserting, true);
+
+    ebr_enter();
+
+    do
+    {
+        del = _locate(thiz, element, preds, succs);
+        atomic_store_explicit(&node->next[0], (uintptr_t)succs[0], memory_order_relaxed);
+    } while (!_cas(&preds[0]->next[0], (uintptr_t)succs[0], (uintptr_t)node));
+
+    for (uint32_t i = 1; i < height;)
+    {
+        atomic_store(&node->next[i], (uintptr_t)succs[i]);
+
+        /* the node or its successor is being deleted, a shorter tower will do */
+        if (_marked(atomic_load(&node->next[0])) || _marked(atomic_load(&succs[i]->next[0])) || del == succs[i])
+            break;
+
+        if (_cas(&preds[i]->next[i], (uintptr_t)succs[i], (uintptr_t)node))
+        {
+            i++;
+            continue;
+        }
+
+        /* equal elements are passed, so the node is the bottom predecessor
+         * unless an equal one was linked after it */
+        del = _locate(thiz, element, preds, succs);
+        if (preds[0] != node)
+            break;
+    }
+
+    atomic_store(&node->inserting, false);
+
+    ebr_exit();
+
+    atomic_fetch_add_explicit(&thiz->_enqueued, 1, memory_order_relaxed);
+
+    return true;
+}
+
+static void *sl_queue_poll(struct sl_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    struct _node_t *x = thiz->_head;
+    struct _node_t *newhead = NULL;
+    uintptr_t obshead;
+    uintptr_t nxt;
+    uint32_t offset = 0;
+    void *item;
+
+    ebr_enter();
+
+    obshead = atomic_load(&x->next[0]);
+
+    /* mark the way through the deleted prefix, the first successor found
+     * unmarked is ours */
+    do
+    {
+        nxt = atomic_load(&x->next[0]);
+        if (_ref(nxt) == thiz->_tail)
+        {
+            ebr_exit();
+            return NULL;
+        }
+
+        /* a node still linking its tower must stay reachable */
+        if (!newhead && atomic_load(&x->inserting))
+            newhead = x;
+
+        nxt = atomic_fetch_or(&x->next[0], 1);
+        offset++;
+        x = _ref(nxt);
+    } while (_marked(nxt));
+
+    item = (void *)x->item;
+    atomic_store(&x->deleted, true);
+
+    if (offset >= SL_QUEUE_BOUND_OFFSET)
+    {
+        if (!newhead)
+            newhead = x;
+
+        if (_cas(&thiz->_head->next[0], obshead, (uintptr_t)newhead | 1))
+        {
+            _restructure(thiz);
+
+            for (struct _node_t *next, *cur = _ref(obshead); cur != newhead; cur = next)
+            {
+                next = _ref(atomic_load(&cur->next[0]));
+                ebr_retire(&cur->entry, _reclaim);
+            }
+        }
+    }
+
+    ebr_exit();
+
+    atomic_fetch_add_explicit(&thiz->_dequeued, 1, memory_order_relaxed);
+
+    return item;
+}
+
+static void *sl_queue_peek(struct sl_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    struct _node_t *x = thiz->_head;
+    void *item = NULL;
+    uintptr_t nxt;
+
+    ebr_enter();
+
+    for (;;)
+    {
+        nxt = atomic_load(&x->next[0]);
+        if (_ref(nxt) == thiz->_tail)
+            break;
+
+        if (!_marked(nxt))
+        {
+            item = (void *)_ref(nxt)->item;
+            break;
+        }
+
+        x = _ref(nxt);
+    }
+
+    ebr_exit();
+
+    return item;
+}
+
+struct queue_t *sl_queue(int32_t (*const compare)(const void *, const void *))
+{
+    struct sl_queue_t *thiz = NULL;
+
+    if (!compare)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (posix_memalign((void **)&thiz, CACHE_LINE_SIZE, sizeof(struct sl_queue_t)) != 0)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    memset((void *)thiz, 0, sizeof(struct sl_queue_t));
+
+    thiz->_head = _node(NULL, SL_QUEUE_LEVELS);
+    thiz->_tail = _node(NULL, SL_QUEUE_LEVELS);
+    if (!thiz->_head || !thiz->_tail)
+    {
+        free(thiz->_head);
+        free(thiz->_tail);
+        free(thiz);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < SL_QUEUE_LEVELS; i++)
+        atomic_init(&thiz->_head->next[i], (uintptr_t)thiz->_tail);
+
+    thiz->_compare = compare;
+    atomic_init(&thiz->_enqueued, 0);
+    atomic_init(&thiz->_dequeued, 0);
+
+    /* methods */
+    thiz->size = sl_queue_size;
+    thiz->clear = sl_queue_clear;
+    thiz->free = sl_queue_free;
+    thiz->offer = sl_queue_offer;
+    thiz->poll = sl_queue_poll;
+    thiz->peek = sl_queue_peek;
+
+    return (struct queue_t *)thiz;
+}
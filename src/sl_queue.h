@@ -0,0 +1,36 @@
+#ifndef _SL_QUEUE_H_
+#define _SL_QUEUE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Creates an unbounded lock-free priority queue that any number of threads
+ * may share.
+ *
+ * a Linden-Jonsson skiplist: poll marks the first node deleted with a single
+ * fetch-and-or and unlinks the deleted prefix in batches, offer links a node
+ * level by level with compare-and-swap, and unlinked nodes are reclaimed with
+ * epoch based reclamation. poll returns the first element in compare order,
+ * equal elements in insertion order unless their offers overlap.
+ *
+ * an offer racing with poll may still pass the polled element to compare, so
+ * polled elements must be released through ebr_retire rather than freed at once.
+ * clear and free must not run concurrently with other calls.
+ *
+ * @param compare sort condition function, the same contract as lp_queue:
+ *                compare(a, b) > 0 places a after b
+ * @return the queue, or NULL on failure
+ */
+extern struct queue_t *sl_queue(int32_t (*const compare)(const void *, const void *));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,980 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include "spsc_queue.h"
+#include "cpu_util.h"
+#include "parker.h"
+#include "event_fd.h"
+#include "queue_stats.h"
+#include "time_util.h"
+
+/**
+ * single-producer single-consumer queue
+ *
+ * lock-free ring of element pointers. the producer owns _tail, the consumer
+ * owns _head, and each side keeps a cached copy of the other side's index
+ * so it only touches the foreign cache line when the ring looks full or empty.
+ */
+struct spsc_queue_t
+{
+
+    /**
+     * Returns the number of elements in this collection.
+     *
+     * @param thiz this
+     * @return the number of elements in this collection
+     */
+    uint32_t (*size)(struct spsc_queue_t *const thiz);
+
+    /**
+     * Removes all of the elements from this collection.
+     *
+     *  @param thiz this
+     */
+    void (*clear)(struct spsc_queue_t *const thiz);
+
+    /**
+     * Free collection
+     *
+     * @param thiz this
+     */
+    void (*free)(struct spsc_queue_t *const thiz);
+
+    /**
+     * Inserts the specified element into this queue if it is possible to do
+     * so immediately without violating capacity restrictions.
+     *
+     * @param thiz this
+     * @param element element
+     * @return true if the element was added to this queue, else false
+     */
+    bool (*offer)(struct spsc_queue_t *const thiz, const void *const element);
+
+    /**
+     * Retrieves and removes the head of this queue,
+     * or returns NULL if this queue is empty.
+     *
+     * @param thiz this
+     * @return the head of this queue, or NULL if this queue is empty
+     */
+    void *(*poll)(struct spsc_queue_t *const thiz);
+
+    /**
+     * Retrieves, but does not remove, the head of this queue,
+     * or returns NULL if this queue is empty.
+     *
+     * @param thiz this
+     * @return the head of this queue, or NULL if this queue is empty
+     */
+    void *(*peek)(struct spsc_queue_t *const thiz);
+
+    /**
+     * Inserts the specified element into this queue, waiting if necessary for space to become available.
+     *
+     * @param thiz this
+     * @param element the element to add
+     */
+    bool (*put)(struct spsc_queue_t *const thiz, const void *const element);
+
+    /**
+     * Inserts the specified element into this queue, waiting up to the
+     * specified wait time if necessary for space to become available.
+     *
+     * @param thiz this
+     * @param element the element to add
+     * @param timeout how long to wait before giving up, in units of unit
+     * @param unit a time_unit_t determining how to interpret the timeout parameter
+     * @return true if successful, or false if the specified waiting time elapses before space is available
+     */
+    bool (*offer_await)(struct spsc_queue_t *const thiz, const void *const element, const uint64_t timeout, const struct time_unit_t *const unit);
+
+    /**
+     * Retrieves and removes the head of this queue, waiting if necessary until an element becomes available.
+     *
+     * @param thiz this
+     * @return the head of this queue
+     */
+    void *(*take)(struct spsc_queue_t *const thiz);
+
+    /**
+     * Retrieves and removes the head of this queue, waiting up to the
+     * specified wait time if necessary for an element to become available.
+     *
+     * @param thiz this
+     * @param timeout how long to wait before giving up, in units of unit
+     * @param unit a time_unit_t determining how to interpret the timeout parameter
+     * @return the head of this queue, or NULL if the specified waiting time elapses before an element is available
+     */
+    void *(*poll_await)(struct spsc_queue_t *const thiz, const uint64_t timeout, const struct time_unit_t *const unit);
+
+    /**
+     * Inserts as many of the specified elements as possible without waiting,
+     * in order, with a single acquisition of the queue.
+     *
+     * @param thiz this
+     * @param elements the elements to add
+     * @param n number of elements
+     * @return the number of elements added, always a prefix of elements
+     */
+    uint32_t (*offer_batch)(struct spsc_queue_t *const thiz, void *const *elements, const uint32_t n);
+
+    /**
+     * Inserts all of the specified elements, in order, waiting if necessary for space to become available.
+     *
+     * @param thiz this
+     * @param elements the elements to add
+     * @param n number of elements
+     * @return the number of elements added, n unless an error occurred
+     */
+    uint32_t (*put_batch)(struct spsc_queue_t *const thiz, void *const *elements, const uint32_t n);
+
+    /**
+     * Removes at most max available elements from this queue without waiting.
+     *
+     * @param thiz this
+     * @param out receives the removed elements in queue order
+     * @param max the maximum number of elements to remove
+     * @return the number of elements removed
+     */
+    uint32_t (*drain_to)(struct spsc_queue_t *const thiz, void **out, const uint32_t max);
+
+    /**
+     * Removes at most max elements from this queue, waiting up to the
+     * specified wait time if necessary until at least min have been removed.
+     *
+     * @param thiz this
+     * @param out receives the removed elements in queue order
+     * @param min the number of elements to wait for
+     * @param max the maximum number of elements to remove
+     * @param timeout how long to wait before giving up, in units of unit
+     * @param unit a time_unit_t determining how to interpret the timeout parameter, or NULL to wait without limit
+     * @return the number of elements removed, less than min only if the waiting time elapsed
+     */
+    uint32_t (*take_batch)(struct spsc_queue_t *const thiz, void **out, const uint32_t min, const uint32_t max,
+                           const uint64_t timeout, const struct time_unit_t *const unit);
+
+    /**
+     * Returns a non-blocking eventfd that becomes readable when this queue
+     * turns ready for the event, for use with poll/epoll. The descriptor is
+     * owned by the queue and closed by free. Read it before draining the
+     * queue, and drain until the queue reports nothing left.
+     *
+     * @param thiz this
+     * @param event QUEUE_EVENT_NOT_EMPTY or QUEUE_EVENT_NOT_FULL
+     * @return the descriptor, or -1 with errno set
+     */
+    int (*eventfd)(struct spsc_queue_t *const thiz, const enum queue_event_t event);
+
+    /**
+     * Closes this queue and wakes every blocked thread. Later puts fail
+     * with errno EPIPE, takes return the remaining elements and then fail
+     * with errno EPIPE. A queue cannot be reopened.
+     *
+     * @param thiz this
+     */
+    void (*close)(struct spsc_queue_t *const thiz);
+
+    /**
+     * Returns true if this queue has been closed.
+     *
+     * @param thiz this
+     * @return true if this queue has been closed
+     */
+    bool (*closed)(struct spsc_queue_t *const thiz);
+
+    /**
+     * Reads the operational counters of this queue. The lock counters stay
+     * 0, there is no lock.
+     *
+     * @param thiz this
+     * @param stats filled with the totals since the queue was created
+     */
+    void (*stats)(struct spsc_queue_t *const thiz, struct queue_stats_t *const stats);
+
+    /**
+     * Inserts the specified element into this queue, waiting until the
+     * deadline if necessary for space to become available.
+     *
+     * @param thiz this
+     * @param element the element to add
+     * @param deadline absolute CLOCK_MONOTONIC time to give up at, or NULL to wait without limit
+     * @return true if successful, or false if the deadline passes before space is available
+     */
+    bool (*offer_until)(struct spsc_queue_t *const thiz, const void *const element, const struct timespec *const deadline);
+
+    /**
+     * Retrieves and removes the head of this queue, waiting until the
+     * deadline if necessary for an element to become available.
+     *
+     * @param thiz this
+     * @param deadline absolute CLOCK_MONOTONIC time to give up at, or NULL to wait without limit
+     * @return the head of this queue, or NULL if the deadline passes before an element is available
+     */
+    void *(*poll_until)(struct spsc_queue_t *const thiz, const struct timespec *const deadline);
+
+    /* queue capacity */
+    uint32_t _capacity;
+
+    /* ring index mask, ring length minus one */
+    uint32_t _mask;
+
+    /* element ring */
+    const void **_items;
+
+    /* parked consumer : queue non-empty */
+    struct parker_t _not_empty;
+
+    /* parked producer : queue non-full */
+    struct parker_t _not_full;
+
+    /* readiness descriptor : queue non-empty */
+    struct event_fd_t _readable;
+
+    /* readiness descriptor : queue non-full */
+    struct event_fd_t _writable;
+
+    /* set once by close */
+    atomic_bool _closed;
+
+    /* operational counters */
+    struct queue_counters_t *_stats;
+
+    /* producer : free running index of the next free slot */
+    CACHE_ALIGNED atomic_uint _tail;
+
+    /* producer : last observed _head */
+    uint32_t _head_cache;
+
+    /* producer : elements published, written by the producer only */
+    atomic_uint_least64_t _offers;
+
+    /* consumer : free running index of the head element */
+    CACHE_ALIGNED atomic_uint _head;
+
+    /* consumer : last observed _tail */
+    uint32_t _tail_cache;
+
+    /* consumer : elements consumed, written by the consumer only */
+    atomic_uint_least64_t _takes;
+};
+
+#define SPSC_QUEUE_MAX_CAPACITY 0x80000000U
+
+static bool _not_empty(void *arg)
+{
+    struct spsc_queue_t *const thiz = (struct spsc_queue_t *)arg;
+
+    if (atomic_load(&thiz->_closed))
+        return true;
+
+    return atomic_load_explicit(&thiz->_tail, memory_order_acquire) != atomic_load_explicit(&thiz->_head, memory_order_relaxed);
+}
+
+static bool _not_full(void *arg)
+{
+    struct spsc_queue_t *const thiz = (struct spsc_queue_t *)arg;
+
+    if (atomic_load(&thiz->_closed))
+        return true;
+
+    return atomic_load_explicit(&thiz->_tail, memory_order_relaxed) - atomic_load_explicit(&thiz->_head, memory_order_acquire) < thiz->_capacity;
+}
+
+/**
+ * Signals the readiness descriptor if the consumer had caught up with the
+ * elements published from index t. The parkers issue no fence on notify, so
+ * an armed descriptor fences the tail store before the head load itself.
+ */
+static inline void _signal_readable(struct spsc_queue_t *const thiz, const uint32_t t)
+{
+    if (event_fd_fence(&thiz->_readable) && atomic_load_explicit(&thiz->_head, memory_order_relaxed) == t)
+        event_fd_signal(&thiz->_readable);
+}
+
+/**
+ * Signals the readiness descriptor if the producer had filled the ring up to
+ * the elements consumed from index h, fencing the same way.
+ */
+static inline void _signal_writable(struct spsc_queue_t *const thiz, const uint32_t h)
+{
+    if (event_fd_fence(&thiz->_writable) && atomic_load_explicit(&thiz->_tail, memory_order_relaxed) == h + thiz->_capacity)
+        event_fd_signal(&thiz->_writable);
+}
+
+/**
+ * Adds n to a counter written by one side only, without a read-modify-write.
+ */
+static inline void _count(atomic_uint_least64_t *const counter, const uint64_t n)
+{
+#ifndef DISABLE_CLQUEUE_STATS
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n, memory_order_relaxed);
+#endif
+}
+
+/**
+ * Waits for ready, counting the wait when the queue is not ready at once.
+ *
+ * @return the last value returned by ready, false once the deadline has passed
+ */
+static inline bool _await(struct spsc_queue_t *const thiz, struct parker_t *const p, bool (*const ready)(void *),
+                          const struct timespec *const deadline)
+{
+    if (ready(thiz))
+        return true;
+
+    const uint64_t start = queue_counters_wait_begin();
+    const bool r = parker_await(p, ready, thiz, deadline);
+
+    queue_counters_wait_end(thiz->_stats, start, !r);
+
+    return r;
+}
+
+/**
+ * Wakes one parked thread, counting the wakeup if one was sent.
+ */
+static inline void _notify(struct spsc_queue_t *const thiz, struct parker_t *const p)
+{
+    if (parker_notify(p))
+        queue_counters_add(thiz->_stats, QUEUE_STAT_SIGNALS, 1);
+}
+
+static inline void _notify_all(struct spsc_queue_t *const thiz, struct parker_t *const p)
+{
+    if (parker_notify_all(p))
+        queue_counters_add(thiz->_stats, QUEUE_STAT_SIGNALS, 1);
+}
+
+/**
+ * Counts elements an offer or put could not insert.
+ */
+static inline void _reject(struct spsc_queue_t *const thiz, const uint32_t n)
+{
+    queue_counters_add(thiz->_stats, QUEUE_STAT_REJECTED, n);
+}
+
+static inline bool _enqueue(struct spsc_queue_t *const thiz, const void *const element)
+{
+    const uint32_t t = atomic_load_explicit(&thiz->_tail, memory_order_relaxed);
+
+    if (t - thiz->_head_cache == thiz->_capacity)
+    {
+        thiz->_head_cache = atomic_load_explicit(&thiz->_head, memory_order_acquire);
+        if (t - thiz->_head_cache == thiz->_capacity && event_fd_fence(&thiz->_writable))
+            thiz->_head_cache = atomic_load_explicit(&thiz->_head, memory_order_acquire);
+        if (t - thiz->_head_cache == thiz->_capacity)
+            return false;
+    }
+
+    thiz->_items[t & thiz->_mask] = element;
+    atomic_store_explicit(&thiz->_tail, t + 1, memory_order_release);
+    _count(&thiz->_offers, 1);
+
+    _notify(thiz, &thiz->_not_empty);
+    _signal_readable(thiz, t);
+
+    return true;
+}
+
+static inline void *_dequeue(struct spsc_queue_t *const thiz)
+{
+    const uint32_t h = atomic_load_explicit(&thiz->_head, memory_order_relaxed);
+
+    if (h == thiz->_tail_cache)
+    {
+        thiz->_tail_cache = atomic_load_explicit(&thiz->_tail, memory_order_acquire);
+        if (h == thiz->_tail_cache && event_fd_fence(&thiz->_readable))
+            thiz->_tail_cache = atomic_load_explicit(&thiz->_tail, memory_order_acquire);
+        if (h == thiz->_tail_cache)
+            return NULL;
+    }
+
+    void *x = (void *)thiz->_items[h & thiz->_mask];
+    atomic_store_explicit(&thiz->_head, h + 1, memory_order_release);
+    _count(&thiz->_takes, 1);
+
+    _notify(thiz, &thiz->_not_full);
+    _signal_writable(thiz, h);
+
+    return x;
+}
+
+/**
+ * Publishes up to n elements with a single tail store.
+ */
+static inline uint32_t _enqueue_batch(struct spsc_queue_t *const thiz, void *const *elements, const uint32_t n)
+{
+    const uint32_t t = atomic_load_explicit(&thiz->_tail, memory_order_relaxed);
+    uint32_t k = thiz->_capacity - (t - thiz->_head_cache);
+
+    if (k < n)
+    {
+        thiz->_head_cache = atomic_load_explicit(&thiz->_head, memory_order_acquire);
+        k = thiz->_capacity - (t - thiz->_head_cache);
+        if (k == 0 && event_fd_fence(&thiz->_writable))
+        {
+            thiz->_head_cache = atomic_load_explicit(&thiz->_head, memory_order_acquire);
+            k = thiz->_capacity - (t - thiz->_head_cache);
+        }
+    }
+
+    if (k > n)
+        k = n;
+
+    if (k == 0)
+        return 0;
+
+    for (uint32_t i = 0; i < k; i++)
+        thiz->_items[(t + i) & thiz->_mask] = elements[i];
+
+    atomic_store_explicit(&thiz->_tail, t + k, memory_order_release);
+    _count(&thiz->_offers, k);
+
+    _notify(thiz, &thiz->_not_empty);
+    _signal_readable(thiz, t);
+
+    return k;
+}
+
+/**
+ * Consumes up to max elements with a single head store.
+ */
+static inline uint32_t _dequeue_batch(struct spsc_queue_t *const thiz, void **const out, const uint32_t max)
+{
+    const uint32_t h = atomic_load_explicit(&thiz->_head, memory_order_relaxed);
+    uint32_t k = thiz->_tail_cache - h;
+
+    if (k < max)
+    {
+        thiz->_tail_cache = atomic_load_explicit(&thiz->_tail, memory_order_acquire);
+        k = thiz->_tail_cache - h;
+        if (k == 0 && event_fd_fence(&thiz->_readable))
+        {
+            thiz->_tail_cache = atomic_load_explicit(&thiz->_tail, memory_order_acquire);
+            k = thiz->_tail_cache - h;
+        }
+    }
+
+    if (k > max)
+        k = max;
+
+    if (k == 0)
+        return 0;
+
+    for (uint32_t i = 0; i < k; i++)
+        out[i] = (void *)thiz->_items[(h + i) & thiz->_mask];
+
+    atomic_store_explicit(&thiz->_head, h + k, memory_order_release);
+    _count(&thiz->_takes, k);
+
+    _notify(thiz, &thiz->_not_full);
+    _signal_writable(thiz, h);
+
+    return k;
+}
+
+static uint32_t spsc_queue_size(struct spsc_queue_t *const thiz)
+{
+    const uint32_t h = atomic_load_explicit(&thiz->_head, memory_order_acquire);
+
+    return atomic_load_explicit(&thiz->_tail, memory_order_acquire) - h;
+}
+
+static void spsc_queue_clear(struct spsc_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return;
+    }
+
+    for (void *item; (item = _dequeue(thiz)) != NULL;)
+        free(item);
+
+    return;
+}
+
+static void spsc_queue_free(struct spsc_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return;
+    }
+
+    thiz->clear(thiz);
+
+    parker_destroy(&thiz->_not_empty);
+    parker_destroy(&thiz->_not_full);
+    event_fd_destroy(&thiz->_readable);
+    event_fd_destroy(&thiz->_writable);
+
+    queue_counters_free(thiz->_stats);
+    free(thiz->_items);
+    free(thiz);
+}
+
+static bool spsc_queue_offer(struct spsc_queue_t *const thiz, const void *const element)
+{
+    if (!thiz || !element)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (atomic_load(&thiz->_closed))
+    {
+        _reject(thiz, 1);
+        errno = EPIPE;
+        return false;
+    }
+
+    if (!_enqueue(thiz, element))
+    {
+        _reject(thiz, 1);
+        return false;
+    }
+
+    return true;
+}
+
+static void *spsc_queue_poll(struct spsc_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    /* read before trying, so elements put before close are still taken */
+    const bool closed = atomic_load(&thiz->_closed);
+    void *item = _dequeue(thiz);
+
+    if (!item && closed)
+        errno = EPIPE;
+
+    return item;
+}
+
+static void *spsc_queue_peek(struct spsc_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    const uint32_t h = atomic_load_explicit(&thiz->_head, memory_order_relaxed);
+
+    if (h == thiz->_tail_cache)
+    {
+        thiz->_tail_cache = atomic_load_explicit(&thiz->_tail, memory_order_acquire);
+        if (h == thiz->_tail_cache)
+            return NULL;
+    }
+
+    return (void *)thiz->_items[h & thiz->_mask];
+}
+
+static bool spsc_queue_put(struct spsc_queue_t *const thiz, const void *const element)
+{
+    if (!thiz || !element)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    while (!atomic_load(&thiz->_closed))
+    {
+        if (_enqueue(thiz, element))
+            return true;
+        _await(thiz, &thiz->_not_full, _not_full, NULL);
+    }
+
+    _reject(thiz, 1);
+    errno = EPIPE;
+    return false;
+}
+
+static void *spsc_queue_take(struct spsc_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    void *item;
+    bool closed;
+
+    for (;;)
+    {
+        closed = atomic_load(&thiz->_closed);
+        if ((item = _dequeue(thiz)) != NULL || closed)
+            break;
+        _await(thiz, &thiz->_not_empty, _not_empty, NULL);
+    }
+
+    if (!item)
+        errno = EPIPE;
+
+    return item;
+}
+
+static bool spsc_queue_offer_until(struct spsc_queue_t *const thiz, const void *const element, const struct timespec *const deadline)
+{
+    if (!thiz || !element)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (atomic_load(&thiz->_closed))
+        goto offer_closed;
+
+    if (_enqueue(thiz, element))
+        return true;
+
+    while (_await(thiz, &thiz->_not_full, _not_full, deadline))
+    {
+        if (atomic_load(&thiz->_closed))
+            goto offer_closed;
+
+        if (_enqueue(thiz, element))
+            return true;
+    }
+
+    _reject(thiz, 1);
+    return false;
+
+offer_closed:
+    _reject(thiz, 1);
+    errno = EPIPE;
+    return false;
+}
+
+static bool spsc_queue_offer_wait(struct spsc_queue_t *const thiz, const void *const element,
+                                  const uint64_t timeout, const struct time_unit_t *const unit)
+{
+    if (!thiz || !element || !unit)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    /* the deadline is only needed once the queue turns out full */
+    if (!atomic_load(&thiz->_closed) && _enqueue(thiz, element))
+        return true;
+
+    struct timespec timeo;
+
+    calc_timeout(&timeo, timeout, unit);
+
+    return spsc_queue_offer_until(thiz, element, &timeo);
+}
+
+static void *spsc_queue_poll_until(struct spsc_queue_t *const thiz, const struct timespec *const deadline)
+{
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    bool closed = atomic_load(&thiz->_closed);
+    void *item;
+
+    if ((item = _dequeue(thiz)) != NULL)
+        return item;
+
+    while (!closed && _await(thiz, &thiz->_not_empty, _not_empty, deadline))
+    {
+        closed = atomic_load(&thiz->_closed);
+        if ((item = _dequeue(thiz)) != NULL)
+            return item;
+    }
+
+    if (closed)
+        errno = EPIPE;
+
+    return NULL;
+}
+
+static void *spsc_queue_poll_wait(struct spsc_queue_t *const thiz, const uint64_t timeout, const struct time_unit_t *const unit)
+{
+    if (!thiz || !unit)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    void *item;
+
+    /* the deadline is only needed once the queue turns out empty */
+    if ((item = _dequeue(thiz)) != NULL)
+        return item;
+
+    struct timespec timeo;
+
+    calc_timeout(&timeo, timeout, unit);
+
+    return spsc_queue_poll_until(thiz, &timeo);
+}
+
+static uint32_t spsc_queue_offer_batch(struct spsc_queue_t *const thiz, void *const *elements, const uint32_t n)
+{
+    if (!thiz || !elements)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (!elements[i])
+        {
+            errno = EINVAL;
+            return 0;
+        }
+    }
+
+    if (atomic_load(&thiz->_closed))
+    {
+        _reject(thiz, n);
+        errno = EPIPE;
+        return 0;
+    }
+
+    const uint32_t k = _enqueue_batch(thiz, elements, n);
+
+    if (k < n)
+        _reject(thiz, n - k);
+
+    return k;
+}
+
+static uint32_t spsc_queue_put_batch(struct spsc_queue_t *const thiz, void *const *elements, const uint32_t n)
+{
+    if (!thiz || !elements)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (!elements[i])
+        {
+            errno = EINVAL;
+            return 0;
+        }
+    }
+
+    uint32_t done = 0;
+
+    while (!atomic_load(&thiz->_closed))
+    {
+        done += _enqueue_batch(thiz, elements + done, n - done);
+        if (done == n)
+            return done;
+        _await(thiz, &thiz->_not_full, _not_full, NULL);
+    }
+
+    _reject(thiz, n - done);
+    errno = EPIPE;
+    return done;
+}
+
+static uint32_t spsc_queue_drain_to(struct spsc_queue_t *const thiz, void **out, const uint32_t max)
+{
+    if (!thiz || !out)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    const bool closed = atomic_load(&thiz->_closed);
+    const uint32_t k = _dequeue_batch(thiz, out, max);
+
+    if (k == 0 && max > 0 && closed)
+        errno = EPIPE;
+
+    return k;
+}
+
+static uint32_t spsc_queue_take_batch(struct spsc_queue_t *const thiz, void **out, const uint32_t min, const uint32_t max,
+                                      const uint64_t timeout, const struct time_unit_t *const unit)
+{
+    if (!thiz || !out)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    uint32_t need = (min > max) ? max : min;
+    bool closed = atomic_load(&thiz->_closed);
+    uint32_t taken = _dequeue_batch(thiz, out, max);
+    struct timespec timeo;
+
+    if (taken >= need)
+        return taken;
+
+    if (unit)
+        calc_timeout(&timeo, timeout, unit);
+
+    while (taken < need && !closed && _await(thiz, &thiz->_not_empty, _not_empty, unit ? &timeo : NULL))
+    {
+        closed = atomic_load(&thiz->_closed);
+        taken += _dequeue_batch(thiz, out + taken, max - taken);
+    }
+
+    if (taken < need && closed)
+        errno = EPIPE;
+
+    return taken;
+}
+
+static int spsc_queue_eventfd(struct spsc_queue_t *const thiz, const enum queue_event_t event)
+{
+    if (!thiz)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    switch (event)
+    {
+    case QUEUE_EVENT_NOT_EMPTY:
+        return event_fd_open(&thiz->_readable, _not_empty, thiz);
+    case QUEUE_EVENT_NOT_FULL:
+        return event_fd_open(&thiz->_writable, _not_full, thiz);
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+static void spsc_queue_close(struct spsc_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = EINVAL;
+        return;
+    }
+
+    if (atomic_exchange(&thiz->_closed, true))
+        return;
+
+    _notify_all(thiz, &thiz->_not_empty);
+    _notify_all(thiz, &thiz->_not_full);
+    event_fd_signal(&thiz->_readable);
+    event_fd_signal(&thiz->_writable);
+}
+
+static bool spsc_queue_closed(struct spsc_queue_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    return atomic_load(&thiz->_closed);
+}
+
+static void spsc_queue_stats(struct spsc_queue_t *const thiz, struct queue_stats_t *const stats)
+{
+    if (!thiz || !stats)
+    {
+        errno = EINVAL;
+        return;
+    }
+
+    queue_counters_read(thiz->_stats, stats);
+
+    stats->offers = atomic_load_explicit(&thiz->_offers, memory_order_relaxed);
+    stats->takes = atomic_load_explicit(&thiz->_takes, memory_order_relaxed);
+}
+
+struct blocking_queue_t *spsc_queue(const uint32_t capacity)
+{
+    struct spsc_queue_t *thiz = NULL;
+    uint32_t length = 1;
+
+    if (capacity == 0 || capacity > SPSC_QUEUE_MAX_CAPACITY)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    while (length < capacity)
+        length <<= 1;
+
+    if (posix_memalign((void **)&thiz, CACHE_LINE_SIZE, sizeof(struct spsc_queue_t)) != 0)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    memset((void *)thiz, 0, sizeof(struct spsc_queue_t));
+
+    thiz->_items = (const void **)calloc(length, sizeof(void *));
+    if (!thiz->_items)
+    {
+        free(thiz);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    thiz->_stats = queue_counters();
+    if (!thiz->_stats)
+    {
+        free(thiz->_items);
+        free(thiz);
+        return NULL;
+    }
+
+    thiz->_capacity = capacity;
+    thiz->_mask = length - 1;
+
+    atomic_init(&thiz->_head, 0);
+    atomic_init(&thiz->_tail, 0);
+
+    parker_init(&thiz->_not_empty);
+    parker_init(&thiz->_not_full);
+
+    /* one producer and one consumer notify on every element, and park seldom */
+    parker_asymmetric(&thiz->_not_empty);
+    parker_asymmetric(&thiz->_not_full);
+    event_fd_init(&thiz->_readable);
+    event_fd_init(&thiz->_writable);
+    atomic_init(&thiz->_closed, false);
+
+    /* methods */
+    thiz->size = spsc_queue_size;
+    thiz->clear = spsc_queue_clear;
+    thiz->free = spsc_queue_free;
+    thiz->offer = spsc_queue_offer;
+    thiz->poll = spsc_queue_poll;
+    thiz->peek = spsc_queue_peek;
+    thiz->put = spsc_queue_put;
+    thiz->offer_await = spsc_queue_offer_wait;
+    thiz->take = spsc_queue_take;
+    thiz->poll_await = spsc_queue_poll_wait;
+    thiz->offer_batch = spsc_queue_offer_batch;
+    thiz->put_batch = spsc_queue_put_batch;
+    thiz->drain_to = spsc_queue_drain_to;
+    thiz->take_batch = spsc_queue_take_batch;
+    thiz->eventfd = spsc_queue_eventfd;
+    thiz->close = spsc_queue_close;
+    thiz->closed = spsc_queue_closed;
+    thiz->stats = spsc_queue_stats;
+    thiz->offer_until = spsc_queue_offer_until;
+    thiz->poll_until = spsc_queue_poll_until;
+
+    return (struct blocking_queue_t *)thiz;
+}
@@ -0,0 +1,26 @@
+#ifndef _SPSC_QUEUE_H_
+#define _SPSC_QUEUE_H_
+
+#include <stdint.h>
+#include "blocking_queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Creates a single-producer single-consumer blocking queue.
+ *
+ * offer, put and offer_await may only be called from one producer thread,
+ * poll, peek, take, poll_await and clear only from one consumer thread.
+ *
+ * @param capacity the capacity of this queue, must be non-zero
+ * @return the queue, or NULL on failure
+ */
+extern struct blocking_queue_t *spsc_queue(const uint32_t capacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -19,6 +19,7 @@ const struct time_unit_t TIME_UNIT_SECOND = {
     .to_second = second_to_second,
     .to_milli = second_to_milli,
     .to_nano = second_to_nano,
+    .nanos = NANOS_PER_SECOND,
 };
 
 uint64_t milli_to_second(const uint64_t time)
@@ -40,6 +41,7 @@ const struct time_unit_t TIME_UNIT_MILLI = {
     .to_second = milli_to_second,
     .to_milli = milli_to_milli,
     .to_nano = milli_to_nano,
+    .nanos = NANOS_PER_MILLI,
 };
 
 uint64_t nano_to_second(const uint64_t time)
@@ -61,5 +63,6 @@ const struct time_unit_t TIME_UNIT_NANO = {
     .to_second = nano_to_second,
     .to_milli = nano_to_milli,
     .to_nano = nano_to_nano,
+    .nanos = 1,
 };
 
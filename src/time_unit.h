@@ -3,16 +3,40 @@
 
 #include <inttypes.h>
 
+#define NANOS_PER_SECOND 1000000000ULL
+#define NANOS_PER_MILLI 1000000ULL
+
 struct time_unit_t
 {
     uint64_t (*to_second)(const uint64_t);
     uint64_t (*to_milli)(const uint64_t);
     uint64_t (*to_nano)(const uint64_t);
+
+    /* nanoseconds per unit */
+    uint64_t nanos;
 };
 
 extern const struct time_unit_t TIME_UNIT_SECOND;
 extern const struct time_unit_t TIME_UNIT_MILLI;
 extern const struct time_unit_t TIME_UNIT_NANO;
 
+/**
+ * Converts time in units of unit to nanoseconds. The predefined units are
+ * matched by address, so a unit known at the call site folds to a multiply
+ * by a constant, others multiply by unit->nanos, or call unit->to_nano if
+ * they leave it 0.
+ */
+static inline uint64_t time_unit_to_nano(const struct time_unit_t *const unit, const uint64_t time)
+{
+    if (unit == &TIME_UNIT_MILLI)
+        return time * NANOS_PER_MILLI;
+    if (unit == &TIME_UNIT_SECOND)
+        return time * NANOS_PER_SECOND;
+    if (unit == &TIME_UNIT_NANO)
+        return time;
+
+    return __builtin_expect(unit->nanos != 0, 1) ? time * unit->nanos : unit->to_nano(time);
+}
+
 #endif
 
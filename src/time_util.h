@@ -5,6 +5,17 @@
 #include <stdint.h>
 #include "time_unit.h"
 
+/**
+ * Clock deadlines are computed on. With ENABLE_CLQUEUE_COARSE_CLOCK it is
+ * CLOCK_MONOTONIC_COARSE, the same clock read from the vdso at tick
+ * resolution, so a timed wait may give up up to a tick early.
+ */
+#ifdef ENABLE_CLQUEUE_COARSE_CLOCK
+#define DEADLINE_CLOCK CLOCK_MONOTONIC_COARSE
+#else
+#define DEADLINE_CLOCK CLOCK_MONOTONIC
+#endif
+
 /**
  * Returns the current value of the nanoseconds.
  */
@@ -14,7 +25,7 @@ static inline uint64_t nano_time(void)
     if (clock_gettime(CLOCK_MONOTONIC, &time) < 0)
         return -1;
 
-    return TIME_UNIT_SECOND.to_nano(time.tv_sec) + time.tv_nsec;
+    return (uint64_t)time.tv_sec * NANOS_PER_SECOND + time.tv_nsec;
 }
 
 static inline uint64_t timespec_to_nano(const struct timespec *const time)
@@ -22,7 +33,7 @@ static inline uint64_t timespec_to_nano(const struct timespec *const time)
     if (!time)
         return 0;
 
-    return TIME_UNIT_SECOND.to_nano(time->tv_sec) + time->tv_nsec;
+    return (uint64_t)time->tv_sec * NANOS_PER_SECOND + time->tv_nsec;
 }
 
 static inline void nano_to_timespec(struct timespec *time, uint64_t nano)
@@ -30,10 +41,18 @@ static inline void nano_to_timespec(struct timespec *time, uint64_t nano)
     if (!time)
         return;
 
-    time->tv_sec = TIME_UNIT_NANO.to_second(nano);
-    time->tv_nsec = !nano ? 0 : (nano % 1000000000);
+    time->tv_sec = nano / NANOS_PER_SECOND;
+    time->tv_nsec = nano % NANOS_PER_SECOND;
 }
 
+/**
+ * Computes the absolute deadline timeout from now on DEADLINE_CLOCK, for the
+ * offer_until and poll_until calls of a blocking queue. A timeout of 0 gives
+ * a deadline that has already passed, without reading the clock.
+ *
+ * @param unit unit of timeout, NULL for milliseconds
+ * @return 0, or -1 if the clock could not be read
+ */
 static inline int32_t calc_timeout(struct timespec *const time, const uint64_t timeout, const struct time_unit_t *const unit)
 {
     if (!time)
@@ -45,22 +64,16 @@ static inline int32_t calc_timeout(struct timespec *const time, const uint64_t t
         return 0;
     }
 
-    struct time_unit_t *u = (struct time_unit_t *)unit;
-    if (!u) {
-        u = (struct time_unit_t *)&TIME_UNIT_MILLI;
-    }
+    const struct time_unit_t *const u = unit ? unit : &TIME_UNIT_MILLI;
 
     struct timespec jiffies;
-    if (clock_gettime(CLOCK_MONOTONIC, &jiffies) < 0)
+    if (clock_gettime(DEADLINE_CLOCK, &jiffies) < 0)
         return -1;
 
-    uint64_t curr_time = TIME_UNIT_SECOND.to_nano(jiffies.tv_sec) + jiffies.tv_nsec;
-    uint64_t offset_time = curr_time + (unit->to_nano(timeout));
-    time->tv_sec = TIME_UNIT_NANO.to_second(offset_time);
-    time->tv_nsec = offset_time % 1000000000;
+    uint64_t offset_time = timespec_to_nano(&jiffies) + time_unit_to_nano(u, timeout);
+    nano_to_timespec(time, offset_time);
 
     return 0;
 }
 
 #endif
-
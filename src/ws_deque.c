@@ -0,0 +1,241 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include "ws_deque.h"
+#include "cpu_util.h"
+#include "ebr.h"
+
+#define WS_DEQUE_MAX_CAPACITY 0x80000000U
+
+/**
+ * element ring, replaced by a ring twice the size when full
+ */
+struct _ws_ring_t
+{
+    /* retire link */
+    struct ebr_entry_t entry;
+
+    /* ring index mask, ring length minus one */
+    int64_t mask;
+
+    /* elements, indexed by top and bottom */
+    _Atomic(const void *) items[];
+};
+
+struct ws_deque_t
+{
+    /* thieves : index of the oldest element */
+    CACHE_ALIGNED atomic_int_least64_t _top;
+
+    /* owner : index of the next free slot */
+    CACHE_ALIGNED atomic_int_least64_t _bottom;
+
+    /* current ring, written by the owner only */
+    _Atomic(struct _ws_ring_t *) _ring;
+};
+
+static struct _ws_ring_t *_ring(const int64_t length)
+{
+    struct _ws_ring_t *r = (struct _ws_ring_t *)malloc(sizeof(struct _ws_ring_t) + (size_t)length * sizeof(void *));
+    if (!r)
+        return NULL;
+
+    r->mask = length - 1;
+
+    return r;
+}
+
+static void _reclaim(struct ebr_entry_t *const entry)
+{
+    free((struct _ws_ring_t *)entry);
+}
+
+static inline const void *_get(struct _ws_ring_t *const r, const int64_t i)
+{
+    return atomic_load_explicit(&r->items[i & r->mask], memory_order_relaxed);
+}
+
+static inline void _set(struct _ws_ring_t *const r, const int64_t i, const void *const element)
+{
+    atomic_store_explicit(&r->items[i & r->mask], element, memory_order_relaxed);
+}
+
+/**
+ * Replaces a full ring by one twice the size. Owner only.
+ */
+static struct _ws_ring_t *_grow(struct ws_deque_t *const thiz, struct _ws_ring_t *const r, const int64_t t, const int64_t b)
+{
+    struct _ws_ring_t *g;
+
+    if (r->mask + 1 >= WS_DEQUE_MAX_CAPACITY || (g = _ring((r->mask + 1) << 1)) == NULL)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    for (int64_t i = t; i < b; i++)
+        _set(g, i, _get(r, i));
+
+    atomic_store_explicit(&thiz->_ring, g, memory_order_release);
+
+    /* thieves still reading the old ring hold an epoch */
+    ebr_retire(&r->entry, _reclaim);
+
+    return g;
+}
+
+struct ws_deque_t *ws_deque(const uint32_t capacity)
+{
+    struct ws_deque_t *thiz = NULL;
+    struct _ws_ring_t *r;
+    int64_t length = 1;
+
+    if (capacity == 0 || capacity > WS_DEQUE_MAX_CAPACITY)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    while (length < capacity)
+        length <<= 1;
+
+    if (posix_memalign((void **)&thiz, CACHE_LINE_SIZE, sizeof(struct ws_deque_t)) != 0)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    r = _ring(length);
+    if (!r)
+    {
+        free(thiz);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    memset((void *)thiz, 0, sizeof(struct ws_deque_t));
+
+    atomic_init(&thiz->_top, 0);
+    atomic_init(&thiz->_bottom, 0);
+    atomic_init(&thiz->_ring, r);
+
+    return thiz;
+}
+
+bool ws_deque_push(struct ws_deque_t *const thiz, const void *const element)
+{
+    if (!thiz || !element)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    const int64_t b = atomic_load_explicit(&thiz->_bottom, memory_order_relaxed);
+    const int64_t t = atomic_load_explicit(&thiz->_top, memory_order_acquire);
+    struct _ws_ring_t *r = atomic_load_explicit(&thiz->_ring, memory_order_relaxed);
+
+    if (b - t > r->mask && (r = _grow(thiz, r, t, b)) == NULL)
+        return false;
+
+    _set(r, b, element);
+
+    /* publish the element with the slot */
+    atomic_store_explicit(&thiz->_bottom, b + 1, memory_order_release);
+
+    return true;
+}
+
+void *ws_deque_pop(struct ws_deque_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    const int64_t b = atomic_load_explicit(&thiz->_bottom, memory_order_relaxed) - 1;
+    struct _ws_ring_t *r = atomic_load_explicit(&thiz->_ring, memory_order_relaxed);
+    const void *item = NULL;
+    int64_t t;
+
+    /* claim the bottom slot before looking at top, thieves do the reverse */
+    atomic_store_explicit(&thiz->_bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    t = atomic_load_explicit(&thiz->_top, memory_order_relaxed);
+
+    if (t <= b)
+    {
+        item = _get(r, b);
+
+        if (t == b)
+        {
+            /* last element, race the thieves for it */
+            if (!atomic_compare_exchange_strong_explicit(&thiz->_top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+                item = NULL;
+
+            atomic_store_explicit(&thiz->_bottom, b + 1, memory_order_relaxed);
+        }
+    }
+    else
+    {
+        atomic_store_explicit(&thiz->_bottom, b + 1, memory_order_relaxed);
+    }
+
+    return (void *)item;
+}
+
+void *ws_deque_steal(struct ws_deque_t *const thiz)
+{
+    if (!thiz)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    int64_t t = atomic_load_explicit(&thiz->_top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    const int64_t b = atomic_load_explicit(&thiz->_bottom, memory_order_acquire);
+    const void *item = NULL;
+
+    if (t >= b)
+        return NULL;
+
+    ebr_enter();
+
+    item = _get(atomic_load_explicit(&thiz->_ring, memory_order_acquire), t);
+
+    ebr_exit();
+
+    if (!atomic_compare_exchange_strong_explicit(&thiz->_top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+    {
+        errno = EAGAIN;
+        return NULL;
+    }
+
+    return (void *)item;
+}
+
+uint32_t ws_deque_size(struct ws_deque_t *const thiz)
+{
+    if (!thiz)
+        return 0;
+
+    const int64_t b = atomic_load_explicit(&thiz->_bottom, memory_order_relaxed);
+    const int64_t t = atomic_load_explicit(&thiz->_top, memory_order_relaxed);
+
+    return (b > t) ? (uint32_t)(b - t) : 0;
+}
+
+void ws_deque_free(struct ws_deque_t *const thiz)
+{
+    if (!thiz)
+        return;
+
+    free(atomic_load(&thiz->_ring));
+    free(thiz);
+}
@@ -0,0 +1,72 @@
+#ifndef _WS_DEQUE_H_
+#define _WS_DEQUE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Work Stealing Deque
+ *
+ * Chase-Lev deque. one owner thread pushes and pops at the bottom without
+ * locks or read-modify-write operations, except for the last element, while
+ * any number of thieves steal from the top. the ring grows when full and the
+ * replaced rings are reclaimed with epoch based reclamation.
+ */
+struct ws_deque_t;
+
+/**
+ * Creates a work stealing deque.
+ *
+ * @param capacity initial capacity, rounded up to a power of two
+ * @return the deque, or NULL on failure
+ */
+extern struct ws_deque_t *ws_deque(const uint32_t capacity);
+
+/**
+ * Pushes an element at the bottom. Owner thread only.
+ *
+ * @param deque deque
+ * @param element element
+ * @return true if the element was added, false if memory is insufficient
+ */
+extern bool ws_deque_push(struct ws_deque_t *const deque, const void *const element);
+
+/**
+ * Pops the most recently pushed element. Owner thread only.
+ *
+ * @param deque deque
+ * @return the element, or NULL if the deque is empty
+ */
+extern void *ws_deque_pop(struct ws_deque_t *const deque);
+
+/**
+ * Steals the least recently pushed element. Any thread.
+ *
+ * @param deque deque
+ * @return the element, or NULL if the deque is empty, with errno EAGAIN if
+ *         the element was lost to a concurrent pop or steal
+ */
+extern void *ws_deque_steal(struct ws_deque_t *const deque);
+
+/**
+ * @param deque deque
+ * @return the number of elements, a snapshot when other threads are active
+ */
+extern uint32_t ws_deque_size(struct ws_deque_t *const deque);
+
+/**
+ * Free the deque. No thread may use it any more.
+ *
+ * @param deque deque
+ */
+extern void ws_deque_free(struct ws_deque_t *const deque);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,418 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "ws_scheduler.h"
+#include "ws_deque.h"
+#include "lb_queue.h"
+#include "node_pool.h"
+#include "parker.h"
+#include "cpu_util.h"
+
+/* initial capacity of a worker deque, it grows on demand */
+#define WS_SCHEDULER_DEQUE_CAPACITY 256
+
+/**
+ * submitted task
+ */
+struct _ws_task_t
+{
+    void (*fn)(void *);
+    void *arg;
+
+    /* group counting the task, or NULL */
+    struct ws_group_t *group;
+};
+
+/**
+ * worker thread
+ */
+struct _ws_worker_t
+{
+    /* owner scheduler */
+    struct ws_scheduler_t *scheduler;
+
+    /* tasks submitted by this worker, NULL for a thread helping in a join */
+    struct ws_deque_t *deque;
+
+    /* thread */
+    pthread_t thread;
+
+    /* victim selection state */
+    uint32_t seed;
+};
+
+struct ws_scheduler_t
+{
+    /* workers */
+    struct _ws_worker_t *_workers;
+
+    /* number of workers */
+    uint32_t _count;
+
+    /* shared queue : submissions from outside the workers */
+    struct blocking_queue_t *_queue;
+
+    /* true if _queue was created by the scheduler */
+    bool _owned;
+
+    /* task allocator */
+    struct node_pool_t *_tasks;
+
+    /* parked idle workers and joining threads */
+    struct parker_t _idle;
+
+    /* tasks submitted and not yet taken, what idle workers park on */
+    atomic_uint _pending;
+
+    /* set once by free, workers exit when they find no more work */
+    atomic_bool _stopping;
+};
+
+/**
+ * joining thread, what it waits for
+ */
+struct _ws_join_t
+{
+    struct ws_scheduler_t *scheduler;
+    struct ws_group_t *group;
+};
+
+/* worker run by the calling thread, NULL outside the workers */
+static __thread struct _ws_worker_t *_self;
+
+static bool _has_work(void *arg)
+{
+    struct ws_scheduler_t *const thiz = (struct ws_scheduler_t *)arg;
+
+    return atomic_load(&thiz->_stopping) || atomic_load(&thiz->_pending) > 0;
+}
+
+static bool _joinable(void *arg)
+{
+    struct _ws_join_t *const join = (struct _ws_join_t *)arg;
+
+    return atomic_load(&join->group->_pending) == 0 || _has_work(join->scheduler);
+}
+
+static inline uint32_t _random(struct _ws_worker_t *const w)
+{
+    /* xorshift32 */
+    w->seed ^= w->seed << 13;
+    w->seed ^= w->seed >> 17;
+    w->seed ^= w->seed << 5;
+
+    return w->seed;
+}
+
+/**
+ * Steals from the other workers, starting at a random victim. A lost race
+ * means the victim had work, so the round is repeated.
+ */
+static struct _ws_task_t *_steal(struct _ws_worker_t *const w)
+{
+    struct ws_scheduler_t *const thiz = w->scheduler;
+    struct _ws_task_t *task;
+    bool contended;
+
+    do
+    {
+        const uint32_t start = _random(w) % thiz->_count;
+
+        contended = false;
+
+        for (uint32_t i = 0; i < thiz->_count; i++)
+        {
+            struct _ws_worker_t *const victim = &thiz->_workers[(start + i) % thiz->_count];
+
+            if (victim == w)
+                continue;
+
+            errno = 0;
+            if ((task = (struct _ws_task_t *)ws_deque_steal(victim->deque)) != NULL)
+                return task;
+
+            if (errno == EAGAIN)
+                contended = true;
+        }
+    } while (contended);
+
+    return NULL;
+}
+
+/**
+ * Finds the next task: own deque first, then the shared queue, then the
+ * other workers.
+ */
+static struct _ws_task_t *_next(struct _ws_worker_t *const w)
+{
+    struct ws_scheduler_t *const thiz = w->scheduler;
+    struct _ws_task_t *task = NULL;
+
+    if (w->deque)
+        task = (struct _ws_task_t *)ws_deque_pop(w->deque);
+
+    if (!task)
+        task = (struct _ws_task_t *)thiz->_queue->poll(thiz->_queue);
+
+    if (!task)
+        task = _steal(w);
+
+    if (task)
+        atomic_fetch_sub(&thiz->_pending, 1);
+
+    return task;
+}
+
+/**
+ * Runs a task and counts it off its group. The group may be gone as soon as
+ * its count reaches 0, so only the scheduler is touched after that.
+ */
+static void _execute(struct ws_scheduler_t *const thiz, struct _ws_task_t *const task)
+{
+    struct ws_group_t *const group = task->group;
+
+    task->fn(task->arg);
+    node_pool_release(thiz->_tasks, task);
+
+    if (group && atomic_fetch_sub(&group->_pending, 1) == 1)
+        parker_notify_all(&thiz->_idle);
+}
+
+static void *_run(void *arg)
+{
+    struct _ws_worker_t *const w = (struct _ws_worker_t *)arg;
+    struct ws_scheduler_t *const thiz = w->scheduler;
+    struct _ws_task_t *task;
+    bool stopping;
+
+    _self = w;
+
+    for (;;)
+    {
+        /* read before looking for work, so no task submitted before free is left behind */
+        stopping = atomic_load(&thiz->_stopping);
+
+        if ((task = _next(w)) != NULL)
+        {
+            _execute(thiz, task);
+            continue;
+        }
+
+        if (stopping)
+            break;
+
+        parker_await(&thiz->_idle, _has_work, thiz, NULL);
+    }
+
+    _self = NULL;
+
+    return NULL;
+}
+
+/**
+ * Stops and joins the first n workers, then frees everything.
+ */
+static void _destroy(struct ws_scheduler_t *const thiz, const uint32_t n)
+{
+    atomic_store(&thiz->_stopping, true);
+    parker_notify_all(&thiz->_idle);
+
+    for (uint32_t i = 0; i < n; i++)
+        pthread_join(thiz->_workers[i].thread, NULL);
+
+    for (uint32_t i = 0; i < thiz->_count; i++)
+        ws_deque_free(thiz->_workers[i].deque);
+
+    if (thiz->_owned)
+        thiz->_queue->free(thiz->_queue);
+
+    if (thiz->_tasks)
+        node_pool_free(thiz->_tasks);
+
+    parker_destroy(&thiz->_idle);
+
+    free(thiz->_workers);
+    free(thiz);
+}
+
+struct ws_scheduler_t *ws_scheduler(const uint32_t workers, struct blocking_queue_t *const queue)
+{
+    struct ws_scheduler_t *thiz;
+    uint32_t started = 0;
+
+    if (workers == 0)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    thiz = (struct ws_scheduler_t *)calloc(1, sizeof(struct ws_scheduler_t));
+    if (!thiz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    thiz->_count = workers;
+    thiz->_queue = queue;
+    atomic_init(&thiz->_stopping, false);
+    atomic_init(&thiz->_pending, 0);
+    parker_init(&thiz->_idle);
+
+    thiz->_workers = (struct _ws_worker_t *)calloc(workers, sizeof(struct _ws_worker_t));
+    if (!thiz->_workers)
+        goto fail_r;
+
+    if (!thiz->_queue)
+    {
+        if ((thiz->_queue = lb_queue(0)) == NULL)
+            goto fail_r;
+
+        thiz->_owned = true;
+    }
+
+    if ((thiz->_tasks = node_pool(sizeof(struct _ws_task_t), 0)) == NULL)
+        goto fail_r;
+
+    for (uint32_t i = 0; i < workers; i++)
+    {
+        thiz->_workers[i].scheduler = thiz;
+        thiz->_workers[i].seed = i + 1;
+
+        if ((thiz->_workers[i].deque = ws_deque(WS_SCHEDULER_DEQUE_CAPACITY)) == NULL)
+            goto fail_r;
+    }
+
+    for (; started < workers; started++)
+    {
+        if (pthread_create(&thiz->_workers[started].thread, NULL, _run, &thiz->_workers[started]) != 0)
+            goto fail_r;
+    }
+
+    return thiz;
+
+fail_r:
+    if (!thiz->_workers)
+    {
+        free(thiz);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    _destroy(thiz, started);
+    errno = ENOMEM;
+
+    return NULL;
+}
+
+/**
+ * Submits a task counted by group, or by nothing if group is NULL.
+ */
+static bool _submit(struct ws_scheduler_t *const thiz, struct ws_group_t *const group, void (*const task)(void *),
+                    void *const arg)
+{
+    struct _ws_task_t *t = (struct _ws_task_t *)node_pool_alloc(thiz->_tasks);
+    if (!t)
+    {
+        errno = ENOMEM;
+        return false;
+    }
+
+    t->fn = task;
+    t->arg = arg;
+    t->group = group;
+
+    if (group)
+        atomic_fetch_add(&group->_pending, 1);
+
+    /* counted before it can be taken, so the count never drops below 0 */
+    atomic_fetch_add(&thiz->_pending, 1);
+
+    if (_self && _self->scheduler == thiz)
+    {
+        if (!ws_deque_push(_self->deque, t))
+            goto fail_r;
+    }
+    else if (!thiz->_queue->put(thiz->_queue, t))
+    {
+        goto fail_r;
+    }
+
+    parker_notify(&thiz->_idle);
+
+    return true;
+
+fail_r:
+    atomic_fetch_sub(&thiz->_pending, 1);
+    if (group)
+        atomic_fetch_sub(&group->_pending, 1);
+    node_pool_release(thiz->_tasks, t);
+
+    return false;
+}
+
+bool ws_scheduler_submit(struct ws_scheduler_t *const thiz, void (*const task)(void *), void *const arg)
+{
+    if (!thiz || !task)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    return _submit(thiz, NULL, task, arg);
+}
+
+void ws_group_init(struct ws_group_t *const group)
+{
+    if (group)
+        atomic_init(&group->_pending, 0);
+}
+
+bool ws_scheduler_submit_group(struct ws_scheduler_t *const thiz, struct ws_group_t *const group,
+                               void (*const task)(void *), void *const arg)
+{
+    if (!thiz || !group || !task)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    return _submit(thiz, group, task, arg);
+}
+
+void ws_scheduler_join(struct ws_scheduler_t *const thiz, struct ws_group_t *const group)
+{
+    if (!thiz || !group)
+    {
+        errno = EINVAL;
+        return;
+    }
+
+    struct _ws_join_t join = {thiz, group};
+    struct _ws_worker_t helper = {thiz, NULL, 0, (uint32_t)(uintptr_t)&join | 1};
+    struct _ws_worker_t *const w = (_self && _self->scheduler == thiz) ? _self : &helper;
+    struct _ws_task_t *task;
+
+    /* run tasks, of the group or not, until the group is done instead of blocking a worker */
+    while (atomic_load(&group->_pending) > 0)
+    {
+        if ((task = _next(w)) != NULL)
+            _execute(thiz, task);
+        else
+            parker_await(&thiz->_idle, _joinable, &join, NULL);
+    }
+}
+
+void ws_scheduler_free(struct ws_scheduler_t *const thiz)
+{
+    if (!thiz)
+        return;
+
+    _destroy(thiz, thiz->_count);
+}
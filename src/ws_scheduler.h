@@ -0,0 +1,98 @@
+#ifndef _WS_SCHEDULER_H_
+#define _WS_SCHEDULER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "blocking_queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Work Stealing Scheduler
+ *
+ * a fixed set of worker threads, each owning a ws_deque. a task submitted
+ * from a worker is pushed on that worker's deque and most likely runs on the
+ * same cpu with a warm cache, a task submitted from any other thread goes
+ * through a shared blocking queue. idle workers take from the shared queue,
+ * then steal from the other deques, then park.
+ */
+struct ws_scheduler_t;
+
+/**
+ * task group, counts the tasks submitted to it that have not finished yet.
+ * lives as long as a thread may still submit to it or join it.
+ */
+struct ws_group_t
+{
+    atomic_uint _pending;
+};
+
+/**
+ * Creates a scheduler and starts its workers.
+ *
+ * @param workers number of worker threads, must be non-zero
+ * @param queue shared queue for submissions from outside the workers, owned
+ *              by the caller and outliving the scheduler, or NULL for an
+ *              unbounded lb_queue owned by the scheduler
+ * @return the scheduler, or NULL on failure
+ */
+extern struct ws_scheduler_t *ws_scheduler(const uint32_t workers, struct blocking_queue_t *const queue);
+
+/**
+ * Submits a task. Waits for space in the shared queue if the caller is not
+ * a worker of this scheduler and the queue is full.
+ *
+ * @param scheduler scheduler
+ * @param task task function
+ * @param arg task argument
+ * @return true if the task was submitted, else false with errno set
+ */
+extern bool ws_scheduler_submit(struct ws_scheduler_t *const scheduler, void (*const task)(void *), void *const arg);
+
+/**
+ * Initializes an empty task group.
+ *
+ * @param group group
+ */
+extern void ws_group_init(struct ws_group_t *const group);
+
+/**
+ * Submits a task counted by group until it has run, as ws_scheduler_submit.
+ *
+ * @param scheduler scheduler
+ * @param group group
+ * @param task task function
+ * @param arg task argument
+ * @return true if the task was submitted, else false with errno set
+ */
+extern bool ws_scheduler_submit_group(struct ws_scheduler_t *const scheduler, struct ws_group_t *const group,
+                                      void (*const task)(void *), void *const arg);
+
+/**
+ * Waits until every task of group has run, including the ones submitted
+ * while waiting. The caller does not block while there is work: it runs
+ * tasks, a worker from its own deque first, any thread from the shared queue
+ * and by stealing, and only parks when nothing is left to take. A task may
+ * join a group of its own children.
+ *
+ * @param scheduler scheduler
+ * @param group group
+ */
+extern void ws_scheduler_join(struct ws_scheduler_t *const scheduler, struct ws_group_t *const group);
+
+/**
+ * Runs every submitted task, including the tasks they submit, then stops the
+ * workers and frees the scheduler. Must not be called from a worker.
+ *
+ * @param scheduler scheduler
+ */
+extern void ws_scheduler_free(struct ws_scheduler_t *const scheduler);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif